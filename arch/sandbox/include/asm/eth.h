@@ -10,6 +10,7 @@
 #define __ETH_H
 
 #include <net.h>
+#include <net6.h>
 
 void sandbox_eth_disable_response(int index, bool disable);
 
@@ -41,6 +42,35 @@ int sandbox_eth_arp_req_to_reply(struct udevice *dev, void *packet,
 int sandbox_eth_ping_req_to_reply(struct udevice *dev, void *packet,
 				  unsigned int len);
 
+#ifdef CONFIG_IPV6
+/*
+ * sandbox_eth_nd_req_to_reply()
+ *
+ * Check for a neighbour solicitation to be sent. If so, inject an
+ * advertisement
+ *
+ * @dev: device that received the packet
+ * @packet: pointer to the received pacaket buffer
+ * @len: length of received packet
+ * Return: 0 if injected, -EAGAIN if not
+ */
+int sandbox_eth_nd_req_to_reply(struct udevice *dev, void *packet,
+				unsigned int len);
+
+/*
+ * sandbox_eth_ping6_req_to_reply()
+ *
+ * Check for an ICMPv6 echo request to be sent. If so, inject a reply
+ *
+ * @dev: device that received the packet
+ * @packet: pointer to the received pacaket buffer
+ * @len: length of received packet
+ * Return: 0 if injected, -EAGAIN if not
+ */
+int sandbox_eth_ping6_req_to_reply(struct udevice *dev, void *packet,
+				   unsigned int len);
+#endif
+
 /*
  * sandbox_eth_recv_arp_req()
  *
@@ -76,6 +106,7 @@ typedef int sandbox_eth_tx_hand_f(struct udevice *dev, void *pkt,
  *
  * fake_host_hwaddr - MAC address of mocked machine
  * fake_host_ipaddr - IP address of mocked machine
+ * fake_host_ip6addr - IPv6 address of mocked machine
  * disabled - Will not respond
  * recv_packet_buffer - buffers of the packet returned as received
  * recv_packet_length - lengths of the packet returned as received
@@ -86,6 +117,7 @@ typedef int sandbox_eth_tx_hand_f(struct udevice *dev, void *pkt,
 struct eth_sandbox_priv {
 	uchar fake_host_hwaddr[ARP_HLEN];
 	struct in_addr fake_host_ipaddr;
+	struct in6_addr fake_host_ip6addr;
 	bool disabled;
 	uchar * recv_packet_buffer[PKTBUFSRX];
 	int recv_packet_length[PKTBUFSRX];
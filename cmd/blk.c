@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Command-line access to generic block-device features
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <command.h>
+#include <console.h>
+#include <dm.h>
+#include <mapmem.h>
+#include <part.h>
+#include <rand.h>
+#include <time.h>
+#include <dm/device-internal.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+
+/* Number of latency histogram buckets, the last one being 2^n us or more */
+#define BLK_BENCH_BUCKETS	24
+
+static int blk_cmd_get_dev(const char *ifname, const char *devstr,
+			   struct udevice **devp)
+{
+	struct blk_desc *desc;
+	int ret;
+
+	if (blk_get_device_by_str(ifname, devstr, &desc) < 0)
+		return CMD_RET_FAILURE;
+	ret = device_probe(desc->bdev);
+	if (ret) {
+		printf("Cannot probe %s %s (err=%d)\n", ifname, devstr, ret);
+		return CMD_RET_FAILURE;
+	}
+	*devp = desc->bdev;
+
+	return 0;
+}
+
+static int do_blk_readahead(struct cmd_tbl *cmdtp, int flag, int argc,
+			    char *const argv[])
+{
+	struct blk_readahead_stats stats;
+	struct udevice *dev;
+	uint reads;
+	int ret;
+
+	if (argc != 3 && argc != 4)
+		return CMD_RET_USAGE;
+	if (blk_cmd_get_dev(argv[1], argv[2], &dev))
+		return CMD_RET_FAILURE;
+
+	if (argc == 4) {
+		ret = blk_set_readahead(dev, simple_strtoul(argv[3], NULL, 0));
+		if (ret) {
+			printf("Cannot set read-ahead (err=%d)\n", ret);
+			return CMD_RET_FAILURE;
+		}
+	}
+
+	ret = blk_get_readahead(dev, &stats);
+	if (ret) {
+		printf("Cannot get read-ahead (err=%d)\n", ret);
+		return CMD_RET_FAILURE;
+	}
+	reads = stats.hits + stats.misses;
+	printf("window: " LBAFU " blocks\n", stats.window);
+	printf("reads: %u, hits: %u (%u%%), device reads: %u\n", reads,
+	       stats.hits, reads ? stats.hits * 100 / reads : 0, stats.fills);
+
+	return 0;
+}
+
+/**
+ * struct blk_bench - results of a benchmark run
+ *
+ * @ios:	Number of I/Os done
+ * @us:		Time taken by the whole run
+ * @min_us:	Shortest I/O latency
+ * @max_us:	Longest I/O latency
+ * @total_us:	Sum of all I/O latencies
+ * @hist:	Number of I/Os for each latency range. Entry n counts the
+ *		latencies from 2^(n-1) to 2^n - 1 us
+ */
+struct blk_bench {
+	uint ios;
+	ulong us;
+	ulong min_us;
+	ulong max_us;
+	u64 total_us;
+	uint hist[BLK_BENCH_BUCKETS + 1];
+};
+
+static void blk_bench_show(const char *test, struct blk_bench *bench,
+			   lbaint_t xfer, ulong blksz)
+{
+	u64 bytes = (u64)bench->ios * xfer * blksz;
+	ulong us = max(bench->us, 1UL);
+	int i;
+
+	printf("%s: %u I/Os of " LBAFU " blocks, %llu bytes in %lu us\n",
+	       test, bench->ios, xfer, bytes, bench->us);
+	if (!bench->ios)
+		return;
+
+	printf("throughput: ");
+	print_size(div_u64(bytes * 1000000, us), "/s");
+	printf(", %llu IOPS\n", div_u64((u64)bench->ios * 1000000, us));
+	printf("latency: min %lu us, avg %llu us, max %lu us\n",
+	       bench->min_us, div_u64(bench->total_us, bench->ios),
+	       bench->max_us);
+
+	for (i = 0; i <= BLK_BENCH_BUCKETS; i++) {
+		ulong lo = i ? 1UL << (i - 1) : 0;
+
+		if (!bench->hist[i])
+			continue;
+		if (i == BLK_BENCH_BUCKETS)
+			printf("  %8lu us and more: %u\n", lo, bench->hist[i]);
+		else
+			printf("  %8lu - %8lu us: %u\n", lo, (1UL << i) - 1,
+			       bench->hist[i]);
+	}
+}
+
+static int do_blk_bench(struct cmd_tbl *cmdtp, int flag, int argc,
+			char *const argv[])
+{
+	struct blk_readahead_stats stats;
+	struct blk_bench bench = { .min_us = ULONG_MAX };
+	lbaint_t start, cnt, xfer = 0x80, blk, n;
+	lbaint_t window = 0;
+	struct blk_desc *desc;
+	struct udevice *dev;
+	const char *test;
+	bool write, random;
+	ulong addr, t, us;
+	uint i, nios;
+	void *buf;
+	int ret = CMD_RET_SUCCESS;
+
+	if (argc != 7 && argc != 8)
+		return CMD_RET_USAGE;
+	test = argv[3];
+	random = !strncmp(test, "rand", 4);
+	write = !strcmp(test + (random ? 4 : 0), "write");
+	if (!write && strcmp(test + (random ? 4 : 0), "read"))
+		return CMD_RET_USAGE;
+	addr = hextoul(argv[4], NULL);
+	start = hextoul(argv[5], NULL);
+	cnt = hextoul(argv[6], NULL);
+	if (argc == 8)
+		xfer = hextoul(argv[7], NULL);
+	if (!xfer || cnt < xfer)
+		return CMD_RET_USAGE;
+
+	if (blk_cmd_get_dev(argv[1], argv[2], &dev))
+		return CMD_RET_FAILURE;
+	desc = dev_get_uclass_plat(dev);
+	if (start + cnt > desc->lba) {
+		printf("Blocks " LBAFU " to " LBAFU " are beyond the device\n",
+		       start, start + cnt - 1);
+		return CMD_RET_FAILURE;
+	}
+
+	/* Measure the device itself, not the caches in front of it */
+	if (!blk_get_readahead(dev, &stats) && stats.window) {
+		window = stats.window;
+		blk_set_readahead(dev, 0);
+	}
+
+	/* Every I/O transfers xfer blocks, within the blocks given */
+	nios = cnt / xfer;
+	buf = map_sysmem(addr, xfer * desc->blksz);
+	bench.us = timer_get_us();
+	for (i = 0; i < nios; i++) {
+		blk = start + (random ? rand() % nios : i) * xfer;
+		if (!write)
+			blkcache_invalidate(desc->if_type, desc->devnum);
+
+		t = timer_get_us();
+		if (write)
+			n = blk_dwrite(desc, blk, xfer, buf);
+		else
+			n = blk_dread(desc, blk, xfer, buf);
+		us = timer_get_us() - t;
+		if (n != xfer) {
+			printf("Error at block " LBAFU "\n", blk);
+			ret = CMD_RET_FAILURE;
+			break;
+		}
+
+		bench.ios++;
+		bench.total_us += us;
+		bench.min_us = min(bench.min_us, us);
+		bench.max_us = max(bench.max_us, us);
+		bench.hist[min(us ? ilog2(us) + 1 : 0, BLK_BENCH_BUCKETS)]++;
+		if (ctrlc())
+			break;
+	}
+	bench.us = timer_get_us() - bench.us;
+	unmap_sysmem(buf);
+
+	if (window)
+		blk_set_readahead(dev, window);
+	blk_bench_show(test, &bench, xfer, desc->blksz);
+
+	return ret;
+}
+
+#ifdef CONFIG_SYS_LONGHELP
+static char blk_help_text[] =
+	"readahead <interface> <dev> [<blocks>]\n"
+	"    - show read-ahead statistics, or set the read-ahead window\n"
+	"      (0 to disable)\n"
+	"blk bench <interface> <dev> <test> <addr> <blk#> <cnt> [<xfer>]\n"
+	"    - measure throughput, IOPS and latency. <test> is read, write,\n"
+	"      randread or randwrite. Sequential tests go through blocks\n"
+	"      <blk#> to <blk#> + <cnt> - 1 in I/Os of <xfer> blocks (default\n"
+	"      0x80), random ones do as many I/Os at random places in them.\n"
+	"      <addr> holds the data of one I/O. Write tests destroy data!";
+#endif
+
+U_BOOT_CMD_WITH_SUBCMDS(blk, "block device tools", blk_help_text,
+	U_BOOT_SUBCMD_MKENT(readahead, 4, 1, do_blk_readahead),
+	U_BOOT_SUBCMD_MKENT(bench, 8, 0, do_blk_bench));
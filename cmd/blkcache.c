@@ -14,14 +14,25 @@ static int blkc_show(struct cmd_tbl *cmdtp, int flag,
 		     int argc, char *const argv[])
 {
 	struct block_cache_stats stats;
+	int iftype, devnum;
+	int i;
+
+	for (i = 0; !blkcache_dev_stats(i, &iftype, &devnum, &stats); i++) {
+		printf("%s %d: hits %u, misses %u, evictions %u, entries %u/%u, max blocks/entry %u\n",
+		       blk_get_if_type_name(iftype), devnum, stats.hits,
+		       stats.misses, stats.evictions, stats.entries,
+		       stats.max_entries, stats.max_blocks_per_entry);
+	}
+
 	blkcache_stats(&stats);
 
 	printf("hits: %u\n"
 	       "misses: %u\n"
+	       "evictions: %u\n"
 	       "entries: %u\n"
 	       "max blocks/entry: %u\n"
 	       "max cache entries: %u\n",
-	       stats.hits, stats.misses, stats.entries,
+	       stats.hits, stats.misses, stats.evictions, stats.entries,
 	       stats.max_blocks_per_entry, stats.max_entries);
 	return 0;
 }
@@ -30,11 +41,29 @@ static int blkc_configure(struct cmd_tbl *cmdtp, int flag,
 			  int argc, char *const argv[])
 {
 	unsigned blocks_per_entry, max_entries;
-	if (argc != 3)
+	struct blk_desc *desc;
+
+	if (argc != 3 && argc != 5)
 		return CMD_RET_USAGE;
 
 	blocks_per_entry = simple_strtoul(argv[1], 0, 0);
 	max_entries = simple_strtoul(argv[2], 0, 0);
+	if (argc == 5) {
+		desc = blk_get_devnum_by_typename(argv[3],
+						  simple_strtoul(argv[4], 0,
+								 0));
+		if (!desc) {
+			printf("no device %s %s\n", argv[3], argv[4]);
+			return CMD_RET_FAILURE;
+		}
+		if (blkcache_configure_dev(desc->if_type, desc->devnum,
+					   blocks_per_entry, max_entries))
+			return CMD_RET_FAILURE;
+		printf("%s %d: changed to max of %u entries of %u blocks each\n",
+		       argv[3], desc->devnum, max_entries, blocks_per_entry);
+		return 0;
+	}
+
 	blkcache_configure(blocks_per_entry, max_entries);
 	printf("changed to max of %u entries of %u blocks each\n",
 	       max_entries, blocks_per_entry);
@@ -43,7 +72,7 @@ static int blkc_configure(struct cmd_tbl *cmdtp, int flag,
 
 static struct cmd_tbl cmd_blkc_sub[] = {
 	U_BOOT_CMD_MKENT(show, 0, 0, blkc_show, "", ""),
-	U_BOOT_CMD_MKENT(configure, 3, 0, blkc_configure, "", ""),
+	U_BOOT_CMD_MKENT(configure, 5, 0, blkc_configure, "", ""),
 };
 
 static __maybe_unused void blkc_reloc(void)
@@ -80,9 +109,10 @@ static int do_blkcache(struct cmd_tbl *cmdtp, int flag,
 }
 
 U_BOOT_CMD(
-	blkcache, 4, 0, do_blkcache,
+	blkcache, 6, 0, do_blkcache,
 	"block cache diagnostics and control",
 	"show - show and reset statistics\n"
-	"blkcache configure <blocks> <entries> "
-	"- set max blocks per entry and max cache entries\n"
+	"blkcache configure <blocks> <entries> [<interface> <dev>]\n"
+	"    - set max blocks per entry and max cache entries, for all\n"
+	"      devices or only for the given one\n"
 );
@@ -71,6 +71,37 @@ U_BOOT_CMD(ext4write, 7, 1, do_ext4_write,
 
 #endif
 
+#if defined(CONFIG_CMD_EXT4_CACHE)
+static int do_ext4_cache(struct cmd_tbl *cmdtp, int flag, int argc,
+			 char *const argv[])
+{
+	struct ext4_cache_stats stats;
+
+	if (argc == 2 && !strcmp(argv[1], "flush")) {
+		ext4fs_cache_invalidate();
+		return 0;
+	}
+	if (argc != 1)
+		return CMD_RET_USAGE;
+
+	ext4fs_cache_stats(&stats);
+	printf("hits: %u\n"
+	       "misses: %u\n"
+	       "entries: %u\n"
+	       "max cache entries: %u\n",
+	       stats.hits, stats.misses, stats.entries, stats.max_entries);
+
+	return 0;
+}
+
+U_BOOT_CMD(ext4cache, 2, 0, do_ext4_cache,
+	   "ext4 metadata cache",
+	   "\n"
+	   "    - show and reset the metadata cache statistics\n"
+	   "ext4cache flush\n"
+	   "    - drop all cached metadata");
+#endif
+
 U_BOOT_CMD(
 	ext4size,	4,	0,	do_ext4_size,
 	"determine a file's size",
@@ -111,3 +111,39 @@ U_BOOT_CMD(
 	fstypes, 1, 1, do_fstypes_wrapper,
 	"List supported filesystem types", ""
 );
+
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+static int do_fscache(struct cmd_tbl *cmdtp, int flag, int argc,
+		      char *const argv[])
+{
+	struct fs_cache_stats stats;
+
+	if (argc == 2 && !strcmp(argv[1], "flush")) {
+		fs_cache_flush();
+		return 0;
+	}
+	if (argc != 1)
+		return CMD_RET_USAGE;
+
+	fs_cache_stats(&stats);
+	printf("mounts: %u\n"
+	       "reuses: %u\n"
+	       "hits: %u\n"
+	       "misses: %u\n"
+	       "entries: %u\n"
+	       "max cache entries: %u\n",
+	       stats.mounts, stats.reuses, stats.hits, stats.misses,
+	       stats.entries, stats.max_entries);
+
+	return 0;
+}
+
+U_BOOT_CMD(
+	fscache, 2, 0, do_fscache,
+	"filesystem mount and dentry cache",
+	"\n"
+	"    - show and reset the mount and dentry cache statistics\n"
+	"fscache flush\n"
+	"    - unmount the kept filesystem and drop all cached paths"
+);
+#endif
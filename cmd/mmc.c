@@ -385,6 +385,14 @@ static lbaint_t mmc_sparse_reserve(struct sparse_storage *info,
 	return blkcnt;
 }
 
+static lbaint_t mmc_sparse_erase(struct sparse_storage *info, lbaint_t blk,
+				 lbaint_t blkcnt)
+{
+	struct blk_desc *dev_desc = info->priv;
+
+	return blk_derase(dev_desc, blk, blkcnt);
+}
+
 static int do_mmc_sparse_write(struct cmd_tbl *cmdtp, int flag,
 			       int argc, char *const argv[])
 {
@@ -425,6 +433,9 @@ static int do_mmc_sparse_write(struct cmd_tbl *cmdtp, int flag,
 	sparse.size = dev_desc->lba - blk;
 	sparse.write = mmc_sparse_write;
 	sparse.reserve = mmc_sparse_reserve;
+	/* erase instead of writing zeroes if that gives the same result */
+	sparse.erase = mmc_erased_value(mmc) ? NULL : mmc_sparse_erase;
+	sparse.erase_grp = mmc->erase_grp_size;
 	sparse.mssg = NULL;
 	sprintf(dest, "0x" LBAF, sparse.start * sparse.blksz);
 
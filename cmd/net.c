@@ -14,11 +14,23 @@
 #include <env.h>
 #include <image.h>
 #include <net.h>
+#include <net6.h>
 #include <net/udp.h>
 #include <net/sntp.h>
 
 static int netboot_common(enum proto_t, struct cmd_tbl *, int, char * const []);
 
+#if defined(CONFIG_IPV6)
+#define IPV6_ARG	1
+#define IPV6_USAGE	" [-ipv6]"
+#define IPV6_HELP	"\n-ipv6: use IPv6, with the server in " \
+			"$serverip6 or given as [hostIPv6addr]:"
+#else
+#define IPV6_ARG	0
+#define IPV6_USAGE	""
+#define IPV6_HELP	""
+#endif
+
 #ifdef CONFIG_CMD_BOOTP
 static int do_bootp(struct cmd_tbl *cmdtp, int flag, int argc,
 		    char *const argv[])
@@ -45,9 +57,9 @@ int do_tftpb(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 }
 
 U_BOOT_CMD(
-	tftpboot,	3,	1,	do_tftpb,
+	tftpboot,	3 + IPV6_ARG,	1,	do_tftpb,
 	"boot image via network using TFTP protocol",
-	"[loadAddress] [[hostIPaddr:]bootfilename]"
+	"[loadAddress] [[hostIPaddr:]bootfilename]" IPV6_USAGE IPV6_HELP
 );
 #endif
 
@@ -59,9 +71,9 @@ static int do_tftpput(struct cmd_tbl *cmdtp, int flag, int argc,
 }
 
 U_BOOT_CMD(
-	tftpput,	4,	1,	do_tftpput,
+	tftpput,	4 + IPV6_ARG,	1,	do_tftpput,
 	"TFTP put command, for uploading files to a server",
-	"Address Size [[hostIPaddr:]filename]"
+	"Address Size [[hostIPaddr:]filename]" IPV6_USAGE IPV6_HELP
 );
 #endif
 
@@ -124,6 +136,21 @@ U_BOOT_CMD(
 );
 #endif
 
+#if defined(CONFIG_CMD_WGET)
+static int do_wget(struct cmd_tbl *cmdtp, int flag, int argc,
+		   char *const argv[])
+{
+	return netboot_common(WGET, cmdtp, argc, argv);
+}
+
+U_BOOT_CMD(
+	wget,	3,	1,	do_wget,
+	"load file via network using HTTP protocol",
+	"[loadAddress] [[hostIPaddr:]path]\n"
+	"The server port is 80, or the value of $httpdstp if it is set."
+);
+#endif
+
 static void netboot_update_env(void)
 {
 	char tmp[22];
@@ -197,9 +224,18 @@ static int netboot_common(enum proto_t proto, struct cmd_tbl *cmdtp, int argc,
 	int   rcode = 0;
 	int   size;
 	ulong addr;
+	bool __maybe_unused use_ip6 = false;
 
 	net_boot_file_name_explicit = false;
 
+#if defined(CONFIG_IPV6)
+	if ((proto == TFTPGET || proto == TFTPPUT) && argc > 1 &&
+	    !strcmp(argv[argc - 1], "-ipv6")) {
+		use_ip6 = true;
+		argc--;
+	}
+#endif
+
 	/* pre-set image_load_addr */
 	s = env_get("loadaddr");
 	if (s != NULL)
@@ -257,7 +293,13 @@ static int netboot_common(enum proto_t proto, struct cmd_tbl *cmdtp, int argc,
 	}
 	bootstage_mark(BOOTSTAGE_ID_NET_START);
 
+#if defined(CONFIG_IPV6)
+	net_use_ip6 = use_ip6;
+#endif
 	size = net_loop(proto);
+#if defined(CONFIG_IPV6)
+	net_use_ip6 = false;
+#endif
 	if (size < 0) {
 		bootstage_error(BOOTSTAGE_ID_NET_NETLOOP_OK);
 		return CMD_RET_FAILURE;
@@ -312,6 +354,73 @@ U_BOOT_CMD(
 );
 #endif
 
+#if defined(CONFIG_CMD_PING6)
+static int do_ping6(struct cmd_tbl *cmdtp, int flag, int argc,
+		    char *const argv[])
+{
+	if (argc < 2)
+		return CMD_RET_USAGE;
+
+	if (string_to_ip6(argv[1], strlen(argv[1]), &net_ping_ip6) ||
+	    ip6_is_unspecified_addr(&net_ping_ip6))
+		return CMD_RET_USAGE;
+
+	if (net_loop(PING6) < 0) {
+		printf("ping6 failed; host %s is not alive\n", argv[1]);
+		return CMD_RET_FAILURE;
+	}
+
+	printf("host %s is alive\n", argv[1]);
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	ping6,	2,	1,	do_ping6,
+	"send ICMPv6 ECHO_REQUEST to network host",
+	"pingAddress"
+);
+#endif
+
+#if defined(CONFIG_CMD_ARP)
+static int do_arp(struct cmd_tbl *cmdtp, int flag, int argc,
+		  char *const argv[])
+{
+	struct in_addr ip;
+
+	if (argc == 1) {
+		arp_cache_show();
+		return CMD_RET_SUCCESS;
+	}
+
+	if (strcmp(argv[1], "-d"))
+		return CMD_RET_USAGE;
+
+	ip.s_addr = 0;
+	if (argc > 2) {
+		ip = string_to_ip(argv[2]);
+		if (ip.s_addr == 0)
+			return CMD_RET_USAGE;
+	}
+
+	if (arp_cache_delete(ip) && ip.s_addr) {
+		printf("%s is not in the ARP cache\n", argv[2]);
+		return CMD_RET_FAILURE;
+	}
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	arp,	3,	1,	do_arp,
+	"show or flush the ARP cache",
+	"\n"
+	"    - show the ARP cache\n"
+	"arp -d [ipaddr]\n"
+	"    - remove ipaddr from the ARP cache, or all the entries"
+);
+#endif
+
 #if defined(CONFIG_CMD_CDP)
 
 static void cdp_update_env(void)
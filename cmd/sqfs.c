@@ -40,3 +40,36 @@ U_BOOT_CMD(sqfsload, 7, 0, do_sqfs_load,
 	   "      ARCH_DMA_MINALIGN then a misaligned buffer warning will\n"
 	   "      be printed and performance will suffer for the load."
 );
+
+#if CONFIG_IS_ENABLED(SQUASHFS_CACHE)
+static int do_sqfs_cache(struct cmd_tbl *cmdtp, int flag, int argc,
+			 char * const argv[])
+{
+	struct sqfs_cache_stats stats;
+
+	if (argc == 2 && !strcmp(argv[1], "flush")) {
+		sqfs_cache_invalidate();
+		return 0;
+	}
+	if (argc != 1)
+		return CMD_RET_USAGE;
+
+	sqfs_cache_stats(&stats);
+	printf("tables: hits %u, misses %u, size %lu/%lu KiB\n",
+	       stats.table_hits, stats.table_misses, stats.table_size / 1024,
+	       stats.table_max_size / 1024);
+	printf("fragments: hits %u, misses %u, entries %u/%u\n",
+	       stats.frag_hits, stats.frag_misses, stats.frag_entries,
+	       stats.frag_max_entries);
+
+	return 0;
+}
+
+U_BOOT_CMD(sqfscache, 2, 0, do_sqfs_cache,
+	   "SquashFS table and fragment cache",
+	   "\n"
+	   "    - show and reset the cache statistics\n"
+	   "sqfscache flush\n"
+	   "    - drop everything from the cache"
+);
+#endif
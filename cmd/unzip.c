@@ -86,6 +86,7 @@ U_BOOT_CMD(
 	"<interface> <dev> <addr> length [wbuf=1M [offs=0 [outsize=0]]]\n"
 	"\twbuf is the size in bytes (hex) of write buffer\n"
 	"\t\tand should be padded to erase size for SSDs\n"
+	"\t\t(done automatically for MMC erase groups)\n"
 	"\toffs is the output start offset in bytes (hex)\n"
 	"\toutsize is the size of the expected output (hex bytes)\n"
 	"\t\tand is required for files with uncompressed lengths\n"
@@ -41,6 +41,8 @@ int run_usb_dnl_gadget(int usbctrl_index, char *usb_dnl_gadget)
 	unsigned long start_time = get_timer(0);
 #endif
 
+	dfu_set_write_async(true);
+
 	while (1) {
 		if (g_dnl_detach()) {
 			/*
@@ -102,9 +104,11 @@ int run_usb_dnl_gadget(int usbctrl_index, char *usb_dnl_gadget)
 			goto exit;
 
 		WATCHDOG_RESET();
+		dfu_write_poll();
 		usb_gadget_handle_interrupts(usbctrl_index);
 	}
 exit:
+	dfu_set_write_async(false);
 	g_dnl_unregister();
 	usb_gadget_release(usbctrl_index);
 
@@ -9,13 +9,23 @@
 #include <common.h>
 #include <blk.h>
 #include <dm.h>
+#include <fs.h>
 #include <log.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <part.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
 #include <dm/uclass-internal.h>
 #include <linux/err.h>
+#include <linux/sizes.h>
+
+/*
+ * Large reads from devices which support queued requests are split into
+ * requests of this size, with up to BLK_QUEUE_DEPTH of them in flight
+ */
+#define BLK_QUEUE_CHUNK		SZ_128K
+#define BLK_QUEUE_DEPTH		8
 
 static const char *if_typename_str[IF_TYPE_COUNT] = {
 	[IF_TYPE_IDE]		= "ide",
@@ -344,6 +354,157 @@ ulong blk_write_devnum(enum if_type if_type, int devnum, lbaint_t start,
 	return blk_dwrite(desc, start, blkcnt, buffer);
 }
 
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+static void blk_readahead_invalidate(struct udevice *dev)
+{
+	struct blk_readahead *ra = dev_get_uclass_priv(dev);
+
+	ra->cnt = 0;
+}
+
+int blk_set_readahead(struct udevice *dev, lbaint_t window)
+{
+	struct blk_readahead *ra = dev_get_uclass_priv(dev);
+
+	if (!ra)
+		return -EINVAL;
+	free(ra->buf);
+	ra->buf = NULL;
+	ra->buf_blocks = 0;
+	ra->cnt = 0;
+	ra->next = 0;
+	ra->window = window;
+	ra->hits = 0;
+	ra->misses = 0;
+	ra->fills = 0;
+
+	return 0;
+}
+
+int blk_get_readahead(struct udevice *dev, struct blk_readahead_stats *stats)
+{
+	struct blk_readahead *ra = dev_get_uclass_priv(dev);
+
+	if (!ra)
+		return -EINVAL;
+	stats->window = ra->window;
+	stats->hits = ra->hits;
+	stats->misses = ra->misses;
+	stats->fills = ra->fills;
+
+	return 0;
+}
+
+/*
+ * Fill the read-ahead buffer with up to one window of blocks starting at
+ * @start. Returns the number of blocks now held, or 0 if the caller should
+ * read from the device directly.
+ */
+static lbaint_t blk_readahead_fill(struct udevice *dev, lbaint_t start)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_readahead *ra = dev_get_uclass_priv(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+	lbaint_t count;
+	ulong ret;
+
+	if (!ra->buf || ra->buf_blocks < ra->window) {
+		free(ra->buf);
+		ra->buf = memalign(ARCH_DMA_MINALIGN, ra->window * desc->blksz);
+		ra->buf_blocks = ra->buf ? ra->window : 0;
+		if (!ra->buf)
+			return 0;
+	}
+
+	count = ra->window;
+	if (desc->lba && start + count > desc->lba)
+		count = desc->lba - start;
+	ra->cnt = 0;
+	ret = ops->read(dev, start, count, ra->buf);
+	if (ret != count)
+		return 0;
+	ra->start = start;
+	ra->cnt = count;
+	ra->fills++;
+	log_debug("fill: start " LBAF ", count " LBAFU "\n", start, count);
+
+	return count;
+}
+
+/*
+ * Read through the read-ahead buffer. A request which carries on from where
+ * the previous one ended and is smaller than the window is satisfied by
+ * reading the whole window in one command, so the following requests come
+ * out of memory. Anything else goes straight to the device.
+ */
+static ulong blk_readahead_read(struct udevice *dev, lbaint_t start,
+				lbaint_t blkcnt, void *buffer)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_readahead *ra = dev_get_uclass_priv(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+	bool seq = start == ra->next;
+	bool hit = true;
+	lbaint_t done = 0;
+
+	if (!ra->window)
+		return ops->read(dev, start, blkcnt, buffer);
+
+	while (done < blkcnt) {
+		lbaint_t blk = start + done;
+		lbaint_t left = blkcnt - done;
+		void *dst = buffer + done * desc->blksz;
+		lbaint_t n;
+		ulong ret;
+
+		if (ra->cnt && blk >= ra->start && blk < ra->start + ra->cnt) {
+			n = min(left, ra->start + ra->cnt - blk);
+			memcpy(dst, ra->buf + (blk - ra->start) * desc->blksz,
+			       n * desc->blksz);
+			done += n;
+			continue;
+		}
+
+		hit = false;
+		if (seq && left < ra->window && blk_readahead_fill(dev, blk))
+			continue;
+
+		ret = ops->read(dev, blk, left, dst);
+		if (ret != left) {
+			if (!done || IS_ERR_VALUE(ret))
+				return done ? done : ret;
+			return done + ret;
+		}
+		done += left;
+	}
+	ra->next = start + blkcnt;
+	if (hit)
+		ra->hits++;
+	else
+		ra->misses++;
+
+	return blkcnt;
+}
+
+static int blk_pre_remove(struct udevice *dev)
+{
+	struct blk_readahead *ra = dev_get_uclass_priv(dev);
+
+	free(ra->buf);
+	ra->buf = NULL;
+
+	return 0;
+}
+#else
+static inline void blk_readahead_invalidate(struct udevice *dev) {}
+
+static inline ulong blk_readahead_read(struct udevice *dev, lbaint_t start,
+				       lbaint_t blkcnt, void *buffer)
+{
+	return blk_get_ops(dev)->read(dev, start, blkcnt, buffer);
+}
+#endif
+
 int blk_select_hwpart(struct udevice *dev, int hwpart)
 {
 	const struct blk_ops *ops = blk_get_ops(dev);
@@ -352,6 +513,7 @@ int blk_select_hwpart(struct udevice *dev, int hwpart)
 		return -ENOSYS;
 	if (!ops->select_hwpart)
 		return 0;
+	blk_readahead_invalidate(dev);
 
 	return ops->select_hwpart(dev, hwpart);
 }
@@ -436,6 +598,158 @@ int blk_get_device(int if_type, int devnum, struct udevice **devp)
 	return device_probe(*devp);
 }
 
+int blk_submit(struct udevice *dev, struct blk_req *req)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+
+	req->done = false;
+	req->pending = 0;
+	if (req->op == BLK_REQ_WRITE) {
+		if (!ops->write)
+			return -ENOSYS;
+		blkcache_invalidate(desc->if_type, desc->devnum);
+		blk_readahead_invalidate(dev);
+		fs_cache_invalidate(desc);
+	} else if (!ops->read) {
+		return -ENOSYS;
+	}
+
+	if (ops->submit)
+		return ops->submit(dev, req);
+
+	if (req->op == BLK_REQ_WRITE)
+		req->result = ops->write(dev, req->start, req->blkcnt,
+					 req->buffer);
+	else
+		req->result = ops->read(dev, req->start, req->blkcnt,
+					req->buffer);
+	req->done = true;
+
+	return 0;
+}
+
+int blk_poll(struct udevice *dev)
+{
+	const struct blk_ops *ops = blk_get_ops(dev);
+
+	if (!ops->poll)
+		return 0;
+
+	return ops->poll(dev);
+}
+
+int blk_cancel(struct udevice *dev, struct blk_req *req)
+{
+	const struct blk_ops *ops = blk_get_ops(dev);
+
+	if (req->done)
+		return 0;
+	if (!ops->cancel)
+		return -ENOSYS;
+
+	return ops->cancel(dev, req);
+}
+
+long blk_wait(struct udevice *dev, struct blk_req *req)
+{
+	ulong start = get_timer(0);
+	int ret = 0;
+
+	while (!req->done) {
+		ret = blk_poll(dev);
+		if (ret > 0)
+			start = get_timer(0);
+		else if (ret < 0 || get_timer(start) > BLK_REQ_TIMEOUT_MS)
+			break;
+	}
+	if (req->done)
+		return req->result;
+
+	log_debug("request at " LBAF " not finished (err=%d)\n", req->start,
+		  ret);
+	blk_cancel(dev, req);
+
+	return ret < 0 ? ret : -ETIMEDOUT;
+}
+
+/*
+ * Read a large range from a device which supports queued requests. The
+ * range is split into BLK_QUEUE_CHUNK-sized requests and up to
+ * BLK_QUEUE_DEPTH of them are kept in flight, so the device always has the
+ * next request to hand when it finishes one.
+ */
+static ulong blk_read_queued(struct udevice *dev, lbaint_t start,
+			     lbaint_t blkcnt, void *buffer)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_req reqs[BLK_QUEUE_DEPTH];
+	bool busy[BLK_QUEUE_DEPTH] = { false };
+	lbaint_t chunk = max(BLK_QUEUE_CHUNK >> desc->log2blksz, 1);
+	lbaint_t next = 0, good = blkcnt;
+	ulong timer = get_timer(0);
+	int inflight = 0;
+	int i, ret;
+
+	while ((next < blkcnt && good == blkcnt) || inflight) {
+		for (i = 0; i < BLK_QUEUE_DEPTH; i++) {
+			struct blk_req *req = &reqs[i];
+
+			if (busy[i]) {
+				if (!req->done)
+					continue;
+				busy[i] = false;
+				inflight--;
+				if (req->result != req->blkcnt) {
+					lbaint_t ok = req->start - start;
+
+					if (req->result > 0)
+						ok += req->result;
+					good = min(good, ok);
+				}
+			}
+			if (next >= blkcnt || good != blkcnt)
+				continue;
+
+			req->op = BLK_REQ_READ;
+			req->start = start + next;
+			req->blkcnt = min(chunk, blkcnt - next);
+			req->buffer = buffer + (next << desc->log2blksz);
+			ret = blk_submit(dev, req);
+			if (ret == -EBUSY && inflight)
+				break;
+			if (ret) {
+				good = next;
+				break;
+			}
+			busy[i] = true;
+			inflight++;
+			next += req->blkcnt;
+		}
+
+		if (!inflight)
+			continue;
+		ret = blk_poll(dev);
+		if (ret > 0) {
+			timer = get_timer(0);
+		} else if (ret < 0 || get_timer(timer) > BLK_REQ_TIMEOUT_MS) {
+			/* reqs[] is going away, so the device must drop them */
+			log_debug("poll failed (err=%d)\n", ret);
+			for (i = 0; i < BLK_QUEUE_DEPTH; i++) {
+				if (!busy[i])
+					continue;
+				if (blk_cancel(dev, &reqs[i]))
+					log_err("Cannot cancel request at "
+						LBAF "\n", reqs[i].start);
+				good = min(good, reqs[i].start - start);
+			}
+			break;
+		}
+	}
+
+	return good;
+}
+
 unsigned long blk_dread(struct blk_desc *block_dev, lbaint_t start,
 			lbaint_t blkcnt, void *buffer)
 {
@@ -449,7 +763,11 @@ unsigned long blk_dread(struct blk_desc *block_dev, lbaint_t start,
 	if (blkcache_read(block_dev->if_type, block_dev->devnum,
 			  start, blkcnt, block_dev->blksz, buffer))
 		return blkcnt;
-	blks_read = ops->read(dev, start, blkcnt, buffer);
+	if (ops->submit &&
+	    (blkcnt << block_dev->log2blksz) > BLK_QUEUE_CHUNK)
+		blks_read = blk_read_queued(dev, start, blkcnt, buffer);
+	else
+		blks_read = blk_readahead_read(dev, start, blkcnt, buffer);
 	if (blks_read == blkcnt)
 		blkcache_fill(block_dev->if_type, block_dev->devnum,
 			      start, blkcnt, block_dev->blksz, buffer);
@@ -467,6 +785,8 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 		return -ENOSYS;
 
 	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	blk_readahead_invalidate(dev);
+	fs_cache_invalidate(block_dev);
 	return ops->write(dev, start, blkcnt, buffer);
 }
 
@@ -480,6 +800,8 @@ unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 		return -ENOSYS;
 
 	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	blk_readahead_invalidate(dev);
+	fs_cache_invalidate(block_dev);
 	return ops->erase(dev, start, blkcnt);
 }
 
@@ -718,6 +1040,18 @@ static int blk_post_probe(struct udevice *dev)
 
 		part_init(desc);
 	}
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+	blk_set_readahead(dev, CONFIG_BLK_READAHEAD_WINDOW);
+#endif
+
+	return 0;
+}
+
+static int blk_pre_unbind(struct udevice *dev)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+
+	blkcache_free(desc->if_type, desc->devnum);
 
 	return 0;
 }
@@ -726,5 +1060,10 @@ UCLASS_DRIVER(blk) = {
 	.id		= UCLASS_BLK,
 	.name		= "blk",
 	.post_probe	= blk_post_probe,
+	.pre_unbind	= blk_pre_unbind,
 	.per_device_plat_auto	= sizeof(struct blk_desc),
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+	.pre_remove	= blk_pre_remove,
+	.per_device_auto	= sizeof(struct blk_readahead),
+#endif
 };
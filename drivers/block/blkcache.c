@@ -12,21 +12,67 @@
 #include <asm/global_data.h>
 #include <linux/ctype.h>
 #include <linux/list.h>
+#include <linux/log2.h>
 
 #ifdef CONFIG_NEEDS_MANUAL_RELOC
 DECLARE_GLOBAL_DATA_PTR;
 #endif
 
+/*
+ * The cache is kept per device. Each device has a small hash table of sets,
+ * indexed by the LBA bucket of the first cached block. A bucket is the
+ * smallest power of two that can hold max_blocks_per_entry blocks, so an
+ * entry that covers a given block always starts in that block's bucket or
+ * in the one before it. A lookup therefore only has to visit two sets of
+ * at most BLKCACHE_WAYS entries, however large the cache is.
+ */
+#define BLKCACHE_WAYS	4
+
 struct block_cache_node {
 	struct list_head lh;
-	int iftype;
-	int devnum;
 	lbaint_t start;
 	lbaint_t blkcnt;
 	unsigned long blksz;
 	char *cache;
 };
 
+/**
+ * struct block_cache_set - one set of the hash table
+ *
+ * @lru:	Entries in this set, most recently used first
+ * @count:	Number of entries in @lru
+ */
+struct block_cache_set {
+	struct list_head lru;
+	unsigned count;
+};
+
+/**
+ * struct block_cache_dev - cache for a single block device
+ *
+ * @lh:		Entry in the list of cached devices
+ * @iftype:	IF_TYPE_x for type of device
+ * @devnum:	Device index of particular type
+ * @custom:	true if the size was set for this device with
+ *		blkcache_configure_dev(), false to follow the defaults
+ * @bucket_shift: log2 of the number of blocks in a hash bucket
+ * @nsets:	Number of sets in @sets (a power of two)
+ * @ways:	Maximum number of entries in each set
+ * @sets:	Hash table, or NULL if nothing is cached yet
+ * @stats:	Statistics and limits for this device
+ */
+struct block_cache_dev {
+	struct list_head lh;
+	int iftype;
+	int devnum;
+	bool custom;
+	unsigned bucket_shift;
+	unsigned nsets;
+	unsigned ways;
+	struct block_cache_set *sets;
+	struct block_cache_stats stats;
+};
+
 static LIST_HEAD(block_cache);
 
 static struct block_cache_stats _stats = {
@@ -46,45 +92,153 @@ int blkcache_init(void)
 }
 #endif
 
-static struct block_cache_node *cache_find(int iftype, int devnum,
-					   lbaint_t start, lbaint_t blkcnt,
-					   unsigned long blksz)
+static void cache_free_entries(struct block_cache_dev *bdev)
+{
+	struct block_cache_node *node, *n;
+	unsigned i;
+
+	if (bdev->sets) {
+		for (i = 0; i < bdev->nsets; i++) {
+			list_for_each_entry_safe(node, n, &bdev->sets[i].lru,
+						 lh) {
+				free(node->cache);
+				free(node);
+			}
+		}
+		free(bdev->sets);
+		bdev->sets = NULL;
+	}
+	bdev->stats.entries = 0;
+}
+
+static void cache_free_dev(struct block_cache_dev *bdev)
+{
+	cache_free_entries(bdev);
+	list_del(&bdev->lh);
+	free(bdev);
+}
+
+static void cache_set_limits(struct block_cache_dev *bdev, unsigned blocks,
+			     unsigned entries)
+{
+	unsigned nsets;
+
+	cache_free_entries(bdev);
+	bdev->stats.max_blocks_per_entry = blocks;
+	bdev->stats.max_entries = entries;
+
+	nsets = entries / BLKCACHE_WAYS;
+	bdev->nsets = nsets ? rounddown_pow_of_two(nsets) : 1;
+	bdev->ways = entries / bdev->nsets;
+	bdev->bucket_shift = blocks > 1 ? order_base_2(blocks) : 0;
+}
+
+static struct block_cache_dev *cache_find_dev(int iftype, int devnum,
+					      bool create)
+{
+	struct block_cache_dev *bdev;
+
+	list_for_each_entry(bdev, &block_cache, lh) {
+		if (bdev->iftype == iftype && bdev->devnum == devnum) {
+			if (block_cache.next != &bdev->lh) {
+				/* keep the busiest device at the front */
+				list_del(&bdev->lh);
+				list_add(&bdev->lh, &block_cache);
+			}
+			return bdev;
+		}
+	}
+	if (!create)
+		return NULL;
+
+	bdev = calloc(1, sizeof(*bdev));
+	if (!bdev)
+		return NULL;
+	bdev->iftype = iftype;
+	bdev->devnum = devnum;
+	cache_set_limits(bdev, _stats.max_blocks_per_entry,
+			 _stats.max_entries);
+	list_add(&bdev->lh, &block_cache);
+
+	return bdev;
+}
+
+static struct block_cache_set *cache_set(struct block_cache_dev *bdev,
+					 lbaint_t bucket)
+{
+	u32 hash = lower_32_bits(bucket) ^ upper_32_bits(bucket);
+
+	return &bdev->sets[hash & (bdev->nsets - 1)];
+}
+
+static struct block_cache_node *cache_find_in_set(struct block_cache_set *set,
+						  lbaint_t start,
+						  lbaint_t blkcnt,
+						  unsigned long blksz)
 {
 	struct block_cache_node *node;
 
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
+	list_for_each_entry(node, &set->lru, lh)
+		if ((node->blksz == blksz) &&
 		    (node->start <= start) &&
 		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
+			if (set->lru.next != &node->lh) {
 				/* maintain MRU ordering */
 				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
+				list_add(&node->lh, &set->lru);
 			}
 			return node;
 		}
-	return 0;
+	return NULL;
+}
+
+static struct block_cache_node *cache_find(struct block_cache_dev *bdev,
+					   lbaint_t start, lbaint_t blkcnt,
+					   unsigned long blksz)
+{
+	struct block_cache_node *node;
+	struct block_cache_set *set, *prev;
+	lbaint_t bucket;
+
+	if (!bdev->sets || blkcnt > bdev->stats.max_blocks_per_entry)
+		return NULL;
+
+	bucket = start >> bdev->bucket_shift;
+	set = cache_set(bdev, bucket);
+	node = cache_find_in_set(set, start, blkcnt, blksz);
+	if (node || !bucket)
+		return node;
+
+	prev = cache_set(bdev, bucket - 1);
+	if (prev == set)
+		return NULL;
+
+	return cache_find_in_set(prev, start, blkcnt, blksz);
 }
 
 int blkcache_read(int iftype, int devnum,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
+	struct block_cache_dev *bdev = cache_find_dev(iftype, devnum, false);
+	struct block_cache_node *node = NULL;
+
+	if (bdev)
+		node = cache_find(bdev, start, blkcnt, blksz);
 	if (node) {
 		const char *src = node->cache + (start - node->start) * blksz;
 		memcpy(buffer, src, blksz * blkcnt);
 		debug("hit: start " LBAF ", count " LBAFU "\n",
 		      start, blkcnt);
+		++bdev->stats.hits;
 		++_stats.hits;
 		return 1;
 	}
 
 	debug("miss: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
+	if (bdev)
+		++bdev->stats.misses;
 	++_stats.misses;
 	return 0;
 }
@@ -94,21 +248,42 @@ void blkcache_fill(int iftype, int devnum,
 		   unsigned long blksz, void const *buffer)
 {
 	lbaint_t bytes;
+	struct block_cache_dev *bdev;
+	struct block_cache_set *set;
 	struct block_cache_node *node;
+	unsigned i;
+
+	bdev = cache_find_dev(iftype, devnum, true);
+	if (!bdev)
+		return;
 
 	/* don't cache big stuff */
-	if (blkcnt > _stats.max_blocks_per_entry)
+	if (blkcnt > bdev->stats.max_blocks_per_entry)
 		return;
 
-	if (_stats.max_entries == 0)
+	if (bdev->stats.max_entries == 0)
 		return;
 
+	if (!bdev->sets) {
+		bdev->sets = malloc(bdev->nsets * sizeof(*bdev->sets));
+		if (!bdev->sets)
+			return;
+		for (i = 0; i < bdev->nsets; i++) {
+			INIT_LIST_HEAD(&bdev->sets[i].lru);
+			bdev->sets[i].count = 0;
+		}
+	}
+
 	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
+	set = cache_set(bdev, start >> bdev->bucket_shift);
+	if (bdev->ways <= set->count) {
 		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
+		node = list_last_entry(&set->lru, struct block_cache_node, lh);
 		list_del(&node->lh);
-		_stats.entries--;
+		set->count--;
+		bdev->stats.entries--;
+		bdev->stats.evictions++;
+		_stats.evictions++;
 		debug("drop: start " LBAF ", count " LBAFU "\n",
 		      node->start, node->blkcnt);
 		if (node->blkcnt * node->blksz < bytes) {
@@ -133,46 +308,45 @@ void blkcache_fill(int iftype, int devnum,
 	debug("fill: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
 
-	node->iftype = iftype;
-	node->devnum = devnum;
 	node->start = start;
 	node->blkcnt = blkcnt;
 	node->blksz = blksz;
 	memcpy(node->cache, buffer, bytes);
-	list_add(&node->lh, &block_cache);
-	_stats.entries++;
+	list_add(&node->lh, &set->lru);
+	set->count++;
+	bdev->stats.entries++;
 }
 
 void blkcache_invalidate(int iftype, int devnum)
 {
-	struct list_head *entry, *n;
-	struct block_cache_node *node;
+	struct block_cache_dev *bdev = cache_find_dev(iftype, devnum, false);
 
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
-			--_stats.entries;
-		}
-	}
+	if (bdev)
+		cache_free_entries(bdev);
+}
+
+void blkcache_free(int iftype, int devnum)
+{
+	struct block_cache_dev *bdev = cache_find_dev(iftype, devnum, false);
+
+	if (bdev)
+		cache_free_dev(bdev);
 }
 
 void blkcache_configure(unsigned blocks, unsigned entries)
 {
-	struct block_cache_node *node;
+	struct block_cache_dev *bdev, *n;
+
 	if ((blocks != _stats.max_blocks_per_entry) ||
 	    (entries != _stats.max_entries)) {
-		/* invalidate cache */
-		while (!list_empty(&block_cache)) {
-			node = (struct block_cache_node *)block_cache.next;
-			list_del(&node->lh);
-			free(node->cache);
-			free(node);
+		/*
+		 * invalidate cache; devices following the defaults are set
+		 * up again with the new size on their next fill
+		 */
+		list_for_each_entry_safe(bdev, n, &block_cache, lh) {
+			if (!bdev->custom)
+				cache_free_dev(bdev);
 		}
-		_stats.entries = 0;
 	}
 
 	_stats.max_blocks_per_entry = blocks;
@@ -180,11 +354,52 @@ void blkcache_configure(unsigned blocks, unsigned entries)
 
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
+}
+
+int blkcache_configure_dev(int iftype, int devnum, unsigned blocks,
+			   unsigned entries)
+{
+	struct block_cache_dev *bdev = cache_find_dev(iftype, devnum, true);
+
+	if (!bdev)
+		return -ENOMEM;
+	cache_set_limits(bdev, blocks, entries);
+	bdev->custom = true;
+
+	return 0;
 }
 
 void blkcache_stats(struct block_cache_stats *stats)
 {
+	struct block_cache_dev *bdev;
+
+	_stats.entries = 0;
+	list_for_each_entry(bdev, &block_cache, lh) {
+		_stats.entries += bdev->stats.entries;
+		bdev->stats.hits = 0;
+		bdev->stats.misses = 0;
+		bdev->stats.evictions = 0;
+	}
 	memcpy(stats, &_stats, sizeof(*stats));
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
+}
+
+int blkcache_dev_stats(int index, int *iftypep, int *devnump,
+		       struct block_cache_stats *stats)
+{
+	struct block_cache_dev *bdev;
+
+	list_for_each_entry(bdev, &block_cache, lh) {
+		if (index--)
+			continue;
+		*iftypep = bdev->iftype;
+		*devnump = bdev->devnum;
+		memcpy(stats, &bdev->stats, sizeof(*stats));
+		return 0;
+	}
+
+	return -ENOENT;
 }
@@ -243,9 +243,67 @@ int sandbox_host_unbind(struct udevice *dev)
 	return 0;
 }
 
+/*
+ * Queued requests are held until the next poll, which completes the oldest
+ * one. This behaves like a device working through its queue.
+ */
+static int host_block_submit(struct udevice *dev, struct blk_req *req)
+{
+	struct host_block_dev *host_dev = dev_get_plat(dev);
+
+	if (host_dev->queued == SANDBOX_HOST_QUEUE_DEPTH)
+		return -EBUSY;
+	host_dev->queue[host_dev->queued++] = req;
+
+	return 0;
+}
+
+static int host_block_poll(struct udevice *dev)
+{
+	struct host_block_dev *host_dev = dev_get_plat(dev);
+	struct blk_req *req;
+
+	if (!host_dev->queued)
+		return 0;
+
+	req = host_dev->queue[0];
+	host_dev->queued--;
+	memmove(host_dev->queue, host_dev->queue + 1,
+		host_dev->queued * sizeof(req));
+	if (req->op == BLK_REQ_WRITE)
+		req->result = host_block_write(dev, req->start, req->blkcnt,
+					       req->buffer);
+	else
+		req->result = host_block_read(dev, req->start, req->blkcnt,
+					      req->buffer);
+	req->done = true;
+
+	return 1;
+}
+
+static int host_block_cancel(struct udevice *dev, struct blk_req *req)
+{
+	struct host_block_dev *host_dev = dev_get_plat(dev);
+	int i;
+
+	for (i = 0; i < host_dev->queued; i++) {
+		if (host_dev->queue[i] != req)
+			continue;
+		host_dev->queued--;
+		memmove(host_dev->queue + i, host_dev->queue + i + 1,
+			(host_dev->queued - i) * sizeof(req));
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
 static const struct blk_ops sandbox_host_blk_ops = {
 	.read	= host_block_read,
 	.write	= host_block_write,
+	.submit	= host_block_submit,
+	.poll	= host_block_poll,
+	.cancel	= host_block_cancel,
 };
 
 U_BOOT_DRIVER(sandbox_host_blk) = {
@@ -14,7 +14,9 @@
 #include <mmc.h>
 #include <fat.h>
 #include <dfu.h>
+#include <div64.h>
 #include <hash.h>
+#include <time.h>
 #include <linux/list.h>
 #include <linux/compiler.h>
 
@@ -182,10 +184,48 @@ static unsigned char *dfu_buf;
 static unsigned long dfu_buf_size;
 static enum dfu_device_type dfu_buf_device_type;
 
+/*
+ * Downloaded data is collected in a ring of buffers, dfu_buf being the
+ * first one. A full buffer is queued and, once dfu_set_write_async() has
+ * been called, written to the medium piece by piece by dfu_write_poll()
+ * from the download loop while the next buffer is being received.
+ * dfu_write() only waits for the medium when every buffer is queued.
+ */
+struct dfu_write_buf {
+	unsigned char *data;
+	long len;
+	long done;
+};
+
+static struct dfu_write_buf dfu_wbufs[CONFIG_DFU_WRITE_BUFS];
+static int dfu_wbuf_count = 1;		/* number of allocated buffers */
+static int dfu_wbuf_head;		/* oldest queued buffer */
+static int dfu_wbuf_queued;		/* number of queued buffers */
+static struct dfu_entity *dfu_wbuf_owner;
+static bool dfu_write_async;
+static int dfu_write_err;
+
+static void dfu_write_discard(void)
+{
+	dfu_wbuf_head = 0;
+	dfu_wbuf_queued = 0;
+	dfu_wbuf_owner = NULL;
+}
+
 unsigned char *dfu_free_buf(void)
 {
+	int i;
+
+	for (i = 1; i < dfu_wbuf_count; i++) {
+		free(dfu_wbufs[i].data);
+		dfu_wbufs[i].data = NULL;
+	}
+	dfu_wbuf_count = 1;
+	dfu_write_discard();
+
 	free(dfu_buf);
 	dfu_buf = NULL;
+	dfu_wbufs[0].data = NULL;
 	return dfu_buf;
 }
 
@@ -194,13 +234,17 @@ unsigned long dfu_get_buf_size(void)
 	return dfu_buf_size;
 }
 
+static int dfu_write_wait(void);
+
 unsigned char *dfu_get_buf(struct dfu_entity *dfu)
 {
 	char *s;
 
 	/* manage several entity with several contraint */
-	if (dfu_buf && dfu->dev_type != dfu_buf_device_type)
+	if (dfu_buf && dfu->dev_type != dfu_buf_device_type) {
+		dfu_write_wait();
 		dfu_free_buf();
+	}
 
 	if (dfu_buf != NULL)
 		return dfu_buf;
@@ -220,10 +264,39 @@ unsigned char *dfu_get_buf(struct dfu_entity *dfu)
 		printf("%s: Could not memalign 0x%lx bytes\n",
 		       __func__, dfu_buf_size);
 
+	dfu_wbufs[0].data = dfu_buf;
 	dfu_buf_device_type = dfu->dev_type;
 	return dfu_buf;
 }
 
+/*
+ * The extra buffers are only needed when writing in the background, so
+ * they are allocated when such a download starts. Fewer buffers are used
+ * if there is not enough memory for all of them.
+ */
+static void dfu_alloc_write_bufs(void)
+{
+	unsigned char *buf;
+
+	if (!dfu_write_async || dfu_wbuf_queued)
+		return;
+
+	while (dfu_wbuf_count < CONFIG_DFU_WRITE_BUFS) {
+		buf = memalign(CONFIG_SYS_CACHELINE_SIZE, dfu_buf_size);
+		if (!buf) {
+			debug("%s: Using %d buffers of 0x%lx bytes\n",
+			      __func__, dfu_wbuf_count, dfu_buf_size);
+			break;
+		}
+		dfu_wbufs[dfu_wbuf_count++].data = buf;
+	}
+}
+
+void dfu_set_write_async(bool async)
+{
+	dfu_write_async = async;
+}
+
 static char *dfu_get_hash_algo(void)
 {
 	char *s;
@@ -241,11 +314,77 @@ static char *dfu_get_hash_algo(void)
 	return NULL;
 }
 
-static int dfu_write_buffer_drain(struct dfu_entity *dfu)
+/* Write the next piece of the oldest queued buffer */
+static int dfu_write_queued(void)
 {
+	struct dfu_write_buf *wbuf = &dfu_wbufs[dfu_wbuf_head];
+	struct dfu_entity *dfu = dfu_wbuf_owner;
+	ulong start;
 	long w_size;
 	int ret;
 
+	w_size = wbuf->len - wbuf->done;
+	if (dfu->max_write_size && w_size > dfu->max_write_size)
+		w_size = dfu->max_write_size;
+
+	start = get_timer(0);
+	ret = dfu->write_medium(dfu, dfu->offset, wbuf->data + wbuf->done,
+				&w_size);
+	dfu->write_time += get_timer(start);
+	if (ret) {
+		debug("%s: Write error!\n", __func__);
+		dfu_write_discard();
+		return ret;
+	}
+
+	/* update offset */
+	dfu->offset += w_size;
+
+	wbuf->done += w_size;
+	if (w_size <= 0 || wbuf->done >= wbuf->len) {
+		dfu_wbuf_head = (dfu_wbuf_head + 1) % dfu_wbuf_count;
+		dfu_wbuf_queued--;
+		puts("#");
+	}
+
+	return 0;
+}
+
+/* Write out every queued buffer */
+static int dfu_write_wait(void)
+{
+	int ret = 0;
+
+	while (dfu_wbuf_queued && !ret)
+		ret = dfu_write_queued();
+
+	return ret;
+}
+
+void dfu_write_poll(void)
+{
+	if (dfu_wbuf_queued)
+		dfu_write_err = dfu_write_queued();
+}
+
+/* Return and clear the error of the last write done by dfu_write_poll() */
+static int dfu_write_get_err(void)
+{
+	int ret = dfu_write_err;
+
+	dfu_write_err = 0;
+
+	return ret;
+}
+
+static int dfu_write_buffer_drain(struct dfu_entity *dfu)
+{
+	struct dfu_write_buf *wbuf;
+	ulong start;
+	long w_size;
+	int ret = 0;
+	int next;
+
 	/* flush size? */
 	w_size = dfu->i_buf - dfu->i_buf_start;
 	if (w_size == 0)
@@ -255,23 +394,39 @@ static int dfu_write_buffer_drain(struct dfu_entity *dfu)
 		dfu_hash_algo->hash_update(dfu_hash_algo, &dfu->crc,
 					   dfu->i_buf_start, w_size, 0);
 
-	ret = dfu->write_medium(dfu, dfu->offset, dfu->i_buf_start, &w_size);
-	if (ret)
-		debug("%s: Write error!\n", __func__);
+	next = (dfu_wbuf_head + dfu_wbuf_queued) % dfu_wbuf_count;
+	wbuf = &dfu_wbufs[next];
+	wbuf->len = w_size;
+	wbuf->done = 0;
+	dfu_wbuf_queued++;
+	dfu_wbuf_owner = dfu;
+
+	/* wait for the medium unless there is a free buffer to fill */
+	start = get_timer(0);
+	while (dfu_wbuf_queued &&
+	       (!dfu_write_async || dfu_wbuf_queued == dfu_wbuf_count)) {
+		ret = dfu_write_queued();
+		if (ret)
+			break;
+	}
+	dfu->wait_time += get_timer(start);
 
-	/* point back */
+	/* point to the next free buffer */
+	next = (dfu_wbuf_head + dfu_wbuf_queued) % dfu_wbuf_count;
+	dfu->i_buf_start = dfu_wbufs[next].data;
+	dfu->i_buf_end = dfu->i_buf_start + dfu_buf_size;
 	dfu->i_buf = dfu->i_buf_start;
 
-	/* update offset */
-	dfu->offset += w_size;
-
-	puts("#");
-
 	return ret;
 }
 
 void dfu_transaction_cleanup(struct dfu_entity *dfu)
 {
+	/* drop whatever is still queued for this entity */
+	if (dfu == dfu_wbuf_owner)
+		dfu_write_discard();
+	dfu_write_err = 0;
+
 	/* clear everything */
 	dfu->crc = 0;
 	dfu->offset = 0;
@@ -282,6 +437,9 @@ void dfu_transaction_cleanup(struct dfu_entity *dfu)
 	dfu->r_left = 0;
 	dfu->b_left = 0;
 	dfu->bad_skip = 0;
+	dfu->start_time = 0;
+	dfu->write_time = 0;
+	dfu->wait_time = 0;
 
 	dfu->inited = 0;
 }
@@ -293,6 +451,11 @@ int dfu_transaction_initiate(struct dfu_entity *dfu, bool read)
 	if (dfu->inited)
 		return 0;
 
+	/* finish writing what another transaction left behind */
+	ret = dfu_write_wait();
+	if (ret)
+		return ret;
+
 	dfu_transaction_cleanup(dfu);
 
 	if (dfu->i_buf_start == NULL)
@@ -305,25 +468,45 @@ int dfu_transaction_initiate(struct dfu_entity *dfu, bool read)
 		if (ret < 0)
 			return ret;
 		debug("%s: %s %lld [B]\n", __func__, dfu->name, dfu->r_left);
+	} else {
+		dfu_alloc_write_bufs();
 	}
 
+	dfu->start_time = get_timer(0);
 	dfu->inited = 1;
 	dfu_initiated_callback(dfu);
 
 	return 0;
 }
 
+static void dfu_show_write_stats(struct dfu_entity *dfu)
+{
+	ulong time = max(get_timer(dfu->start_time), 1UL);
+
+	printf("\nDFU %s: %llu bytes in %lu ms (%llu KiB/s), %lu ms writing, %lu ms waiting for the medium\n",
+	       dfu->name, dfu->offset, time,
+	       lldiv(dfu->offset * 1000, time) >> 10, dfu->write_time,
+	       dfu->wait_time);
+}
+
 int dfu_flush(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 {
 	int ret = 0;
 
-	ret = dfu_write_buffer_drain(dfu);
+	ret = dfu_write_get_err();
+	if (!ret)
+		ret = dfu_write_buffer_drain(dfu);
+	if (!ret)
+		ret = dfu_write_wait();
 	if (ret)
 		return ret;
 
 	if (dfu->flush_medium)
 		ret = dfu->flush_medium(dfu);
 
+	if (dfu->inited && dfu->offset)
+		dfu_show_write_stats(dfu);
+
 	if (dfu_hash_algo)
 		printf("\nDFU complete %s: 0x%08x\n", dfu_hash_algo->name,
 		       dfu->crc);
@@ -355,6 +538,14 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 		return -1;
 	}
 
+	/* report a failed background write */
+	ret = dfu_write_get_err();
+	if (ret) {
+		dfu_transaction_cleanup(dfu);
+		dfu_error_callback(dfu, "DFU write error");
+		return ret;
+	}
+
 	/* DFU 1.1 standard says:
 	 * The wBlockNum field is a block sequence number. It increments each
 	 * time a block is transferred, wrapping to zero from 65,535. It is used
@@ -526,6 +717,7 @@ static int dfu_fill_entity(struct dfu_entity *dfu, char *s, int alt,
 
 	dfu->alt = alt;
 	dfu->max_buf_size = 0;
+	dfu->max_write_size = 0;
 	dfu->free_entity = NULL;
 
 	/* Specific for mmc device */
@@ -18,6 +18,9 @@
 #include <part.h>
 #include <command.h>
 
+/* Raw writes are split up so that USB is serviced while they are done */
+#define DFU_MMC_WRITE_SIZE	(128 << 10)
+
 static unsigned char *dfu_file_buf;
 static u64 dfu_file_buf_len;
 static u64 dfu_file_buf_offset;
@@ -389,6 +392,7 @@ int dfu_fill_entity_mmc(struct dfu_entity *dfu, char *devstr, char **argv, int a
 		dfu->data.mmc.lba_start		= second_arg;
 		dfu->data.mmc.lba_size		= third_arg;
 		dfu->data.mmc.lba_blk_size	= mmc->read_bl_len;
+		dfu->max_write_size		= DFU_MMC_WRITE_SIZE;
 
 		/*
 		 * Check for an extra entry at dfu_alt_info env variable
@@ -433,6 +437,7 @@ int dfu_fill_entity_mmc(struct dfu_entity *dfu, char *devstr, char **argv, int a
 		dfu->data.mmc.lba_start		= partinfo.start + offset;
 		dfu->data.mmc.lba_size		= partinfo.size - offset;
 		dfu->data.mmc.lba_blk_size	= partinfo.blksz;
+		dfu->max_write_size		= DFU_MMC_WRITE_SIZE;
 	} else if (!strcmp(entity_type, "fat")) {
 		dfu->layout = DFU_FS_FAT;
 	} else if (!strcmp(entity_type, "ext4")) {
@@ -29,6 +29,38 @@ static u32 fastboot_bytes_received;
  */
 static u32 fastboot_bytes_expected;
 
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+/**
+ * stream_part - partition the next download is written to, empty if none
+ */
+static char stream_part[FASTBOOT_COMMAND_LEN];
+
+/**
+ * streamed_part - partition written by the last download, empty if none
+ */
+static char streamed_part[FASTBOOT_COMMAND_LEN];
+
+/**
+ * streaming - true while the current download is written to stream_part
+ */
+static bool streaming;
+
+/**
+ * stream_failed - true if writing the current download failed
+ */
+static bool stream_failed;
+
+/**
+ * stream_fill - number of bytes not yet written in the download buffer
+ */
+static u32 stream_fill;
+
+/**
+ * stream_response - response to send once the current download completes
+ */
+static char stream_response[FASTBOOT_RESPONSE_LEN];
+#endif
+
 static void okay(char *, char *);
 static void getvar(char *, char *);
 static void download(char *, char *);
@@ -48,6 +80,9 @@ static void oem_partconf(char *, char *);
 #if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_BOOTBUS)
 static void oem_bootbus(char *, char *);
 #endif
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+static void oem_stream(char *, char *);
+#endif
 
 #if CONFIG_IS_ENABLED(FASTBOOT_UUU_SUPPORT)
 static void run_ucmd(char *, char *);
@@ -122,6 +157,12 @@ static const struct {
 		.dispatch = oem_bootbus,
 	},
 #endif
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+	[FASTBOOT_COMMAND_OEM_STREAM] = {
+		.command = "oem stream",
+		.dispatch = oem_stream,
+	},
+#endif
 #if CONFIG_IS_ENABLED(FASTBOOT_UUU_SUPPORT)
 	[FASTBOOT_COMMAND_UCMD] = {
 		.command = "UCmd",
@@ -219,13 +260,41 @@ static void download(char *cmd_parameter, char *response)
 	 *
 	 * where cmd_parameter is an 8 digit hexadecimal number
 	 */
-	if (fastboot_bytes_expected > fastboot_buf_size) {
+	if (fastboot_bytes_expected > fastboot_download_limit()) {
 		fastboot_fail(cmd_parameter, response);
-	} else {
-		printf("Starting download of %d bytes\n",
-		       fastboot_bytes_expected);
-		fastboot_response("DATA", response, "%s", cmd_parameter);
+		return;
+	}
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+	streaming = false;
+	streamed_part[0] = '\0';
+	if (stream_part[0]) {
+		if (fastboot_mmc_stream_open(stream_part, response)) {
+			stream_part[0] = '\0';
+			return;
+		}
+		streaming = true;
+		stream_failed = false;
+		stream_fill = 0;
+		printf("Writing download to '%s'\n", stream_part);
 	}
+#endif
+	printf("Starting download of %d bytes\n", fastboot_bytes_expected);
+	fastboot_response("DATA", response, "%s", cmd_parameter);
+}
+
+/**
+ * fastboot_download_limit() - Get the size of the largest download accepted
+ *
+ * Return: Size of the download buffer, or U32_MAX if the next download is
+ * written to storage while it is received
+ */
+u32 fastboot_download_limit(void)
+{
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+	if (stream_part[0] && !streaming)
+		return U32_MAX;
+#endif
+	return fastboot_buf_size;
 }
 
 /**
@@ -238,6 +307,82 @@ u32 fastboot_data_remaining(void)
 	return fastboot_bytes_expected - fastboot_bytes_received;
 }
 
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+/**
+ * fastboot_stream_write() - Write out the data held in the download buffer
+ *
+ * @last: true if the download is complete
+ *
+ * Whatever the writer does not consume (partial blocks or headers) is moved
+ * to the start of the buffer and written with the next piece. After an
+ * error the rest of the download is received and dropped, the error is
+ * reported once the download completes.
+ */
+static void fastboot_stream_write(bool last)
+{
+	long ret = 0;
+
+	if (!stream_failed) {
+		ret = fastboot_mmc_stream_write(fastboot_buf_addr, stream_fill,
+						last, stream_response);
+		if (!ret && !last && stream_fill == fastboot_buf_size) {
+			fastboot_fail("download buffer too small", stream_response);
+			ret = -1;
+		}
+		if (ret < 0)
+			stream_failed = true;
+	}
+	if (stream_failed) {
+		stream_fill = 0;
+		return;
+	}
+
+	memmove(fastboot_buf_addr, fastboot_buf_addr + ret, stream_fill - ret);
+	stream_fill -= ret;
+}
+
+/**
+ * fastboot_stream_data() - Add received data to the download buffer
+ *
+ * @data: Pointer to received fastboot data
+ * @len: Length of received fastboot data
+ *
+ * The buffer is written out whenever it is full.
+ */
+static void fastboot_stream_data(const void *data, u32 len)
+{
+	u32 n;
+
+	while (len) {
+		n = min(len, fastboot_buf_size - stream_fill);
+		memcpy(fastboot_buf_addr + stream_fill, data, n);
+		stream_fill += n;
+		data += n;
+		len -= n;
+		if (stream_fill == fastboot_buf_size)
+			fastboot_stream_write(false);
+	}
+}
+
+/**
+ * fastboot_stream_complete() - Write the end of a streamed download
+ *
+ * @response: Pointer to fastboot response buffer
+ */
+static void fastboot_stream_complete(char *response)
+{
+	fastboot_stream_write(true);
+	if (!stream_failed && !fastboot_mmc_stream_close(stream_response))
+		strlcpy(streamed_part, stream_part, sizeof(streamed_part));
+	strlcpy(response, stream_response, FASTBOOT_RESPONSE_LEN);
+
+	streaming = false;
+	stream_part[0] = '\0';
+	/* The download buffer does not hold the image */
+	image_size = 0;
+}
+#endif
+
 /**
  * fastboot_data_download() - Copy image data to fastboot_buf_addr.
  *
@@ -266,6 +411,11 @@ void fastboot_data_download(const void *fastboot_data,
 			      response);
 		return;
 	}
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+	if (streaming)
+		fastboot_stream_data(fastboot_data, fastboot_data_len);
+	else
+#endif
 	/* Download data to fastboot_buf_addr */
 	memcpy(fastboot_buf_addr + fastboot_bytes_received,
 	       fastboot_data, fastboot_data_len);
@@ -282,6 +432,23 @@ void fastboot_data_download(const void *fastboot_data,
 	*response = '\0';
 }
 
+/**
+ * fastboot_data_flush() - Write out downloaded data while more is received
+ *
+ * When the current download is written to storage as it arrives, write out
+ * the download buffer once CONFIG_FASTBOOT_FLASH_STREAM_CHUNK bytes are
+ * pending. Transports call this after queueing the next receive, so that
+ * the transfer and the write overlap. Otherwise this does nothing.
+ */
+void fastboot_data_flush(void)
+{
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+	if (streaming && stream_fill >= min_t(u32, fastboot_buf_size,
+					      CONFIG_FASTBOOT_FLASH_STREAM_CHUNK))
+		fastboot_stream_write(false);
+#endif
+}
+
 /**
  * fastboot_data_complete() - Mark current transfer complete
  *
@@ -298,6 +465,10 @@ void fastboot_data_complete(char *response)
 	env_set_hex("filesize", image_size);
 	fastboot_bytes_expected = 0;
 	fastboot_bytes_received = 0;
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+	if (streaming)
+		fastboot_stream_complete(response);
+#endif
 }
 
 #if CONFIG_IS_ENABLED(FASTBOOT_FLASH)
@@ -312,6 +483,18 @@ void fastboot_data_complete(char *response)
  */
 static void flash(char *cmd_parameter, char *response)
 {
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+	if (streamed_part[0]) {
+		/* The image was already written while it was downloaded */
+		if (cmd_parameter && !strcmp(cmd_parameter, streamed_part))
+			fastboot_okay(NULL, response);
+		else
+			fastboot_fail("image was streamed to another partition",
+				      response);
+		streamed_part[0] = '\0';
+		return;
+	}
+#endif
 #if CONFIG_IS_ENABLED(FASTBOOT_FLASH_MMC)
 	fastboot_mmc_flash_write(cmd_parameter, fastboot_buf_addr, image_size,
 				 response);
@@ -342,6 +525,30 @@ static void erase(char *cmd_parameter, char *response)
 }
 #endif
 
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+/**
+ * oem_stream() - Write the next download to a partition as it arrives
+ *
+ * @cmd_parameter: Pointer to partition name, or empty to cancel
+ * @response: Pointer to fastboot response buffer
+ *
+ * The next download is not limited by the size of the download buffer. It
+ * is written to the partition while it is received, and the following
+ * "flash" command for the same partition only reports the result.
+ */
+static void oem_stream(char *cmd_parameter, char *response)
+{
+	if (!cmd_parameter)
+		cmd_parameter = "";
+	if (strlen(cmd_parameter) >= sizeof(stream_part)) {
+		fastboot_fail("partition name too long", response);
+		return;
+	}
+	strcpy(stream_part, cmd_parameter);
+	fastboot_okay(NULL, response);
+}
+#endif
+
 #if CONFIG_IS_ENABLED(FASTBOOT_UUU_SUPPORT)
 /**
  * run_ucmd() - Execute the UCmd command
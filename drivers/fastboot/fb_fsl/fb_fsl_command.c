@@ -321,6 +321,16 @@ void fastboot_data_download(const void *fastboot_data,
 	*response = '\0';
 }
 
+/**
+ * fastboot_data_flush() - Write out downloaded data while more is received
+ *
+ * Downloads are always kept in fastboot_buf_addr here, so there is nothing
+ * to do.
+ */
+void fastboot_data_flush(void)
+{
+}
+
 /**
  * fastboot_data_complete() - Mark current transfer complete
  *
@@ -137,7 +137,8 @@ static void getvar_version_bootloader(char *var_parameter, char *response)
 
 static void getvar_downloadsize(char *var_parameter, char *response)
 {
-	fastboot_response("OKAY", response, "0x%08x", fastboot_buf_size);
+	fastboot_response("OKAY", response, "0x%08x",
+			  fastboot_download_limit());
 }
 
 static void getvar_serialno(char *var_parameter, char *response)
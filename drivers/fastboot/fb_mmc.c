@@ -14,11 +14,13 @@
 #include <image-sparse.h>
 #include <image.h>
 #include <log.h>
+#include <malloc.h>
 #include <part.h>
 #include <mmc.h>
 #include <div64.h>
 #include <linux/compat.h>
 #include <android_image.h>
+#include <asm/cache.h>
 
 #define FASTBOOT_MAX_BLK_WRITE 16384
 
@@ -168,6 +170,59 @@ static lbaint_t fb_mmc_sparse_reserve(struct sparse_storage *info,
 	return blkcnt;
 }
 
+#if CONFIG_IS_ENABLED(MMC_WRITE)
+static lbaint_t fb_mmc_sparse_erase(struct sparse_storage *info,
+		lbaint_t blk, lbaint_t blkcnt)
+{
+	struct fb_mmc_sparse *sparse = info->priv;
+
+	if (fastboot_progress_callback)
+		fastboot_progress_callback("erasing");
+
+	return blk_derase(sparse->dev_desc, blk, blkcnt);
+}
+#endif
+
+/**
+ * fb_mmc_sparse_init() - Set up sparse storage for a partition
+ *
+ * Zero fills are erased instead of written if erased blocks read back as
+ * zeroes on this device.
+ *
+ * @sparse: Sparse storage to set up
+ * @sparse_priv: Private data for @sparse
+ * @dev_desc: Block device holding the partition
+ * @info: Partition to write to
+ */
+static void fb_mmc_sparse_init(struct sparse_storage *sparse,
+			       struct fb_mmc_sparse *sparse_priv,
+			       struct blk_desc *dev_desc,
+			       struct disk_partition *info)
+{
+	sparse_priv->dev_desc = dev_desc;
+
+	sparse->blksz = info->blksz;
+	sparse->start = info->start;
+	sparse->size = info->size;
+	sparse->write = fb_mmc_sparse_write;
+	sparse->reserve = fb_mmc_sparse_reserve;
+	sparse->erase = NULL;
+	sparse->erase_grp = 0;
+	sparse->mssg = fastboot_fail;
+	sparse->priv = sparse_priv;
+
+#if CONFIG_IS_ENABLED(MMC_WRITE)
+	if (dev_desc->if_type == IF_TYPE_MMC) {
+		struct mmc *mmc = find_mmc_device(dev_desc->devnum);
+
+		if (mmc && !mmc_erased_value(mmc)) {
+			sparse->erase = fb_mmc_sparse_erase;
+			sparse->erase_grp = mmc->erase_grp_size;
+		}
+	}
+#endif
+}
+
 static void write_raw_image(struct blk_desc *dev_desc,
 			    struct disk_partition *info, const char *part_name,
 			    void *buffer, u32 download_bytes, char *response)
@@ -610,19 +665,11 @@ void fastboot_mmc_flash_write(const char *cmd, void *download_buffer,
 		struct sparse_storage sparse;
 		int err;
 
-		sparse_priv.dev_desc = dev_desc;
-
-		sparse.blksz = info.blksz;
-		sparse.start = info.start;
-		sparse.size = info.size;
-		sparse.write = fb_mmc_sparse_write;
-		sparse.reserve = fb_mmc_sparse_reserve;
-		sparse.mssg = fastboot_fail;
+		fb_mmc_sparse_init(&sparse, &sparse_priv, dev_desc, &info);
 
 		printf("Flashing sparse image at offset " LBAFU "\n",
 		       sparse.start);
 
-		sparse.priv = &sparse_priv;
 		err = write_sparse_image(&sparse, cmd, download_buffer,
 					 response);
 		if (!err)
@@ -633,6 +680,213 @@ void fastboot_mmc_flash_write(const char *cmd, void *download_buffer,
 	}
 }
 
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+/**
+ * struct fb_mmc_stream - state of an image written while it is downloaded
+ *
+ * @dev_desc:	Block device holding the partition
+ * @info:	Partition the image is written to
+ * @started:	true once the image type is known
+ * @sparse:	true if the image is a sparse image
+ * @blk:	Next block to write for a raw image
+ * @sparse_priv: Private data for @storage
+ * @storage:	Sparse storage backend for @dev_desc
+ * @ss:		Sparse image parser state
+ */
+struct fb_mmc_stream {
+	struct blk_desc *dev_desc;
+	struct disk_partition info;
+	bool started;
+	bool sparse;
+	lbaint_t blk;
+	struct fb_mmc_sparse sparse_priv;
+	struct sparse_storage storage;
+	struct sparse_stream ss;
+};
+
+static struct fb_mmc_stream fb_stream;
+
+/**
+ * fastboot_mmc_stream_open() - Prepare to write an image while downloading
+ *
+ * @cmd: Named partition to write image to
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 if OK, -ve on error
+ */
+int fastboot_mmc_stream_open(const char *cmd, char *response)
+{
+	struct fb_mmc_stream *st = &fb_stream;
+
+	/* a previous download may have been abandoned half way */
+	if (st->sparse)
+		sparse_stream_release(&st->ss);
+	memset(st, '\0', sizeof(*st));
+
+	/* These need the whole image before anything can be written */
+#ifdef CONFIG_FASTBOOT_MMC_BOOT_SUPPORT
+	if (!strcmp(cmd, CONFIG_FASTBOOT_MMC_BOOT1_NAME) ||
+	    !strcmp(cmd, CONFIG_FASTBOOT_MMC_BOOT2_NAME))
+		goto unsupported;
+#endif
+#if CONFIG_IS_ENABLED(EFI_PARTITION)
+	if (!strcmp(cmd, CONFIG_FASTBOOT_GPT_NAME))
+		goto unsupported;
+#endif
+#if CONFIG_IS_ENABLED(DOS_PARTITION)
+	if (!strcmp(cmd, CONFIG_FASTBOOT_MBR_NAME))
+		goto unsupported;
+#endif
+	if (IS_ENABLED(CONFIG_ANDROID_BOOT_IMAGE) &&
+	    !strncasecmp(cmd, "zimage", 6))
+		goto unsupported;
+
+#if CONFIG_IS_ENABLED(FASTBOOT_MMC_USER_SUPPORT)
+	if (!strcmp(cmd, CONFIG_FASTBOOT_MMC_USER_NAME)) {
+		st->dev_desc = fastboot_mmc_get_dev(response);
+		if (!st->dev_desc)
+			return -ENODEV;
+
+		strlcpy((char *)&st->info.name, cmd, sizeof(st->info.name));
+		st->info.size	= st->dev_desc->lba;
+		st->info.blksz	= st->dev_desc->blksz;
+	}
+#endif
+
+	if (!st->info.name[0] &&
+	    fastboot_mmc_get_part_info(cmd, &st->dev_desc, &st->info,
+				       response) < 0)
+		return -ENOENT;
+	/* keep the name given by the client for messages */
+	strlcpy((char *)&st->info.name, cmd, sizeof(st->info.name));
+	st->blk = st->info.start;
+
+	return 0;
+
+unsupported:
+	fastboot_fail("streaming not supported for this partition", response);
+	return -EINVAL;
+}
+
+static int fb_mmc_stream_start(struct fb_mmc_stream *st, const void *buffer,
+			       u32 len, bool last)
+{
+	if (len < sizeof(sparse_header_t) && !last)
+		return 0;
+
+	st->started = true;
+	st->sparse = len >= sizeof(sparse_header_t) &&
+		     is_sparse_image((void *)buffer);
+	if (!st->sparse) {
+		puts("Flashing Raw Image\n");
+		return 0;
+	}
+
+	fb_mmc_sparse_init(&st->storage, &st->sparse_priv, st->dev_desc,
+			   &st->info);
+
+	printf("Flashing sparse image at offset " LBAFU "\n",
+	       st->storage.start);
+	sparse_stream_init(&st->ss, &st->storage);
+
+	return 0;
+}
+
+static long fb_mmc_stream_raw(struct fb_mmc_stream *st, const void *buffer,
+			      u32 len, bool last, char *response)
+{
+	lbaint_t blksz = st->info.blksz;
+	lbaint_t blkcnt = len / blksz;
+	u32 tail = len - blkcnt * blksz;
+	void *pad = NULL;
+
+	if (last && tail) {
+		/* the buffer may end before the last block does */
+		pad = memalign(ARCH_DMA_MINALIGN, blksz);
+		if (!pad) {
+			fastboot_fail("malloc failed", response);
+			return -1;
+		}
+		memcpy(pad, buffer + blkcnt * blksz, tail);
+		memset(pad + tail, '\0', blksz - tail);
+	}
+
+	if (st->blk + blkcnt + !!pad > st->info.start + st->info.size) {
+		pr_err("too large for partition: '%s'\n", st->info.name);
+		fastboot_fail("too large for partition", response);
+		goto err;
+	}
+
+	if (fb_mmc_blk_write(st->dev_desc, st->blk, blkcnt, buffer) != blkcnt ||
+	    (pad && fb_mmc_blk_write(st->dev_desc, st->blk + blkcnt, 1,
+				     pad) != 1)) {
+		pr_err("failed writing to device %d\n", st->dev_desc->devnum);
+		fastboot_fail("failed writing to device", response);
+		goto err;
+	}
+	st->blk += blkcnt;
+	if (pad) {
+		st->blk++;
+		free(pad);
+		return len;
+	}
+
+	return blkcnt * blksz;
+
+err:
+	free(pad);
+	return -1;
+}
+
+/**
+ * fastboot_mmc_stream_write() - Write the next piece of a streamed image
+ *
+ * @buffer: Image data following what was consumed by the previous call
+ * @len: Number of bytes available at @buffer
+ * @last: true if this is the end of the image
+ * @response: Pointer to fastboot response buffer
+ * Return: number of bytes consumed, or -1 on error
+ */
+long fastboot_mmc_stream_write(const void *buffer, u32 len, bool last,
+			       char *response)
+{
+	struct fb_mmc_stream *st = &fb_stream;
+
+	if (!st->started) {
+		fb_mmc_stream_start(st, buffer, len, last);
+		if (!st->started)
+			return 0;
+	}
+
+	if (st->sparse)
+		return sparse_stream_write(&st->ss, buffer, len, response);
+
+	return fb_mmc_stream_raw(st, buffer, len, last, response);
+}
+
+/**
+ * fastboot_mmc_stream_close() - Finish writing a streamed image
+ *
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 if OK, -1 on error
+ */
+int fastboot_mmc_stream_close(char *response)
+{
+	struct fb_mmc_stream *st = &fb_stream;
+	const char *name = (const char *)st->info.name;
+
+	if (st->sparse) {
+		if (sparse_stream_finish(&st->ss, name, response))
+			return -1;
+	} else {
+		printf("........ wrote " LBAFU " bytes to '%s'\n",
+		       (st->blk - st->info.start) * st->info.blksz, name);
+	}
+	fastboot_okay(NULL, response);
+
+	return 0;
+}
+#endif
+
 /**
  * fastboot_mmc_flash_erase() - Erase eMMC for fastboot
  *
@@ -325,6 +325,30 @@ int mmc_set_blocklen(struct mmc *mmc, int len)
 				   MMC_QUIRK_RETRY_SET_BLOCKLEN, 4);
 }
 
+/* Largest block count which SET_BLOCK_COUNT can take on all cards */
+#define MMC_MAX_SET_BLOCK_COUNT	0xffff
+
+bool mmc_use_set_block_count(struct mmc *mmc, lbaint_t blkcnt)
+{
+	return mmc->set_block_count && blkcnt > 1 &&
+	       blkcnt <= MMC_MAX_SET_BLOCK_COUNT;
+}
+
+/*
+ * Announce the length of the next multi-block transfer, so that the card
+ * ends it by itself and no STOP_TRANSMISSION is needed
+ */
+int mmc_set_block_count(struct mmc *mmc, lbaint_t blkcnt)
+{
+	struct mmc_cmd cmd;
+
+	cmd.cmdidx = MMC_CMD_SET_BLOCK_COUNT;
+	cmd.cmdarg = blkcnt;
+	cmd.resp_type = MMC_RSP_R1;
+
+	return mmc_send_cmd(mmc, &cmd, NULL);
+}
+
 #ifdef MMC_SUPPORTS_TUNING
 static const u8 tuning_blk_pattern_4bit[] = {
 	0xff, 0x0f, 0xff, 0x00, 0xff, 0xcc, 0xc3, 0xcc,
@@ -400,6 +424,10 @@ static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 {
 	struct mmc_cmd cmd;
 	struct mmc_data data;
+	bool set_count = mmc_use_set_block_count(mmc, blkcnt);
+
+	if (set_count && mmc_set_block_count(mmc, blkcnt))
+		return 0;
 
 	if (blkcnt > 1)
 		cmd.cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
@@ -421,7 +449,7 @@ static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 	if (mmc_send_cmd(mmc, &cmd, &data))
 		return 0;
 
-	if (blkcnt > 1) {
+	if (blkcnt > 1 && !set_count) {
 		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
 		cmd.cmdarg = 0;
 		cmd.resp_type = MMC_RSP_R1b;
@@ -2606,6 +2634,19 @@ static int mmc_startup(struct mmc *mmc)
 
 	mmc->best_mode = mmc->selected_mode;
 
+	/*
+	 * SET_BLOCK_COUNT is mandatory from MMC 3.1 and optional for SD
+	 * cards. It also needs a host which does not stop multi-block
+	 * transfers by itself.
+	 */
+	mmc->set_block_count = false;
+	if ((mmc->host_caps & MMC_CAP_CMD23) && !mmc_host_is_spi(mmc)) {
+		if (IS_SD(mmc))
+			mmc->set_block_count = mmc->scr[0] & SD_CMD23_SUPPORT;
+		else
+			mmc->set_block_count = mmc->version >= MMC_VERSION_3;
+	}
+
 	/* Fix the block length for DDR mode */
 	if (mmc->ddr_mode) {
 		mmc->read_bl_len = MMC_MAX_BLOCK_LEN;
@@ -16,6 +16,8 @@ int mmc_send_status(struct mmc *mmc, unsigned int *status);
 int mmc_poll_for_busy(struct mmc *mmc, int timeout);
 
 int mmc_set_blocklen(struct mmc *mmc, int len);
+bool mmc_use_set_block_count(struct mmc *mmc, lbaint_t blkcnt);
+int mmc_set_block_count(struct mmc *mmc, lbaint_t blkcnt);
 
 #if CONFIG_IS_ENABLED(BLK)
 ulong mmc_bread(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
@@ -96,6 +96,7 @@ static int msm_sdc_probe(struct udevice *dev)
 	int ret;
 
 	host->quirks = SDHCI_QUIRK_WAIT_SEND_CMD | SDHCI_QUIRK_BROKEN_R1B;
+	host->host_caps |= MMC_CAP_CMD23;
 
 	host->max_clk = 0;
 
@@ -556,6 +556,7 @@ static int rockchip_sdhci_probe(struct udevice *dev)
 
 	host->ops = &rockchip_sdhci_ops;
 	host->quirks = SDHCI_QUIRK_WAIT_SEND_CMD;
+	host->host_caps |= MMC_CAP_CMD23;
 
 	host->mmc = &plat->mmc;
 	host->mmc->priv = &prv->host;
@@ -29,6 +29,8 @@ struct sandbox_mmc_priv {
 	char *buf;
 	int csize;	/* CSIZE value to report */
 	int size;
+	uint block_count;	/* blocks in next transfer, from CMD23 */
+	bool open_ended;	/* multi-block transfer waiting for CMD12 */
 };
 
 /**
@@ -36,6 +38,9 @@ struct sandbox_mmc_priv {
  *
  * This emulate an SD card version 2. Single-block reads result in zero data.
  * Multiple-block reads return a test string.
+ *
+ * A multiple-block transfer must either have been announced with
+ * SET_BLOCK_COUNT or be followed by STOP_TRANSMISSION, but not both.
  */
 static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 				struct mmc_data *data)
@@ -77,17 +82,30 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 			resp[4] = (cmd->cmdarg & 0xF) << 24;
 		break;
 	}
-	case MMC_CMD_READ_SINGLE_BLOCK:
-	case MMC_CMD_READ_MULTIPLE_BLOCK:
-		memcpy(data->dest, &priv->buf[cmd->cmdarg * data->blocksize],
-		       data->blocks * data->blocksize);
+	case MMC_CMD_SET_BLOCK_COUNT:
+		priv->block_count = cmd->cmdarg & 0xffff;
 		break;
-	case MMC_CMD_WRITE_SINGLE_BLOCK:
+	case MMC_CMD_READ_MULTIPLE_BLOCK:
 	case MMC_CMD_WRITE_MULTIPLE_BLOCK:
-		memcpy(&priv->buf[cmd->cmdarg * data->blocksize], data->src,
-		       data->blocks * data->blocksize);
+		if (priv->block_count && priv->block_count != data->blocks)
+			return -EIO;
+		priv->open_ended = !priv->block_count;
+		priv->block_count = 0;
+		fallthrough;
+	case MMC_CMD_READ_SINGLE_BLOCK:
+	case MMC_CMD_WRITE_SINGLE_BLOCK:
+		if (data->flags & MMC_DATA_READ)
+			memcpy(data->dest,
+			       &priv->buf[cmd->cmdarg * data->blocksize],
+			       data->blocks * data->blocksize);
+		else
+			memcpy(&priv->buf[cmd->cmdarg * data->blocksize],
+			       data->src, data->blocks * data->blocksize);
 		break;
 	case MMC_CMD_STOP_TRANSMISSION:
+		if (!priv->open_ended)
+			return -EIO;
+		priv->open_ended = false;
 		break;
 	case SD_CMD_ERASE_WR_BLK_START:
 		erase_start = cmd->cmdarg;
@@ -112,7 +130,8 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	case SD_CMD_APP_SEND_SCR: {
 		u32 *scr = (u32 *)data->dest;
 
-		scr[0] = cpu_to_be32(2 << 24 | 1 << 15);  /* SD version 3 */
+		/* SD version 3, with CMD23 */
+		scr[0] = cpu_to_be32(2 << 24 | 1 << 15 | SD_CMD23_SUPPORT);
 		break;
 	}
 	default:
@@ -207,7 +226,8 @@ static int sandbox_mmc_bind(struct udevice *dev)
 	struct mmc_config *cfg = &plat->cfg;
 
 	cfg->name = dev->name;
-	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_8BIT;
+	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_8BIT |
+			 MMC_CAP_CMD23;
 	cfg->voltages = MMC_VDD_165_195 | MMC_VDD_32_33 | MMC_VDD_33_34;
 	cfg->f_min = 1000000;
 	cfg->f_max = 52000000;
@@ -64,6 +64,9 @@ void sdhci_prepare_adma_table(struct sdhci_adma_desc *table,
 /**
  * sdhci_adma_init() - initialize the ADMA descriptor table
  *
+ * The table is allocated once per host and sized so that it can describe the
+ * largest transfer the MMC core issues (CONFIG_SYS_MMC_MAX_BLK_COUNT blocks).
+ *
  * Return: pointer to the allocated descriptor table or NULL in case of an
  * error.
  */
@@ -273,6 +273,7 @@ static int sdhci_cdns_probe(struct udevice *dev)
 	host->ioaddr = plat->hrs_addr + SDHCI_CDNS_SRS_BASE;
 	host->ops = &sdhci_cdns_ops;
 	host->quirks |= SDHCI_QUIRK_WAIT_SEND_CMD;
+	host->host_caps |= MMC_CAP_CMD23;
 	sdhci_cdns_mmc_ops = sdhci_ops;
 #ifdef MMC_SUPPORTS_TUNING
 	sdhci_cdns_mmc_ops.execute_tuning = sdhci_cdns_execute_tuning;
@@ -157,17 +157,18 @@ static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data)
 				continue;
 			}
 		}
-		if ((host->flags & USE_DMA) && !transfer_done &&
+		/*
+		 * Only SDMA stops at buffer boundaries, ADMA walks the whole
+		 * descriptor chain without raising DMA_END.
+		 */
+		if ((host->flags & USE_SDMA) && !transfer_done &&
 		    (stat & SDHCI_INT_DMA_END)) {
 			sdhci_writel(host, SDHCI_INT_DMA_END, SDHCI_INT_STATUS);
-			if (host->flags & USE_SDMA) {
-				start_addr &=
-				~(SDHCI_DEFAULT_BOUNDARY_SIZE - 1);
-				start_addr += SDHCI_DEFAULT_BOUNDARY_SIZE;
-				start_addr = dev_phys_to_bus(mmc_to_dev(host->mmc),
-							     start_addr);
-				sdhci_writel(host, start_addr, SDHCI_DMA_ADDRESS);
-			}
+			start_addr &= ~(SDHCI_DEFAULT_BOUNDARY_SIZE - 1);
+			start_addr += SDHCI_DEFAULT_BOUNDARY_SIZE;
+			start_addr = dev_phys_to_bus(mmc_to_dev(host->mmc),
+						     start_addr);
+			sdhci_writel(host, start_addr, SDHCI_DMA_ADDRESS);
 		}
 		if (timeout-- > 0)
 			udelay(10);
@@ -863,19 +864,28 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 	}
 #endif
 #if CONFIG_IS_ENABLED(MMC_SDHCI_ADMA)
-	if (!(caps & SDHCI_CAN_DO_ADMA2)) {
-		printf("%s: Your controller doesn't support SDMA!!\n",
-		       __func__);
-		return -EINVAL;
-	}
-	host->adma_desc_table = sdhci_adma_init();
-	host->adma_addr = (dma_addr_t)host->adma_desc_table;
+	/*
+	 * Prefer ADMA2 when the controller has it: the descriptor pool is
+	 * allocated once and covers a full b_max transfer, so a request never
+	 * has to be restarted at SDMA buffer boundaries.
+	 */
+	if (caps & SDHCI_CAN_DO_ADMA2) {
+		if (!host->adma_desc_table)
+			host->adma_desc_table = sdhci_adma_init();
+		if (!host->adma_desc_table)
+			return -ENOMEM;
+		host->adma_addr = (dma_addr_t)host->adma_desc_table;
 
+		host->flags &= ~USE_SDMA;
 #ifdef CONFIG_DMA_ADDR_T_64BIT
-	host->flags |= USE_ADMA64;
+		host->flags |= USE_ADMA64;
 #else
-	host->flags |= USE_ADMA;
+		host->flags |= USE_ADMA;
 #endif
+	} else {
+		debug("%s: Your controller doesn't support ADMA2, using %s\n",
+		      __func__, host->flags & USE_SDMA ? "SDMA" : "PIO");
+	}
 #endif
 	if (host->quirks & SDHCI_QUIRK_REG32_RW)
 		host->version =
@@ -944,6 +954,10 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 	if (caps & SDHCI_CAN_DO_HISPD)
 		cfg->host_caps |= MMC_MODE_HS | MMC_MODE_HS_52MHz;
 
+	/*
+	 * MMC_CAP_CMD23 is left to the host drivers (in host->host_caps):
+	 * not every controller copes with a transfer ended without CMD12.
+	 */
 	cfg->host_caps |= MMC_MODE_4BIT;
 
 	/* Since Host Controller Version3.0 */
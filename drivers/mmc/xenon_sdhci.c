@@ -488,7 +488,8 @@ static int xenon_sdhci_probe(struct udevice *dev)
 	if (priv->pad_ctrl_reg)
 		armada_3700_soc_pad_voltage_set(host);
 
-	host->host_caps = MMC_MODE_HS | MMC_MODE_HS_52MHz | MMC_MODE_DDR_52MHz;
+	host->host_caps = MMC_MODE_HS | MMC_MODE_HS_52MHz | MMC_MODE_DDR_52MHz |
+			  MMC_CAP_CMD23;
 
 	ret = mmc_of_parse(dev, &plat->cfg);
 	if (ret)
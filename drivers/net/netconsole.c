@@ -130,6 +130,12 @@ void nc_start(void)
 		memcpy(pkt, output_packet, output_packet_len);
 		net_send_udp_packet(nc_ether, nc_ip, nc_out_port, nc_in_port,
 				    output_packet_len);
+		/*
+		 * If the server was in the ARP cache the packet is sent
+		 * and nc_ether is filled in, so there is no reply to wait for
+		 */
+		if (memcmp(nc_ether, net_null_ethaddr, 6))
+			net_set_state(NETLOOP_SUCCESS);
 	}
 }
 
@@ -11,6 +11,7 @@
 #include <log.h>
 #include <malloc.h>
 #include <net.h>
+#include <net6.h>
 #include <asm/eth.h>
 #include <asm/global_data.h>
 #include <asm/test.h>
@@ -162,6 +163,127 @@ int sandbox_eth_ping_req_to_reply(struct udevice *dev, void *packet,
 	return 0;
 }
 
+#ifdef CONFIG_IPV6
+/*
+ * sandbox_eth_nd_req_to_reply()
+ *
+ * Check for a neighbour solicitation to be sent. If so, inject an
+ * advertisement
+ *
+ * returns 0 if injected, -EAGAIN if not
+ */
+int sandbox_eth_nd_req_to_reply(struct udevice *dev, void *packet,
+				unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip6_hdr *ip6;
+	struct nd_msg *ns;
+	struct ethernet_hdr *eth_recv;
+	struct ip6_hdr *ip6r;
+	struct nd_msg *na;
+	int na_len = sizeof(*na) + 8;
+
+	if (ntohs(eth->et_protlen) != PROT_IPV6)
+		return -EAGAIN;
+
+	ip6 = packet + ETHER_HDR_SIZE;
+	ns = (struct nd_msg *)(ip6 + 1);
+
+	if (ip6->ip6_nxt != IPPROTO_ICMPV6 ||
+	    ns->icmph.icmp6_type != ICMPV6_NEIGHBOUR_SOLICIT)
+		return -EAGAIN;
+
+	/* Don't allow the buffer to overrun */
+	if (priv->recv_packets >= PKTBUFSRX)
+		return 0;
+
+	/* store this as the assumed IPv6 address of the fake host */
+	priv->fake_host_ip6addr = ns->target;
+
+	/* Formulate a fake response */
+	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IPV6);
+
+	ip6r = (void *)eth_recv + ETHER_HDR_SIZE;
+	ip6_add_hdr((uchar *)ip6r, &ns->target, &ip6->ip6_src, IPPROTO_ICMPV6,
+		    ND_HOP_LIMIT, na_len);
+	na = (struct nd_msg *)(ip6r + 1);
+	memset(na, '\0', na_len);
+	na->icmph.icmp6_type = ICMPV6_NEIGHBOUR_ADVERT;
+	na->icmph.un.na_flags = htonl(ICMPV6_NA_SOLICITED |
+				      ICMPV6_NA_OVERRIDE);
+	na->target = ns->target;
+	na->opt[0] = ND_OPT_TARGET_LL_ADDR;
+	na->opt[1] = ND_OPT_LL_ADDR_LEN;
+	memcpy(&na->opt[2], priv->fake_host_hwaddr, ARP_HLEN);
+	na->icmph.icmp6_cksum = ip6_csum(&ip6r->ip6_src, &ip6r->ip6_dst,
+					 na_len, IPPROTO_ICMPV6, na);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP6_HDR_SIZE + na_len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+/*
+ * sandbox_eth_ping6_req_to_reply()
+ *
+ * Check for an ICMPv6 echo request to be sent. If so, inject a reply
+ *
+ * returns 0 if injected, -EAGAIN if not
+ */
+int sandbox_eth_ping6_req_to_reply(struct udevice *dev, void *packet,
+				   unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip6_hdr *ip6;
+	struct icmp6_hdr *icmp;
+	struct ethernet_hdr *eth_recv;
+	struct ip6_hdr *ip6r;
+	struct icmp6_hdr *icmpr;
+
+	if (ntohs(eth->et_protlen) != PROT_IPV6)
+		return -EAGAIN;
+
+	ip6 = packet + ETHER_HDR_SIZE;
+	icmp = (struct icmp6_hdr *)(ip6 + 1);
+
+	if (ip6->ip6_nxt != IPPROTO_ICMPV6 ||
+	    icmp->icmp6_type != ICMPV6_ECHO_REQUEST)
+		return -EAGAIN;
+
+	/* Don't allow the buffer to overrun */
+	if (priv->recv_packets >= PKTBUFSRX)
+		return 0;
+
+	/* reply to the ping */
+	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_recv, packet, len);
+	ip6r = (void *)eth_recv + ETHER_HDR_SIZE;
+	icmpr = (struct icmp6_hdr *)(ip6r + 1);
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	ip6r->ip6_src = ip6->ip6_dst;
+	ip6r->ip6_dst = ip6->ip6_src;
+
+	icmpr->icmp6_type = ICMPV6_ECHO_REPLY;
+	icmpr->icmp6_cksum = 0;
+	icmpr->icmp6_cksum = ip6_csum(&ip6r->ip6_src, &ip6r->ip6_dst,
+				      ntohs(ip6r->ip6_plen), IPPROTO_ICMPV6,
+				      icmpr);
+
+	priv->recv_packet_length[priv->recv_packets] = len;
+	++priv->recv_packets;
+
+	return 0;
+}
+#endif
+
 /*
  * sandbox_eth_recv_arp_req()
  *
@@ -270,6 +392,12 @@ static int sb_default_handler(struct udevice *dev, void *packet,
 		return 0;
 	if (!sandbox_eth_ping_req_to_reply(dev, packet, len))
 		return 0;
+#ifdef CONFIG_IPV6
+	if (!sandbox_eth_nd_req_to_reply(dev, packet, len))
+		return 0;
+	if (!sandbox_eth_ping6_req_to_reply(dev, packet, len))
+		return 0;
+#endif
 
 	return 0;
 }
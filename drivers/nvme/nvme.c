@@ -17,8 +17,10 @@
 #include <linux/compat.h>
 #include "nvme.h"
 
-#define NVME_Q_DEPTH		2
+#define NVME_Q_DEPTH		CONFIG_NVME_IO_QUEUE_DEPTH
 #define NVME_AQ_DEPTH		2
+/* Size of nvme_dev.queues: the admin queue and all I/O queues */
+#define NVME_MAX_QUEUES		(NVME_IO_Q + CONFIG_NVME_IO_QUEUES)
 #define NVME_SQ_SIZE(depth)	(depth * sizeof(struct nvme_command))
 #define NVME_CQ_SIZE(depth)	(depth * sizeof(struct nvme_completion))
 #define NVME_CQ_ALLOCATION	ALIGN(NVME_CQ_SIZE(NVME_Q_DEPTH), \
@@ -45,8 +47,19 @@ static int nvme_wait_ready(struct nvme_dev *dev, bool enabled)
 	return -ETIME;
 }
 
-static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
-			   int total_len, u64 dma_addr)
+/**
+ * nvme_setup_prps() - set up the PRP entries for a transfer
+ *
+ * @dev:	NVMe device
+ * @poolp:	PRP list to use; this is reallocated if it is too small
+ * @entriesp:	Number of entries *@poolp can hold, updated on reallocation
+ * @prp2:	Returns the value for the PRP2 field of the command
+ * @total_len:	Length of the transfer in bytes
+ * @dma_addr:	Address of the transfer
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+static int nvme_setup_prps(struct nvme_dev *dev, u64 **poolp, u32 *entriesp,
+			   u64 *prp2, int total_len, u64 dma_addr)
 {
 	u32 page_size = dev->page_size;
 	int offset = dma_addr & (page_size - 1);
@@ -74,21 +87,22 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 	nprps = DIV_ROUND_UP(length, page_size);
 	num_pages = DIV_ROUND_UP(nprps, prps_per_page);
 
-	if (nprps > dev->prp_entry_num) {
-		free(dev->prp_pool);
+	if (nprps > *entriesp) {
+		free(*poolp);
 		/*
 		 * Always increase in increments of pages.  It doesn't waste
 		 * much memory and reduces the number of allocations.
 		 */
-		dev->prp_pool = memalign(page_size, num_pages * page_size);
-		if (!dev->prp_pool) {
+		*poolp = memalign(page_size, num_pages * page_size);
+		if (!*poolp) {
 			printf("Error: malloc prp_pool fail\n");
+			*entriesp = 0;
 			return -ENOMEM;
 		}
-		dev->prp_entry_num = prps_per_page * num_pages;
+		*entriesp = prps_per_page * num_pages;
 	}
 
-	prp_pool = dev->prp_pool;
+	prp_pool = *poolp;
 	i = 0;
 	while (nprps) {
 		if (i == ((page_size >> 3) - 1)) {
@@ -101,10 +115,10 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 		dma_addr += page_size;
 		nprps--;
 	}
-	*prp2 = (ulong)dev->prp_pool;
+	*prp2 = (ulong)*poolp;
 
-	flush_dcache_range((ulong)dev->prp_pool, (ulong)dev->prp_pool +
-			   dev->prp_entry_num * sizeof(u64));
+	flush_dcache_range((ulong)*poolp, (ulong)*poolp +
+			   *entriesp * sizeof(u64));
 
 	return 0;
 }
@@ -309,6 +323,13 @@ static int nvme_disable_ctrl(struct nvme_dev *dev)
 
 static void nvme_free_queue(struct nvme_queue *nvmeq)
 {
+	int i;
+
+	if (nvmeq->slots) {
+		for (i = 0; i < nvmeq->num_slots; i++)
+			free(nvmeq->slots[i].prp_list);
+		free(nvmeq->slots);
+	}
 	free((void *)nvmeq->cqes);
 	free(nvmeq->sq_cmds);
 	free(nvmeq);
@@ -531,7 +552,11 @@ static int nvme_create_queue(struct nvme_queue *nvmeq, int qid)
 	struct nvme_dev *dev = nvmeq->dev;
 	int result;
 
-	nvmeq->cq_vector = qid - 1;
+	/*
+	 * Completions are polled, and without MSI-X only vector 0 may be
+	 * used, so all I/O queues share it.
+	 */
+	nvmeq->cq_vector = 0;
 	result = nvme_alloc_cq(dev, qid, nvmeq);
 	if (result < 0)
 		goto release_cq;
@@ -584,20 +609,29 @@ static void nvme_create_io_queues(struct nvme_dev *dev)
 
 static int nvme_setup_io_queues(struct nvme_dev *dev)
 {
+	struct nvme_ops *ops = (struct nvme_ops *)dev->udev->driver->ops;
 	int nr_io_queues;
 	int result;
 
-	nr_io_queues = 1;
+	/* Controllers with their own queue setup only have one I/O queue */
+	nr_io_queues = CONFIG_NVME_IO_QUEUES;
+	if (ops && ops->setup_queue)
+		nr_io_queues = 1;
 	result = nvme_set_queue_count(dev, nr_io_queues);
 	if (result <= 0)
 		return result;
 
-	dev->max_qid = nr_io_queues;
+	dev->max_qid = min(nr_io_queues, result);
 
 	/* Free previously allocated queues */
 	nvme_free_queues(dev, nr_io_queues + 1);
 	nvme_create_io_queues(dev);
 
+	/* Only use the I/O queues which could be created */
+	if (dev->online_queues <= NVME_IO_Q)
+		return -EIO;
+	dev->max_qid = min(dev->max_qid, dev->online_queues - 1);
+
 	return 0;
 }
 
@@ -719,8 +753,313 @@ static int nvme_blk_probe(struct udevice *udev)
 	return 0;
 }
 
+/*
+ * Owner of the slots of commands which timed out. Their command IDs are not
+ * used again until the controller completes them or is reset, so that a late
+ * completion cannot be taken for that of a newer command.
+ */
+static struct blk_req nvme_timed_out_req;
+
+/* Process the completions of commands queued on one I/O queue */
+static int nvme_poll_queue(struct nvme_ns *ns, struct nvme_queue *nvmeq)
+{
+	u16 head = nvmeq->cq_head;
+	u16 phase = nvmeq->cq_phase;
+	struct nvme_io_slot *slot;
+	struct blk_req *req;
+	int count = 0;
+	u16 status, cid;
+
+	while (nvmeq->busy_slots) {
+		status = nvme_read_completion_status(nvmeq, head);
+		if ((status & 0x01) != phase)
+			break;
+		cid = readw(&nvmeq->cqes[head].command_id);
+		if (++head == nvmeq->q_depth) {
+			head = 0;
+			phase = !phase;
+		}
+		if (cid >= nvmeq->num_slots || !nvmeq->slots[cid].req) {
+			printf("ERROR: unexpected completion, cid = %x\n", cid);
+			continue;
+		}
+
+		slot = &nvmeq->slots[cid];
+		req = slot->req;
+		slot->req = NULL;
+		nvmeq->busy_slots--;
+		if (req == &nvme_timed_out_req)
+			continue;
+		if (status >> 1) {
+			printf("ERROR: status = %x, cid = %x\n", status >> 1,
+			       cid);
+			req->result = -EIO;
+		}
+		if (--req->pending)
+			continue;
+
+		if (req->op == BLK_REQ_READ)
+			invalidate_dcache_range((ulong)req->buffer,
+						(ulong)req->buffer +
+						(req->blkcnt << ns->lba_shift));
+		req->done = true;
+		count++;
+	}
+
+	/* One doorbell write for the whole batch of completions */
+	if (head != nvmeq->cq_head || phase != nvmeq->cq_phase) {
+		writel(head, nvmeq->q_db + nvmeq->dev->db_stride);
+		nvmeq->cq_head = head;
+		nvmeq->cq_phase = phase;
+	}
+
+	return count;
+}
+
+/* Hand the slots of a request over to nvme_timed_out_req */
+static void nvme_drop_req(struct nvme_dev *dev, struct blk_req *req)
+{
+	struct nvme_queue *nvmeq;
+	int qid, cid;
+
+	for (qid = NVME_IO_Q; qid <= dev->max_qid; qid++) {
+		nvmeq = dev->queues[qid];
+		for (cid = 0; cid < nvmeq->num_slots; cid++) {
+			if (nvmeq->slots[cid].req == req)
+				nvmeq->slots[cid].req = &nvme_timed_out_req;
+		}
+	}
+}
+
+static int nvme_blk_poll(struct udevice *udev)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+	int count = 0;
+	int qid;
+
+	for (qid = NVME_IO_Q; qid <= dev->max_qid; qid++)
+		count += nvme_poll_queue(ns, dev->queues[qid]);
+
+	return count;
+}
+
+static uint nvme_busy_slots(struct nvme_dev *dev)
+{
+	uint busy = 0;
+	int qid;
+
+	for (qid = NVME_IO_Q; qid <= dev->max_qid; qid++)
+		busy += dev->queues[qid]->busy_slots;
+
+	return busy;
+}
+
+/*
+ * Wait for all commands queued with nvme_blk_submit() to complete. Each
+ * command may take up to IO_TIMEOUT seconds.
+ */
+static int nvme_blk_drain(struct udevice *udev)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	ulong start = get_timer(0);
+	uint busy, left;
+
+	busy = nvme_busy_slots(ns->dev);
+	while (busy) {
+		nvme_blk_poll(udev);
+		left = nvme_busy_slots(ns->dev);
+		if (left < busy)
+			start = get_timer(0);
+		else if (get_timer(start) > IO_TIMEOUT * 1000)
+			return -ETIMEDOUT;
+		busy = left;
+	}
+
+	return 0;
+}
+
+static int nvme_alloc_slots(struct nvme_dev *dev, struct nvme_queue *nvmeq)
+{
+	u32 entries = DIV_ROUND_UP(1 << dev->max_transfer_shift,
+				   dev->page_size) + 1;
+	u32 size = ALIGN(entries * sizeof(u64), dev->page_size);
+	int i;
+
+	nvmeq->slots = calloc(nvmeq->q_depth - 1, sizeof(*nvmeq->slots));
+	if (!nvmeq->slots)
+		return -ENOMEM;
+	for (i = 0; i < nvmeq->q_depth - 1; i++) {
+		nvmeq->slots[i].prp_list = memalign(dev->page_size, size);
+		if (!nvmeq->slots[i].prp_list)
+			break;
+		nvmeq->slots[i].prp_entries = size / sizeof(u64);
+	}
+	if (!i) {
+		free(nvmeq->slots);
+		nvmeq->slots = NULL;
+		return -ENOMEM;
+	}
+	nvmeq->num_slots = i;
+
+	return 0;
+}
+
+/*
+ * Return the number of I/O slots of all queues, allocating them on first
+ * use, or 0 if commands cannot be queued on this controller
+ */
+static uint nvme_get_slots(struct nvme_dev *dev)
+{
+	struct nvme_ops *ops = (struct nvme_ops *)dev->udev->driver->ops;
+	uint slots = 0;
+	int qid;
+
+	/*
+	 * Controllers with their own submission hooks handle one command at
+	 * a time.
+	 */
+	if (ops && ops->submit_cmd)
+		return 0;
+
+	for (qid = NVME_IO_Q; qid <= dev->max_qid; qid++) {
+		struct nvme_queue *nvmeq = dev->queues[qid];
+
+		if (!nvmeq->slots)
+			nvme_alloc_slots(dev, nvmeq);
+		slots += nvmeq->num_slots;
+	}
+
+	return slots;
+}
+
+/* Find a free I/O slot, going round the I/O queues */
+static struct nvme_io_slot *nvme_find_slot(struct nvme_dev *dev,
+					   struct nvme_queue **nvmeqp,
+					   u16 *cidp)
+{
+	struct nvme_queue *nvmeq;
+	int i, cid;
+
+	for (i = 0; i < dev->max_qid; i++) {
+		nvmeq = dev->queues[NVME_IO_Q + dev->next_qid];
+		if (++dev->next_qid == dev->max_qid)
+			dev->next_qid = 0;
+		if (nvmeq->busy_slots == nvmeq->num_slots)
+			continue;
+
+		for (cid = 0; cid < nvmeq->num_slots; cid++) {
+			if (!nvmeq->slots[cid].req) {
+				*nvmeqp = nvmeq;
+				*cidp = cid;
+				return &nvmeq->slots[cid];
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * nvme_queue_rw() - queue read or write commands for part of a request
+ *
+ * Commands of up to the maximum transfer size are queued for the blocks
+ * left in @req, for as long as there are free I/O slots.
+ *
+ * @ns:		Namespace
+ * @req:	Request the commands belong to
+ * @slbap:	Next block to transfer, updated on return
+ * @leftp:	Number of blocks left to transfer, updated on return
+ * @bufferp:	Next buffer address, updated on return
+ * Return: 0 if OK, -ENOMEM if a PRP list could not be allocated
+ */
+static int nvme_queue_rw(struct nvme_ns *ns, struct blk_req *req, u64 *slbap,
+			 lbaint_t *leftp, uintptr_t *bufferp)
+{
+	struct nvme_dev *dev = ns->dev;
+	u32 max_lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
+	struct nvme_io_slot *slot;
+	struct nvme_queue *nvmeq;
+	struct nvme_command c;
+	u32 lbas;
+	u64 prp2;
+	u16 cid;
+
+	memset(&c, '\0', sizeof(c));
+	c.rw.opcode = req->op == BLK_REQ_READ ? nvme_cmd_read : nvme_cmd_write;
+	c.rw.nsid = cpu_to_le32(ns->ns_id);
+
+	while (*leftp) {
+		slot = nvme_find_slot(dev, &nvmeq, &cid);
+		if (!slot)
+			break;
+		lbas = min_t(lbaint_t, *leftp, max_lbas);
+
+		if (nvme_setup_prps(dev, &slot->prp_list, &slot->prp_entries,
+				    &prp2, lbas << ns->lba_shift, *bufferp))
+			return -ENOMEM;
+		c.rw.command_id = cpu_to_le16(cid);
+		c.rw.slba = cpu_to_le64(*slbap);
+		c.rw.length = cpu_to_le16(lbas - 1);
+		c.rw.prp1 = cpu_to_le64(*bufferp);
+		c.rw.prp2 = cpu_to_le64(prp2);
+
+		slot->req = req;
+		nvmeq->busy_slots++;
+		req->pending++;
+		nvme_submit_cmd(nvmeq, &c);
+
+		*slbap += lbas;
+		*leftp -= lbas;
+		*bufferp += lbas << ns->lba_shift;
+	}
+
+	return 0;
+}
+
 static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
-			 lbaint_t blkcnt, void *buffer, bool read)
+			 lbaint_t blkcnt, void *buffer, bool read);
+
+static int nvme_blk_submit(struct udevice *udev, struct blk_req *req)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+	u32 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
+	u32 ncmds = DIV_ROUND_UP(req->blkcnt, lbas);
+	uintptr_t buffer = (uintptr_t)req->buffer;
+	lbaint_t left = req->blkcnt;
+	u64 slba = req->start;
+	uint slots;
+
+	/* A request too large for the queues is done synchronously */
+	slots = nvme_get_slots(dev);
+	if (ncmds > slots) {
+		req->result = nvme_blk_rw(udev, req->start, req->blkcnt,
+					  req->buffer,
+					  req->op == BLK_REQ_READ);
+		req->done = true;
+		return 0;
+	}
+	if (slots - nvme_busy_slots(dev) < ncmds)
+		return -EBUSY;
+
+	flush_dcache_range(buffer, buffer + (req->blkcnt << ns->lba_shift));
+
+	req->result = req->blkcnt;
+	if (nvme_queue_rw(ns, req, &slba, &left, &buffer))
+		req->result = -ENOMEM;
+	if (!req->pending)
+		req->done = true;
+
+	return 0;
+}
+
+/*
+ * Transfer a range with one command at a time, for controllers which
+ * cannot queue commands
+ */
+static ulong nvme_blk_rw_sync(struct udevice *udev, lbaint_t blknr,
+			      lbaint_t blkcnt, void *buffer, bool read)
 {
 	struct nvme_ns *ns = dev_get_priv(udev);
 	struct nvme_dev *dev = ns->dev;
@@ -757,8 +1096,8 @@ static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
 			total_lbas -= lbas;
 		}
 
-		if (nvme_setup_prps(dev, &prp2,
-				    lbas << ns->lba_shift, temp_buffer))
+		if (nvme_setup_prps(dev, &dev->prp_pool, &dev->prp_entry_num,
+				    &prp2, lbas << ns->lba_shift, temp_buffer))
 			return -EIO;
 		c.rw.slba = cpu_to_le64(slba);
 		slba += lbas;
@@ -780,6 +1119,80 @@ static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
 	return (total_len - temp_len) >> desc->log2blksz;
 }
 
+/*
+ * Transfer a range, keeping as many commands in flight as there are free
+ * I/O slots: a new command is queued as soon as one completes, and all the
+ * completions found by each poll are acknowledged together.
+ */
+static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
+			 lbaint_t blkcnt, void *buffer, bool read)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct blk_req req = {
+		.op = read ? BLK_REQ_READ : BLK_REQ_WRITE,
+		.start = blknr,
+		.blkcnt = blkcnt,
+		.buffer = buffer,
+		.result = blkcnt,
+	};
+	uintptr_t next = (uintptr_t)buffer;
+	lbaint_t left = blkcnt;
+	u64 slba = blknr;
+	ulong start;
+	uint pending;
+
+	if (!nvme_get_slots(ns->dev)) {
+		/* Commands queued with nvme_blk_submit() must not see ours */
+		if (nvme_blk_drain(udev))
+			return -EIO;
+		return nvme_blk_rw_sync(udev, blknr, blkcnt, buffer, read);
+	}
+
+	flush_dcache_range((ulong)buffer,
+			   (ulong)buffer + (blkcnt << ns->lba_shift));
+
+	start = get_timer(0);
+	while (left || req.pending) {
+		if (left && req.result >= 0 &&
+		    nvme_queue_rw(ns, &req, &slba, &left, &next))
+			req.result = -ENOMEM;
+		if (req.result < 0)
+			left = 0;
+
+		/* IO_TIMEOUT applies to each command, not the whole range */
+		pending = req.pending;
+		nvme_blk_poll(udev);
+		if (req.pending < pending)
+			start = get_timer(0);
+		else if (get_timer(start) > IO_TIMEOUT * 1000)
+			break;
+	}
+
+	if (req.pending) {
+		/*
+		 * The controller is not responding. Our commands must not
+		 * refer to req once it is out of scope, but their slots stay
+		 * busy: the controller may still complete them later.
+		 */
+		printf("ERROR: I/O timed out, %u commands pending\n",
+		       req.pending);
+		nvme_drop_req(ns->dev, &req);
+		return 0;
+	}
+
+	/* nvme_poll_queue() invalidated the buffer of a read */
+	return req.result < 0 ? 0 : blkcnt;
+}
+
+static int nvme_blk_cancel(struct udevice *udev, struct blk_req *req)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+
+	nvme_drop_req(ns->dev, req);
+
+	return 0;
+}
+
 static ulong nvme_blk_read(struct udevice *udev, lbaint_t blknr,
 			   lbaint_t blkcnt, void *buffer)
 {
@@ -795,6 +1208,9 @@ static ulong nvme_blk_write(struct udevice *udev, lbaint_t blknr,
 static const struct blk_ops nvme_blk_ops = {
 	.read	= nvme_blk_read,
 	.write	= nvme_blk_write,
+	.submit	= nvme_blk_submit,
+	.poll	= nvme_blk_poll,
+	.cancel	= nvme_blk_cancel,
 };
 
 U_BOOT_DRIVER(nvme_blk) = {
@@ -819,13 +1235,13 @@ int nvme_init(struct udevice *udev)
 		goto free_nvme;
 	}
 
-	ndev->queues = malloc(NVME_Q_NUM * sizeof(struct nvme_queue *));
+	ndev->queues = malloc(NVME_MAX_QUEUES * sizeof(struct nvme_queue *));
 	if (!ndev->queues) {
 		ret = -ENOMEM;
 		printf("Error: %s: Out of memory!\n", udev->name);
 		goto free_nvme;
 	}
-	memset(ndev->queues, 0, NVME_Q_NUM * sizeof(struct nvme_queue *));
+	memset(ndev->queues, 0, NVME_MAX_QUEUES * sizeof(struct nvme_queue *));
 
 	ndev->cap = nvme_readq(&ndev->bar->cap);
 	ndev->q_depth = min_t(int, NVME_CAP_MQES(ndev->cap) + 1, NVME_Q_DEPTH);
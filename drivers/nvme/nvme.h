@@ -604,6 +604,7 @@ struct nvme_dev {
 	unsigned queue_count;
 	unsigned online_queues;
 	unsigned max_qid;
+	unsigned next_qid;
 	int q_depth;
 	u32 db_stride;
 	u32 ctrl_config;
@@ -623,13 +624,31 @@ struct nvme_dev {
 	u32 nn;
 };
 
-/* Admin queue and a single I/O queue. */
+/*
+ * Admin queue and the first I/O queue. Up to CONFIG_NVME_IO_QUEUES I/O
+ * queues follow it.
+ */
 enum nvme_queue_id {
 	NVME_ADMIN_Q,
 	NVME_IO_Q,
 	NVME_Q_NUM,
 };
 
+/**
+ * struct nvme_io_slot - an I/O command in flight
+ *
+ * The command ID of the command is the index of its slot in its queue.
+ *
+ * @req:	Block request the command belongs to, or NULL if free
+ * @prp_list:	PRP list for the command
+ * @prp_entries: Number of entries @prp_list can hold
+ */
+struct nvme_io_slot {
+	struct blk_req *req;
+	u64 *prp_list;
+	u32 prp_entries;
+};
+
 /*
  * An NVM Express queue. Each device has at least two (one for admin
  * commands and one for I/O commands).
@@ -647,6 +666,9 @@ struct nvme_queue {
 	u16 qid;
 	u8 cq_phase;
 	u8 cqe_seen;
+	struct nvme_io_slot *slots;
+	u16 num_slots;
+	u16 busy_slots;
 	unsigned long cmdid_data[];
 };
 
@@ -579,6 +579,9 @@ static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 
 	req->actual = 0;
 	usb_ep_queue(ep, req, 0);
+
+	/* Write to storage while the controller receives the next packet */
+	fastboot_data_flush();
 }
 
 static void do_exit_on_complete(struct usb_ep *ep, struct usb_request *req)
@@ -7,66 +7,281 @@
 #include <common.h>
 #include <blk.h>
 #include <dm.h>
+#include <malloc.h>
 #include <part.h>
 #include <virtio_types.h>
 #include <virtio.h>
 #include <virtio_ring.h>
+#include <linux/sizes.h>
 #include "virtio_blk.h"
 
+/* Maximum number of requests in flight */
+#define VIRTIO_BLK_MAX_REQS	32
+/* Maximum number of data segments in a request */
+#define VIRTIO_BLK_MAX_SEGS	32
+/* Largest request, so that large transfers keep several requests in flight */
+#define VIRTIO_BLK_MAX_REQ_SIZE	SZ_256K
+
+static const u32 feature[] = {
+	VIRTIO_BLK_F_SIZE_MAX,
+	VIRTIO_BLK_F_SEG_MAX,
+};
+
+/**
+ * struct virtio_blk_slot - a request in flight
+ *
+ * @out_hdr:	Request header. The device hands back its address when the
+ *		request completes, which identifies the slot
+ * @status:	Status written by the device
+ * @req:	Block request being handled, or NULL if the slot is free
+ */
+struct virtio_blk_slot {
+	struct virtio_blk_outhdr out_hdr;
+	u8 status;
+	struct blk_req *req;
+};
+
+/**
+ * struct virtio_blk_priv - private data for a virtio block device
+ *
+ * @vq:		Request queue
+ * @slots:	Requests in flight
+ * @num_slots:	Number of entries in @slots
+ * @seg_size:	Maximum size of a data segment, in bytes
+ * @max_segs:	Maximum number of data segments in a request
+ * @max_blocks:	Maximum number of blocks in a request
+ * @ring_descs:	Number of ring descriptors needed for a request
+ * @sg:		Scatterlists for the header, data segments and status of the
+ *		request being added
+ * @sgs:	Pointers to the entries of @sg
+ */
 struct virtio_blk_priv {
 	struct virtqueue *vq;
+	struct virtio_blk_slot *slots;
+	unsigned int num_slots;
+	u32 seg_size;
+	u32 max_segs;
+	lbaint_t max_blocks;
+	unsigned int ring_descs;
+	struct virtio_sg *sg;
+	struct virtio_sg **sgs;
 };
 
+/**
+ * virtio_blk_queue() - add virtio requests for part of a block request
+ *
+ * Requests of up to @priv->max_blocks blocks are added for the blocks left
+ * in @req, for as long as there are free slots and room in the ring. The
+ * device is not notified.
+ *
+ * @dev:	Block device
+ * @req:	Request the virtio requests belong to
+ * @startp:	Next block to transfer, updated on return
+ * @leftp:	Number of blocks left to transfer, updated on return
+ * @bufferp:	Next buffer address, updated on return
+ * Return: number of requests added, or -ve on error
+ */
+static int virtio_blk_queue(struct udevice *dev, struct blk_req *req,
+			    lbaint_t *startp, lbaint_t *leftp, void **bufferp)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	struct virtio_blk_slot *slot;
+	unsigned int num_out, num_in, nsegs;
+	lbaint_t blkcnt;
+	u32 type, len;
+	ulong bytes;
+	void *buf;
+	int count = 0;
+	int i, ret;
+
+	type = req->op == BLK_REQ_WRITE ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+
+	for (i = 0; *leftp && i < priv->num_slots; i++) {
+		slot = &priv->slots[i];
+		if (slot->req)
+			continue;
+
+		slot->out_hdr.type = cpu_to_virtio32(dev, type);
+		slot->out_hdr.ioprio = 0;
+		slot->out_hdr.sector = cpu_to_virtio64(dev, *startp);
+		priv->sg[0].addr = &slot->out_hdr;
+		priv->sg[0].length = sizeof(slot->out_hdr);
+
+		blkcnt = min(*leftp, priv->max_blocks);
+		bytes = blkcnt * 512;
+		buf = *bufferp;
+		for (nsegs = 0; bytes; nsegs++) {
+			len = min_t(ulong, bytes, priv->seg_size);
+			priv->sg[1 + nsegs].addr = buf;
+			priv->sg[1 + nsegs].length = len;
+			buf += len;
+			bytes -= len;
+		}
+
+		priv->sg[1 + nsegs].addr = &slot->status;
+		priv->sg[1 + nsegs].length = sizeof(slot->status);
+
+		num_out = 1;
+		num_in = 1;
+		if (type & VIRTIO_BLK_T_OUT)
+			num_out += nsegs;
+		else
+			num_in += nsegs;
+
+		ret = virtqueue_add(priv->vq, priv->sgs, num_out, num_in);
+		if (ret == -ENOSPC)
+			break;
+		if (ret)
+			return ret;
+
+		slot->req = req;
+		req->pending++;
+		count++;
+
+		*startp += blkcnt;
+		*leftp -= blkcnt;
+		*bufferp = buf;
+	}
+
+	return count;
+}
+
 static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
-			       lbaint_t blkcnt, void *buffer, u32 type)
+			       lbaint_t blkcnt, void *buffer,
+			       enum blk_req_op op);
+
+static int virtio_blk_submit(struct udevice *dev, struct blk_req *req)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
-	unsigned int num_out = 0, num_in = 0;
-	struct virtio_sg *sgs[3];
-	u8 status;
-	int ret;
+	lbaint_t start = req->start;
+	lbaint_t left = req->blkcnt;
+	void *buffer = req->buffer;
+	unsigned int nreqs, busy = 0;
+	int i, ret;
 
-	struct virtio_blk_outhdr out_hdr = {
-		.type = cpu_to_virtio32(dev, type),
-		.sector = cpu_to_virtio64(dev, sector),
-	};
-	struct virtio_sg hdr_sg = { &out_hdr, sizeof(out_hdr) };
-	struct virtio_sg data_sg = { buffer, blkcnt * 512 };
-	struct virtio_sg status_sg = { &status, sizeof(status) };
+	/* A request too large for the queue is done synchronously */
+	nreqs = DIV_ROUND_UP(req->blkcnt, priv->max_blocks);
+	if (nreqs > priv->num_slots) {
+		req->result = virtio_blk_do_req(dev, req->start, req->blkcnt,
+						req->buffer, req->op);
+		req->done = true;
+		return 0;
+	}
 
-	sgs[num_out++] = &hdr_sg;
+	for (i = 0; i < priv->num_slots; i++)
+		if (priv->slots[i].req)
+			busy++;
+	if (priv->num_slots - busy < nreqs ||
+	    priv->vq->num_free < nreqs * priv->ring_descs)
+		return -EBUSY;
 
-	if (type & VIRTIO_BLK_T_OUT)
-		sgs[num_out++] = &data_sg;
+	req->result = req->blkcnt;
+	ret = virtio_blk_queue(dev, req, &start, &left, &buffer);
+	if (ret < 0)
+		req->result = ret;
+	else if (left)
+		req->result = -ENOMEM;	/* no indirect table, ring full */
+	if (req->pending)
+		virtqueue_kick(priv->vq);
 	else
-		sgs[num_out + num_in++] = &data_sg;
+		req->done = true;
 
-	sgs[num_out + num_in++] = &status_sg;
+	return 0;
+}
 
-	ret = virtqueue_add(priv->vq, sgs, num_out, num_in);
-	if (ret)
-		return ret;
+/*
+ * Owner of the slots of cancelled requests. The device still owns their
+ * buffers, so the slots are not used again until it hands them back.
+ */
+static struct blk_req virtio_blk_cancelled_req;
 
-	virtqueue_kick(priv->vq);
+static int virtio_blk_poll(struct udevice *dev)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	struct virtio_blk_outhdr *hdr;
+	struct virtio_blk_slot *slot;
+	struct blk_req *req;
+	int count = 0;
 
-	while (!virtqueue_get_buf(priv->vq, NULL))
-		;
+	while ((hdr = virtqueue_get_buf(priv->vq, NULL))) {
+		slot = container_of(hdr, struct virtio_blk_slot, out_hdr);
+		req = slot->req;
+		slot->req = NULL;
+		if (!req || req == &virtio_blk_cancelled_req)
+			continue;
+		if (slot->status != VIRTIO_BLK_S_OK)
+			req->result = -EIO;
+		if (--req->pending)
+			continue;
+		req->done = true;
+		count++;
+	}
 
-	return status == VIRTIO_BLK_S_OK ? blkcnt : -EIO;
+	return count;
+}
+
+static int virtio_blk_cancel(struct udevice *dev, struct blk_req *req)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	int i;
+
+	for (i = 0; i < priv->num_slots; i++) {
+		if (priv->slots[i].req == req)
+			priv->slots[i].req = &virtio_blk_cancelled_req;
+	}
+
+	return 0;
+}
+
+/*
+ * Split a transfer into requests and keep as many of them in flight as the
+ * queue allows, notifying the device once for each batch added
+ */
+static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
+			       lbaint_t blkcnt, void *buffer,
+			       enum blk_req_op op)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	struct blk_req req = {
+		.op = op,
+		.start = sector,
+		.blkcnt = blkcnt,
+		.buffer = buffer,
+		.result = blkcnt,
+	};
+	lbaint_t start = sector;
+	lbaint_t left = blkcnt;
+	int ret;
+
+	while (left || req.pending) {
+		if (left && req.result >= 0) {
+			ret = virtio_blk_queue(dev, &req, &start, &left,
+					       &buffer);
+			if (ret < 0)
+				req.result = ret;
+			else if (ret)
+				virtqueue_kick(priv->vq);
+		}
+		if (req.result < 0)
+			left = 0;
+
+		virtio_blk_poll(dev);
+	}
+
+	return req.result;
 }
 
 static ulong virtio_blk_read(struct udevice *dev, lbaint_t start,
 			     lbaint_t blkcnt, void *buffer)
 {
-	return virtio_blk_do_req(dev, start, blkcnt, buffer,
-				 VIRTIO_BLK_T_IN);
+	return virtio_blk_do_req(dev, start, blkcnt, buffer, BLK_REQ_READ);
 }
 
 static ulong virtio_blk_write(struct udevice *dev, lbaint_t start,
 			      lbaint_t blkcnt, const void *buffer)
 {
 	return virtio_blk_do_req(dev, start, blkcnt, (void *)buffer,
-				 VIRTIO_BLK_T_OUT);
+				 BLK_REQ_WRITE);
 }
 
 static int virtio_blk_bind(struct udevice *dev)
@@ -98,7 +313,8 @@ static int virtio_blk_bind(struct udevice *dev)
 	desc->bdev = dev;
 
 	/* Indicate what driver features we support */
-	virtio_driver_features_init(uc_priv, NULL, 0, NULL, 0);
+	virtio_driver_features_init(uc_priv, feature, ARRAY_SIZE(feature),
+				    NULL, 0);
 
 	return 0;
 }
@@ -107,12 +323,56 @@ static int virtio_blk_probe(struct udevice *dev)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	unsigned int ring_size;
+	u32 seg_size, max_segs;
 	u64 cap;
-	int ret;
+	int i, ret;
 
 	ret = virtio_find_vqs(dev, 1, &priv->vq);
 	if (ret)
 		return ret;
+	ring_size = virtqueue_get_vring_size(priv->vq);
+
+	/* Split requests as the device asks, in whole blocks */
+	if (virtio_cread_feature(dev, VIRTIO_BLK_F_SIZE_MAX,
+				 struct virtio_blk_config, size_max,
+				 &seg_size) || seg_size < 512)
+		seg_size = VIRTIO_BLK_MAX_REQ_SIZE;
+	if (virtio_cread_feature(dev, VIRTIO_BLK_F_SEG_MAX,
+				 struct virtio_blk_config, seg_max,
+				 &max_segs) || !max_segs)
+		max_segs = 1;
+	priv->seg_size = min(ALIGN_DOWN(seg_size, 512),
+			     (u32)VIRTIO_BLK_MAX_REQ_SIZE);
+	priv->max_segs = min3(max_segs, (u32)VIRTIO_BLK_MAX_SEGS,
+			      VIRTIO_BLK_MAX_REQ_SIZE / priv->seg_size);
+
+	/*
+	 * With indirect descriptors, each request takes one descriptor of
+	 * the ring. Otherwise it takes one for the header, one per data
+	 * segment and one for the status.
+	 */
+	if (priv->vq->indirect) {
+		priv->ring_descs = 1;
+	} else {
+		priv->max_segs = min(priv->max_segs, ring_size - 2);
+		priv->ring_descs = priv->max_segs + 2;
+	}
+	priv->max_blocks = priv->max_segs * priv->seg_size / 512;
+	priv->num_slots = min(ring_size / priv->ring_descs,
+			      (unsigned int)VIRTIO_BLK_MAX_REQS);
+
+	priv->slots = calloc(priv->num_slots, sizeof(*priv->slots));
+	priv->sg = calloc(priv->max_segs + 2, sizeof(*priv->sg));
+	priv->sgs = calloc(priv->max_segs + 2, sizeof(*priv->sgs));
+	if (!priv->slots || !priv->sg || !priv->sgs) {
+		free(priv->slots);
+		free(priv->sg);
+		free(priv->sgs);
+		return -ENOMEM;
+	}
+	for (i = 0; i < priv->max_segs + 2; i++)
+		priv->sgs[i] = &priv->sg[i];
 
 	desc->blksz = 512;
 	desc->log2blksz = 9;
@@ -122,9 +382,23 @@ static int virtio_blk_probe(struct udevice *dev)
 	return 0;
 }
 
+static int virtio_blk_remove(struct udevice *dev)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+
+	free(priv->slots);
+	free(priv->sg);
+	free(priv->sgs);
+
+	return virtio_reset(dev);
+}
+
 static const struct blk_ops virtio_blk_ops = {
 	.read	= virtio_blk_read,
 	.write	= virtio_blk_write,
+	.submit	= virtio_blk_submit,
+	.poll	= virtio_blk_poll,
+	.cancel	= virtio_blk_cancel,
 };
 
 U_BOOT_DRIVER(virtio_blk) = {
@@ -133,7 +407,7 @@ U_BOOT_DRIVER(virtio_blk) = {
 	.ops	= &virtio_blk_ops,
 	.bind	= virtio_blk_bind,
 	.probe	= virtio_blk_probe,
-	.remove	= virtio_reset,
+	.remove	= virtio_blk_remove,
 	.priv_auto	= sizeof(struct virtio_blk_priv),
 	.flags	= DM_FLAG_ACTIVE_DMA,
 };
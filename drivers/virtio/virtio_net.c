@@ -6,21 +6,42 @@
 
 #include <common.h>
 #include <dm.h>
+#include <malloc.h>
 #include <net.h>
 #include <virtio_types.h>
 #include <virtio.h>
 #include <virtio_ring.h>
 #include "virtio_net.h"
 
-/* Amount of buffers to keep in the RX virtqueue */
-#define VIRTIO_NET_NUM_RX_BUFS	32
-
 /*
  * This value comes from the VirtIO spec: 1500 for maximum packet size,
  * 14 for the Ethernet header, 12 for virtio_net_hdr. In total 1526 bytes.
  */
 #define VIRTIO_NET_RX_BUF_SIZE	1526
 
+/* Transmit buffers hold the virtio net header followed by the frame */
+#define VIRTIO_NET_TX_BUF_SIZE	(sizeof(struct virtio_net_hdr_v1) + \
+				 PKTSIZE_ALIGN)
+
+/**
+ * struct virtio_net_priv - private data for a virtio net device
+ *
+ * @rx_vq:	Receive queue
+ * @tx_vq:	Transmit queue
+ * @rx_buff:	Receive buffers, each VIRTIO_NET_RX_BUF_SIZE bytes
+ * @num_rx_bufs: Number of buffers in @rx_buff
+ * @rx_refill:	Number of receive buffers given back since the device was
+ *		last notified
+ * @rx_merge:	Buffer to gather frames spread over several receive buffers,
+ *		or NULL if VIRTIO_NET_F_MRG_RXBUF is not negotiated
+ * @tx_buff:	Transmit buffers, each VIRTIO_NET_TX_BUF_SIZE bytes
+ * @tx_busy:	true for each buffer of @tx_buff which the device still has
+ * @num_tx_bufs: Number of buffers in @tx_buff
+ * @tx_next:	Next transmit buffer to try
+ * @rx_running:	true once the receive buffers are in the receive queue
+ * @any_layout:	The header and frame can share a descriptor
+ * @net_hdr_len: Size of the virtio net header
+ */
 struct virtio_net_priv {
 	union {
 		struct virtqueue *vqs[2];
@@ -30,24 +51,62 @@ struct virtio_net_priv {
 		};
 	};
 
-	char rx_buff[VIRTIO_NET_NUM_RX_BUFS][VIRTIO_NET_RX_BUF_SIZE];
+	char *rx_buff;
+	unsigned int num_rx_bufs;
+	unsigned int rx_refill;
+	uchar *rx_merge;
+	char *tx_buff;
+	bool *tx_busy;
+	unsigned int num_tx_bufs;
+	unsigned int tx_next;
 	bool rx_running;
+	bool any_layout;
 	int net_hdr_len;
 };
 
 /*
- * For simplicity, the driver only negotiates the VIRTIO_NET_F_MAC feature.
- * For the VIRTIO_NET_F_STATUS feature, we don't negotiate it, hence per spec
- * we should assume the link is always active.
+ * The driver negotiates the VIRTIO_NET_F_MAC feature and, if enabled,
+ * VIRTIO_NET_F_MRG_RXBUF. For the VIRTIO_NET_F_STATUS feature, we don't
+ * negotiate it, hence per spec we should assume the link is always active.
  */
 static const u32 feature[] = {
-	VIRTIO_NET_F_MAC
+	VIRTIO_NET_F_MAC,
+#if CONFIG_IS_ENABLED(VIRTIO_NET_MRG_RXBUF)
+	VIRTIO_NET_F_MRG_RXBUF,
+#endif
 };
 
 static const u32 feature_legacy[] = {
-	VIRTIO_NET_F_MAC
+	VIRTIO_NET_F_MAC,
+	VIRTIO_F_ANY_LAYOUT,
+#if CONFIG_IS_ENABLED(VIRTIO_NET_MRG_RXBUF)
+	VIRTIO_NET_F_MRG_RXBUF,
+#endif
 };
 
+/* Notify the device of the receive buffers given back to it */
+static void virtio_net_rx_kick(struct virtio_net_priv *priv)
+{
+	if (priv->rx_refill) {
+		virtqueue_kick(priv->rx_vq);
+		priv->rx_refill = 0;
+	}
+}
+
+/*
+ * Give a receive buffer back to the device, only notifying it once a
+ * quarter of the buffers has been given back
+ */
+static void virtio_net_rx_refill(struct virtio_net_priv *priv, void *buf)
+{
+	struct virtio_sg sg = { buf, VIRTIO_NET_RX_BUF_SIZE };
+	struct virtio_sg *sgs[] = { &sg };
+
+	virtqueue_add(priv->rx_vq, sgs, 0, 1);
+	if (++priv->rx_refill >= max(priv->num_rx_bufs / 4, 1U))
+		virtio_net_rx_kick(priv);
+}
+
 static int virtio_net_start(struct udevice *dev)
 {
 	struct virtio_net_priv *priv = dev_get_priv(dev);
@@ -60,8 +119,8 @@ static int virtio_net_start(struct udevice *dev)
 		sg.length = VIRTIO_NET_RX_BUF_SIZE;
 
 		/* setup the receive buffer address */
-		for (i = 0; i < VIRTIO_NET_NUM_RX_BUFS; i++) {
-			sg.addr = priv->rx_buff[i];
+		for (i = 0; i < priv->num_rx_bufs; i++) {
+			sg.addr = priv->rx_buff + i * VIRTIO_NET_RX_BUF_SIZE;
 			virtqueue_add(priv->rx_vq, sgs, 0, 1);
 		}
 
@@ -74,47 +133,135 @@ static int virtio_net_start(struct udevice *dev)
 	return 0;
 }
 
+/* Mark the transmit buffers of packets which were sent as free */
+static void virtio_net_tx_reclaim(struct virtio_net_priv *priv)
+{
+	char *buf;
+
+	while ((buf = virtqueue_get_buf(priv->tx_vq, NULL)))
+		priv->tx_busy[(buf - priv->tx_buff) /
+			      VIRTIO_NET_TX_BUF_SIZE] = false;
+}
+
 static int virtio_net_send(struct udevice *dev, void *packet, int length)
 {
 	struct virtio_net_priv *priv = dev_get_priv(dev);
-	struct virtio_net_hdr hdr;
-	struct virtio_net_hdr_v1 hdr_v1;
-	struct virtio_sg hdr_sg;
-	struct virtio_sg data_sg = { packet, length };
+	struct virtio_sg hdr_sg, data_sg;
 	struct virtio_sg *sgs[] = { &hdr_sg, &data_sg };
+	unsigned int i, n;
+	char *buf;
 	int ret;
 
-	if (priv->net_hdr_len == sizeof(struct virtio_net_hdr))
-		hdr_sg.addr = &hdr;
-	else
-		hdr_sg.addr = &hdr_v1;
-	hdr_sg.length = priv->net_hdr_len;
+	if (length > PKTSIZE_ALIGN)
+		return -EINVAL;
 
-	memset(hdr_sg.addr, 0, priv->net_hdr_len);
+	/* Wait for a free buffer if all of them are queued */
+	for (n = 0; ; n++) {
+		if (n == priv->num_tx_bufs) {
+			virtio_net_tx_reclaim(priv);
+			n = 0;
+		}
+		i = priv->tx_next;
+		if (++priv->tx_next == priv->num_tx_bufs)
+			priv->tx_next = 0;
+		if (!priv->tx_busy[i])
+			break;
+	}
 
-	ret = virtqueue_add(priv->tx_vq, sgs, 2, 0);
+	/*
+	 * The frame is copied, so that the caller can reuse its buffer as
+	 * soon as we return, without waiting for the device
+	 */
+	buf = priv->tx_buff + i * VIRTIO_NET_TX_BUF_SIZE;
+	memset(buf, 0, priv->net_hdr_len);
+	memcpy(buf + priv->net_hdr_len, packet, length);
+
+	hdr_sg.addr = buf;
+	if (priv->any_layout) {
+		hdr_sg.length = priv->net_hdr_len + length;
+		ret = virtqueue_add(priv->tx_vq, sgs, 1, 0);
+	} else {
+		hdr_sg.length = priv->net_hdr_len;
+		data_sg.addr = buf + priv->net_hdr_len;
+		data_sg.length = length;
+		ret = virtqueue_add(priv->tx_vq, sgs, 2, 0);
+	}
 	if (ret)
 		return ret;
+	priv->tx_busy[i] = true;
 
 	virtqueue_kick(priv->tx_vq);
 
+	/* Free the buffers of earlier packets while we are here */
+	virtio_net_tx_reclaim(priv);
+
+	return 0;
+}
+
+/*
+ * Gather a frame which the device spread over @num receive buffers, the
+ * first of which is @buf with @len bytes in it
+ */
+static int virtio_net_recv_merged(struct udevice *dev, void *buf,
+				  unsigned int len, unsigned int num,
+				  uchar **packetp)
+{
+	struct virtio_net_priv *priv = dev_get_priv(dev);
+	unsigned int size = 0;
+	unsigned int skip = priv->net_hdr_len;
+	bool drop = false;
+
+	/* Only the first buffer starts with the header */
 	while (1) {
-		if (virtqueue_get_buf(priv->tx_vq, NULL))
+		len -= skip;
+		if (size + len > PKTSIZE_ALIGN)
+			drop = true;
+		else
+			memcpy(priv->rx_merge + size, buf + skip, len);
+		size += len;
+		virtio_net_rx_refill(priv, buf);
+		if (!--num)
+			break;
+		skip = 0;
+
+		buf = virtqueue_get_buf(priv->rx_vq, &len);
+		if (!buf) {
+			drop = true;
 			break;
+		}
 	}
 
-	return 0;
+	if (drop) {
+		debug("%s: dropped merged frame of %u bytes\n", __func__,
+		      size);
+		return -EAGAIN;
+	}
+	*packetp = priv->rx_merge;
+
+	return size;
 }
 
 static int virtio_net_recv(struct udevice *dev, int flags, uchar **packetp)
 {
 	struct virtio_net_priv *priv = dev_get_priv(dev);
+	struct virtio_net_hdr_v1 *hdr;
 	unsigned int len;
 	void *buf;
 
 	buf = virtqueue_get_buf(priv->rx_vq, &len);
-	if (!buf)
+	if (!buf) {
+		/* Nothing to do, so let the device have the buffers back */
+		virtio_net_rx_kick(priv);
 		return -EAGAIN;
+	}
+
+	if (priv->rx_merge) {
+		hdr = buf;
+		if (virtio16_to_cpu(dev, hdr->num_buffers) > 1)
+			return virtio_net_recv_merged(dev, buf, len,
+					virtio16_to_cpu(dev, hdr->num_buffers),
+					packetp);
+	}
 
 	*packetp = buf + priv->net_hdr_len;
 	return len - priv->net_hdr_len;
@@ -123,12 +270,13 @@ static int virtio_net_recv(struct udevice *dev, int flags, uchar **packetp)
 static int virtio_net_free_pkt(struct udevice *dev, uchar *packet, int length)
 {
 	struct virtio_net_priv *priv = dev_get_priv(dev);
-	void *buf = packet - priv->net_hdr_len;
-	struct virtio_sg sg = { buf, VIRTIO_NET_RX_BUF_SIZE };
-	struct virtio_sg *sgs[] = { &sg };
+
+	/* The buffers of a merged frame are back in the rx ring already */
+	if (packet == priv->rx_merge)
+		return 0;
 
 	/* Put the buffer back to the rx ring */
-	virtqueue_add(priv->rx_vq, sgs, 0, 1);
+	virtio_net_rx_refill(priv, packet - priv->net_hdr_len);
 
 	return 0;
 }
@@ -191,6 +339,18 @@ static int virtio_net_bind(struct udevice *dev)
 	return 0;
 }
 
+static void virtio_net_free_bufs(struct virtio_net_priv *priv)
+{
+	free(priv->rx_buff);
+	free(priv->tx_buff);
+	free(priv->tx_busy);
+	free(priv->rx_merge);
+	priv->rx_buff = NULL;
+	priv->tx_buff = NULL;
+	priv->tx_busy = NULL;
+	priv->rx_merge = NULL;
+}
+
 static int virtio_net_probe(struct udevice *dev)
 {
 	struct virtio_net_priv *priv = dev_get_priv(dev);
@@ -201,6 +361,27 @@ static int virtio_net_probe(struct udevice *dev)
 	if (ret < 0)
 		return ret;
 
+	/* Frames are sent with a single descriptor if the device allows */
+	priv->any_layout = !uc_priv->legacy ||
+			   virtio_has_feature(dev, VIRTIO_F_ANY_LAYOUT);
+
+	priv->num_rx_bufs = min(virtqueue_get_vring_size(priv->rx_vq),
+				(unsigned int)CONFIG_VIRTIO_NET_RX_BUFS);
+	priv->num_tx_bufs = min(virtqueue_get_vring_size(priv->tx_vq) /
+				(priv->any_layout ? 1 : 2),
+				(unsigned int)CONFIG_VIRTIO_NET_TX_BUFS);
+	priv->rx_buff = malloc(priv->num_rx_bufs * VIRTIO_NET_RX_BUF_SIZE);
+	priv->tx_buff = malloc(priv->num_tx_bufs * VIRTIO_NET_TX_BUF_SIZE);
+	priv->tx_busy = calloc(priv->num_tx_bufs, sizeof(*priv->tx_busy));
+	if (virtio_has_feature(dev, VIRTIO_NET_F_MRG_RXBUF))
+		priv->rx_merge = malloc(PKTSIZE_ALIGN);
+	if (!priv->rx_buff || !priv->tx_buff || !priv->tx_busy ||
+	    (virtio_has_feature(dev, VIRTIO_NET_F_MRG_RXBUF) &&
+	     !priv->rx_merge)) {
+		virtio_net_free_bufs(priv);
+		return -ENOMEM;
+	}
+
 	/*
 	 * For v1.0 compliant device, it always assumes the member
 	 * 'num_buffers' exists in the struct virtio_net_hdr while
@@ -208,7 +389,7 @@ static int virtio_net_probe(struct udevice *dev)
 	 * VIRTIO_NET_F_MRG_RXBUF was negotiated. Without that feature
 	 * the structure was 2 bytes shorter.
 	 */
-	if (uc_priv->legacy)
+	if (uc_priv->legacy && !priv->rx_merge)
 		priv->net_hdr_len = sizeof(struct virtio_net_hdr);
 	else
 		priv->net_hdr_len = sizeof(struct virtio_net_hdr_v1);
@@ -216,6 +397,18 @@ static int virtio_net_probe(struct udevice *dev)
 	return 0;
 }
 
+static int virtio_net_remove(struct udevice *dev)
+{
+	struct virtio_net_priv *priv = dev_get_priv(dev);
+	int ret;
+
+	/* The device must stop using the buffers before they are freed */
+	ret = virtio_reset(dev);
+	virtio_net_free_bufs(priv);
+
+	return ret;
+}
+
 static const struct eth_ops virtio_net_ops = {
 	.start = virtio_net_start,
 	.send = virtio_net_send,
@@ -231,7 +424,7 @@ U_BOOT_DRIVER(virtio_net) = {
 	.id	= UCLASS_ETH,
 	.bind	= virtio_net_bind,
 	.probe	= virtio_net_probe,
-	.remove = virtio_reset,
+	.remove = virtio_net_remove,
 	.ops	= &virtio_net_ops,
 	.priv_auto	= sizeof(struct virtio_net_priv),
 	.plat_auto	= sizeof(struct eth_pdata),
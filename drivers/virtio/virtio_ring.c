@@ -16,10 +16,26 @@
 #include <linux/bug.h>
 #include <linux/compat.h>
 
+static struct vring_desc *alloc_indirect(struct virtqueue *vq,
+					 unsigned int total_sg)
+{
+	struct vring_desc *desc;
+	unsigned int i;
+
+	desc = memalign(VRING_DESC_ALIGN_SIZE, total_sg * sizeof(*desc));
+	if (!desc)
+		return NULL;
+
+	for (i = 0; i < total_sg; i++)
+		desc[i].next = cpu_to_virtio16(vq->vdev, i + 1);
+
+	return desc;
+}
+
 int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 		  unsigned int out_sgs, unsigned int in_sgs)
 {
-	struct vring_desc *desc;
+	struct vring_desc *desc = NULL;
 	unsigned int total_sg = out_sgs + in_sgs;
 	unsigned int i, n, avail, descs_used, uninitialized_var(prev);
 	int head;
@@ -28,9 +44,22 @@ int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 
 	head = vq->free_head;
 
-	desc = vq->vring.desc;
-	i = head;
-	descs_used = total_sg;
+	/*
+	 * A chain of several buffers takes a single ring descriptor when it
+	 * is described by an indirect table. If the table cannot be
+	 * allocated, fall back to using the ring.
+	 */
+	if (vq->indirect && total_sg > 1 && vq->num_free)
+		desc = alloc_indirect(vq, total_sg);
+
+	if (desc) {
+		i = 0;
+		descs_used = 1;
+	} else {
+		desc = vq->vring.desc;
+		i = head;
+		descs_used = total_sg;
+	}
 
 	if (vq->num_free < descs_used) {
 		debug("Can't add buf len %i - avail = %i\n",
@@ -70,6 +99,17 @@ int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 	/* Last one doesn't continue */
 	desc[prev].flags &= cpu_to_virtio16(vq->vdev, ~VRING_DESC_F_NEXT);
 
+	if (desc != vq->vring.desc) {
+		/* Point the ring descriptor at the indirect table */
+		vq->vring.desc[head].flags = cpu_to_virtio16(vq->vdev,
+						VRING_DESC_F_INDIRECT);
+		vq->vring.desc[head].addr = cpu_to_virtio64(vq->vdev,
+						(u64)(uintptr_t)desc);
+		vq->vring.desc[head].len = cpu_to_virtio32(vq->vdev,
+						total_sg * sizeof(*desc));
+		i = virtio16_to_cpu(vq->vdev, vq->vring.desc[head].next);
+	}
+
 	/* We're using some buffers from the free list. */
 	vq->num_free -= descs_used;
 
@@ -139,6 +179,12 @@ static void detach_buf(struct virtqueue *vq, unsigned int head)
 	unsigned int i;
 	__virtio16 nextflag = cpu_to_virtio16(vq->vdev, VRING_DESC_F_NEXT);
 
+	/* Free the indirect table, if any: it has no next flag in the ring */
+	if (vq->vring.desc[head].flags &
+	    cpu_to_virtio16(vq->vdev, VRING_DESC_F_INDIRECT))
+		free((void *)(uintptr_t)virtio64_to_cpu(vq->vdev,
+						vq->vring.desc[head].addr));
+
 	/* Put back on free list: unmap first-level descriptors and find end */
 	i = head;
 
@@ -154,6 +200,18 @@ static void detach_buf(struct virtqueue *vq, unsigned int head)
 	vq->num_free++;
 }
 
+/* Return the address of the first buffer of the chain starting at @head */
+static void *desc_buf(struct virtqueue *vq, unsigned int head)
+{
+	struct vring_desc *desc = &vq->vring.desc[head];
+
+	if (desc->flags & cpu_to_virtio16(vq->vdev, VRING_DESC_F_INDIRECT))
+		desc = (struct vring_desc *)(uintptr_t)
+			virtio64_to_cpu(vq->vdev, desc->addr);
+
+	return (void *)(uintptr_t)virtio64_to_cpu(vq->vdev, desc->addr);
+}
+
 static inline bool more_used(const struct virtqueue *vq)
 {
 	return vq->last_used_idx != virtio16_to_cpu(vq->vdev,
@@ -164,6 +222,7 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
 {
 	unsigned int i;
 	u16 last_used;
+	void *buf;
 
 	if (!more_used(vq)) {
 		debug("(%s.%d): No more buffers in queue\n",
@@ -189,6 +248,7 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
 		return NULL;
 	}
 
+	buf = desc_buf(vq, i);
 	detach_buf(vq, i);
 	vq->last_used_idx++;
 	/*
@@ -200,8 +260,7 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
 		virtio_store_mb(&vring_used_event(&vq->vring),
 				cpu_to_virtio16(vq->vdev, vq->last_used_idx));
 
-	return (void *)(uintptr_t)virtio64_to_cpu(vq->vdev,
-						  vq->vring.desc[i].addr);
+	return buf;
 }
 
 static struct virtqueue *__vring_new_virtqueue(unsigned int index,
@@ -227,6 +286,7 @@ static struct virtqueue *__vring_new_virtqueue(unsigned int index,
 	vq->num_added = 0;
 	list_add_tail(&vq->list, &uc_priv->vqs);
 
+	vq->indirect = virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC);
 	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
 
 	/* Tell other side not to bother us */
@@ -333,6 +393,7 @@ void virtqueue_dump(struct virtqueue *vq)
 	       vq->index, vq->vring.desc, vq->vring.num);
 	printf("\tfree_head %u, num_added %u, num_free %u\n",
 	       vq->free_head, vq->num_added, vq->num_free);
+	printf("\tindirect %d, event %d\n", vq->indirect, vq->event);
 	printf("\tlast_used_idx %u, avail_flags_shadow %u, avail_idx_shadow %u\n",
 	       vq->last_used_idx, vq->avail_flags_shadow, vq->avail_idx_shadow);
 
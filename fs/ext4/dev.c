@@ -30,6 +30,8 @@
 #include <ext_common.h>
 #include "ext4_common.h"
 #include <log.h>
+#include <malloc.h>
+#include <linux/list.h>
 
 lbaint_t part_offset;
 
@@ -63,3 +65,150 @@ int ext4_read_superblock(char *buffer)
 	return ext4fs_devread(sect, off, SUPERBLOCK_SIZE,
 				buffer);
 }
+
+#if CONFIG_IS_ENABLED(EXT4_CACHE)
+/*
+ * The filesystem is mounted again for every command, so metadata blocks are
+ * kept from one mount to the next as long as the same device, partition and
+ * superblock are seen. All cached blocks have the filesystem block size.
+ */
+struct ext4_cache_node {
+	struct list_head lh;
+	lbaint_t sector;
+	char *buf;
+};
+
+static LIST_HEAD(ext4_cache);
+static struct ext4_cache_stats ext4_cache_stats = {
+	.max_entries = CONFIG_EXT4_CACHE_ENTRIES,
+};
+static struct blk_desc *ext4_cache_desc;
+static lbaint_t ext4_cache_start;
+static struct ext2_sblock *ext4_cache_sb;
+static int ext4_cache_blksz;
+
+void ext4fs_cache_invalidate(void)
+{
+	struct ext4_cache_node *node, *n;
+
+	list_for_each_entry_safe(node, n, &ext4_cache, lh) {
+		list_del(&node->lh);
+		free(node->buf);
+		free(node);
+	}
+	ext4_cache_stats.entries = 0;
+}
+
+void ext4fs_cache_mount(struct ext2_sblock *sb)
+{
+	if (ext4_cache_blksz && ext4_cache_desc == ext4fs_blk_desc &&
+	    ext4_cache_start == part_offset &&
+	    !memcmp(ext4_cache_sb, sb, sizeof(*sb)))
+		return;
+
+	ext4fs_cache_invalidate();
+	ext4_cache_blksz = 0;
+	if (!ext4_cache_sb) {
+		ext4_cache_sb = malloc(sizeof(*sb));
+		if (!ext4_cache_sb)
+			return;
+	}
+	memcpy(ext4_cache_sb, sb, sizeof(*sb));
+	ext4_cache_desc = ext4fs_blk_desc;
+	ext4_cache_start = part_offset;
+	ext4_cache_blksz = 1 << (le32_to_cpu(sb->log2_block_size) +
+				 EXT2_MIN_BLOCK_LOG_SIZE);
+}
+
+static struct ext4_cache_node *ext4_cache_find(lbaint_t sector)
+{
+	struct ext4_cache_node *node;
+
+	list_for_each_entry(node, &ext4_cache, lh) {
+		if (node->sector == sector) {
+			if (ext4_cache.next != &node->lh) {
+				/* maintain MRU ordering */
+				list_del(&node->lh);
+				list_add(&node->lh, &ext4_cache);
+			}
+			return node;
+		}
+	}
+
+	return NULL;
+}
+
+static struct ext4_cache_node *ext4_cache_fill(lbaint_t sector)
+{
+	struct ext4_cache_node *node;
+
+	if (ext4_cache_stats.entries >= ext4_cache_stats.max_entries) {
+		/* reuse the least recently used block */
+		node = list_last_entry(&ext4_cache, struct ext4_cache_node,
+				       lh);
+		list_del(&node->lh);
+		ext4_cache_stats.entries--;
+	} else {
+		node = malloc(sizeof(*node));
+		if (!node)
+			return NULL;
+		node->buf = memalign(ARCH_DMA_MINALIGN, ext4_cache_blksz);
+		if (!node->buf) {
+			free(node);
+			return NULL;
+		}
+	}
+
+	if (!ext4fs_devread(sector, 0, ext4_cache_blksz, node->buf)) {
+		free(node->buf);
+		free(node);
+		return NULL;
+	}
+	node->sector = sector;
+	list_add(&node->lh, &ext4_cache);
+	ext4_cache_stats.entries++;
+
+	return node;
+}
+
+int ext4fs_read_meta(lbaint_t sector, int byte_offset, int byte_len,
+		     char *buf)
+{
+	struct ext4_cache_node *node;
+	int log2blksz = ext4fs_blk_desc->log2blksz;
+	lbaint_t sect_perblk;
+	int offset;
+
+	sect_perblk = ext4_cache_blksz >> log2blksz;
+	if (!sect_perblk || !ext4_cache_stats.max_entries)
+		return ext4fs_devread(sector, byte_offset, byte_len, buf);
+
+	/* Find the filesystem block holding the start of the read */
+	sector += byte_offset >> log2blksz;
+	offset = ((sector & (sect_perblk - 1)) << log2blksz) +
+		(byte_offset & (ext4fs_blk_desc->blksz - 1));
+	sector &= ~(sect_perblk - 1);
+	if (offset + byte_len > ext4_cache_blksz)
+		return ext4fs_devread(sector, offset, byte_len, buf);
+
+	node = ext4_cache_find(sector);
+	if (node) {
+		ext4_cache_stats.hits++;
+	} else {
+		ext4_cache_stats.misses++;
+		node = ext4_cache_fill(sector);
+		if (!node)
+			return 0;
+	}
+	memcpy(buf, node->buf + offset, byte_len);
+
+	return 1;
+}
+
+void ext4fs_cache_stats(struct ext4_cache_stats *stats)
+{
+	memcpy(stats, &ext4_cache_stats, sizeof(*stats));
+	ext4_cache_stats.hits = 0;
+	ext4_cache_stats.misses = 0;
+}
+#endif
@@ -22,6 +22,7 @@
 #include <blk.h>
 #include <ext_common.h>
 #include <ext4fs.h>
+#include <fs.h>
 #include <log.h>
 #include <malloc.h>
 #include <memalign.h>
@@ -202,6 +203,7 @@ void put_ext4(uint64_t off, const void *buf, uint32_t size)
 	int log2blksz = fs->dev_desc->log2blksz;
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, sec_buf, fs->dev_desc->blksz);
 
+	ext4fs_cache_invalidate();
 	startblock = off >> log2blksz;
 	startblock += part_offset;
 	remainder = off & (uint64_t)(fs->dev_desc->blksz - 1);
@@ -1587,9 +1589,9 @@ static int ext4fs_blockgroup
 	debug("ext4fs read %d group descriptor (blkno %ld blkoff %u)\n",
 	      group, blkno, blkoff);
 
-	return ext4fs_devread((lbaint_t)blkno <<
-			      (LOG2_BLOCK_SIZE(data) - log2blksz),
-			      blkoff, desc_size, (char *)blkgrp);
+	return ext4fs_read_meta((lbaint_t)blkno <<
+				(LOG2_BLOCK_SIZE(data) - log2blksz),
+				blkoff, desc_size, (char *)blkgrp);
 }
 
 int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
@@ -1633,15 +1635,107 @@ int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
 	free(blkgrp);
 
 	/* Read the inode. */
-	status = ext4fs_devread((lbaint_t)blkno << (LOG2_BLOCK_SIZE(data) -
-				log2blksz), blkoff,
-				sizeof(struct ext2_inode), (char *)inode);
+	status = ext4fs_read_meta((lbaint_t)blkno << (LOG2_BLOCK_SIZE(data) -
+				  log2blksz), blkoff,
+				  sizeof(struct ext2_inode), (char *)inode);
 	if (status == 0)
 		return 0;
 
 	return 1;
 }
 
+/*
+ * Find the extent holding @fileblock. On success *@blknrp is set to the
+ * filesystem block that holds @fileblock, or 0 if it lies in a hole, and the
+ * number of file blocks from @fileblock to the end of that extent (or hole)
+ * is returned.
+ */
+static long int ext4fs_map_extent(struct ext2_inode *inode, int fileblock,
+				  struct ext_block_cache *cache,
+				  long int *blknrp)
+{
+	long int startblock, endblock, count;
+	struct ext_block_cache *c, cd;
+	struct ext4_extent_header *ext_block;
+	struct ext4_extent *extent;
+	unsigned long long start;
+	int log2_blksz;
+	int i;
+
+	log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root)
+		- get_fs()->dev_desc->log2blksz;
+
+	if (cache) {
+		c = cache;
+	} else {
+		c = &cd;
+		ext_cache_init(c);
+	}
+	ext_block = ext4fs_get_extent_block(ext4fs_root, c,
+					    (struct ext4_extent_header *)
+					    inode->b.blocks.dir_blocks,
+					    fileblock, log2_blksz);
+	if (!ext_block) {
+		printf("invalid extent block\n");
+		if (!cache)
+			ext_cache_fini(c);
+		return -EINVAL;
+	}
+
+	extent = (struct ext4_extent *)(ext_block + 1);
+
+	/*
+	 * A hole past the last extent of this leaf may end anywhere in the
+	 * next leaf, so only report a single block for it
+	 */
+	*blknrp = 0;
+	count = 1;
+	for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
+		startblock = le32_to_cpu(extent[i].ee_block);
+		endblock = startblock + le16_to_cpu(extent[i].ee_len);
+
+		if (startblock > fileblock) {
+			/* Sparse file */
+			count = startblock - fileblock;
+			break;
+		} else if (fileblock < endblock) {
+			start = le16_to_cpu(extent[i].ee_start_hi);
+			start = (start << 32) +
+				le32_to_cpu(extent[i].ee_start_lo);
+			*blknrp = (fileblock - startblock) + start;
+			count = endblock - fileblock;
+			break;
+		}
+	}
+
+	if (!cache)
+		ext_cache_fini(c);
+
+	return count;
+}
+
+/*
+ * Map @fileblock like read_allocated_block() does, but also return how many
+ * file blocks from there on are physically contiguous (or part of the same
+ * hole), so that callers can read a whole run at once. Inodes that use
+ * indirect blocks are still resolved one block at a time.
+ */
+long int ext4fs_map_blocks(struct ext2_inode *inode, int fileblock,
+			   struct ext_block_cache *cache, long int *blknrp)
+{
+	long int blknr;
+
+	if (le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL)
+		return ext4fs_map_extent(inode, fileblock, cache, blknrp);
+
+	blknr = read_allocated_block(inode, fileblock, cache);
+	if (blknr < 0)
+		return blknr;
+	*blknrp = blknr;
+
+	return 1;
+}
+
 long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 			      struct ext_block_cache *cache)
 {
@@ -1652,62 +1746,19 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 	long int rblock;
 	long int perblock_parent;
 	long int perblock_child;
-	unsigned long long start;
 	/* get the blocksize of the filesystem */
 	blksz = EXT2_BLOCK_SIZE(ext4fs_root);
 	log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root)
 		- get_fs()->dev_desc->log2blksz;
 
 	if (le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL) {
-		long int startblock, endblock;
-		struct ext_block_cache *c, cd;
-		struct ext4_extent_header *ext_block;
-		struct ext4_extent *extent;
-		int i;
-
-		if (cache) {
-			c = cache;
-		} else {
-			c = &cd;
-			ext_cache_init(c);
-		}
-		ext_block =
-			ext4fs_get_extent_block(ext4fs_root, c,
-						(struct ext4_extent_header *)
-						inode->b.blocks.dir_blocks,
-						fileblock, log2_blksz);
-		if (!ext_block) {
-			printf("invalid extent block\n");
-			if (!cache)
-				ext_cache_fini(c);
-			return -EINVAL;
-		}
-
-		extent = (struct ext4_extent *)(ext_block + 1);
-
-		for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
-			startblock = le32_to_cpu(extent[i].ee_block);
-			endblock = startblock + le16_to_cpu(extent[i].ee_len);
-
-			if (startblock > fileblock) {
-				/* Sparse file */
-				if (!cache)
-					ext_cache_fini(c);
-				return 0;
+		long int count;
 
-			} else if (fileblock < endblock) {
-				start = le16_to_cpu(extent[i].ee_start_hi);
-				start = (start << 32) +
-					le32_to_cpu(extent[i].ee_start_lo);
-				if (!cache)
-					ext_cache_fini(c);
-				return (fileblock - startblock) + start;
-			}
-		}
+		count = ext4fs_map_extent(inode, fileblock, cache, &blknr);
+		if (count < 0)
+			return count;
 
-		if (!cache)
-			ext_cache_fini(c);
-		return 0;
+		return blknr;
 	}
 
 	/* Direct blocks. */
@@ -1742,10 +1793,10 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 		if ((le32_to_cpu(inode->b.blocks.indir_block) <<
 		     log2_blksz) != ext4fs_indir1_blkno) {
 			status =
-			    ext4fs_devread((lbaint_t)le32_to_cpu
-					   (inode->b.blocks.
-					    indir_block) << log2_blksz, 0,
-					   blksz, (char *)ext4fs_indir1_block);
+			    ext4fs_read_meta((lbaint_t)le32_to_cpu
+					     (inode->b.blocks.
+					      indir_block) << log2_blksz, 0,
+					     blksz, (char *)ext4fs_indir1_block);
 			if (status == 0) {
 				printf("** SI ext2fs read block (indir 1)"
 					"failed. **\n");
@@ -1791,11 +1842,11 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 		if ((le32_to_cpu(inode->b.blocks.double_indir_block) <<
 		     log2_blksz) != ext4fs_indir1_blkno) {
 			status =
-			    ext4fs_devread((lbaint_t)le32_to_cpu
-					   (inode->b.blocks.
-					    double_indir_block) << log2_blksz,
-					   0, blksz,
-					   (char *)ext4fs_indir1_block);
+			    ext4fs_read_meta((lbaint_t)le32_to_cpu
+					     (inode->b.blocks.
+					      double_indir_block) << log2_blksz,
+					     0, blksz,
+					     (char *)ext4fs_indir1_block);
 			if (status == 0) {
 				printf("** DI ext2fs read block (indir 2 1)"
 					"failed. **\n");
@@ -1831,12 +1882,12 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 		}
 		if ((le32_to_cpu(ext4fs_indir1_block[rblock / perblock]) <<
 		     log2_blksz) != ext4fs_indir2_blkno) {
-			status = ext4fs_devread((lbaint_t)le32_to_cpu
-						(ext4fs_indir1_block
-						 [rblock /
-						  perblock]) << log2_blksz, 0,
-						blksz,
-						(char *)ext4fs_indir2_block);
+			status = ext4fs_read_meta((lbaint_t)le32_to_cpu
+						  (ext4fs_indir1_block
+						   [rblock /
+						    perblock]) << log2_blksz, 0,
+						  blksz,
+						  (char *)ext4fs_indir2_block);
 			if (status == 0) {
 				printf("** DI ext2fs read block (indir 2 2)"
 					"failed. **\n");
@@ -1882,7 +1933,7 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 		}
 		if ((le32_to_cpu(inode->b.blocks.triple_indir_block) <<
 		     log2_blksz) != ext4fs_indir1_blkno) {
-			status = ext4fs_devread
+			status = ext4fs_read_meta
 			    ((lbaint_t)
 			     le32_to_cpu(inode->b.blocks.triple_indir_block)
 			     << log2_blksz, 0, blksz,
@@ -1924,12 +1975,12 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 						       perblock_parent]) <<
 		     log2_blksz)
 		    != ext4fs_indir2_blkno) {
-			status = ext4fs_devread((lbaint_t)le32_to_cpu
-						(ext4fs_indir1_block
-						 [rblock /
-						  perblock_parent]) <<
-						log2_blksz, 0, blksz,
-						(char *)ext4fs_indir2_block);
+			status = ext4fs_read_meta((lbaint_t)le32_to_cpu
+						  (ext4fs_indir1_block
+						   [rblock /
+						    perblock_parent]) <<
+						  log2_blksz, 0, blksz,
+						  (char *)ext4fs_indir2_block);
 			if (status == 0) {
 				printf("** TI ext2fs read block (indir 2 2)"
 					"failed. **\n");
@@ -1969,11 +2020,11 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 						       perblock_child]) <<
 		     log2_blksz) != ext4fs_indir3_blkno) {
 			status =
-			    ext4fs_devread((lbaint_t)le32_to_cpu
-					   (ext4fs_indir2_block
-					    [(rblock / perblock_child)
-					     % (blksz / 4)]) << log2_blksz, 0,
-					   blksz, (char *)ext4fs_indir3_block);
+			    ext4fs_read_meta((lbaint_t)le32_to_cpu
+					     (ext4fs_indir2_block
+					      [(rblock / perblock_child)
+					       % (blksz / 4)]) << log2_blksz, 0,
+					     blksz, (char *)ext4fs_indir3_block);
 			if (status == 0) {
 				printf("** TI ext2fs read block (indir 2 2)"
 				       "failed. **\n");
@@ -2336,16 +2387,25 @@ int ext4fs_find_file(const char *path, struct ext2fs_node *rootnode,
 int ext4fs_open(const char *filename, loff_t *len)
 {
 	struct ext2fs_node *fdiro = NULL;
-	int status;
+	int status, ino;
 
 	if (ext4fs_root == NULL)
 		return -1;
 
 	ext4fs_file = NULL;
-	status = ext4fs_find_file(filename, &ext4fs_root->diropen, &fdiro,
-				  FILETYPE_REG);
-	if (status == 0)
-		goto fail;
+	if (!fs_dcache_lookup(filename, &ino, sizeof(ino))) {
+		fdiro = zalloc(sizeof(struct ext2fs_node));
+		if (!fdiro)
+			return -1;
+		fdiro->data = ext4fs_root;
+		fdiro->ino = ino;
+	} else {
+		status = ext4fs_find_file(filename, &ext4fs_root->diropen,
+					  &fdiro, FILETYPE_REG);
+		if (status == 0)
+			goto fail;
+		fs_dcache_add(filename, &fdiro->ino, sizeof(fdiro->ino));
+	}
 
 	if (!fdiro->inode_read) {
 		status = ext4fs_read_inode(fdiro->data, fdiro->ino,
@@ -2382,6 +2442,8 @@ int ext4fs_mount(unsigned part_length)
 	if (le16_to_cpu(data->sblock.magic) != EXT2_MAGIC)
 		goto fail_noerr;
 
+	ext4fs_cache_mount(&data->sblock);
+
 
 	if (le32_to_cpu(data->sblock.revision_level) == 0) {
 		fs->inodesz = 128;
@@ -26,6 +26,8 @@
 #include <ext4fs.h>
 #include "ext4_common.h"
 #include <div64.h>
+#include <fs.h>
+#include <fs_internal.h>
 #include <malloc.h>
 #include <part.h>
 #include <uuid.h>
@@ -48,24 +50,27 @@ void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
  * Taken from openmoko-kernel mailing list: By Andy green
  * Optimized read file API : collects and defers contiguous sector
  * reads into one potentially more efficient larger sequential read action
+ *
+ * The file is mapped a whole extent at a time, and runs which are
+ * contiguous on disk (also across extents) are read straight into @buf with
+ * a single device read.
  */
 int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		loff_t len, char *buf, loff_t *actread)
 {
 	struct ext_filesystem *fs = get_fs();
-	int i;
+	lbaint_t i;
 	lbaint_t blockcnt;
 	int log2blksz = fs->dev_desc->log2blksz;
 	int log2_fs_blocksize = LOG2_BLOCK_SIZE(node->data) - log2blksz;
 	int blocksize = (1 << (log2_fs_blocksize + log2blksz));
 	unsigned int filesize = le32_to_cpu(node->inode.size);
-	lbaint_t previous_block_number = -1;
 	lbaint_t delayed_start = 0;
 	lbaint_t delayed_extent = 0;
 	lbaint_t delayed_skipfirst = 0;
 	lbaint_t delayed_next = 0;
 	char *delayed_buf = NULL;
-	char *start_buf = buf;
+	loff_t end;
 	short status;
 	struct ext_block_cache cache;
 
@@ -80,43 +85,44 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		return -1;
 	}
 
-	blockcnt = lldiv(((len + pos) + blocksize - 1), blocksize);
+	end = len + pos;
+	blockcnt = lldiv(end + blocksize - 1, blocksize);
 
-	for (i = lldiv(pos, blocksize); i < blockcnt; i++) {
+	for (i = lldiv(pos, blocksize); i < blockcnt;) {
 		long int blknr;
-		int blockoff = pos - (blocksize * i);
-		int blockend = blocksize;
-		int skipfirst = 0;
-		blknr = read_allocated_block(&node->inode, i, &cache);
-		if (blknr < 0) {
+		long int count;
+		loff_t runstart, runend;
+		lbaint_t skipfirst;
+
+		count = ext4fs_map_blocks(&node->inode, i, &cache, &blknr);
+		if (count <= 0) {
 			ext_cache_fini(&cache);
 			return -1;
 		}
-
-		blknr = blknr << log2_fs_blocksize;
-
-		/* Last block.  */
-		if (i == blockcnt - 1) {
-			blockend = (len + pos) - (blocksize * i);
-
-			/* The last portion is exactly blocksize. */
-			if (!blockend)
-				blockend = blocksize;
+		if (count > blockcnt - i)
+			count = blockcnt - i;
+
+		/* Clip the run to the requested byte range */
+		runstart = (loff_t)i * blocksize;
+		runend = runstart + (loff_t)count * blocksize;
+		skipfirst = 0;
+		if (runstart < pos) {
+			skipfirst = pos - runstart;
+			runstart = pos;
 		}
+		if (runend > end)
+			runend = end;
 
-		/* First block. */
-		if (i == lldiv(pos, blocksize)) {
-			skipfirst = blockoff;
-			blockend -= skipfirst;
-		}
 		if (blknr) {
-			int status;
+			lbaint_t sector = (lbaint_t)blknr << log2_fs_blocksize;
 
-			if (previous_block_number != -1) {
-				if (delayed_next == blknr) {
-					delayed_extent += blockend;
-					delayed_next += blockend >> log2blksz;
-				} else {	/* spill */
+			/* ext4fs_devread() takes an int length */
+			if (delayed_extent && delayed_next == sector &&
+			    delayed_extent + (runend - runstart) <= INT_MAX) {
+				delayed_extent += runend - runstart;
+			} else {
+				if (delayed_extent) {
+					/* spill */
 					status = ext4fs_devread(delayed_start,
 							delayed_skipfirst,
 							delayed_extent,
@@ -125,27 +131,15 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 						ext_cache_fini(&cache);
 						return -1;
 					}
-					previous_block_number = blknr;
-					delayed_start = blknr;
-					delayed_extent = blockend;
-					delayed_skipfirst = skipfirst;
-					delayed_buf = buf;
-					delayed_next = blknr +
-						(blockend >> log2blksz);
 				}
-			} else {
-				previous_block_number = blknr;
-				delayed_start = blknr;
-				delayed_extent = blockend;
+				delayed_start = sector;
+				delayed_extent = runend - runstart;
 				delayed_skipfirst = skipfirst;
 				delayed_buf = buf;
-				delayed_next = blknr +
-					(blockend >> log2blksz);
 			}
+			delayed_next = sector + (count << log2_fs_blocksize);
 		} else {
-			int n;
-			int n_left;
-			if (previous_block_number != -1) {
+			if (delayed_extent) {
 				/* spill */
 				status = ext4fs_devread(delayed_start,
 							delayed_skipfirst,
@@ -155,18 +149,15 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 					ext_cache_fini(&cache);
 					return -1;
 				}
-				previous_block_number = -1;
+				delayed_extent = 0;
 			}
 			/* Zero no more than `len' bytes. */
-			n = blocksize - skipfirst;
-			n_left = len - ( buf - start_buf );
-			if (n > n_left)
-				n = n_left;
-			memset(buf, 0, n);
+			memset(buf, 0, runend - runstart);
 		}
-		buf += blocksize - skipfirst;
+		buf += runend - runstart;
+		i += count;
 	}
-	if (previous_block_number != -1) {
+	if (delayed_extent) {
 		/* spill */
 		status = ext4fs_devread(delayed_start,
 					delayed_skipfirst, delayed_extent,
@@ -175,7 +166,6 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 			ext_cache_fini(&cache);
 			return -1;
 		}
-		previous_block_number = -1;
 	}
 
 	*actread  = len;
@@ -241,6 +231,41 @@ int ext4fs_probe(struct blk_desc *fs_dev_desc,
 	return 0;
 }
 
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+int ext4fs_revalidate(struct blk_desc *fs_dev_desc,
+		      struct disk_partition *fs_partition)
+{
+	struct ext2_sblock *sblock;
+	int ret = -1;
+
+	if (!ext4fs_root)
+		return -1;
+
+	/* Drop the file opened by the previous operation */
+	if (ext4fs_file) {
+		ext4fs_free_node(ext4fs_file, &ext4fs_root->diropen);
+		ext4fs_file = NULL;
+	}
+	ext4fs_reinit_global();
+
+	/*
+	 * Someone else may have used the ext4 code in the meantime, and the
+	 * device may have been rewritten: make sure the superblock is still
+	 * the one which was mounted.
+	 */
+	ext4fs_set_blk_dev(fs_dev_desc, fs_partition);
+	sblock = malloc(SUPERBLOCK_SIZE);
+	if (!sblock)
+		return -ENOMEM;
+	if (ext4_read_superblock((char *)sblock) &&
+	    !memcmp(sblock, &ext4fs_root->sblock, SUPERBLOCK_SIZE))
+		ret = 0;
+	free(sblock);
+
+	return ret;
+}
+#endif
+
 int ext4_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
 		   loff_t *len_read)
 {
@@ -253,8 +278,10 @@ int ext4_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
 		return -1;
 	}
 
-	if (len == 0)
+	if (len == 0) {
 		len = file_len;
+		fs_bounce_set_len(file_len - offset);
+	}
 
 	return ext4fs_read(buf, offset, len, len_read);
 }
@@ -294,7 +321,7 @@ int ext_cache_read(struct ext_block_cache *cache, lbaint_t block, int size)
 	cache->buf = memalign(ARCH_DMA_MINALIGN, size);
 	if (!cache->buf)
 		return 0;
-	if (!ext4fs_devread(block, 0, size, cache->buf)) {
+	if (!ext4fs_read_meta(block, 0, size, cache->buf)) {
 		ext_cache_fini(cache);
 		return 0;
 	}
@@ -14,6 +14,7 @@
 #include <exports.h>
 #include <fat.h>
 #include <fs.h>
+#include <fs_internal.h>
 #include <log.h>
 #include <asm/byteorder.h>
 #include <part.h>
@@ -43,6 +44,14 @@ static struct disk_partition cur_part_info;
 #define DOS_FS_TYPE_OFFSET	0x36
 #define DOS_FS32_TYPE_OFFSET	0x52
 
+/* Largest number of sectors read at once into a misaligned buffer */
+#define FAT_BOUNCE_SECTS	128
+
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+/* Boot sector of the volume last found by fat_set_blk_dev() */
+static u8 fat_mount_bs[512];
+#endif
+
 static int disk_read(__u32 block, __u32 nr_blocks, void *buf)
 {
 	ulong ret;
@@ -78,15 +87,43 @@ int fat_set_blk_dev(struct blk_desc *dev_desc, struct disk_partition *info)
 	}
 
 	/* Check for FAT12/FAT16/FAT32 filesystem */
-	if (!memcmp(buffer + DOS_FS_TYPE_OFFSET, "FAT", 3))
-		return 0;
-	if (!memcmp(buffer + DOS_FS32_TYPE_OFFSET, "FAT32", 5))
-		return 0;
+	if (memcmp(buffer + DOS_FS_TYPE_OFFSET, "FAT", 3) &&
+	    memcmp(buffer + DOS_FS32_TYPE_OFFSET, "FAT32", 5)) {
+		cur_dev = NULL;
+		return -1;
+	}
 
-	cur_dev = NULL;
-	return -1;
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+	memcpy(fat_mount_bs, buffer, sizeof(fat_mount_bs));
+#endif
+	return 0;
 }
 
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+int fat_revalidate(struct blk_desc *dev_desc, struct disk_partition *info)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, buffer, dev_desc->blksz);
+
+	/* Other users of the FAT code may have switched devices */
+	cur_dev = dev_desc;
+	cur_part_info = *info;
+
+	/*
+	 * The boot sector holds the geometry and the volume ID, so a
+	 * reformatted or rewritten volume shows up as a different one. Files
+	 * changed through the block layer (ums, dfu...) leave it as it is, but
+	 * those writes drop the kept mount in fs_cache_invalidate().
+	 */
+	if (disk_read(0, 1, buffer) != 1 ||
+	    memcmp(buffer, fat_mount_bs, sizeof(fat_mount_bs))) {
+		cur_dev = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+#endif
+
 int fat_register_device(struct blk_desc *dev_desc, int part_no)
 {
 	struct disk_partition info;
@@ -157,6 +194,90 @@ int flush_dirty_fat_buffer(fsdata *mydata)
 }
 #endif
 
+/*
+ * Allocate the FAT window cache of 'mydata'.
+ * Return 0 on success, -1 otherwise.
+ */
+static int fat_alloc_fatbuf(fsdata *mydata)
+{
+	int i;
+
+	mydata->fatbufnum = -1;
+	mydata->fat_dirty = 0;
+	for (i = 0; i < FATBUFWINDOWS; i++) {
+		mydata->fatwin[i] = -1;
+		mydata->fatlru[i] = i;
+	}
+	mydata->fatbuf = malloc_cache_aligned(FATBUFSIZE * FATBUFWINDOWS);
+	if (!mydata->fatbuf) {
+		debug("Error: allocating memory\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Return the buffer of the current (most recently used) FAT window */
+static __u8 *fat_cur_window(fsdata *mydata)
+{
+	return mydata->fatbuf + mydata->fatlru[0] * FATBUFSIZE;
+}
+
+/*
+ * Make FAT window 'bufnum' the current one, reading it from disk unless it
+ * is still cached. Only the current window may be dirty, so it is written
+ * back before switching to another one.
+ * Return the window buffer, or NULL on failure.
+ */
+static __u8 *fat_get_window(fsdata *mydata, __u32 bufnum)
+{
+	__u8 slot;
+	int i;
+
+	if (mydata->fatbufnum == (int)bufnum)
+		return fat_cur_window(mydata);
+
+	/* Write back the current window to the disk */
+	if (flush_dirty_fat_buffer(mydata) < 0)
+		return NULL;
+
+	for (i = 1; i < FATBUFWINDOWS; i++) {
+		if (mydata->fatwin[mydata->fatlru[i]] == (int)bufnum)
+			break;
+	}
+
+	if (i == FATBUFWINDOWS) {
+		__u32 getsize = FATBUFBLOCKS;
+		__u32 fatlength = mydata->fatlength;
+		__u32 startblock = bufnum * FATBUFBLOCKS;
+
+		/* Replace the least recently used window */
+		i = FATBUFWINDOWS - 1;
+		slot = mydata->fatlru[i];
+		mydata->fatwin[slot] = -1;
+
+		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
+		if (startblock + getsize > fatlength)
+			getsize = fatlength - startblock;
+
+		startblock += mydata->fat_sect;	/* Offset from start of disk */
+
+		if (disk_read(startblock, getsize,
+			      mydata->fatbuf + slot * FATBUFSIZE) < 0) {
+			debug("Error reading FAT blocks\n");
+			return NULL;
+		}
+		mydata->fatwin[slot] = bufnum;
+	}
+
+	slot = mydata->fatlru[i];
+	memmove(&mydata->fatlru[1], &mydata->fatlru[0], i);
+	mydata->fatlru[0] = slot;
+	mydata->fatbufnum = bufnum;
+
+	return fat_cur_window(mydata);
+}
+
 /*
  * Get the entry at index 'entry' in a FAT (12/16/32) table.
  * On failure 0x00 is returned.
@@ -166,6 +287,7 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	__u32 bufnum;
 	__u32 offset, off8;
 	__u32 ret = 0x00;
+	__u8 *fatbuf;
 
 	if (CHECK_CLUST(entry, mydata->fatsize)) {
 		printf("Error: Invalid FAT entry: 0x%08x\n", entry);
@@ -194,42 +316,23 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	debug("FAT%d: entry: 0x%08x = %d, offset: 0x%04x = %d\n",
 	       mydata->fatsize, entry, entry, offset, offset);
 
-	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		__u32 getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
-		if (startblock + getsize > fatlength)
-			getsize = fatlength - startblock;
-
-		startblock += mydata->fat_sect;	/* Offset from start of disk */
-
-		/* Write back the fatbuf to the disk */
-		if (flush_dirty_fat_buffer(mydata) < 0)
-			return -1;
-
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
-			return ret;
-		}
-		mydata->fatbufnum = bufnum;
-	}
+	/* Find the block of FAT entries in the cache. */
+	fatbuf = fat_get_window(mydata, bufnum);
+	if (!fatbuf)
+		return ret;
 
 	/* Get the actual entry from the table */
 	switch (mydata->fatsize) {
 	case 32:
-		ret = FAT2CPU32(((__u32 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU32(((__u32 *)fatbuf)[offset]);
 		break;
 	case 16:
-		ret = FAT2CPU16(((__u16 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU16(((__u16 *)fatbuf)[offset]);
 		break;
 	case 12:
 		off8 = (offset * 3) / 2;
 		/* fatbut + off8 may be unaligned, read in byte granularity */
-		ret = mydata->fatbuf[off8] + (mydata->fatbuf[off8 + 1] << 8);
+		ret = fatbuf[off8] + (fatbuf[off8 + 1] << 8);
 
 		if (offset & 0x1)
 			ret >>= 4;
@@ -260,21 +363,44 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	debug("gc - clustnum: %d, startsect: %d\n", clustnum, startsect);
 
 	if ((unsigned long)buffer & (ARCH_DMA_MINALIGN - 1)) {
-		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
+		ALLOC_CACHE_ALIGN_BUFFER(__u8, sectbuf, mydata->sect_size);
+		__u32 max_sects = min_t(unsigned long,
+					size / mydata->sect_size,
+					FAT_BOUNCE_SECTS);
+		__u8 *tmpbuf = NULL;
 
 		debug("FAT: Misaligned buffer address (%p)\n", buffer);
 
+		/* Bounce through as few reads as memory allows */
+		if (max_sects > 1)
+			tmpbuf = malloc_cache_aligned(max_sects *
+						      mydata->sect_size);
+		if (!tmpbuf) {
+			tmpbuf = sectbuf;
+			max_sects = 1;
+		}
+
 		while (size >= mydata->sect_size) {
-			ret = disk_read(startsect++, 1, tmpbuf);
-			if (ret != 1) {
+			__u32 sect_count = min_t(unsigned long, max_sects,
+						 size / mydata->sect_size);
+			__u32 bytes_read = sect_count * mydata->sect_size;
+
+			ret = disk_read(startsect, sect_count, tmpbuf);
+			if (ret != sect_count) {
 				debug("Error reading data (got %d)\n", ret);
+				if (tmpbuf != sectbuf)
+					free(tmpbuf);
 				return -1;
 			}
 
-			memcpy(buffer, tmpbuf, mydata->sect_size);
-			buffer += mydata->sect_size;
-			size -= mydata->sect_size;
+			memcpy(buffer, tmpbuf, bytes_read);
+			fs_bounce_add(buffer, bytes_read);
+			startsect += sect_count;
+			buffer += bytes_read;
+			size -= bytes_read;
 		}
+		if (tmpbuf != sectbuf)
+			free(tmpbuf);
 	} else if (size >= mydata->sect_size) {
 		__u32 bytes_read;
 		__u32 sect_count = size / mydata->sect_size;
@@ -299,11 +425,26 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 		}
 
 		memcpy(buffer, tmpbuf, size);
+		fs_bounce_add(buffer, size);
 	}
 
 	return 0;
 }
 
+/* Maximum number of cluster runs resolved before reading file data */
+#define FAT_MAX_RUNS	32
+
+/**
+ * struct fat_run - run of consecutive clusters
+ *
+ * @clust:	First cluster of the run
+ * @count:	Number of clusters in the run
+ */
+struct fat_run {
+	__u32 clust;
+	__u32 count;
+};
+
 /**
  * get_contents() - read from file
  *
@@ -338,6 +479,7 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 
 	if (maxsize > 0 && filesize > pos + maxsize)
 		filesize = pos + maxsize;
+	fs_bounce_set_len(filesize - pos);
 
 	debug("%llu bytes\n", filesize);
 
@@ -378,6 +520,7 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 		filesize -= actsize;
 		actsize -= pos;
 		memcpy(buffer, tmp_buffer + pos, actsize);
+		fs_bounce_add(buffer, actsize);
 		free(tmp_buffer);
 		*gotsize += actsize;
 		if (!filesize)
@@ -392,50 +535,57 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 		}
 	}
 
-	actsize = bytesperclust;
-	endclust = curclust;
+	while (filesize > 0) {
+		struct fat_run runs[FAT_MAX_RUNS];
+		int nruns, i;
 
-	do {
-		/* search for consecutive clusters */
+		/*
+		 * Resolve as much of the cluster chain as fits into runs[]
+		 * before reading any data, so that the FAT and the file data
+		 * are not read in alternation.
+		 */
+		runs[0].clust = curclust;
+		runs[0].count = 1;
+		nruns = 1;
+		endclust = curclust;
+		actsize = bytesperclust;
 		while (actsize < filesize) {
 			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
 			if (CHECK_CLUST(newclust, mydata->fatsize)) {
 				debug("curclust: 0x%x\n", newclust);
 				printf("Invalid FAT entry\n");
 				return -1;
 			}
+			if (newclust != endclust + 1) {
+				if (nruns == FAT_MAX_RUNS) {
+					curclust = newclust;
+					break;
+				}
+				runs[nruns].clust = newclust;
+				runs[nruns].count = 0;
+				nruns++;
+			}
+			runs[nruns - 1].count++;
 			endclust = newclust;
 			actsize += bytesperclust;
 		}
 
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
+		/* read each run of consecutive clusters at once */
+		for (i = 0; i < nruns; i++) {
+			actsize = min(filesize,
+				      (loff_t)runs[i].count * bytesperclust);
+			if (get_cluster(mydata, runs[i].clust, buffer,
+					actsize) != 0) {
+				printf("Error reading cluster\n");
+				return -1;
+			}
+			*gotsize += actsize;
+			filesize -= actsize;
+			buffer += actsize;
 		}
-		*gotsize += (int)actsize;
-		filesize -= actsize;
-		buffer += actsize;
+	}
 
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	return 0;
 }
 
 /*
@@ -623,13 +773,8 @@ static int get_fs_info(fsdata *mydata)
 		mydata->root_cluster = 0;
 	}
 
-	mydata->fatbufnum = -1;
-	mydata->fat_dirty = 0;
-	mydata->fatbuf = malloc_cache_aligned(FATBUFSIZE);
-	if (mydata->fatbuf == NULL) {
-		debug("Error: allocating memory\n");
+	if (fat_alloc_fatbuf(mydata))
 		return -1;
-	}
 
 	debug("FAT%d, fat_sect: %d, fatlength: %d\n",
 	       mydata->fatsize, mydata->fat_sect, mydata->fatlength);
@@ -1164,8 +1309,35 @@ int file_fat_detectfs(void)
 	return 0;
 }
 
+/*
+ * Find the directory entry of the file @filename, from the dentry cache if
+ * possible. On success *@dentp points either into @itr or to @dentbuf.
+ * Directories are not cached, so @type must not be TYPE_DIR.
+ */
+static int fat_lookup_file(fat_itr *itr, const char *filename, int type,
+			   dir_entry *dentbuf, dir_entry **dentp)
+{
+	int ret;
+
+	if (!fs_dcache_lookup(filename, dentbuf, sizeof(*dentbuf))) {
+		*dentp = dentbuf;
+		return 0;
+	}
+
+	ret = fat_itr_resolve(itr, filename, type);
+	if (ret)
+		return ret;
+
+	*dentp = itr->dent;
+	if (!fat_itr_isdir(itr))
+		fs_dcache_add(filename, itr->dent, sizeof(*itr->dent));
+
+	return 0;
+}
+
 int fat_exists(const char *filename)
 {
+	dir_entry dent, *dentptr;
 	fsdata fsdata;
 	fat_itr *itr;
 	int ret;
@@ -1177,7 +1349,7 @@ int fat_exists(const char *filename)
 	if (ret)
 		goto out;
 
-	ret = fat_itr_resolve(itr, filename, TYPE_ANY);
+	ret = fat_lookup_file(itr, filename, TYPE_ANY, &dent, &dentptr);
 	free(fsdata.fatbuf);
 out:
 	free(itr);
@@ -1208,6 +1380,7 @@ static void __maybe_unused fat2rtc(u16 date, u16 time, struct rtc_time *tm)
 
 int fat_size(const char *filename, loff_t *size)
 {
+	dir_entry dent, *dentptr;
 	fsdata fsdata;
 	fat_itr *itr;
 	int ret;
@@ -1219,7 +1392,7 @@ int fat_size(const char *filename, loff_t *size)
 	if (ret)
 		goto out_free_itr;
 
-	ret = fat_itr_resolve(itr, filename, TYPE_FILE);
+	ret = fat_lookup_file(itr, filename, TYPE_FILE, &dent, &dentptr);
 	if (ret) {
 		/*
 		 * Directories don't have size, but fs_size() is not
@@ -1235,7 +1408,7 @@ int fat_size(const char *filename, loff_t *size)
 		goto out_free_both;
 	}
 
-	*size = FAT2CPU32(itr->dent->size);
+	*size = FAT2CPU32(dentptr->size);
 out_free_both:
 	free(fsdata.fatbuf);
 out_free_itr:
@@ -1246,6 +1419,7 @@ out_free_itr:
 int file_fat_read_at(const char *filename, loff_t pos, void *buffer,
 		     loff_t maxsize, loff_t *actread)
 {
+	dir_entry dent, *dentptr;
 	fsdata fsdata;
 	fat_itr *itr;
 	int ret;
@@ -1257,15 +1431,12 @@ int file_fat_read_at(const char *filename, loff_t pos, void *buffer,
 	if (ret)
 		goto out_free_itr;
 
-	ret = fat_itr_resolve(itr, filename, TYPE_FILE);
+	ret = fat_lookup_file(itr, filename, TYPE_FILE, &dent, &dentptr);
 	if (ret)
 		goto out_free_both;
 
 	debug("reading %s at pos %llu\n", filename, pos);
 
-	/* For saving default max clustersize memory allocated to malloc pool */
-	dir_entry *dentptr = itr->dent;
-
 	ret = get_contents(&fsdata, dentptr, pos, buffer, maxsize, actread);
 
 out_free_both:
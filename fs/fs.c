@@ -12,11 +12,13 @@
 #include <env.h>
 #include <lmb.h>
 #include <log.h>
+#include <malloc.h>
 #include <mapmem.h>
 #include <part.h>
 #include <ext4fs.h>
 #include <fat.h>
 #include <fs.h>
+#include <fs_internal.h>
 #include <sandboxfs.h>
 #include <ubifs_uboot.h>
 #include <btrfs.h>
@@ -26,6 +28,7 @@
 #include <linux/math64.h>
 #include <efi_loader.h>
 #include <squashfs.h>
+#include <linux/list.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -172,6 +175,16 @@ struct fstype_info {
 	int (*unlink)(const char *filename);
 	int (*mkdir)(const char *dirname);
 	int (*ln)(const char *filename, const char *target);
+	/*
+	 * Optional. Check that the filesystem left mounted by a previous
+	 * operation is still the one found on the partition, and drop any
+	 * state kept for a single file. Return 0 if it can be used again,
+	 * or non-zero to probe the partition from scratch. Filesystems
+	 * which provide this are kept mounted between operations when
+	 * CONFIG_FS_MOUNT_CACHE is enabled.
+	 */
+	int (*revalidate)(struct blk_desc *fs_dev_desc,
+			  struct disk_partition *fs_partition);
 };
 
 static struct fstype_info fstypes[] = {
@@ -200,6 +213,9 @@ static struct fstype_info fstypes[] = {
 		.readdir = fat_readdir,
 		.closedir = fat_closedir,
 		.ln = fs_ln_unsupported,
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+		.revalidate = fat_revalidate,
+#endif
 	},
 #endif
 
@@ -225,6 +241,9 @@ static struct fstype_info fstypes[] = {
 		.opendir = fs_opendir_unsupported,
 		.unlink = fs_unlink_unsupported,
 		.mkdir = fs_mkdir_unsupported,
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+		.revalidate = ext4fs_revalidate,
+#endif
 	},
 #endif
 #ifdef CONFIG_SANDBOX
@@ -364,6 +383,197 @@ const char *fs_get_type_name(void)
 	return fs_get_info(fs_type)->name;
 }
 
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+/*
+ * The filesystem found by the last operation is kept mounted, so that the
+ * next operation on the same partition only has to revalidate it instead of
+ * probing it again. Paths resolved on it are remembered in a small dentry
+ * cache which lives as long as the mount.
+ */
+static int fs_mount_type = FS_TYPE_ANY;
+static struct blk_desc *fs_mount_desc;
+static int fs_mount_hwpart;
+static struct disk_partition fs_mount_partition;
+
+struct fs_dcache_node {
+	struct list_head lh;
+	char *path;
+	int size;
+	u8 data[FS_DCACHE_DATA_MAX];
+};
+
+static LIST_HEAD(fs_dcache);
+
+static struct fs_cache_stats fs_cstats = {
+	.max_entries = CONFIG_FS_DCACHE_ENTRIES,
+};
+
+static void fs_dcache_free(struct fs_dcache_node *node)
+{
+	list_del(&node->lh);
+	free(node->path);
+	free(node);
+	fs_cstats.entries--;
+}
+
+static void fs_dcache_invalidate(void)
+{
+	struct fs_dcache_node *node, *n;
+
+	list_for_each_entry_safe(node, n, &fs_dcache, lh)
+		fs_dcache_free(node);
+}
+
+/* The dentry cache only applies to an operation on the kept mount */
+static bool fs_dcache_active(void)
+{
+	return fs_type != FS_TYPE_ANY && fs_type == fs_mount_type;
+}
+
+int fs_dcache_lookup(const char *path, void *data, int size)
+{
+	struct fs_dcache_node *node;
+
+	if (!fs_dcache_active())
+		return -ENOENT;
+
+	list_for_each_entry(node, &fs_dcache, lh) {
+		if (node->size == size && !strcmp(node->path, path)) {
+			if (fs_dcache.next != &node->lh) {
+				/* maintain MRU ordering */
+				list_del(&node->lh);
+				list_add(&node->lh, &fs_dcache);
+			}
+			memcpy(data, node->data, size);
+			fs_cstats.hits++;
+			return 0;
+		}
+	}
+	fs_cstats.misses++;
+
+	return -ENOENT;
+}
+
+void fs_dcache_add(const char *path, const void *data, int size)
+{
+	struct fs_dcache_node *node;
+
+	if (!fs_dcache_active() || size > FS_DCACHE_DATA_MAX ||
+	    !fs_cstats.max_entries)
+		return;
+
+	if (fs_cstats.entries >= fs_cstats.max_entries)
+		fs_dcache_free(list_last_entry(&fs_dcache,
+					       struct fs_dcache_node, lh));
+
+	node = malloc(sizeof(*node));
+	if (!node)
+		return;
+	node->path = strdup(path);
+	if (!node->path) {
+		free(node);
+		return;
+	}
+	node->size = size;
+	memcpy(node->data, data, size);
+	list_add(&node->lh, &fs_dcache);
+	fs_cstats.entries++;
+}
+
+/* Forget the kept mount, closing it unless an operation is using it */
+static void fs_mount_drop(void)
+{
+	int type = fs_mount_type;
+
+	if (type == FS_TYPE_ANY)
+		return;
+
+	fs_mount_type = FS_TYPE_ANY;
+	fs_dcache_invalidate();
+	if (fs_type != type)
+		fs_get_info(type)->close();
+}
+
+static void fs_mount_keep(struct fstype_info *info)
+{
+	if (!info->revalidate)
+		return;
+
+	fs_mount_type = info->fstype;
+	fs_mount_desc = fs_dev_desc;
+	fs_mount_hwpart = fs_dev_desc->hwpart;
+	fs_mount_partition = fs_partition;
+	fs_cstats.mounts++;
+}
+
+/*
+ * Use the kept mount if it is on @fs_partition and still valid. MMC hardware
+ * partitions share one block device, so its current hardware partition must
+ * match as well.
+ */
+static int fs_mount_reuse(int fstype)
+{
+	struct fstype_info *info;
+
+	if (fs_mount_type == FS_TYPE_ANY)
+		return -ENOENT;
+
+	if (fs_dev_desc == fs_mount_desc &&
+	    fs_dev_desc->hwpart == fs_mount_hwpart &&
+	    fs_partition.start == fs_mount_partition.start &&
+	    fs_partition.size == fs_mount_partition.size &&
+	    (fstype == FS_TYPE_ANY || fstype == fs_mount_type)) {
+		info = fs_get_info(fs_mount_type);
+		if (!info->revalidate(fs_dev_desc, &fs_partition)) {
+			fs_type = fs_mount_type;
+			fs_cstats.reuses++;
+			return 0;
+		}
+	}
+	fs_mount_drop();
+
+	return -ENOENT;
+}
+
+static bool fs_mount_kept(void)
+{
+	return fs_type == fs_mount_type;
+}
+
+void fs_cache_stats(struct fs_cache_stats *stats)
+{
+	memcpy(stats, &fs_cstats, sizeof(*stats));
+	fs_cstats.mounts = 0;
+	fs_cstats.reuses = 0;
+	fs_cstats.hits = 0;
+	fs_cstats.misses = 0;
+}
+
+void fs_cache_flush(void)
+{
+	fs_mount_drop();
+}
+
+void fs_cache_invalidate(struct blk_desc *desc)
+{
+	if (fs_mount_type != FS_TYPE_ANY && desc == fs_mount_desc)
+		fs_mount_drop();
+}
+#else
+static inline void fs_mount_drop(void) {}
+static inline void fs_mount_keep(struct fstype_info *info) {}
+
+static inline int fs_mount_reuse(int fstype)
+{
+	return -ENOENT;
+}
+
+static inline bool fs_mount_kept(void)
+{
+	return false;
+}
+#endif
+
 int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 {
 	struct fstype_info *info;
@@ -390,6 +600,11 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 	if (part < 0)
 		return -1;
 
+	if (!fs_mount_reuse(fstype)) {
+		fs_dev_part = part;
+		return 0;
+	}
+
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
 		if (fstype != FS_TYPE_ANY && info->fstype != FS_TYPE_ANY &&
 				fstype != info->fstype)
@@ -401,6 +616,7 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 		if (!info->probe(fs_dev_desc, &fs_partition)) {
 			fs_type = info->fstype;
 			fs_dev_part = part;
+			fs_mount_keep(info);
 			return 0;
 		}
 	}
@@ -422,10 +638,16 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part)
 		return ret;
 	fs_dev_desc = desc;
 
+	if (!fs_mount_reuse(FS_TYPE_ANY)) {
+		fs_dev_part = part;
+		return 0;
+	}
+
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
 		if (!info->probe(fs_dev_desc, &fs_partition)) {
 			fs_type = info->fstype;
 			fs_dev_part = part;
+			fs_mount_keep(info);
 			return 0;
 		}
 	}
@@ -437,7 +659,8 @@ void fs_close(void)
 {
 	struct fstype_info *info = fs_get_info(fs_type);
 
-	info->close();
+	if (!fs_mount_kept())
+		info->close();
 
 	fs_type = FS_TYPE_ANY;
 }
@@ -543,7 +766,9 @@ static int _fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
 	 * means read the whole file.
 	 */
 	buf = map_sysmem(addr, len);
+	fs_bounce_track(buf, len);
 	ret = info->read(filename, buf, offset, len, actread);
+	fs_bounce_track(NULL, 0);
 	unmap_sysmem(buf);
 
 	/* If we requested a specific number of bytes, check we got it */
@@ -575,6 +800,7 @@ int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 		log_err("** Unable to write file %s **\n", filename);
 		ret = -1;
 	}
+	fs_mount_drop();
 	fs_close();
 
 	return ret;
@@ -640,6 +866,7 @@ int fs_unlink(const char *filename)
 
 	ret = info->unlink(filename);
 
+	fs_mount_drop();
 	fs_close();
 
 	return ret;
@@ -653,6 +880,7 @@ int fs_mkdir(const char *dirname)
 
 	ret = info->mkdir(dirname);
 
+	fs_mount_drop();
 	fs_close();
 
 	return ret;
@@ -669,6 +897,7 @@ int fs_ln(const char *fname, const char *target)
 		log_err("** Unable to create link %s -> %s **\n", fname, target);
 		ret = -1;
 	}
+	fs_mount_drop();
 	fs_close();
 
 	return ret;
@@ -702,6 +931,7 @@ int do_load(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
 	loff_t bytes;
 	loff_t pos;
 	loff_t len_read;
+	u64 bounced;
 	int ret;
 	unsigned long time;
 	char *ep;
@@ -745,6 +975,7 @@ int do_load(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
 	else
 		pos = 0;
 
+	fs_bounce_bytes();
 	time = get_timer(0);
 	ret = _fs_read(filename, addr, pos, bytes, 1, &len_read);
 	time = get_timer(time);
@@ -765,6 +996,9 @@ int do_load(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
 		puts(")");
 	}
 	puts("\n");
+	bounced = fs_bounce_bytes();
+	if (bounced)
+		printf("%llu bytes went through bounce buffers\n", bounced);
 
 	env_set_hex("fileaddr", addr);
 	env_set_hex("filesize", len_read);
@@ -13,6 +13,48 @@
 #include <log.h>
 #include <part.h>
 #include <memalign.h>
+#include <fs_internal.h>
+
+#if CONFIG_IS_ENABLED(FS_BOUNCE_STATS)
+/*
+ * Destination of the file read in progress, see fs_bounce_track(). It stays
+ * empty until fs_bounce_set_len() if the length is not known up front.
+ */
+static char *fs_dest_start, *fs_dest_end;
+static bool fs_dest_open;
+static u64 fs_bounced;
+
+void fs_bounce_track(void *buf, loff_t len)
+{
+	fs_dest_start = buf;
+	fs_dest_end = buf + len;
+	fs_dest_open = buf && !len;
+}
+
+void fs_bounce_set_len(loff_t len)
+{
+	if (!fs_dest_open)
+		return;
+
+	fs_dest_end = fs_dest_start + max_t(loff_t, len, 0);
+	fs_dest_open = false;
+}
+
+void fs_bounce_add(const void *dst, size_t len)
+{
+	if ((char *)dst >= fs_dest_start && (char *)dst < fs_dest_end)
+		fs_bounced += len;
+}
+
+u64 fs_bounce_bytes(void)
+{
+	u64 bytes = fs_bounced;
+
+	fs_bounced = 0;
+
+	return bytes;
+}
+#endif
 
 int fs_devread(struct blk_desc *blk, struct disk_partition *partition,
 	       lbaint_t sector, int byte_offset, int byte_len, char *buf)
@@ -51,6 +93,7 @@ int fs_devread(struct blk_desc *blk, struct disk_partition *partition,
 		readlen = min((int)blk->blksz - byte_offset,
 			      byte_len);
 		memcpy(buf, sec_buf + byte_offset, readlen);
+		fs_bounce_add(buf, readlen);
 		buf += readlen;
 		byte_len -= readlen;
 		sector++;
@@ -69,9 +112,13 @@ int fs_devread(struct blk_desc *blk, struct disk_partition *partition,
 		blk_dread(blk, partition->start + sector, 1,
 			  (void *)p);
 		memcpy(buf, p, byte_len);
+		fs_bounce_add(buf, byte_len);
 		return 1;
 	}
 
+	/* A DMA driver has to bounce a misaligned buffer */
+	if (!IS_ALIGNED((ulong)buf, ARCH_DMA_MINALIGN))
+		fs_bounce_add(buf, block_len);
 	if (blk_dread(blk, partition->start + sector,
 		      block_len >> log2blksz, (void *)buf) !=
 			block_len >> log2blksz) {
@@ -91,6 +138,7 @@ int fs_devread(struct blk_desc *blk, struct disk_partition *partition,
 			return 0;
 		}
 		memcpy(buf, sec_buf, byte_len);
+		fs_bounce_add(buf, byte_len);
 	}
 	return 1;
 }
@@ -10,6 +10,7 @@
 #include <asm/unaligned.h>
 #include <errno.h>
 #include <fs.h>
+#include <fs_internal.h>
 #include <linux/types.h>
 #include <linux/byteorder/little_endian.h>
 #include <linux/byteorder/generic.h>
@@ -20,6 +21,7 @@
 #include <squashfs.h>
 #include <part.h>
 
+#include "sqfs_cache.h"
 #include "sqfs_decompressor.h"
 #include "sqfs_filesystem.h"
 #include "sqfs_utils.h"
@@ -695,6 +697,9 @@ static int sqfs_read_inode_table(unsigned char **inode_table)
 	unsigned long dest_len = 0;
 	bool compressed;
 
+	if (sqfs_cache_get_table(SQFS_CACHE_INODE_TABLE, inode_table, NULL))
+		return 0;
+
 	table_size = get_unaligned_le64(&sblk->directory_table_start) -
 		get_unaligned_le64(&sblk->inode_table_start);
 	start = get_unaligned_le64(&sblk->inode_table_start) /
@@ -766,6 +771,9 @@ static int sqfs_read_inode_table(unsigned char **inode_table)
 		src_table += src_len + SQFS_HEADER_SIZE;
 	}
 
+	sqfs_cache_add_table(SQFS_CACHE_INODE_TABLE, *inode_table,
+			     metablks_count, NULL);
+
 free_itb:
 	free(itb);
 
@@ -784,6 +792,13 @@ static int sqfs_read_directory_table(unsigned char **dir_table, u32 **pos_list)
 
 	*dir_table = NULL;
 	*pos_list = NULL;
+
+	metablks_count = sqfs_cache_get_table(SQFS_CACHE_DIR_TABLE, dir_table,
+					      pos_list);
+	if (metablks_count)
+		return metablks_count;
+	metablks_count = -1;
+
 	/* DIRECTORY TABLE */
 	table_size = get_unaligned_le64(&sblk->fragment_table_start) -
 		get_unaligned_le64(&sblk->directory_table_start);
@@ -860,6 +875,9 @@ static int sqfs_read_directory_table(unsigned char **dir_table, u32 **pos_list)
 		src_table += src_len + SQFS_HEADER_SIZE;
 	}
 
+	sqfs_cache_add_table(SQFS_CACHE_DIR_TABLE, *dir_table, metablks_count,
+			     *pos_list);
+
 out:
 	if (metablks_count < 1) {
 		free(*dir_table);
@@ -1108,6 +1126,8 @@ int sqfs_probe(struct blk_desc *fs_dev_desc, struct disk_partition *fs_partition
 		goto error;
 	}
 
+	sqfs_cache_mount(&ctxt);
+
 	return 0;
 error:
 	ctxt.cur_dev = NULL;
@@ -1311,13 +1331,231 @@ static int sqfs_get_lregfile_info(struct squashfs_lreg_inode *lreg,
 	return datablk_count;
 }
 
+/* Largest amount of file data sqfs_read() fetches with one device read */
+#define SQFS_READ_BATCH_SIZE	(CONFIG_SQUASHFS_READ_BATCH_SIZE * 1024)
+
+/**
+ * struct sqfs_batch - consecutive data blocks fetched with one device read
+ *
+ * @req:	Block request used to read the batch
+ * @buf:	Scratch buffer the batch is read into
+ * @first:	Index of the first data block in the batch
+ * @count:	Number of data blocks in the batch
+ * @size:	Size of the data blocks on disk, in bytes
+ * @offset:	Offset of the first data block in @buf
+ * @n_blks:	Number of device blocks to read into @buf
+ * @busy:	true while the read may still be in flight
+ */
+struct sqfs_batch {
+#if CONFIG_IS_ENABLED(BLK)
+	struct blk_req req;
+#endif
+	char *buf;
+	int first;
+	int count;
+	u64 size;
+	u32 offset;
+	u64 n_blks;
+	bool busy;
+};
+
+/*
+ * Gather as many data blocks starting at @first as fit in @buf_size bytes,
+ * but at least one, and start reading them. Sparse blocks take no room.
+ * With batching disabled, a single block is read and the read is finished
+ * before returning.
+ */
+static int sqfs_batch_start(struct sqfs_batch *batch,
+			    struct squashfs_file_info *finfo, int first,
+			    int last, u64 data_offset, size_t buf_size)
+{
+	u64 start = data_offset / ctxt.cur_dev->blksz;
+	int j, ret;
+
+	batch->first = first;
+	batch->size = 0;
+	batch->offset = data_offset - start * ctxt.cur_dev->blksz;
+	for (j = first; j < last; j++) {
+		u32 size = SQFS_BLOCK_SIZE(finfo->blk_sizes[j]);
+
+		if (j > first && (!SQFS_READ_BATCH_SIZE ||
+				  batch->offset + batch->size + size > buf_size))
+			break;
+		batch->size += size;
+	}
+	batch->count = j - first;
+	batch->n_blks = DIV_ROUND_UP(batch->offset + batch->size,
+				     ctxt.cur_dev->blksz);
+	if (!batch->size)
+		return 0;
+
+#if CONFIG_IS_ENABLED(BLK)
+	if (SQFS_READ_BATCH_SIZE) {
+		batch->req.op = BLK_REQ_READ;
+		batch->req.start = ctxt.cur_part_info.start + start;
+		batch->req.blkcnt = batch->n_blks;
+		batch->req.buffer = batch->buf;
+		do {
+			ret = blk_submit(ctxt.cur_dev->bdev, &batch->req);
+			if (ret == -EBUSY)
+				blk_poll(ctxt.cur_dev->bdev);
+		} while (ret == -EBUSY);
+		if (ret)
+			return ret;
+		batch->busy = true;
+
+		return 0;
+	}
+#endif
+	ret = sqfs_disk_read(start, batch->n_blks, batch->buf);
+	if (ret < 0)
+		return -EIO;
+
+	return 0;
+}
+
+static int sqfs_batch_wait(struct sqfs_batch *batch)
+{
+#if CONFIG_IS_ENABLED(BLK)
+	long ret;
+
+	if (!batch->busy)
+		return 0;
+
+	batch->busy = false;
+	ret = blk_wait(ctxt.cur_dev->bdev, &batch->req);
+	if (ret != batch->n_blks)
+		return ret < 0 ? ret : -EIO;
+#endif
+
+	return 0;
+}
+
+/*
+ * Read the first @len bytes of the data blocks of a file into @buf.
+ *
+ * Consecutive data blocks are fetched in batches of up to
+ * SQFS_READ_BATCH_SIZE bytes with a single device read each, and the next
+ * batch is already being read while the current one is decompressed. Full
+ * blocks are decompressed straight into @buf; only a trailing partial block
+ * goes through a bounce buffer.
+ */
+static int sqfs_read_datablocks(struct squashfs_file_info *finfo,
+				int datablk_count, char *buf, loff_t len,
+				loff_t *actread)
+{
+	u32 block_size = get_unaligned_le32(&ctxt.sblk->block_size);
+	struct sqfs_batch batches[2] = {}, *cur, *next;
+	u64 data_offset = finfo->start;
+	unsigned long dest_len;
+	char *datablock = NULL;
+	int count, i, j, ret;
+	size_t buf_size;
+	loff_t remain;
+	u32 size;
+	char *data;
+
+	/* Every data block but the last one holds block_size bytes */
+	count = min_t(u64, datablk_count,
+		      DIV_ROUND_UP((u64)len, block_size));
+	if (!count)
+		return 0;
+
+	buf_size = max_t(size_t, SQFS_READ_BATCH_SIZE, block_size) +
+		   ctxt.cur_dev->blksz;
+	for (i = 0; i < ARRAY_SIZE(batches); i++) {
+		batches[i].buf = malloc_cache_aligned(buf_size);
+		if (!batches[i].buf) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	cur = &batches[0];
+	next = &batches[1];
+	ret = sqfs_batch_start(cur, finfo, 0, count, data_offset, buf_size);
+	if (ret)
+		goto read_err;
+
+	for (j = 0; j < count;) {
+		data_offset += cur->size;
+		if (j + cur->count < count) {
+			ret = sqfs_batch_start(next, finfo, j + cur->count,
+					       count, data_offset, buf_size);
+			if (ret)
+				goto read_err;
+		}
+
+		ret = sqfs_batch_wait(cur);
+		if (ret)
+			goto read_err;
+
+		data = cur->buf + cur->offset;
+		for (i = 0; i < cur->count; i++, j++) {
+			size = SQFS_BLOCK_SIZE(finfo->blk_sizes[j]);
+			remain = len - *actread;
+
+			if (finfo->blk_sizes[j] == 0) {
+				/* This is a sparse block */
+				dest_len = min_t(loff_t, block_size, remain);
+				memset(buf + *actread, 0, dest_len);
+			} else if (!SQFS_COMPRESSED_BLOCK(finfo->blk_sizes[j])) {
+				dest_len = min_t(loff_t, size, remain);
+				memcpy(buf + *actread, data, dest_len);
+				fs_bounce_add(buf + *actread, dest_len);
+			} else if (remain >= block_size) {
+				dest_len = block_size;
+				ret = sqfs_decompress(&ctxt, buf + *actread,
+						      &dest_len, data, size);
+				if (ret)
+					goto out;
+			} else {
+				if (!datablock)
+					datablock = malloc(block_size);
+				if (!datablock) {
+					ret = -ENOMEM;
+					goto out;
+				}
+
+				dest_len = block_size;
+				ret = sqfs_decompress(&ctxt, datablock,
+						      &dest_len, data, size);
+				if (ret)
+					goto out;
+
+				dest_len = min_t(loff_t, dest_len, remain);
+				memcpy(buf + *actread, datablock, dest_len);
+				fs_bounce_add(buf + *actread, dest_len);
+			}
+
+			*actread += dest_len;
+			data += size;
+		}
+		swap(cur, next);
+	}
+	goto out;
+
+read_err:
+	printf("Error: failed to read data blocks from the device (%d).\n",
+	       ret);
+out:
+	/* A read may still be in flight after an error */
+	for (i = 0; i < ARRAY_SIZE(batches); i++)
+		sqfs_batch_wait(&batches[i]);
+	for (i = 0; i < ARRAY_SIZE(batches); i++)
+		free(batches[i].buf);
+	free(datablock);
+
+	return ret;
+}
+
 int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	      loff_t *actread)
 {
-	char *dir = NULL, *fragment_block, *datablock = NULL, *data_buffer = NULL;
-	char *fragment = NULL, *file = NULL, *resolved, *data;
-	u64 start, n_blks, table_size, data_offset, table_offset, sparse_size;
-	int ret, j, i_number, datablk_count = 0;
+	char *dir = NULL, *fragment_block, *fragment = NULL, *file = NULL;
+	u64 start, n_blks, table_size, table_offset;
+	char *resolved;
+	int ret, i_number, datablk_count = 0;
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_fragment_block_entry frag_entry;
 	struct squashfs_file_info finfo = {0};
@@ -1432,85 +1670,12 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 		finfo.size = len;
 	} else {
 		len = finfo.size;
+		fs_bounce_set_len(len);
 	}
 
-	if (datablk_count) {
-		data_offset = finfo.start;
-		datablock = malloc(get_unaligned_le32(&sblk->block_size));
-		if (!datablock) {
-			ret = -ENOMEM;
-			goto out;
-		}
-	}
-
-	for (j = 0; j < datablk_count; j++) {
-		start = data_offset / ctxt.cur_dev->blksz;
-		table_size = SQFS_BLOCK_SIZE(finfo.blk_sizes[j]);
-		table_offset = data_offset - (start * ctxt.cur_dev->blksz);
-		n_blks = DIV_ROUND_UP(table_size + table_offset,
-				      ctxt.cur_dev->blksz);
-
-		/* Don't load any data for sparse blocks */
-		if (finfo.blk_sizes[j] == 0) {
-			n_blks = 0;
-			table_offset = 0;
-			data_buffer = NULL;
-			data = NULL;
-		} else {
-			data_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-
-			if (!data_buffer) {
-				ret = -ENOMEM;
-				goto out;
-			}
-
-			ret = sqfs_disk_read(start, n_blks, data_buffer);
-			if (ret < 0) {
-				/*
-				 * Possible causes: too many data blocks or too large
-				 * SquashFS block size. Tip: re-compile the SquashFS
-				 * image with mksquashfs's -b <block_size> option.
-				 */
-				printf("Error: too many data blocks to be read.\n");
-				goto out;
-			}
-
-			data = data_buffer + table_offset;
-		}
-
-		/* Load the data */
-		if (finfo.blk_sizes[j] == 0) {
-			/* This is a sparse block */
-			sparse_size = get_unaligned_le32(&sblk->block_size);
-			if ((*actread + sparse_size) > len)
-				sparse_size = len - *actread;
-			memset(buf + *actread, 0, sparse_size);
-			*actread += sparse_size;
-		} else if (SQFS_COMPRESSED_BLOCK(finfo.blk_sizes[j])) {
-			dest_len = get_unaligned_le32(&sblk->block_size);
-			ret = sqfs_decompress(&ctxt, datablock, &dest_len,
-					      data, table_size);
-			if (ret)
-				goto out;
-
-			if ((*actread + dest_len) > len)
-				dest_len = len - *actread;
-			memcpy(buf + *actread, datablock, dest_len);
-			*actread += dest_len;
-		} else {
-			if ((*actread + table_size) > len)
-				table_size = len - *actread;
-			memcpy(buf + *actread, data, table_size);
-			*actread += table_size;
-		}
-
-		data_offset += table_size;
-		if (data_buffer)
-			free(data_buffer);
-		data_buffer = NULL;
-		if (*actread >= len)
-			break;
-	}
+	ret = sqfs_read_datablocks(&finfo, datablk_count, buf, len, actread);
+	if (ret)
+		goto out;
 
 	/*
 	 * There is no need to continue if the file is not fragmented.
@@ -1520,6 +1685,16 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 		goto out;
 	}
 
+	/* Files sharing a fragment block only need it to be read once */
+	fragment_block = sqfs_cache_fragment(frag_entry.start);
+	if (fragment_block) {
+		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
+		fs_bounce_add(buf + *actread, finfo.size - *actread);
+		*actread = finfo.size;
+		ret = 0;
+		goto out;
+	}
+
 	start = frag_entry.start / ctxt.cur_dev->blksz;
 	table_size = SQFS_BLOCK_SIZE(frag_entry.size);
 	table_offset = frag_entry.start - (start * ctxt.cur_dev->blksz);
@@ -1553,7 +1728,10 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 			goto out;
 		}
 
+		sqfs_cache_add_fragment(frag_entry.start, fragment_block,
+					dest_len);
 		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
+		fs_bounce_add(buf + *actread, finfo.size - *actread);
 		*actread = finfo.size;
 
 		free(fragment_block);
@@ -1561,16 +1739,15 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	} else if (finfo.frag && !finfo.comp) {
 		fragment_block = (void *)fragment + table_offset;
 
+		sqfs_cache_add_fragment(frag_entry.start, fragment_block,
+					table_size);
 		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
+		fs_bounce_add(buf + *actread, finfo.size - *actread);
 		*actread = finfo.size;
 	}
 
 out:
 	free(fragment);
-	if (datablk_count) {
-		free(data_buffer);
-		free(datablock);
-	}
 	free(file);
 	free(dir);
 	free(finfo.blk_sizes);
@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * sqfs_cache.c: cache of decompressed SquashFS tables and fragment blocks
+ *
+ * The filesystem is probed again by every command, so the cache is kept
+ * from one probe to the next for as long as the same image is found.
+ */
+
+#include <errno.h>
+#include <fs.h>
+#include <linux/list.h>
+#include <malloc.h>
+#include <part.h>
+#include <squashfs.h>
+#include <string.h>
+
+#include "sqfs_cache.h"
+#include "sqfs_filesystem.h"
+
+struct sqfs_cache_table {
+	unsigned char *data;
+	u32 *pos_list;
+	int count;
+};
+
+struct sqfs_cache_frag {
+	struct list_head lh;
+	u64 start;
+	unsigned long len;
+	void *data;
+};
+
+static struct sqfs_cache_table sqfs_tables[SQFS_CACHE_TABLE_COUNT];
+static LIST_HEAD(sqfs_frags);
+static struct sqfs_cache_stats sqfs_stats = {
+	.table_max_size = CONFIG_SQUASHFS_CACHE_TABLE_SIZE * 1024UL,
+	.frag_max_entries = CONFIG_SQUASHFS_CACHE_FRAGMENTS,
+};
+
+/* Filesystem the cache was filled from */
+static struct blk_desc *sqfs_cache_dev;
+static lbaint_t sqfs_cache_part_start;
+static struct squashfs_super_block sqfs_cache_sblk;
+
+void sqfs_cache_invalidate(void)
+{
+	struct sqfs_cache_frag *frag, *n;
+	int i;
+
+	for (i = 0; i < SQFS_CACHE_TABLE_COUNT; i++) {
+		free(sqfs_tables[i].data);
+		free(sqfs_tables[i].pos_list);
+		sqfs_tables[i].data = NULL;
+		sqfs_tables[i].pos_list = NULL;
+		sqfs_tables[i].count = 0;
+	}
+	sqfs_stats.table_size = 0;
+
+	list_for_each_entry_safe(frag, n, &sqfs_frags, lh) {
+		list_del(&frag->lh);
+		free(frag->data);
+		free(frag);
+	}
+	sqfs_stats.frag_entries = 0;
+}
+
+void sqfs_cache_mount(struct squashfs_ctxt *ctxt)
+{
+	if (sqfs_cache_dev == ctxt->cur_dev &&
+	    sqfs_cache_part_start == ctxt->cur_part_info.start &&
+	    !memcmp(&sqfs_cache_sblk, ctxt->sblk, sizeof(sqfs_cache_sblk)))
+		return;
+
+	sqfs_cache_invalidate();
+	sqfs_cache_dev = ctxt->cur_dev;
+	sqfs_cache_part_start = ctxt->cur_part_info.start;
+	memcpy(&sqfs_cache_sblk, ctxt->sblk, sizeof(sqfs_cache_sblk));
+}
+
+int sqfs_cache_get_table(enum sqfs_cache_table_id id, unsigned char **table,
+			 u32 **pos_list)
+{
+	struct sqfs_cache_table *t = &sqfs_tables[id];
+	size_t size = t->count * SQFS_METADATA_BLOCK_SIZE;
+
+	if (!t->data || (pos_list && !t->pos_list))
+		goto miss;
+
+	*table = malloc(size);
+	if (!*table)
+		goto miss;
+	memcpy(*table, t->data, size);
+
+	if (pos_list) {
+		*pos_list = malloc(t->count * sizeof(u32));
+		if (!*pos_list) {
+			free(*table);
+			*table = NULL;
+			goto miss;
+		}
+		memcpy(*pos_list, t->pos_list, t->count * sizeof(u32));
+	}
+	sqfs_stats.table_hits++;
+
+	return t->count;
+miss:
+	sqfs_stats.table_misses++;
+
+	return 0;
+}
+
+void sqfs_cache_add_table(enum sqfs_cache_table_id id,
+			  const unsigned char *table, int count,
+			  const u32 *pos_list)
+{
+	struct sqfs_cache_table *t = &sqfs_tables[id];
+	size_t size = count * SQFS_METADATA_BLOCK_SIZE;
+
+	sqfs_stats.table_size -= t->count * SQFS_METADATA_BLOCK_SIZE;
+	free(t->data);
+	free(t->pos_list);
+	t->data = NULL;
+	t->pos_list = NULL;
+	t->count = 0;
+
+	if (sqfs_stats.table_size + size > sqfs_stats.table_max_size)
+		return;
+
+	t->data = malloc(size);
+	if (!t->data)
+		return;
+	memcpy(t->data, table, size);
+
+	if (pos_list) {
+		t->pos_list = malloc(count * sizeof(u32));
+		if (!t->pos_list) {
+			free(t->data);
+			t->data = NULL;
+			return;
+		}
+		memcpy(t->pos_list, pos_list, count * sizeof(u32));
+	}
+	t->count = count;
+	sqfs_stats.table_size += size;
+}
+
+void *sqfs_cache_fragment(u64 start)
+{
+	struct sqfs_cache_frag *frag;
+
+	list_for_each_entry(frag, &sqfs_frags, lh) {
+		if (frag->start == start) {
+			if (sqfs_frags.next != &frag->lh) {
+				/* maintain MRU ordering */
+				list_del(&frag->lh);
+				list_add(&frag->lh, &sqfs_frags);
+			}
+			sqfs_stats.frag_hits++;
+			return frag->data;
+		}
+	}
+	sqfs_stats.frag_misses++;
+
+	return NULL;
+}
+
+void sqfs_cache_add_fragment(u64 start, const void *data, unsigned long len)
+{
+	struct sqfs_cache_frag *frag;
+
+	if (!sqfs_stats.frag_max_entries)
+		return;
+
+	if (sqfs_stats.frag_entries >= sqfs_stats.frag_max_entries) {
+		/* reuse the least recently used block */
+		frag = list_last_entry(&sqfs_frags, struct sqfs_cache_frag, lh);
+		list_del(&frag->lh);
+		sqfs_stats.frag_entries--;
+		if (frag->len < len) {
+			free(frag->data);
+			frag->data = NULL;
+		}
+	} else {
+		frag = calloc(1, sizeof(*frag));
+		if (!frag)
+			return;
+	}
+
+	if (!frag->data) {
+		frag->data = malloc(len);
+		if (!frag->data) {
+			free(frag);
+			return;
+		}
+	}
+
+	memcpy(frag->data, data, len);
+	frag->start = start;
+	frag->len = len;
+	list_add(&frag->lh, &sqfs_frags);
+	sqfs_stats.frag_entries++;
+}
+
+void sqfs_cache_stats(struct sqfs_cache_stats *stats)
+{
+	memcpy(stats, &sqfs_stats, sizeof(*stats));
+	sqfs_stats.table_hits = 0;
+	sqfs_stats.table_misses = 0;
+	sqfs_stats.frag_hits = 0;
+	sqfs_stats.frag_misses = 0;
+}
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * sqfs_cache.h: cache of decompressed SquashFS tables and fragment blocks
+ */
+
+#ifndef SQFS_CACHE_H
+#define SQFS_CACHE_H
+
+#include <linux/types.h>
+#include "sqfs_filesystem.h"
+
+enum sqfs_cache_table_id {
+	SQFS_CACHE_INODE_TABLE,
+	SQFS_CACHE_DIR_TABLE,
+	SQFS_CACHE_TABLE_COUNT,
+};
+
+#if CONFIG_IS_ENABLED(SQUASHFS_CACHE)
+/**
+ * sqfs_cache_mount() - check the cache against the filesystem being probed
+ *
+ * Everything cached is dropped unless @ctxt refers to the same device,
+ * partition and superblock as the filesystem the cache was filled from.
+ *
+ * @ctxt:	Context of the filesystem being probed
+ */
+void sqfs_cache_mount(struct squashfs_ctxt *ctxt);
+
+/**
+ * sqfs_cache_get_table() - get a copy of a cached, decompressed table
+ *
+ * @id:		Table to look up
+ * @table:	Returns a newly allocated copy of the table
+ * @pos_list:	If not NULL, returns a newly allocated copy of the metadata
+ *		block positions of the table
+ * Return: number of metadata blocks in the table, or 0 if it is not cached
+ */
+int sqfs_cache_get_table(enum sqfs_cache_table_id id, unsigned char **table,
+			 u32 **pos_list);
+
+/**
+ * sqfs_cache_add_table() - add a copy of a decompressed table to the cache
+ *
+ * Nothing is cached if this would exceed CONFIG_SQUASHFS_CACHE_TABLE_SIZE.
+ *
+ * @id:		Table being added
+ * @table:	Decompressed table
+ * @count:	Number of metadata blocks in @table
+ * @pos_list:	Metadata block positions of the table, or NULL if none
+ */
+void sqfs_cache_add_table(enum sqfs_cache_table_id id,
+			  const unsigned char *table, int count,
+			  const u32 *pos_list);
+
+/**
+ * sqfs_cache_fragment() - look up a fragment block
+ *
+ * @start:	Position of the fragment block on disk
+ * Return: the decompressed fragment block, valid until the next call to
+ *	sqfs_cache_add_fragment(), or NULL if it is not cached
+ */
+void *sqfs_cache_fragment(u64 start);
+
+/**
+ * sqfs_cache_add_fragment() - add a copy of a fragment block to the cache
+ *
+ * @start:	Position of the fragment block on disk
+ * @data:	Decompressed fragment block
+ * @len:	Size of @data in bytes
+ */
+void sqfs_cache_add_fragment(u64 start, const void *data, unsigned long len);
+#else
+static inline void sqfs_cache_mount(struct squashfs_ctxt *ctxt) {}
+
+static inline int sqfs_cache_get_table(enum sqfs_cache_table_id id,
+				       unsigned char **table, u32 **pos_list)
+{
+	return 0;
+}
+
+static inline void sqfs_cache_add_table(enum sqfs_cache_table_id id,
+					const unsigned char *table, int count,
+					const u32 *pos_list) {}
+
+static inline void *sqfs_cache_fragment(u64 start)
+{
+	return NULL;
+}
+
+static inline void sqfs_cache_add_fragment(u64 start, const void *data,
+					   unsigned long len) {}
+#endif
+
+#endif /* SQFS_CACHE_H */
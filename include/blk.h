@@ -8,6 +8,7 @@
 #define BLK_H
 
 #include <efi.h>
+#include <errno.h>
 
 #ifdef CONFIG_SYS_64BIT_LBA
 typedef uint64_t lbaint_t;
@@ -167,6 +168,15 @@ void blkcache_fill(int iftype, int dev,
  */
 void blkcache_invalidate(int iftype, int dev);
 
+/**
+ * blkcache_free() - discard the cache and any settings for a device
+ * because the device is going away.
+ *
+ * @param iftype - IF_TYPE_x for type of device
+ * @param dev - device index of particular type
+ */
+void blkcache_free(int iftype, int dev);
+
 /**
  * blkcache_configure() - configure block cache
  *
@@ -175,12 +185,28 @@ void blkcache_invalidate(int iftype, int dev);
  */
 void blkcache_configure(unsigned blocks, unsigned entries);
 
+/**
+ * blkcache_configure_dev() - configure block cache for a single device
+ *
+ * The device keeps this size until it is changed again with this function;
+ * blkcache_configure() no longer affects it.
+ *
+ * @param iftype - IF_TYPE_x for type of device
+ * @param dev - device index of particular type
+ * @param blocks - maximum blocks per entry
+ * @param entries - maximum entries in cache
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+int blkcache_configure_dev(int iftype, int dev, unsigned blocks,
+			   unsigned entries);
+
 /*
  * statistics of the block cache
  */
 struct block_cache_stats {
 	unsigned hits;
 	unsigned misses;
+	unsigned evictions;
 	unsigned entries; /* current entry count */
 	unsigned max_blocks_per_entry;
 	unsigned max_entries;
@@ -189,10 +215,24 @@ struct block_cache_stats {
 /**
  * get_blkcache_stats() - return statistics and reset
  *
+ * This resets the per-device statistics as well.
+ *
  * @param stats - statistics are copied here
  */
 void blkcache_stats(struct block_cache_stats *stats);
 
+/**
+ * blkcache_dev_stats() - return statistics for a cached device
+ *
+ * @param index - index of the device in the cache (0 for the first)
+ * @param iftypep - returns IF_TYPE_x for type of device
+ * @param devp - returns device index of particular type
+ * @param stats - statistics are copied here
+ * Return: 0 if OK, -ENOENT if there is no device at @index
+ */
+int blkcache_dev_stats(int index, int *iftypep, int *devp,
+		       struct block_cache_stats *stats);
+
 #else
 
 static inline int blkcache_read(int iftype, int dev,
@@ -208,11 +248,54 @@ static inline void blkcache_fill(int iftype, int dev,
 
 static inline void blkcache_invalidate(int iftype, int dev) {}
 
+static inline void blkcache_free(int iftype, int dev) {}
+
 #endif
 
 #if CONFIG_IS_ENABLED(BLK)
 struct udevice;
 
+/**
+ * enum blk_req_op - operation performed by a queued block request
+ *
+ * @BLK_REQ_READ:	Read from the device into the buffer
+ * @BLK_REQ_WRITE:	Write the buffer to the device
+ */
+enum blk_req_op {
+	BLK_REQ_READ,
+	BLK_REQ_WRITE,
+};
+
+/* Time the device may take to finish a queued request, in milliseconds */
+#define BLK_REQ_TIMEOUT_MS	30000
+
+/**
+ * struct blk_req - a block request which can be queued to a device
+ *
+ * The caller fills in @op, @start, @blkcnt and @buffer and passes the
+ * request to blk_submit(). The request and its buffer must stay valid until
+ * @done is set, which happens in blk_submit() or in a later blk_poll(), or
+ * until the request is passed to blk_cancel().
+ *
+ * @op:		Operation to perform
+ * @start:	Start block number (0=first)
+ * @blkcnt:	Number of blocks to transfer
+ * @buffer:	Data buffer
+ * @result:	Number of blocks transferred, or -ve error number. Valid once
+ *		@done is set
+ * @done:	true when the request has finished
+ * @pending:	For use by the driver while the request is in flight
+ */
+struct blk_req {
+	enum blk_req_op op;
+	lbaint_t start;
+	lbaint_t blkcnt;
+	void *buffer;
+	long result;
+	bool done;
+	uint pending;
+};
+
 /* Operations on block devices */
 struct blk_ops {
 	/**
@@ -271,6 +354,46 @@ struct blk_ops {
 	 * @return 0 if OK, -ve on error
 	 */
 	int (*select_hwpart)(struct udevice *dev, int hwpart);
+
+	/**
+	 * submit() - start a request without waiting for it to finish
+	 *
+	 * This method is optional. Devices without it handle blk_submit()
+	 * synchronously using read() and write().
+	 *
+	 * The driver must set @req->result and then @req->done when the
+	 * request finishes, either here or from poll().
+	 *
+	 * @dev:	Device to use
+	 * @req:	Request to start
+	 * @return 0 if OK, -EBUSY if the device queue is full (call poll()
+	 *	and try again), other -ve on error
+	 */
+	int (*submit)(struct udevice *dev, struct blk_req *req);
+
+	/**
+	 * poll() - process finished requests
+	 *
+	 * This must be provided if submit() is.
+	 *
+	 * @dev:	Device to poll
+	 * @return number of requests finished, or -ve on error
+	 */
+	int (*poll)(struct udevice *dev);
+
+	/**
+	 * cancel() - give up on a request which has not finished
+	 *
+	 * This must be provided if submit() is. Once it returns, the driver
+	 * does not access @req again, so the caller may free it. The driver
+	 * keeps any resources the device may still be using until the device
+	 * is done with them.
+	 *
+	 * @dev:	Device to use
+	 * @req:	Request to cancel
+	 * @return 0 if OK, -ve on error
+	 */
+	int (*cancel)(struct udevice *dev, struct blk_req *req);
 };
 
 #define blk_get_ops(dev)	((struct blk_ops *)(dev)->driver->ops)
@@ -288,6 +411,131 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 			 lbaint_t blkcnt);
 
+/**
+ * blk_submit() - start a block request
+ *
+ * If the device supports queued requests this returns as soon as the
+ * request is queued. Otherwise the request is carried out before returning.
+ * In both cases @req->done is set once the request has finished.
+ *
+ * @dev:	Block device
+ * @req:	Request to start
+ * Return: 0 if OK, -EBUSY if the device queue is full (call blk_poll() and
+ *	try again), other -ve on error
+ */
+int blk_submit(struct udevice *dev, struct blk_req *req);
+
+/**
+ * blk_poll() - process finished block requests
+ *
+ * @dev:	Block device
+ * Return: number of requests finished, or -ve on error
+ */
+int blk_poll(struct udevice *dev);
+
+/**
+ * blk_cancel() - give up on a block request
+ *
+ * Once this returns, the device no longer accesses @req. Nothing is done if
+ * the request has already finished.
+ *
+ * @dev:	Block device
+ * @req:	Request previously passed to blk_submit()
+ * Return: 0 if OK, -ve on error
+ */
+int blk_cancel(struct udevice *dev, struct blk_req *req);
+
+/**
+ * blk_wait() - wait for a block request to finish
+ *
+ * The request is cancelled if polling fails, or if no request on the device
+ * finishes for BLK_REQ_TIMEOUT_MS.
+ *
+ * @dev:	Block device
+ * @req:	Request previously passed to blk_submit()
+ * Return: number of blocks transferred, -ETIMEDOUT if the request was
+ *	cancelled because the device stopped responding, or other -ve on error
+ */
+long blk_wait(struct udevice *dev, struct blk_req *req);
+
+/**
+ * struct blk_readahead - sequential read-ahead state of a block device
+ *
+ * This is the uclass-private data of each block device when
+ * CONFIG_BLK_READAHEAD is enabled.
+ *
+ * @window:	Number of blocks to read in one go when sequential access is
+ *		seen, or 0 if read-ahead is disabled
+ * @next:	Block following the last one read, to detect sequential access
+ * @start:	First block held in @buf
+ * @cnt:	Number of valid blocks in @buf (0 if empty)
+ * @buf:	Read-ahead buffer, allocated on first use
+ * @buf_blocks:	Size of @buf in blocks
+ * @hits:	Number of reads satisfied entirely from @buf
+ * @misses:	Number of reads which needed the device
+ * @fills:	Number of times @buf was filled from the device
+ */
+struct blk_readahead {
+	lbaint_t window;
+	lbaint_t next;
+	lbaint_t start;
+	lbaint_t cnt;
+	void *buf;
+	lbaint_t buf_blocks;
+	uint hits;
+	uint misses;
+	uint fills;
+};
+
+/**
+ * struct blk_readahead_stats - read-ahead settings and statistics
+ *
+ * @window:	Read-ahead window in blocks (0 if disabled)
+ * @hits:	Number of reads satisfied entirely from the read-ahead buffer
+ * @misses:	Number of reads which needed the device
+ * @fills:	Number of read-ahead reads sent to the device
+ */
+struct blk_readahead_stats {
+	lbaint_t window;
+	uint hits;
+	uint misses;
+	uint fills;
+};
+
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+/**
+ * blk_set_readahead() - Set the read-ahead window of a block device
+ *
+ * This drops any data held in the read-ahead buffer and resets the
+ * statistics.
+ *
+ * @dev:	Block device (must be probed)
+ * @window:	Number of blocks to read ahead, or 0 to disable read-ahead
+ * Return: 0 if OK, -EINVAL if the device is not probed
+ */
+int blk_set_readahead(struct udevice *dev, lbaint_t window);
+
+/**
+ * blk_get_readahead() - Get read-ahead settings and statistics
+ *
+ * @dev:	Block device (must be probed)
+ * @stats:	Returns the settings and statistics
+ * Return: 0 if OK, -EINVAL if the device is not probed
+ */
+int blk_get_readahead(struct udevice *dev, struct blk_readahead_stats *stats);
+#else
+static inline int blk_set_readahead(struct udevice *dev, lbaint_t window)
+{
+	return -ENOSYS;
+}
+
+static inline int blk_get_readahead(struct udevice *dev,
+				    struct blk_readahead_stats *stats)
+{
+	return -ENOSYS;
+}
+#endif
+
 /**
  * blk_find_device() - Find a block device
  *
@@ -443,7 +691,6 @@ int blk_get_from_parent(struct udevice *parent, struct udevice **devp);
 struct blk_desc *blk_get_by_device(struct udevice *dev);
 
 #else
-#include <errno.h>
 /*
  * These functions should take struct udevice instead of struct blk_desc,
  * but this is convenient for migration to driver model. Add a 'd' prefix
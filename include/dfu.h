@@ -114,6 +114,8 @@ struct dfu_entity {
 	enum dfu_device_type    dev_type;
 	enum dfu_layout         layout;
 	unsigned long           max_buf_size;
+	/* largest piece of a queued buffer written at once, 0 for no limit */
+	unsigned long           max_write_size;
 
 	union {
 		struct mmc_internal_data mmc;
@@ -151,6 +153,11 @@ struct dfu_entity {
 
 	u32 bad_skip;	/* for nand use */
 
+	/* transfer statistics, in ms */
+	ulong start_time;
+	ulong write_time;
+	ulong wait_time;
+
 	unsigned int inited:1;
 };
 
@@ -294,6 +301,24 @@ int dfu_init_env_entities(char *interface, char *devstr);
 unsigned char *dfu_get_buf(struct dfu_entity *dfu);
 unsigned char *dfu_free_buf(void);
 unsigned long dfu_get_buf_size(void);
+
+/**
+ * dfu_set_write_async() - write downloads from dfu_write_poll()
+ *
+ * When enabled, dfu_write() queues full buffers and returns as long as a
+ * free buffer is left (see CONFIG_DFU_WRITE_BUFS). The caller must then
+ * call dfu_write_poll() regularly until dfu_flush() is called.
+ *
+ * @async:	true to queue buffers, false to write them synchronously
+ */
+void dfu_set_write_async(bool async);
+
+/**
+ * dfu_write_poll() - write a piece of the oldest queued buffer
+ *
+ * An error is reported by the next dfu_write() or dfu_flush() call.
+ */
+void dfu_write_poll(void);
 bool dfu_usb_get_reset(void);
 
 #ifdef CONFIG_DFU_TIMEOUT
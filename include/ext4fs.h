@@ -125,6 +125,21 @@ struct ext_block_cache {
 	int size;
 };
 
+/**
+ * struct ext4_cache_stats - statistics of the ext4 metadata cache
+ *
+ * @hits:	Number of metadata reads served from the cache
+ * @misses:	Number of metadata reads that went to the device
+ * @entries:	Number of blocks currently cached
+ * @max_entries: Maximum number of blocks cached
+ */
+struct ext4_cache_stats {
+	unsigned hits;
+	unsigned misses;
+	unsigned entries;
+	unsigned max_entries;
+};
+
 extern struct ext2_data *ext4fs_root;
 extern struct ext2fs_node *ext4fs_file;
 
@@ -157,8 +172,12 @@ int ext4fs_devread(lbaint_t sector, int byte_offset, int byte_len, char *buf);
 void ext4fs_set_blk_dev(struct blk_desc *rbdd, struct disk_partition *info);
 long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 			      struct ext_block_cache *cache);
+long int ext4fs_map_blocks(struct ext2_inode *inode, int fileblock,
+			   struct ext_block_cache *cache, long int *blknrp);
 int ext4fs_probe(struct blk_desc *fs_dev_desc,
 		 struct disk_partition *fs_partition);
+int ext4fs_revalidate(struct blk_desc *fs_dev_desc,
+		      struct disk_partition *fs_partition);
 int ext4_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
 		   loff_t *actread);
 int ext4_read_superblock(char *buffer);
@@ -166,4 +185,51 @@ int ext4fs_uuid(char *uuid_str);
 void ext_cache_init(struct ext_block_cache *cache);
 void ext_cache_fini(struct ext_block_cache *cache);
 int ext_cache_read(struct ext_block_cache *cache, lbaint_t block, int size);
+
+#if CONFIG_IS_ENABLED(EXT4_CACHE)
+/**
+ * ext4fs_read_meta() - read filesystem metadata through the metadata cache
+ *
+ * This takes the same arguments as ext4fs_devread(). Reads which fit in one
+ * filesystem block are served from the cache, which is kept from one mount
+ * of the same filesystem to the next.
+ *
+ * Return: 1 on success, 0 on error
+ */
+int ext4fs_read_meta(lbaint_t sector, int byte_offset, int byte_len,
+		     char *buf);
+
+/**
+ * ext4fs_cache_mount() - check the metadata cache against a new mount
+ *
+ * The cache is dropped unless @sb is the superblock of the filesystem it
+ * was filled from, on the same device and partition.
+ *
+ * @sb:		Superblock of the filesystem being mounted
+ */
+void ext4fs_cache_mount(struct ext2_sblock *sb);
+
+/**
+ * ext4fs_cache_invalidate() - drop everything in the metadata cache
+ */
+void ext4fs_cache_invalidate(void);
+
+/**
+ * ext4fs_cache_stats() - return metadata cache statistics
+ *
+ * The hit and miss counters are reset afterwards.
+ *
+ * @stats:	Returns the statistics
+ */
+void ext4fs_cache_stats(struct ext4_cache_stats *stats);
+#else
+static inline int ext4fs_read_meta(lbaint_t sector, int byte_offset,
+				   int byte_len, char *buf)
+{
+	return ext4fs_devread(sector, byte_offset, byte_len, buf);
+}
+
+static inline void ext4fs_cache_mount(struct ext2_sblock *sb) {}
+static inline void ext4fs_cache_invalidate(void) {}
+#endif
 #endif
@@ -18,6 +18,14 @@ extern u32 fastboot_buf_size;
  */
 extern void (*fastboot_progress_callback)(const char *msg);
 
+/**
+ * fastboot_download_limit() - Get the size of the largest download accepted
+ *
+ * Return: Size of the download buffer, or U32_MAX if the next download is
+ * written to storage while it is received
+ */
+u32 fastboot_download_limit(void);
+
 /**
  * fastboot_getvar() - Writes variable indicated by cmd_parameter to response.
  *
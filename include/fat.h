@@ -26,6 +26,12 @@ struct disk_partition;
 			 sizeof(dir_entry))
 
 #define FATBUFBLOCKS	6
+/* Number of FATBUFBLOCKS windows of the FAT which are cached */
+#ifdef CONFIG_SPL_BUILD
+#define FATBUFWINDOWS	1
+#else
+#define FATBUFWINDOWS	8
+#endif
 #define FATBUFSIZE	(mydata->sect_size * FATBUFBLOCKS)
 #define FAT12BUFSIZE	((FATBUFSIZE*2)/3)
 #define FAT16BUFSIZE	(FATBUFSIZE/2)
@@ -168,16 +174,18 @@ typedef struct dir_slot {
  * (see FAT32 accesses)
  */
 typedef struct {
-	__u8	*fatbuf;	/* Current FAT buffer */
+	__u8	*fatbuf;	/* FAT buffer, FATBUFWINDOWS windows */
 	int	fatsize;	/* Size of FAT in bits */
 	__u32	fatlength;	/* Length of FAT in sectors */
 	__u16	fat_sect;	/* Starting sector of the FAT */
-	__u8	fat_dirty;      /* Set if fatbuf has been modified */
+	__u8	fat_dirty;      /* Set if the current window has been modified */
 	__u32	rootdir_sect;	/* Start sector of root directory */
 	__u16	sect_size;	/* Size of sectors in bytes */
 	__u16	clust_size;	/* Size of clusters in sectors */
 	int	data_begin;	/* The sector of the first cluster, can be negative */
-	int	fatbufnum;	/* Used by get_fatent, init to -1 */
+	int	fatbufnum;	/* Window in fatlru[0], init to -1 */
+	int	fatwin[FATBUFWINDOWS];	/* Window held by each slot */
+	__u8	fatlru[FATBUFWINDOWS];	/* Slots, most recently used first */
 	int	rootdir_size;	/* Size of root dir for non-FAT32 */
 	__u32	root_cluster;	/* First cluster of root dir for FAT32 */
 	u32	total_sect;	/* Number of sectors */
@@ -204,6 +212,7 @@ int file_fat_read_at(const char *filename, loff_t pos, void *buffer,
 		     loff_t maxsize, loff_t *actread);
 int file_fat_read(const char *filename, void *buffer, int maxsize);
 int fat_set_blk_dev(struct blk_desc *rbdd, struct disk_partition *info);
+int fat_revalidate(struct blk_desc *dev_desc, struct disk_partition *info);
 int fat_register_device(struct blk_desc *dev_desc, int part_no);
 
 int file_fat_write(const char *filename, void *buf, loff_t offset, loff_t len,
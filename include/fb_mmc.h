@@ -39,4 +39,37 @@ void fastboot_mmc_flash_write(const char *cmd, void *download_buffer,
  * @response: Pointer to fastboot response buffer
  */
 void fastboot_mmc_erase(const char *cmd, char *response);
+
+/**
+ * fastboot_mmc_stream_open() - Prepare to write an image while downloading
+ *
+ * @cmd: Named partition to write image to
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 if OK, -ve on error
+ */
+int fastboot_mmc_stream_open(const char *cmd, char *response);
+
+/**
+ * fastboot_mmc_stream_write() - Write the next piece of a streamed image
+ *
+ * Only whole blocks and complete sparse headers are consumed, unless @last
+ * is set. The caller passes what was not consumed again with the next
+ * piece of the image.
+ *
+ * @buffer: Image data following what was consumed by the previous call
+ * @len: Number of bytes available at @buffer
+ * @last: true if this is the end of the image
+ * @response: Pointer to fastboot response buffer
+ * Return: number of bytes consumed, or -1 on error
+ */
+long fastboot_mmc_stream_write(const void *buffer, u32 len, bool last,
+			       char *response);
+
+/**
+ * fastboot_mmc_stream_close() - Finish writing a streamed image
+ *
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 if OK, -1 on error
+ */
+int fastboot_mmc_stream_close(char *response);
 #endif
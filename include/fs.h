@@ -80,6 +80,88 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part);
  */
 void fs_close(void);
 
+/* Largest amount of data a filesystem can keep per path in the dentry cache */
+#define FS_DCACHE_DATA_MAX	32
+
+/**
+ * struct fs_cache_stats - statistics of the filesystem mount cache
+ *
+ * @mounts:	Number of times a filesystem was probed and kept mounted
+ * @reuses:	Number of times a kept filesystem was reused instead
+ * @hits:	Number of path lookups found in the dentry cache
+ * @misses:	Number of path lookups not found in the dentry cache
+ * @entries:	Number of paths in the dentry cache
+ * @max_entries: Maximum number of paths in the dentry cache
+ */
+struct fs_cache_stats {
+	unsigned mounts;
+	unsigned reuses;
+	unsigned hits;
+	unsigned misses;
+	unsigned entries;
+	unsigned max_entries;
+};
+
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+/**
+ * fs_dcache_lookup() - look up a path in the dentry cache
+ *
+ * Filesystems call this while resolving a path. The cache only holds paths
+ * of the filesystem currently in use, and only while it is kept mounted.
+ *
+ * @path:	Path as passed to the filesystem
+ * @data:	Returns the data stored with fs_dcache_add()
+ * @size:	Size of @data, which must match the size it was stored with
+ * Return: 0 if found, -ENOENT if not
+ */
+int fs_dcache_lookup(const char *path, void *data, int size);
+
+/**
+ * fs_dcache_add() - add a resolved path to the dentry cache
+ *
+ * @path:	Path as passed to the filesystem
+ * @data:	Data the filesystem needs to find the file again, e.g. its inode
+ *		number
+ * @size:	Size of @data, at most FS_DCACHE_DATA_MAX bytes
+ */
+void fs_dcache_add(const char *path, const void *data, int size);
+
+/**
+ * fs_cache_stats() - get the mount cache statistics
+ *
+ * The counters are reset after being read.
+ *
+ * @stats:	Returns the statistics
+ */
+void fs_cache_stats(struct fs_cache_stats *stats);
+
+/**
+ * fs_cache_flush() - unmount any kept filesystem and empty the dentry cache
+ */
+void fs_cache_flush(void);
+
+/**
+ * fs_cache_invalidate() - drop the kept filesystem if it is on a device
+ *
+ * This is called when blocks are written to or erased on a device outside
+ * the filesystem code, e.g. by ums, fastboot, dfu or 'mmc write', since the
+ * kept filesystem and its dentry cache may no longer match the disk.
+ *
+ * @desc:	Block device which was changed
+ */
+void fs_cache_invalidate(struct blk_desc *desc);
+#else
+static inline int fs_dcache_lookup(const char *path, void *data, int size)
+{
+	return -ENOENT;
+}
+
+static inline void fs_dcache_add(const char *path, const void *data,
+				 int size) {}
+static inline void fs_cache_flush(void) {}
+static inline void fs_cache_invalidate(struct blk_desc *desc) {}
+#endif
+
 /**
  * fs_get_type() - Get type of current filesystem
  *
@@ -13,4 +13,56 @@
 int fs_devread(struct blk_desc *, struct disk_partition *, lbaint_t, int, int,
 	       char *);
 
+#if CONFIG_IS_ENABLED(FS_BOUNCE_STATS)
+/**
+ * fs_bounce_track() - set the destination of the file read in progress
+ *
+ * Only copies into this buffer are counted by fs_bounce_add().
+ *
+ * @buf:	Destination buffer, or NULL once the read is done
+ * @len:	Size of @buf, or 0 if the whole file is read. The filesystem
+ *		then gives the size with fs_bounce_set_len()
+ */
+void fs_bounce_track(void *buf, loff_t len);
+
+/**
+ * fs_bounce_set_len() - set the size of a destination of unknown length
+ *
+ * Filesystems call this once a read of the whole file has looked the file
+ * up, so that metadata copied to buffers beyond the file data is not
+ * counted. It has no effect if the caller gave the length of the read.
+ *
+ * @len:	Number of bytes the read will store
+ */
+void fs_bounce_set_len(loff_t len);
+
+/**
+ * fs_bounce_add() - count file data which did not go straight to the caller
+ *
+ * Filesystems call this when they copy file data into the destination
+ * from a temporary buffer, or hand a destination which is not DMA-aligned
+ * to the block layer, which makes DMA drivers bounce it.
+ *
+ * @dst:	Where the data ends up
+ * @len:	Number of bytes
+ */
+void fs_bounce_add(const void *dst, size_t len);
+
+/**
+ * fs_bounce_bytes() - get and reset the number of bounced bytes
+ *
+ * Return: bytes counted by fs_bounce_add() since the last call
+ */
+u64 fs_bounce_bytes(void);
+#else
+static inline void fs_bounce_track(void *buf, loff_t len) {}
+static inline void fs_bounce_set_len(loff_t len) {}
+static inline void fs_bounce_add(const void *dst, size_t len) {}
+
+static inline u64 fs_bounce_bytes(void)
+{
+	return 0;
+}
+#endif
+
 #endif /* __U_BOOT_FS_INTERNAL_H__ */
@@ -67,7 +67,8 @@ void gzwrite_progress_finish(int retcode, ulong totalwritten, ulong totalsize,
  * @src:	compressed image address
  * @len:	compressed image length in bytes
  * @dev:	block device descriptor
- * @szwritebuf:	bytes per write (pad to erase size)
+ * @szwritebuf:	bytes per write (pad to erase size), rounded up to a whole
+ *		number of erase groups on MMC devices
  * @startoffs:	offset in bytes of first write
  * @szexpected:	expected uncompressed length, may be zero to use gzip trailer
  *		for files under 4GiB
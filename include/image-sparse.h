@@ -24,6 +24,16 @@ struct sparse_storage {
 				 lbaint_t blk,
 				 lbaint_t blkcnt);
 
+	/*
+	 * Optional: make blocks read back as zeroes without writing them.
+	 * Only called for whole groups of erase_grp blocks, aligned to
+	 * erase_grp. Returns the number of blocks erased.
+	 */
+	lbaint_t	(*erase)(struct sparse_storage *info,
+				 lbaint_t blk,
+				 lbaint_t blkcnt);
+	lbaint_t	erase_grp;
+
 	void		(*mssg)(const char *str, char *response);
 };
 
@@ -38,5 +48,88 @@ static inline int is_sparse_image(void *buf)
 	return 0;
 }
 
+/**
+ * struct sparse_stream - state of a sparse image written piece by piece
+ *
+ * @info:	Storage the image is written to
+ * @header:	Copy of the sparse image header
+ * @chunk_header: Copy of the header of the current chunk
+ * @header_done: true once @header has been parsed
+ * @in_chunk:	true while the payload of the current chunk is consumed
+ * @chunk:	Index of the current chunk
+ * @chunk_left:	Payload bytes of the current chunk not consumed yet
+ * @blk:	Next block to write on the storage, where @raw_buf goes
+ * @blkcnt:	Number of storage blocks covered by the current chunk
+ * @bytes_written: Number of bytes written or reserved so far
+ * @total_blocks: Number of sparse blocks processed so far
+ * @raw_buf:	Aligned buffer collecting small or misaligned RAW data
+ * @raw_blks:	Number of blocks in @raw_buf not written yet
+ * @fill_buf:	Buffer holding @fill_val, used for FILL chunks
+ * @fill_val:	Value @fill_buf is filled with
+ */
+struct sparse_stream {
+	struct sparse_storage	*info;
+	sparse_header_t		header;
+	chunk_header_t		chunk_header;
+	bool			header_done;
+	bool			in_chunk;
+	unsigned int		chunk;
+	u64			chunk_left;
+	lbaint_t		blk;
+	lbaint_t		blkcnt;
+	u64			bytes_written;
+	u32			total_blocks;
+	void			*raw_buf;
+	lbaint_t		raw_blks;
+	u32			*fill_buf;
+	u32			fill_val;
+};
+
 int write_sparse_image(struct sparse_storage *info, const char *part_name,
 		       void *data, char *response);
+
+/**
+ * sparse_stream_init() - Start writing a sparse image piece by piece
+ *
+ * @ss: Stream state to initialise
+ * @info: Storage to write the image to
+ */
+void sparse_stream_init(struct sparse_stream *ss, struct sparse_storage *info);
+
+/**
+ * sparse_stream_write() - Write the next piece of a sparse image
+ *
+ * Headers are only parsed once they are complete and raw data is only
+ * consumed in whole storage blocks. Whatever is not consumed must be passed
+ * again, followed by more data, in the next call. Consumed raw data may be
+ * held back to be merged with the following chunks, it is written by
+ * sparse_stream_finish() at the latest. On error the stream is released.
+ *
+ * @ss: Stream state
+ * @data: Image data following what was consumed by the previous call
+ * @len: Number of bytes available at @data
+ * @response: Pointer to fastboot response buffer
+ * Return: number of bytes consumed, or -1 on error
+ */
+long sparse_stream_write(struct sparse_stream *ss, const void *data,
+			 size_t len, char *response);
+
+/**
+ * sparse_stream_finish() - Check that a sparse image was written completely
+ *
+ * Writes out pending data and releases the buffers of the stream.
+ *
+ * @ss: Stream state
+ * @part_name: Name of the partition, for messages
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 if OK, -1 on error
+ */
+int sparse_stream_finish(struct sparse_stream *ss, const char *part_name,
+			 char *response);
+
+/**
+ * sparse_stream_release() - Free the buffers of an abandoned stream
+ *
+ * @ss: Stream state
+ */
+void sparse_stream_release(struct sparse_stream *ss);
@@ -371,6 +371,7 @@ struct vlan_ethernet_hdr {
 #define PROT_NCSI	0x88f8		/* NC-SI control packets        */
 
 #define IPPROTO_ICMP	 1	/* Internet Control Message Protocol	*/
+#define IPPROTO_TCP	 6	/* Transmission Control Protocol	*/
 #define IPPROTO_UDP	17	/* User Datagram Protocol		*/
 
 /*
@@ -564,7 +565,7 @@ extern int		net_restart_wrap;	/* Tried all network devices */
 
 enum proto_t {
 	BOOTP, RARP, ARP, TFTPGET, DHCP, PING, DNS, NFS, CDP, NETCONS, SNTP,
-	TFTPSRV, TFTPPUT, LINKLOCAL, FASTBOOT, WOL, UDP
+	TFTPSRV, TFTPPUT, LINKLOCAL, FASTBOOT, WOL, UDP, WGET, PING6
 };
 
 extern char	net_boot_file_name[1024];/* Boot File name */
@@ -713,6 +714,19 @@ int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport,
 /* Processes a received packet */
 void net_process_received_packet(uchar *in_packet, int len);
 
+/**
+ * arp_cache_show() - print the entries of the ARP cache
+ */
+void arp_cache_show(void);
+
+/**
+ * arp_cache_delete() - remove entries from the ARP cache
+ *
+ * @ip:		IP address of the entry to remove, or 0 to remove all
+ * Return: 0 if OK, -ENOENT if there was no such entry
+ */
+int arp_cache_delete(struct in_addr ip);
+
 #if defined(CONFIG_NETCONSOLE) && !defined(CONFIG_SPL_BUILD)
 void nc_start(void);
 int nc_input_packet(uchar *pkt, struct in_addr src_ip, unsigned dest_port,
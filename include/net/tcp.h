@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Minimal TCP client for the U-Boot network loop
+ */
+
+#ifndef __TCP_H__
+#define __TCP_H__
+
+#include <net.h>
+
+/*
+ *	TCP header, without options.
+ */
+struct tcp_hdr {
+	u16		tcp_src;	/* TCP source port		*/
+	u16		tcp_dst;	/* TCP destination port		*/
+	u32		tcp_seq;	/* Sequence number		*/
+	u32		tcp_ack;	/* Acknowledgment number	*/
+	u8		tcp_hlen;	/* Header length in words << 4	*/
+	u8		tcp_flags;	/* TCP_FIN, TCP_SYN, ...	*/
+	u16		tcp_win;	/* Receive window		*/
+	u16		tcp_xsum;	/* Checksum			*/
+	u16		tcp_urg;	/* Urgent pointer		*/
+} __attribute__((packed));
+
+#define TCP_HDR_SIZE		(sizeof(struct tcp_hdr))
+#define IP_TCP_HDR_SIZE		(IP_HDR_SIZE + TCP_HDR_SIZE)
+
+#define TCP_FIN		0x01
+#define TCP_SYN		0x02
+#define TCP_RST		0x04
+#define TCP_PUSH	0x08
+#define TCP_ACK		0x10
+
+#define TCP_OPT_EOL	0
+#define TCP_OPT_NOP	1
+#define TCP_OPT_MSS	2
+#define TCP_OPT_WS	3
+
+/* Largest segment we accept, for a 1500 byte Ethernet MTU */
+#define TCP_MSS		(1500 - IP_TCP_HDR_SIZE)
+
+/**
+ * enum tcp_event - connection events reported to the TCP user
+ *
+ * @TCP_EV_CONNECTED:	the connection is established, data can be sent
+ * @TCP_EV_CLOSED:	the peer has sent all its data and closed its side
+ * @TCP_EV_RESET:	the peer reset the connection
+ * @TCP_EV_TIMEOUT:	the peer stopped responding
+ */
+enum tcp_event {
+	TCP_EV_CONNECTED,
+	TCP_EV_CLOSED,
+	TCP_EV_RESET,
+	TCP_EV_TIMEOUT,
+};
+
+/**
+ * rxhand_tcp_f - called with data received on the connection, in order
+ *
+ * @data:	received data
+ * @len:	number of bytes at @data
+ */
+typedef void rxhand_tcp_f(const uchar *data, unsigned int len);
+
+/**
+ * tcp_event_f - called when the state of the connection changes
+ *
+ * @event:	what happened
+ */
+typedef void tcp_event_f(enum tcp_event event);
+
+/**
+ * tcp_connect() - open a connection
+ *
+ * Only one connection can be open at a time. It is driven by the network
+ * loop, which must be running (see net_loop()); the connection uses the
+ * timeout handler of the loop until it is closed.
+ *
+ * @dest:	IP address of the server
+ * @dport:	TCP port of the server
+ * @rx:		handler for received data
+ * @event:	handler for connection events
+ * Return: 0 if the SYN was sent, -ve on error
+ */
+int tcp_connect(struct in_addr dest, u16 dport, rxhand_tcp_f *rx,
+		tcp_event_f *event);
+
+/**
+ * tcp_send() - send data on the connection
+ *
+ * The data is copied, and sent again until the peer acknowledges it.
+ * Previously sent data must have been acknowledged.
+ *
+ * @data:	data to send
+ * @len:	number of bytes to send, at most TCP_MSS
+ * Return: 0 if OK, -ve on error
+ */
+int tcp_send(const void *data, unsigned int len);
+
+/**
+ * tcp_close() - close our side of the connection
+ *
+ * A FIN is sent, data from the peer is still received until it closes
+ * its side too.
+ */
+void tcp_close(void);
+
+/**
+ * tcp_abort() - reset the connection
+ *
+ * An RST is sent to the peer and nothing more is received.
+ */
+void tcp_abort(void);
+
+/**
+ * tcp_release() - forget the connection and free its buffers
+ *
+ * Nothing is sent to the peer. This is called when the network loop ends.
+ */
+void tcp_release(void);
+
+/**
+ * tcp_set_tcp_header() - set up the IP and TCP headers of a segment
+ *
+ * @pkt:		start of the IP header
+ * @dest:		destination IP address
+ * @dport:		destination port
+ * @sport:		source port
+ * @payload_len:	number of data bytes following the headers
+ * @action:		TCP flags
+ * @tcp_seq_num:	sequence number
+ * @tcp_ack_num:	acknowledgment number
+ * Return: size of the IP and TCP headers, including options
+ */
+int tcp_set_tcp_header(uchar *pkt, struct in_addr dest, int dport, int sport,
+		       int payload_len, u8 action, u32 tcp_seq_num,
+		       u32 tcp_ack_num);
+
+/**
+ * tcp_receive() - handle a received TCP segment
+ *
+ * @ip:		IP header of the segment
+ * @len:	length of the IP datagram
+ */
+void tcp_receive(struct ip_hdr *ip, unsigned int len);
+
+#endif /* __TCP_H__ */
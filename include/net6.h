@@ -0,0 +1,387 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * IPv6 definitions and the interface of the IPv6 network code
+ *
+ * The IPv6 path sits next to the IPv4 one in net.c: packets with the IPv6
+ * Ethernet type are passed to net_ip6_handler(), neighbour discovery takes
+ * the place of ARP, and UDP payloads are handed to the same UDP handler as
+ * IPv4 ones, so that protocols such as TFTP only need to choose the address
+ * they send to.
+ */
+
+#ifndef __NET6_H__
+#define __NET6_H__
+
+#include <net.h>
+#include <linux/errno.h>
+#include <linux/string.h>
+
+/* IPv6 address */
+struct in6_addr {
+	union {
+		u8	u6_addr8[16];
+		__be16	u6_addr16[8];
+		__be32	u6_addr32[4];
+	} in6_u;
+#define s6_addr		in6_u.u6_addr8
+#define s6_addr16	in6_u.u6_addr16
+#define s6_addr32	in6_u.u6_addr32
+} __packed;
+
+#define IN6ADDRSZ	sizeof(struct in6_addr)
+
+/* Longest text form of an address, with the terminating nul */
+#define INET6_ADDRSTRLEN	46
+
+/*
+ *	IPv6 header
+ */
+struct ip6_hdr {
+	__be32		ip6_vfc;	/* version, class and flow label */
+	__be16		ip6_plen;	/* payload length		*/
+	u8		ip6_nxt;	/* next header			*/
+	u8		ip6_hlim;	/* hop limit			*/
+	struct in6_addr	ip6_src;	/* source address		*/
+	struct in6_addr	ip6_dst;	/* destination address		*/
+} __packed;
+
+#define IP6_HDR_SIZE		(sizeof(struct ip6_hdr))
+#define IP6_VERSION		6
+#define IP6_HOP_LIMIT		64
+
+/*
+ *	UDP header, for use after an IPv6 header
+ */
+struct udp_hdr {
+	__be16		udp_src;	/* UDP source port		*/
+	__be16		udp_dst;	/* UDP destination port		*/
+	__be16		udp_len;	/* Length of UDP packet		*/
+	__be16		udp_xsum;	/* Checksum			*/
+} __packed;
+
+#define IP6_UDP_HDR_SIZE	(IP6_HDR_SIZE + sizeof(struct udp_hdr))
+
+#define IPPROTO_ICMPV6		58	/* ICMP for IPv6		*/
+
+/*
+ *	ICMPv6 header
+ */
+struct icmp6_hdr {
+	u8		icmp6_type;
+	u8		icmp6_code;
+	__be16		icmp6_cksum;
+	union {
+		struct {
+			__be16	id;
+			__be16	sequence;
+		} echo;
+		/* router advertisement */
+		struct {
+			u8	hop_limit;
+			u8	flags;
+			__be16	lifetime;
+		} ra;
+		/* neighbour advertisement flags */
+		__be32		na_flags;
+		__be32		reserved;
+	} un;
+} __packed;
+
+#define ICMP6_HDR_SIZE		(sizeof(struct icmp6_hdr))
+
+#define ICMPV6_ECHO_REQUEST	128
+#define ICMPV6_ECHO_REPLY	129
+#define ICMPV6_ROUTER_SOLICIT	133
+#define ICMPV6_ROUTER_ADVERT	134
+#define ICMPV6_NEIGHBOUR_SOLICIT	135
+#define ICMPV6_NEIGHBOUR_ADVERT		136
+
+/* Neighbour advertisement flags */
+#define ICMPV6_NA_ROUTER	0x80000000
+#define ICMPV6_NA_SOLICITED	0x40000000
+#define ICMPV6_NA_OVERRIDE	0x20000000
+
+/* Neighbour discovery option */
+struct nd_opt_hdr {
+	u8		nd_opt_type;
+	u8		nd_opt_len;	/* in units of 8 bytes		*/
+} __packed;
+
+#define ND_OPT_SOURCE_LL_ADDR	1
+#define ND_OPT_TARGET_LL_ADDR	2
+#define ND_OPT_PREFIX_INFO	3
+
+/* Length of a link-layer address option for Ethernet, in units of 8 bytes */
+#define ND_OPT_LL_ADDR_LEN	1
+
+/* Neighbour solicitation or advertisement */
+struct nd_msg {
+	struct icmp6_hdr icmph;
+	struct in6_addr	target;
+	u8		opt[0];
+} __packed;
+
+/* Router solicitation */
+struct rs_msg {
+	struct icmp6_hdr icmph;
+	u8		opt[0];
+} __packed;
+
+/* Router advertisement */
+struct ra_msg {
+	struct icmp6_hdr icmph;
+	__be32		reachable_time;
+	__be32		retrans_timer;
+	u8		opt[0];
+} __packed;
+
+/* Prefix information option of a router advertisement */
+struct nd_opt_prefix_info {
+	u8		nd_opt_type;
+	u8		nd_opt_len;
+	u8		prefix_len;
+	u8		flags;
+	__be32		valid_lifetime;
+	__be32		preferred_lifetime;
+	__be32		reserved;
+	struct in6_addr	prefix;
+} __packed;
+
+#define ND_OPT_PI_FLAG_ONLINK	0x80
+#define ND_OPT_PI_FLAG_AUTO	0x40
+
+/* Hop limit of all neighbour discovery messages */
+#define ND_HOP_LIMIT		255
+
+extern struct in6_addr net_ip6;		/* Our global IPv6 address */
+extern struct in6_addr net_link_local_ip6;	/* Our link-local address */
+extern u32 net_prefix_length;		/* Prefix length of net_ip6 */
+extern struct in6_addr net_gateway6;	/* Default router */
+extern struct in6_addr net_server_ip6;	/* Server IPv6 address */
+extern struct in6_addr net_ping_ip6;	/* The address to ping */
+extern bool net_use_ip6;		/* Use IPv6 for TFTP and the like */
+extern const struct in6_addr net_all_nodes_mcast;	/* ff02::1 */
+
+static inline bool ip6_is_unspecified_addr(const struct in6_addr *addr)
+{
+	return !(addr->s6_addr32[0] | addr->s6_addr32[1] |
+		 addr->s6_addr32[2] | addr->s6_addr32[3]);
+}
+
+static inline bool ip6_is_link_local(const struct in6_addr *addr)
+{
+	return addr->s6_addr[0] == 0xfe && (addr->s6_addr[1] & 0xc0) == 0x80;
+}
+
+static inline bool ip6_is_multicast(const struct in6_addr *addr)
+{
+	return addr->s6_addr[0] == 0xff;
+}
+
+static inline bool ip6_addr_equal(const struct in6_addr *a,
+				  const struct in6_addr *b)
+{
+	return !memcmp(a, b, IN6ADDRSZ);
+}
+
+#ifdef CONFIG_IPV6
+/**
+ * string_to_ip6() - convert the text form of an IPv6 address
+ *
+ * Both the full form and the form with '::' for a run of zero groups are
+ * accepted, as is an IPv4 address in the last 32 bits.
+ *
+ * @s:		string to convert
+ * @len:	length of the address in @s
+ * @addr:	set to the address
+ * Return: 0 if OK, -EINVAL if @s is not a valid address
+ */
+int string_to_ip6(const char *s, size_t len, struct in6_addr *addr);
+
+/**
+ * net_ip6_handler() - handle a received IPv6 packet
+ *
+ * @et:		Ethernet header of the packet
+ * @ip6:	IPv6 header of the packet
+ * @len:	length of the packet from the IPv6 header on
+ * Return: 0 if the packet was handled, -ve if it was dropped
+ */
+int net_ip6_handler(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len);
+
+/**
+ * net_ip6_init_loop() - set up IPv6 at the start of net_loop()
+ *
+ * This makes the link-local address from the MAC address of the current
+ * Ethernet device.
+ */
+void net_ip6_init_loop(void);
+
+/**
+ * net_ip6_start_loop() - find a router before a protocol starts sending
+ *
+ * If @protocol is to talk to a peer over IPv6 and our address, or a router
+ * to reach the peer, is missing, routers are solicited with
+ * ndisc_router_discover(). This happens in net_loop() once the Ethernet
+ * device is up and before the protocol starts, so that no packet is being
+ * built while the replies are received.
+ *
+ * @protocol:	protocol about to be started
+ * Return: 0 if OK or no router answered, -EINTR if interrupted with Ctrl-C
+ */
+int net_ip6_start_loop(enum proto_t protocol);
+#else
+static inline int string_to_ip6(const char *s, size_t len,
+				struct in6_addr *addr)
+{
+	return -EINVAL;
+}
+
+static inline int net_ip6_handler(struct ethernet_hdr *et,
+				  struct ip6_hdr *ip6, int len)
+{
+	return -EINVAL;
+}
+
+static inline void net_ip6_init_loop(void)
+{
+}
+
+static inline int net_ip6_start_loop(enum proto_t protocol)
+{
+	return 0;
+}
+#endif /* CONFIG_IPV6 */
+
+/**
+ * ip6_is_our_addr() - check if a packet sent to @addr is for us
+ *
+ * @addr:	destination address of the packet
+ * Return: true if @addr is one of our addresses, or a multicast address
+ *	we listen to
+ */
+bool ip6_is_our_addr(const struct in6_addr *addr);
+
+/**
+ * ip6_make_lladdr() - make a link-local address from a MAC address
+ *
+ * @lladdr:	set to the address, with a modified EUI-64 interface ID
+ * @enetaddr:	MAC address
+ */
+void ip6_make_lladdr(struct in6_addr *lladdr, const uchar enetaddr[ARP_HLEN]);
+
+/**
+ * ip6_make_snma() - make the solicited-node multicast address of @addr
+ *
+ * @mcast_addr:	set to the multicast address
+ * @addr:	unicast address
+ */
+void ip6_make_snma(struct in6_addr *mcast_addr, const struct in6_addr *addr);
+
+/**
+ * ip6_make_mult_ethdstaddr() - make the MAC address for a multicast address
+ *
+ * @enetaddr:	set to the MAC address
+ * @mcast_addr:	IPv6 multicast address
+ */
+void ip6_make_mult_ethdstaddr(uchar enetaddr[ARP_HLEN],
+			      const struct in6_addr *mcast_addr);
+
+/**
+ * ip6_addr_in_subnet() - check if two addresses share a prefix
+ *
+ * @our_addr:	first address
+ * @neigh_addr:	second address
+ * @prefix_length: length of the prefix in bits
+ * Return: true if the first @prefix_length bits are the same
+ */
+bool ip6_addr_in_subnet(const struct in6_addr *our_addr,
+			const struct in6_addr *neigh_addr, u32 prefix_length);
+
+/**
+ * ip6_csum() - compute the checksum of an upper layer IPv6 packet
+ *
+ * The checksum covers the IPv6 pseudo-header (RFC 8200 section 8.1) and
+ * @len bytes at @data, which must include the checksum field of the
+ * packet.
+ *
+ * @saddr:	source address
+ * @daddr:	destination address
+ * @len:	length of the upper layer packet
+ * @proto:	upper layer protocol (next header)
+ * @data:	upper layer packet
+ * Return: checksum to store in the packet, or 0 if a received packet is
+ *	correct
+ */
+u16 ip6_csum(const struct in6_addr *saddr, const struct in6_addr *daddr,
+	     u16 len, u8 proto, const void *data);
+
+/**
+ * ip6_add_hdr() - write an IPv6 header
+ *
+ * @xip:	where to write the header
+ * @src:	source address
+ * @dest:	destination address
+ * @nextheader:	protocol of the payload
+ * @hoplimit:	hop limit
+ * @payload_len: length of the payload
+ * Return: size of the header
+ */
+int ip6_add_hdr(uchar *xip, const struct in6_addr *src,
+		const struct in6_addr *dest, int nextheader, int hoplimit,
+		int payload_len);
+
+/**
+ * net_ip6_src() - choose the source address for sending to @dest
+ *
+ * @dest:	destination address
+ * Return: the link-local address for link-local and multicast
+ *	destinations, or when there is no global address, else the global one
+ */
+const struct in6_addr *net_ip6_src(const struct in6_addr *dest);
+
+/**
+ * net_send_ip_packet6() - send an IPv6 packet
+ *
+ * The upper layer packet must already be in net_tx_packet, after room for
+ * the Ethernet and IPv6 headers. Its checksum is filled in for UDP and
+ * ICMPv6. If the MAC address of the next hop is not known yet, it is found
+ * with neighbour discovery first, as is done with ARP for IPv4.
+ *
+ * @ether:	MAC address of the next hop, all zeroes if not known; it is
+ *	updated when neighbour discovery completes
+ * @dest:	destination address
+ * @proto:	upper layer protocol
+ * @len:	length of the upper layer packet
+ * Return: 0 if sent, 1 if waiting for neighbour discovery, -ve on error
+ */
+int net_send_ip_packet6(uchar *ether, const struct in6_addr *dest, int proto,
+			int len);
+
+/**
+ * net_send_udp_packet6() - send a UDP packet over IPv6
+ *
+ * @ether:	MAC address of the next hop, as for net_send_ip_packet6()
+ * @dest:	destination address
+ * @dport:	destination port
+ * @sport:	source port
+ * @len:	length of the UDP payload, which starts IP6_UDP_HDR_SIZE bytes
+ *	after the Ethernet header in net_tx_packet
+ * Return: 0 if sent, 1 if waiting for neighbour discovery, -ve on error
+ */
+int net_send_udp_packet6(uchar *ether, const struct in6_addr *dest, int dport,
+			 int sport, int len);
+
+/**
+ * net_parse_bootfile6() - parse a boot file name with an IPv6 server
+ *
+ * The server address is given in brackets: [2001:db8::1]:file.bin
+ *
+ * @ipaddr:	set to the server address, if there is one
+ * @filename:	set to the file name
+ * @max_len:	size of @filename
+ * Return: 1 if there is a file name, 0 if not, -EINVAL if the server address
+ *	is not valid
+ */
+int net_parse_bootfile6(struct in6_addr *ipaddr, char *filename, int max_len);
+
+#endif /* __NET6_H__ */
@@ -9,9 +9,15 @@
 /* Maximum number of host devices - see drivers/block/sandbox.c */
 #define SANDBOX_HOST_MAX_DEVICES	4
 
+/* Number of requests the host device accepts with blk_submit() */
+#define SANDBOX_HOST_QUEUE_DEPTH	4
+
 struct host_block_dev {
 #ifndef CONFIG_BLK
 	struct blk_desc blk_dev;
+#else
+	struct blk_req *queue[SANDBOX_HOST_QUEUE_DEPTH];
+	int queued;
 #endif
 	char *filename;
 	int fd;
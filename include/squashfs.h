@@ -12,6 +12,29 @@
 
 struct disk_partition;
 
+/**
+ * struct sqfs_cache_stats - statistics of the SquashFS cache
+ *
+ * @table_hits:		Number of inode/directory tables found in the cache
+ * @table_misses:	Number of inode/directory tables decompressed
+ * @table_size:		Size of the cached tables in bytes
+ * @table_max_size:	Maximum size of the cached tables in bytes
+ * @frag_hits:		Number of fragment blocks found in the cache
+ * @frag_misses:	Number of fragment blocks read from the device
+ * @frag_entries:	Number of fragment blocks cached
+ * @frag_max_entries:	Maximum number of fragment blocks cached
+ */
+struct sqfs_cache_stats {
+	unsigned int table_hits;
+	unsigned int table_misses;
+	unsigned long table_size;
+	unsigned long table_max_size;
+	unsigned int frag_hits;
+	unsigned int frag_misses;
+	unsigned int frag_entries;
+	unsigned int frag_max_entries;
+};
+
 int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp);
 int sqfs_readdir(struct fs_dir_stream *dirs, struct fs_dirent **dentp);
 int sqfs_probe(struct blk_desc *fs_dev_desc,
@@ -23,4 +46,18 @@ int sqfs_exists(const char *filename);
 void sqfs_close(void);
 void sqfs_closedir(struct fs_dir_stream *dirs);
 
+/**
+ * sqfs_cache_stats() - return the SquashFS cache statistics
+ *
+ * The hit and miss counters are reset afterwards.
+ *
+ * @stats:	Returns the statistics
+ */
+void sqfs_cache_stats(struct sqfs_cache_stats *stats);
+
+/**
+ * sqfs_cache_invalidate() - drop everything from the SquashFS cache
+ */
+void sqfs_cache_invalidate(void);
+
 #endif /* SQFS_H  */
@@ -89,6 +89,7 @@ struct vring {
  * @index: the zero-based ordinal number for this queue
  * @num_free: number of elements we expect to be able to fit
  * @vring: actual memory layout for this queue
+ * @indirect: buffer chains can be described by indirect descriptor tables
  * @event: host publishes avail event idx
  * @free_head: head of free buffer list
  * @num_added: number we've added since last sync
@@ -102,6 +103,7 @@ struct virtqueue {
 	unsigned int index;
 	unsigned int num_free;
 	struct vring vring;
+	bool indirect;
 	bool event;
 	unsigned int free_head;
 	unsigned int num_added;
@@ -173,6 +175,10 @@ struct virtio_sg;
  * Caller must ensure we don't call this with other virtqueue operations
  * at the same time (except where noted).
  *
+ * If VIRTIO_RING_F_INDIRECT_DESC was negotiated, a chain of several
+ * scatterlists is put in an indirect descriptor table and only uses one
+ * descriptor of the ring.
+ *
  * Returns zero or a negative error (ie. ENOSPC, ENOMEM, EIO).
  */
 int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
@@ -9,10 +9,12 @@
 #include <command.h>
 #include <console.h>
 #include <div64.h>
+#include <dm.h>
 #include <gzip.h>
 #include <image.h>
 #include <malloc.h>
 #include <memalign.h>
+#include <mmc.h>
 #include <u-boot/crc.h>
 #include <watchdog.h>
 #include <u-boot/zlib.h>
@@ -27,6 +29,12 @@
 #define RESERVED		0xe0
 #define DEFLATED		8
 
+/*
+ * gzwrite() inflates this many bytes at a time and computes their CRC
+ * straight away, while they are still in the cache
+ */
+#define GZWRITE_INFLATE_STEP	(32 << 10)
+
 void *gzalloc(void *x, unsigned items, unsigned size)
 {
 	void *p;
@@ -116,6 +124,102 @@ void gzwrite_progress_finish(int returnval,
 	}
 }
 
+/*
+ * Number of blocks which should be written together to avoid
+ * read-modify-write cycles on the device, e.g. an eMMC erase group
+ */
+static uint gzwrite_erase_blks(struct blk_desc *dev)
+{
+#if CONFIG_IS_ENABLED(MMC)
+	struct mmc *mmc;
+
+	if (dev->if_type == IF_TYPE_MMC) {
+		mmc = find_mmc_device(dev->devnum);
+		if (mmc && mmc->erase_grp_size)
+			return mmc->erase_grp_size;
+	}
+#endif
+
+	return 1;
+}
+
+/**
+ * struct gzwrite_chunk - part of the image being written to the device
+ *
+ * @req:	Request used to queue the write
+ * @buf:	Buffer holding the inflated data
+ * @start:	First block to write
+ * @blkcnt:	Number of blocks to write
+ * @busy:	true while the write may still be in flight
+ */
+struct gzwrite_chunk {
+#if CONFIG_IS_ENABLED(BLK)
+	struct blk_req req;
+#endif
+	unsigned char *buf;
+	lbaint_t start;
+	lbaint_t blkcnt;
+	bool busy;
+};
+
+/* Whether writes can be queued, so that inflating can go on meanwhile */
+static bool gzwrite_can_queue(struct blk_desc *dev)
+{
+#if CONFIG_IS_ENABLED(BLK)
+	return blk_get_ops(dev->bdev)->submit;
+#else
+	return false;
+#endif
+}
+
+static int gzwrite_chunk_start(struct blk_desc *dev,
+			       struct gzwrite_chunk *chunk, bool queue)
+{
+	ulong n;
+
+#if CONFIG_IS_ENABLED(BLK)
+	int ret;
+
+	if (queue) {
+		chunk->req.op = BLK_REQ_WRITE;
+		chunk->req.start = chunk->start;
+		chunk->req.blkcnt = chunk->blkcnt;
+		chunk->req.buffer = chunk->buf;
+		do {
+			ret = blk_submit(dev->bdev, &chunk->req);
+			if (ret == -EBUSY)
+				blk_poll(dev->bdev);
+		} while (ret == -EBUSY);
+		if (ret)
+			return ret;
+		chunk->busy = true;
+
+		return 0;
+	}
+#endif
+	n = blk_dwrite(dev, chunk->start, chunk->blkcnt, chunk->buf);
+
+	return n == chunk->blkcnt ? 0 : -EIO;
+}
+
+static int gzwrite_chunk_wait(struct blk_desc *dev,
+			      struct gzwrite_chunk *chunk)
+{
+#if CONFIG_IS_ENABLED(BLK)
+	long ret;
+
+	if (!chunk->busy)
+		return 0;
+
+	chunk->busy = false;
+	ret = blk_wait(dev->bdev, &chunk->req);
+	if (ret != chunk->blkcnt)
+		return ret < 0 ? ret : -EIO;
+#endif
+
+	return 0;
+}
+
 int gzwrite(unsigned char *src, int len,
 	    struct blk_desc *dev,
 	    unsigned long szwritebuf,
@@ -125,13 +229,19 @@ int gzwrite(unsigned char *src, int len,
 	int i, flags;
 	z_stream s;
 	int r = 0;
+	struct gzwrite_chunk chunks[2] = {}, *chunk;
 	unsigned char *writebuf;
 	unsigned crc = 0;
 	ulong totalfilled = 0;
 	lbaint_t blksperbuf, outblock;
+	uint erase_blks;
+	ulong szchunk;
+	u64 skew;
 	u32 expected_crc;
 	u32 payload_size;
 	int iteration = 0;
+	bool queue;
+	int cur = 0;
 
 	if (!szwritebuf ||
 	    (szwritebuf % dev->blksz) ||
@@ -205,56 +315,116 @@ int gzwrite(unsigned char *src, int len,
 
 	s.next_in = src + i;
 	s.avail_in = payload_size+8;
-	writebuf = (unsigned char *)malloc_cache_aligned(szwritebuf);
+
+	/*
+	 * Write whole erase groups, and make the first write end on an
+	 * erase group boundary if the image does not start on one
+	 */
+	erase_blks = gzwrite_erase_blks(dev);
+	blksperbuf = roundup(blksperbuf, erase_blks);
+	writebuf = malloc_cache_aligned(blksperbuf * dev->blksz);
+	if (!writebuf && erase_blks > 1) {
+		erase_blks = 1;
+		blksperbuf = szwritebuf / dev->blksz;
+		writebuf = malloc_cache_aligned(szwritebuf);
+	}
+	if (!writebuf) {
+		printf("%s: cannot allocate %lu bytes\n", __func__, szwritebuf);
+		r = -1;
+		goto out;
+	}
+	szwritebuf = blksperbuf * dev->blksz;
+	skew = outblock;
+	szchunk = szwritebuf - do_div(skew, erase_blks) * dev->blksz;
+	chunks[0].buf = writebuf;
+
+	/*
+	 * If the device queues requests, inflate into the second buffer
+	 * while the first one is being written
+	 */
+	queue = gzwrite_can_queue(dev);
+	if (queue) {
+		chunks[1].buf = malloc_cache_aligned(szwritebuf);
+		queue = chunks[1].buf;
+	}
 
 	/* decompress until deflate stream ends or end of file */
 	do {
-		if (s.avail_in == 0) {
-			printf("%s: weird termination with result %d\n",
-			       __func__, r);
-			break;
-		}
+		lbaint_t writeblocks;
+		ulong numfilled = 0;
 
-		/* run inflate() on input until output buffer not full */
-		do {
-			unsigned long blocks_written;
-			int numfilled;
-			lbaint_t writeblocks;
+		chunk = &chunks[cur];
+		writebuf = chunk->buf;
 
-			s.avail_out = szwritebuf;
-			s.next_out = writebuf;
+		/* run inflate() on input until the chunk is full */
+		while (numfilled < szchunk && r != Z_STREAM_END) {
+			uint step;
+
+			if (s.avail_in == 0) {
+				printf("%s: weird termination with result %d\n",
+				       __func__, r);
+				break;
+			}
+
+			step = min_t(ulong, szchunk - numfilled,
+				     GZWRITE_INFLATE_STEP);
+			s.avail_out = step;
+			s.next_out = writebuf + numfilled;
 			r = inflate(&s, Z_SYNC_FLUSH);
 			if ((r != Z_OK) &&
 			    (r != Z_STREAM_END)) {
 				printf("Error: inflate() returned %d\n", r);
 				goto out;
 			}
-			numfilled = szwritebuf - s.avail_out;
-			crc = crc32(crc, writebuf, numfilled);
-			totalfilled += numfilled;
-			if (numfilled < szwritebuf) {
-				writeblocks = (numfilled+dev->blksz-1)
-						/ dev->blksz;
-				memset(writebuf+numfilled, 0,
-				       dev->blksz-(numfilled%dev->blksz));
-			} else {
-				writeblocks = blksperbuf;
-			}
+			step -= s.avail_out;
+			crc = crc32(crc, writebuf + numfilled, step);
+			numfilled += step;
+		}
+		if (!numfilled)
+			break;
 
-			gzwrite_progress(iteration++,
-					 totalfilled,
-					 szexpected);
-			blocks_written = blk_dwrite(dev, outblock,
-						    writeblocks, writebuf);
-			outblock += blocks_written;
-			if (ctrlc()) {
-				puts("abort\n");
-				goto out;
-			}
-			WATCHDOG_RESET();
-		} while (s.avail_out == 0);
+		totalfilled += numfilled;
+		writeblocks = DIV_ROUND_UP(numfilled, dev->blksz);
+		memset(writebuf + numfilled, 0,
+		       writeblocks * dev->blksz - numfilled);
+
+		gzwrite_progress(iteration++,
+				 totalfilled,
+				 szexpected);
+
+		/* the previous chunk was written while this one was inflated */
+		if (gzwrite_chunk_wait(dev, &chunks[!cur])) {
+			printf("Error: write failed at block " LBAFU "\n",
+			       chunks[!cur].start);
+			r = -1;
+			goto out;
+		}
+		chunk->start = outblock;
+		chunk->blkcnt = writeblocks;
+		if (gzwrite_chunk_start(dev, chunk, queue)) {
+			printf("Error: write failed at block " LBAFU "\n",
+			       outblock);
+			r = -1;
+			goto out;
+		}
+		outblock += writeblocks;
+		szchunk = szwritebuf;
+		cur ^= queue;
+		if (ctrlc()) {
+			puts("abort\n");
+			r = -1;
+			goto out;
+		}
+		WATCHDOG_RESET();
 		/* done when inflate() says it's done */
-	} while (r != Z_STREAM_END);
+	} while (r != Z_STREAM_END && s.avail_in);
+
+	if (gzwrite_chunk_wait(dev, &chunks[!cur])) {
+		printf("Error: write failed at block " LBAFU "\n",
+		       chunks[!cur].start);
+		r = -1;
+		goto out;
+	}
 
 	if ((szexpected != totalfilled) ||
 	    (crc != expected_crc))
@@ -263,9 +433,13 @@ int gzwrite(unsigned char *src, int len,
 		r = 0;
 
 out:
+	/* the buffers cannot be freed while a write may still use them */
+	for (i = 0; i < ARRAY_SIZE(chunks); i++)
+		gzwrite_chunk_wait(dev, &chunks[i]);
 	gzwrite_progress_finish(r, totalfilled, szexpected,
 				expected_crc, crc);
-	free(writebuf);
+	free(chunks[0].buf);
+	free(chunks[1].buf);
 	inflateEnd(&s);
 
 	return r;
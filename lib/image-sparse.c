@@ -50,97 +50,256 @@
 
 static void default_log(const char *ignored, char *response) {}
 
-static lbaint_t write_sparse_chunk_raw(struct sparse_storage *info,
-				       lbaint_t blk, lbaint_t blkcnt,
-				       void *data,
-				       char *response)
-{
-	lbaint_t n = blkcnt, write_blks, blks = 0, aligned_buf_blks = 4096;
-	uint32_t *aligned_buf = NULL;
+/* Number of blocks of consecutive RAW data collected before writing */
+#define SPARSE_RAW_BUF_BLKS	4096
 
-	if (CONFIG_IS_ENABLED(SYS_DCACHE_OFF)) {
-		write_blks = info->write(info, blk, n, data);
-		if (write_blks < n)
-			goto write_fail;
+/* Aligned RAW data of at least this many blocks is written in place */
+#define SPARSE_RAW_DIRECT_BLKS	128
 
-		return write_blks;
+static int write_sparse_fail(struct sparse_storage *info, lbaint_t blk,
+			     lbaint_t n, lbaint_t write_blks, char *response)
+{
+	if (IS_ERR_VALUE(write_blks)) {
+		printf("%s: Write failed, block #" LBAFU " [" LBAFU "] (%lld)\n",
+		       __func__, blk, n, (long long)write_blks);
+		info->mssg("flash write failure", response);
+		return -1;
 	}
 
-	aligned_buf = memalign(ARCH_DMA_MINALIGN, info->blksz * aligned_buf_blks);
-	if (!aligned_buf) {
-		info->mssg("Malloc failed for: CHUNK_TYPE_RAW", response);
-		return -ENOMEM;
+	/* write_blks < n */
+	printf("%s: Write failed, block #" LBAFU " [" LBAFU "]\n",
+	       __func__, blk, n);
+	info->mssg("flash write failure(incomplete)", response);
+	return -1;
+}
+
+/**
+ * sparse_flush_raw() - Write out the RAW data collected so far
+ *
+ * @ss: Stream state
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 if OK, -1 on error
+ */
+static int sparse_flush_raw(struct sparse_stream *ss, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	lbaint_t n = ss->raw_blks, write_blks;
+
+	if (!n)
+		return 0;
+
+	/* write_blks might be > n due to NAND bad-blocks */
+	write_blks = info->write(info, ss->blk, n, ss->raw_buf);
+	if (IS_ERR_VALUE(write_blks) || write_blks < n)
+		return write_sparse_fail(info, ss->blk, n, write_blks,
+					 response);
+
+	ss->blk += write_blks;
+	ss->raw_blks = 0;
+
+	return 0;
+}
+
+/**
+ * sparse_write_raw() - Write RAW chunk data
+ *
+ * Large pieces which are suitably aligned for DMA are written straight from
+ * @data. Small or misaligned pieces are copied to an aligned buffer, where
+ * consecutive ones are merged so that they go out in as few writes as
+ * possible.
+ *
+ * @ss: Stream state
+ * @data: Chunk data
+ * @blkcnt: Number of storage blocks at @data
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 if OK, -1 on error
+ */
+static int sparse_write_raw(struct sparse_stream *ss, const void *data,
+			    lbaint_t blkcnt, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	lbaint_t n, write_blks;
+
+	if (CONFIG_IS_ENABLED(SYS_DCACHE_OFF) ||
+	    (blkcnt >= SPARSE_RAW_DIRECT_BLKS &&
+	     IS_ALIGNED((ulong)data, ARCH_DMA_MINALIGN))) {
+		/* blocks collected so far come first on the storage */
+		if (sparse_flush_raw(ss, response))
+			return -1;
+		write_blks = info->write(info, ss->blk, blkcnt, data);
+		if (IS_ERR_VALUE(write_blks) || write_blks < blkcnt)
+			return write_sparse_fail(info, ss->blk, blkcnt,
+						 write_blks, response);
+		ss->blk += write_blks;
+
+		return 0;
 	}
 
-	while (blkcnt > 0) {
-		n = min(aligned_buf_blks, blkcnt);
-		memcpy(aligned_buf, data, n * info->blksz);
-
-		/* write_blks might be > n due to NAND bad-blocks */
-		write_blks = info->write(info, blk + blks, n, aligned_buf);
-		if (write_blks < n) {
-			free(aligned_buf);
-			goto write_fail;
+	if (!ss->raw_buf) {
+		ss->raw_buf = memalign(ARCH_DMA_MINALIGN,
+				       info->blksz * SPARSE_RAW_BUF_BLKS);
+		if (!ss->raw_buf) {
+			info->mssg("Malloc failed for: CHUNK_TYPE_RAW",
+				   response);
+			return -1;
 		}
+	}
 
-		blks += write_blks;
+	while (blkcnt > 0) {
+		n = min_t(lbaint_t, SPARSE_RAW_BUF_BLKS - ss->raw_blks, blkcnt);
+		memcpy(ss->raw_buf + ss->raw_blks * info->blksz, data,
+		       n * info->blksz);
+		ss->raw_blks += n;
 		data += n * info->blksz;
 		blkcnt -= n;
+
+		if (ss->raw_blks == SPARSE_RAW_BUF_BLKS &&
+		    sparse_flush_raw(ss, response))
+			return -1;
 	}
 
-	free(aligned_buf);
-	return blks;
+	return 0;
+}
 
-write_fail:
-	if (IS_ERR_VALUE(write_blks)) {
-		printf("%s: Write failed, block #" LBAFU " [" LBAFU "] (%lld)\n",
-		       __func__, blk + blks, n, (long long)write_blks);
-		info->mssg("flash write failure", response);
-		return write_blks;
+/**
+ * sparse_fill_blocks() - Write blocks holding a repeated 32-bit value
+ *
+ * The fill buffer is allocated once per image and only refilled when the
+ * value changes, each write covers up to CONFIG_IMAGE_SPARSE_FILLBUF_SIZE.
+ *
+ * @ss: Stream state
+ * @fill_val: Value to fill the blocks with
+ * @blkcnt: Number of blocks to write at ss->blk
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 if OK, -1 on error
+ */
+static int sparse_fill_blocks(struct sparse_stream *ss, uint32_t fill_val,
+			      lbaint_t blkcnt, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	lbaint_t fill_buf_num_blks;
+	lbaint_t blks, j;
+	int i;
+
+	fill_buf_num_blks = max_t(lbaint_t, 1, CONFIG_IMAGE_SPARSE_FILLBUF_SIZE /
+					       info->blksz);
+	if (!ss->fill_buf) {
+		ss->fill_buf = memalign(ARCH_DMA_MINALIGN,
+					ROUNDUP(info->blksz * fill_buf_num_blks,
+						ARCH_DMA_MINALIGN));
+		if (!ss->fill_buf) {
+			info->mssg("Malloc failed for: CHUNK_TYPE_FILL",
+				   response);
+			return -1;
+		}
+		ss->fill_val = ~fill_val;
 	}
 
-	/* write_blks < n */
-	printf("%s: Write failed, block #" LBAFU " [" LBAFU "]\n",
-	       __func__, blk + blks, n);
-	info->mssg("flash write failure(incomplete)", response);
-	return -1;
+	if (ss->fill_val != fill_val) {
+		for (i = 0; i < (info->blksz * fill_buf_num_blks /
+				 sizeof(fill_val)); i++)
+			ss->fill_buf[i] = fill_val;
+		ss->fill_val = fill_val;
+	}
+
+	while (blkcnt > 0) {
+		j = min(blkcnt, fill_buf_num_blks);
+		blks = info->write(info, ss->blk, j, ss->fill_buf);
+		/* blks might be > j (eg. NAND bad-blocks) */
+		if (IS_ERR_VALUE(blks) || blks < j) {
+			printf("%s: %s " LBAFU " [" LBAFU "]\n", __func__,
+			       "Write failed, block #", ss->blk, j);
+			info->mssg("flash write failure", response);
+			return -1;
+		}
+		ss->blk += blks;
+		blkcnt -= j;
+	}
+
+	return 0;
 }
 
-int write_sparse_image(struct sparse_storage *info,
-		       const char *part_name, void *data, char *response)
+/**
+ * sparse_write_fill() - Write a FILL chunk
+ *
+ * A fill of zeroes is turned into an erase of the whole erase groups it
+ * covers when the storage can do that, only the unaligned ends are written.
+ *
+ * @ss: Stream state
+ * @fill_val: Value to fill the chunk with
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 if OK, -1 on error
+ */
+static int sparse_write_fill(struct sparse_stream *ss, uint32_t fill_val,
+			     char *response)
 {
-	lbaint_t blk;
-	lbaint_t blkcnt;
-	lbaint_t blks;
-	uint64_t bytes_written = 0;
-	unsigned int chunk;
-	unsigned int offset;
-	uint64_t chunk_data_sz;
-	uint32_t *fill_buf = NULL;
-	uint32_t fill_val;
-	sparse_header_t *sparse_header;
-	chunk_header_t *chunk_header;
-	uint32_t total_blocks = 0;
-	int fill_buf_num_blks;
-	int i;
-	int j;
+	struct sparse_storage *info = ss->info;
+	lbaint_t blkcnt = ss->blkcnt;
+	lbaint_t head, middle, erased;
+	u32 grp, rem;
+
+	if (sparse_flush_raw(ss, response))
+		return -1;
 
-	fill_buf_num_blks = CONFIG_IMAGE_SPARSE_FILLBUF_SIZE / info->blksz;
+	if (fill_val || !info->erase)
+		return sparse_fill_blocks(ss, fill_val, blkcnt, response);
 
-	/* Read and skip over sparse image header */
-	sparse_header = (sparse_header_t *)data;
+	grp = info->erase_grp ? info->erase_grp : 1;
+	div_u64_rem(ss->blk, grp, &rem);
+	head = min_t(lbaint_t, rem ? grp - rem : 0, blkcnt);
+	div_u64_rem(blkcnt - head, grp, &rem);
+	middle = blkcnt - head - rem;
 
-	data += sparse_header->file_hdr_sz;
-	if (sparse_header->file_hdr_sz > sizeof(sparse_header_t)) {
-		/*
-		 * Skip the remaining bytes in a header that is longer than
-		 * we expected.
-		 */
-		data += (sparse_header->file_hdr_sz - sizeof(sparse_header_t));
+	if (!middle)
+		return sparse_fill_blocks(ss, 0, blkcnt, response);
+
+	if (head && sparse_fill_blocks(ss, 0, head, response))
+		return -1;
+
+	erased = info->erase(info, ss->blk, middle);
+	if (erased == middle) {
+		ss->blk += middle;
+	} else {
+		debug("%s: Erase failed, block #" LBAFU ", writing zeroes\n",
+		      __func__, ss->blk);
+		if (sparse_fill_blocks(ss, 0, middle, response))
+			return -1;
 	}
 
-	if (!info->mssg)
-		info->mssg = default_log;
+	return sparse_fill_blocks(ss, 0, rem, response);
+}
+
+void sparse_stream_release(struct sparse_stream *ss)
+{
+	free(ss->raw_buf);
+	ss->raw_buf = NULL;
+	ss->raw_blks = 0;
+	free(ss->fill_buf);
+	ss->fill_buf = NULL;
+}
+
+/**
+ * sparse_stream_header() - Parse the sparse image header
+ *
+ * @ss: Stream state
+ * @data: Start of the image
+ * @len: Number of bytes available at @data
+ * @response: Pointer to fastboot response buffer
+ *
+ * Return: number of header bytes consumed, 0 if more data is needed or -1 on
+ * error
+ */
+static long sparse_stream_header(struct sparse_stream *ss, const void *data,
+				 size_t len, char *response)
+{
+	sparse_header_t *sparse_header = &ss->header;
+	unsigned int offset;
+
+	if (len < sizeof(sparse_header_t) ||
+	    len < ((sparse_header_t *)data)->file_hdr_sz)
+		return 0;
+
+	memcpy(sparse_header, data, sizeof(sparse_header_t));
 
 	debug("=== Sparse Image Header ===\n");
 	debug("magic: 0x%x\n", sparse_header->magic);
@@ -152,168 +311,270 @@ int write_sparse_image(struct sparse_storage *info,
 	debug("total_blks: %d\n", sparse_header->total_blks);
 	debug("total_chunks: %d\n", sparse_header->total_chunks);
 
+	if (sparse_header->file_hdr_sz < sizeof(sparse_header_t) ||
+	    sparse_header->chunk_hdr_sz < sizeof(chunk_header_t)) {
+		ss->info->mssg("sparse image header size issue", response);
+		return -1;
+	}
+
 	/*
 	 * Verify that the sparse block size is a multiple of our
 	 * storage backend block size
 	 */
-	div_u64_rem(sparse_header->blk_sz, info->blksz, &offset);
+	div_u64_rem(sparse_header->blk_sz, ss->info->blksz, &offset);
 	if (offset) {
 		printf("%s: Sparse image block size issue [%u]\n",
 		       __func__, sparse_header->blk_sz);
-		info->mssg("sparse image block size issue", response);
+		ss->info->mssg("sparse image block size issue", response);
 		return -1;
 	}
 
 	puts("Flashing Sparse Image\n");
 
-	/* Start processing chunks */
-	blk = info->start;
-	for (chunk = 0; chunk < sparse_header->total_chunks; chunk++) {
-		/* Read and skip over chunk header */
-		chunk_header = (chunk_header_t *)data;
-		data += sizeof(chunk_header_t);
-
-		if (chunk_header->chunk_type != CHUNK_TYPE_RAW) {
-			debug("=== Chunk Header ===\n");
-			debug("chunk_type: 0x%x\n", chunk_header->chunk_type);
-			debug("chunk_data_sz: 0x%x\n", chunk_header->chunk_sz);
-			debug("total_size: 0x%x\n", chunk_header->total_sz);
+	/*
+	 * Skip the remaining bytes in a header that is longer than we
+	 * expected.
+	 */
+	return sparse_header->file_hdr_sz;
+}
+
+/**
+ * sparse_stream_chunk() - Parse a chunk header and handle data-less chunks
+ *
+ * @ss: Stream state
+ * @data: Start of the chunk header
+ * @response: Pointer to fastboot response buffer
+ *
+ * Sets ss->chunk_left to the number of payload bytes following the header.
+ *
+ * Return: 0 if OK, -1 on error
+ */
+static int sparse_stream_chunk(struct sparse_stream *ss, const void *data,
+			       char *response)
+{
+	struct sparse_storage *info = ss->info;
+	sparse_header_t *sparse_header = &ss->header;
+	chunk_header_t *chunk_header = &ss->chunk_header;
+	uint64_t chunk_data_sz;
+
+	memcpy(chunk_header, data, sizeof(chunk_header_t));
+
+	if (chunk_header->chunk_type != CHUNK_TYPE_RAW) {
+		debug("=== Chunk Header ===\n");
+		debug("chunk_type: 0x%x\n", chunk_header->chunk_type);
+		debug("chunk_data_sz: 0x%x\n", chunk_header->chunk_sz);
+		debug("total_size: 0x%x\n", chunk_header->total_sz);
+	}
+
+	chunk_data_sz = ((u64)sparse_header->blk_sz) * chunk_header->chunk_sz;
+	ss->blkcnt = DIV_ROUND_UP_ULL(chunk_data_sz, info->blksz);
+	switch (chunk_header->chunk_type) {
+	case CHUNK_TYPE_RAW:
+		if (chunk_header->total_sz !=
+		    (sparse_header->chunk_hdr_sz + chunk_data_sz)) {
+			info->mssg("Bogus chunk size for chunk type Raw",
+				   response);
+			return -1;
 		}
 
-		if (sparse_header->chunk_hdr_sz > sizeof(chunk_header_t)) {
+		if (ss->blk + ss->raw_blks + ss->blkcnt >
+		    info->start + info->size) {
+			printf("%s: Request would exceed partition size!\n",
+			       __func__);
+			info->mssg("Request would exceed partition size!",
+				   response);
+			return -1;
+		}
+
+		ss->bytes_written += ((u64)ss->blkcnt) * info->blksz;
+		ss->total_blocks += chunk_header->chunk_sz;
+		ss->chunk_left = chunk_data_sz;
+		break;
+
+	case CHUNK_TYPE_FILL:
+		if (chunk_header->total_sz !=
+		    (sparse_header->chunk_hdr_sz + sizeof(uint32_t))) {
+			info->mssg("Bogus chunk size for chunk type FILL",
+				   response);
+			return -1;
+		}
+
+		if (ss->blk + ss->raw_blks + ss->blkcnt >
+		    info->start + info->size) {
+			printf("%s: Request would exceed partition size!\n",
+			       __func__);
+			info->mssg("Request would exceed partition size!",
+				   response);
+			return -1;
+		}
+
+		ss->bytes_written += ((u64)ss->blkcnt) * info->blksz;
+		ss->total_blocks += DIV_ROUND_UP_ULL(chunk_data_sz,
+						     sparse_header->blk_sz);
+		ss->chunk_left = sizeof(uint32_t);
+		break;
+
+	case CHUNK_TYPE_DONT_CARE:
+		if (sparse_flush_raw(ss, response))
+			return -1;
+		ss->blk += info->reserve(info, ss->blk, ss->blkcnt);
+		ss->total_blocks += chunk_header->chunk_sz;
+		ss->chunk_left = 0;
+		break;
+
+	case CHUNK_TYPE_CRC32:
+		if (chunk_header->total_sz != sparse_header->chunk_hdr_sz) {
+			info->mssg("Bogus chunk size for chunk type Dont Care",
+				   response);
+			return -1;
+		}
+		ss->total_blocks += chunk_header->chunk_sz;
+		ss->chunk_left = chunk_data_sz;
+		break;
+
+	default:
+		printf("%s: Unknown chunk type: %x\n", __func__,
+		       chunk_header->chunk_type);
+		info->mssg("Unknown chunk type", response);
+		return -1;
+	}
+
+	return 0;
+}
+
+void sparse_stream_init(struct sparse_stream *ss, struct sparse_storage *info)
+{
+	memset(ss, '\0', sizeof(*ss));
+	if (!info->mssg)
+		info->mssg = default_log;
+	ss->info = info;
+	ss->blk = info->start;
+}
+
+static long sparse_stream_consume(struct sparse_stream *ss, const void *data,
+				  size_t len, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	size_t left = len;
+	lbaint_t blks;
+	size_t n;
+	long ret;
+
+	if (!ss->header_done) {
+		ret = sparse_stream_header(ss, data, left, response);
+		if (ret <= 0)
+			return ret;
+		ss->header_done = true;
+		data += ret;
+		left -= ret;
+	}
+
+	while (ss->chunk < ss->header.total_chunks) {
+		if (!ss->in_chunk) {
 			/*
-			 * Skip the remaining bytes in a header that is longer
-			 * than we expected.
+			 * Read and skip over chunk header, including the
+			 * remaining bytes of a header that is longer than we
+			 * expected
 			 */
-			data += (sparse_header->chunk_hdr_sz -
-				 sizeof(chunk_header_t));
+			if (left < ss->header.chunk_hdr_sz)
+				break;
+			if (sparse_stream_chunk(ss, data, response))
+				return -1;
+			data += ss->header.chunk_hdr_sz;
+			left -= ss->header.chunk_hdr_sz;
+			ss->in_chunk = true;
 		}
 
-		chunk_data_sz = ((u64)sparse_header->blk_sz) * chunk_header->chunk_sz;
-		blkcnt = DIV_ROUND_UP_ULL(chunk_data_sz, info->blksz);
-		switch (chunk_header->chunk_type) {
+		switch (ss->chunk_header.chunk_type) {
 		case CHUNK_TYPE_RAW:
-			if (chunk_header->total_sz !=
-			    (sparse_header->chunk_hdr_sz + chunk_data_sz)) {
-				info->mssg("Bogus chunk size for chunk type Raw",
-					   response);
-				return -1;
-			}
-
-			if (blk + blkcnt > info->start + info->size) {
-				printf(
-				    "%s: Request would exceed partition size!\n",
-				    __func__);
-				info->mssg("Request would exceed partition size!",
-					   response);
-				return -1;
-			}
-
-			blks = write_sparse_chunk_raw(info, blk, blkcnt,
-						      data, response);
-			if (blks < 0)
+			/* only whole blocks are written, keep the rest */
+			n = min_t(u64, left, ss->chunk_left);
+			blks = n / info->blksz;
+			if (!blks)
+				goto out;
+			n = blks * info->blksz;
+			if (sparse_write_raw(ss, data, blks, response))
 				return -1;
-
-			blk += blks;
-			bytes_written += ((u64)blkcnt) * info->blksz;
-			total_blocks += chunk_header->chunk_sz;
-			data += chunk_data_sz;
 			break;
 
 		case CHUNK_TYPE_FILL:
-			if (chunk_header->total_sz !=
-			    (sparse_header->chunk_hdr_sz + sizeof(uint32_t))) {
-				info->mssg("Bogus chunk size for chunk type FILL", response);
-				return -1;
-			}
-
-			fill_buf = (uint32_t *)
-				   memalign(ARCH_DMA_MINALIGN,
-					    ROUNDUP(
-						info->blksz * fill_buf_num_blks,
-						ARCH_DMA_MINALIGN));
-			if (!fill_buf) {
-				info->mssg("Malloc failed for: CHUNK_TYPE_FILL",
-					   response);
-				return -1;
-			}
-
-			fill_val = *(uint32_t *)data;
-			data = (char *)data + sizeof(uint32_t);
-
-			for (i = 0;
-			     i < (info->blksz * fill_buf_num_blks /
-				  sizeof(fill_val));
-			     i++)
-				fill_buf[i] = fill_val;
-
-			if (blk + blkcnt > info->start + info->size) {
-				printf(
-				    "%s: Request would exceed partition size!\n",
-				    __func__);
-				info->mssg("Request would exceed partition size!",
-					   response);
-				free(fill_buf);
+			n = sizeof(uint32_t);
+			if (left < n)
+				goto out;
+			if (sparse_write_fill(ss, *(uint32_t *)data,
+					      response))
 				return -1;
-			}
-
-			for (i = 0; i < blkcnt;) {
-				j = blkcnt - i;
-				if (j > fill_buf_num_blks)
-					j = fill_buf_num_blks;
-				blks = info->write(info, blk, j, fill_buf);
-				/* blks might be > j (eg. NAND bad-blocks) */
-				if (blks < j) {
-					printf("%s: %s " LBAFU " [%d]\n",
-					       __func__,
-					       "Write failed, block #",
-					       blk, j);
-					info->mssg("flash write failure",
-						   response);
-					free(fill_buf);
-					return -1;
-				}
-				blk += blks;
-				i += j;
-			}
-			bytes_written += ((u64)blkcnt) * info->blksz;
-			total_blocks += DIV_ROUND_UP_ULL(chunk_data_sz,
-							 sparse_header->blk_sz);
-			free(fill_buf);
 			break;
 
-		case CHUNK_TYPE_DONT_CARE:
-			blk += info->reserve(info, blk, blkcnt);
-			total_blocks += chunk_header->chunk_sz;
+		default:
+			n = min_t(u64, left, ss->chunk_left);
 			break;
+		}
 
-		case CHUNK_TYPE_CRC32:
-			if (chunk_header->total_sz !=
-			    sparse_header->chunk_hdr_sz) {
-				info->mssg("Bogus chunk size for chunk type Dont Care",
-					   response);
-				return -1;
-			}
-			total_blocks += chunk_header->chunk_sz;
-			data += chunk_data_sz;
+		data += n;
+		left -= n;
+		ss->chunk_left -= n;
+		if (ss->chunk_left)
 			break;
+		ss->in_chunk = false;
+		ss->chunk++;
+	}
 
-		default:
-			printf("%s: Unknown chunk type: %x\n", __func__,
-			       chunk_header->chunk_type);
-			info->mssg("Unknown chunk type", response);
-			return -1;
-		}
+out:
+	return len - left;
+}
+
+long sparse_stream_write(struct sparse_stream *ss, const void *data,
+			 size_t len, char *response)
+{
+	long ret;
+
+	ret = sparse_stream_consume(ss, data, len, response);
+	if (ret < 0)
+		sparse_stream_release(ss);
+
+	return ret;
+}
+
+int sparse_stream_finish(struct sparse_stream *ss, const char *part_name,
+			 char *response)
+{
+	struct sparse_storage *info = ss->info;
+	int ret;
+
+	ret = sparse_flush_raw(ss, response);
+	sparse_stream_release(ss);
+	if (ret)
+		return -1;
+
+	if (!ss->header_done || ss->chunk < ss->header.total_chunks) {
+		printf("%s: Sparse image is truncated\n", __func__);
+		info->mssg("sparse image truncated", response);
+		return -1;
 	}
 
 	debug("Wrote %d blocks, expected to write %d blocks\n",
-	      total_blocks, sparse_header->total_blks);
-	printf("........ wrote %llu bytes to '%s'\n", bytes_written, part_name);
+	      ss->total_blocks, ss->header.total_blks);
+	printf("........ wrote %llu bytes to '%s'\n", ss->bytes_written,
+	       part_name);
 
-	if (total_blocks != sparse_header->total_blks) {
+	if (ss->total_blocks != ss->header.total_blks) {
 		info->mssg("sparse image write failure", response);
 		return -1;
 	}
 
 	return 0;
 }
+
+int write_sparse_image(struct sparse_storage *info,
+		       const char *part_name, void *data, char *response)
+{
+	struct sparse_stream ss;
+
+	sparse_stream_init(&ss, info);
+	/* the whole image is in memory, so there is no length limit */
+	if (sparse_stream_write(&ss, data, SIZE_MAX, response) < 0)
+		return -1;
+
+	return sparse_stream_finish(&ss, part_name, response);
+}
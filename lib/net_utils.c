@@ -11,6 +11,8 @@
 
 #include <common.h>
 #include <net.h>
+#include <net6.h>
+#include <linux/ctype.h>
 
 struct in_addr string_to_ip(const char *s)
 {
@@ -43,6 +45,90 @@ struct in_addr string_to_ip(const char *s)
 	return addr;
 }
 
+#ifdef CONFIG_IPV6
+int string_to_ip6(const char *s, size_t len, struct in6_addr *addr)
+{
+	const char *end = s + len;
+	const char *start;
+	u16 groups[8];
+	int ngroups = 0, gap = -1;
+	int digits, i;
+	u32 val;
+
+	if (!s || !len)
+		return -EINVAL;
+
+	/* A leading "::" is the only place where a colon can come first */
+	if (*s == ':') {
+		if (len < 2 || s[1] != ':')
+			return -EINVAL;
+		gap = 0;
+		s += 2;
+	}
+
+	while (s < end) {
+		if (ngroups == 8)
+			return -EINVAL;
+
+		start = s;
+		for (val = 0, digits = 0; s < end && isxdigit(*s); s++) {
+			val = val << 4 | (isdigit(*s) ? *s - '0' :
+					  tolower(*s) - 'a' + 10);
+			digits++;
+		}
+
+		if (s < end && *s == '.') {
+			/* IPv4 address in the last 32 bits */
+			char ip4[16];
+			struct in_addr ip;
+
+			if (ngroups > 6 || end - start >= sizeof(ip4))
+				return -EINVAL;
+			for (s = start; s < end; s++) {
+				if (!isdigit(*s) && *s != '.')
+					return -EINVAL;
+			}
+			memcpy(ip4, start, end - start);
+			ip4[end - start] = '\0';
+			ip = string_to_ip(ip4);
+			if (!ip.s_addr)
+				return -EINVAL;
+			val = ntohl(ip.s_addr);
+			groups[ngroups++] = val >> 16;
+			groups[ngroups++] = val & 0xffff;
+			break;
+		}
+
+		if (!digits || digits > 4)
+			return -EINVAL;
+		groups[ngroups++] = val;
+
+		if (s == end)
+			break;
+		if (*s++ != ':' || s == end)
+			return -EINVAL;
+		if (*s == ':') {
+			if (gap >= 0)
+				return -EINVAL;
+			gap = ngroups;
+			s++;
+		}
+	}
+
+	if (gap < 0 ? ngroups != 8 : ngroups > 7)
+		return -EINVAL;
+
+	memset(addr, '\0', sizeof(*addr));
+	for (i = 0; i < ngroups; i++) {
+		int pos = (gap >= 0 && i >= gap) ? 8 - ngroups + i : i;
+
+		addr->s6_addr16[pos] = htons(groups[i]);
+	}
+
+	return 0;
+}
+#endif
+
 void string_to_enetaddr(const char *addr, uint8_t *enetaddr)
 {
 	char *end;
@@ -366,6 +366,50 @@ static char *ip6_addr_string(char *buf, char *end, u8 *addr, int field_width,
 		      flags & ~SPECIAL);
 }
 
+static char *ip6_compressed_string(char *buf, char *end, u8 *addr,
+				   int field_width, int precision, int flags)
+{
+	/* (8 * 4 hex digits), 7 colons and trailing zero */
+	char ip6_addr[8 * 5];
+	char *p = ip6_addr;
+	int zero_start = -1, zero_len = 1;
+	int i, run, shift;
+	u16 word;
+
+	/* The longest run of two or more zero words is written as "::" */
+	for (i = 0; i < 8; i += run + 1) {
+		for (run = 0; i + run < 8; run++) {
+			if (addr[2 * (i + run)] || addr[2 * (i + run) + 1])
+				break;
+		}
+		if (run > zero_len) {
+			zero_start = i;
+			zero_len = run;
+		}
+	}
+
+	for (i = 0; i < 8; i++) {
+		if (i == zero_start) {
+			*p++ = ':';
+			if (!i)
+				*p++ = ':';
+			i += zero_len - 1;
+			continue;
+		}
+		word = addr[2 * i] << 8 | addr[2 * i + 1];
+		for (shift = 12; shift > 0 && !(word >> shift); shift -= 4)
+			;
+		for (; shift >= 0; shift -= 4)
+			*p++ = hex_asc_lo(word >> shift);
+		if (i != 7)
+			*p++ = ':';
+	}
+	*p = '\0';
+
+	return string(buf, end, ip6_addr, field_width, precision,
+		      flags & ~SPECIAL);
+}
+
 static char *ip4_addr_string(char *buf, char *end, u8 *addr, int field_width,
 			 int precision, int flags)
 {
@@ -450,10 +494,10 @@ static char *uuid_string(char *buf, char *end, u8 *addr, int field_width,
  *       decimal for v4 and colon separated network-order 16 bit hex for v6)
  * - 'i' [46] for 'raw' IPv4/IPv6 addresses, IPv6 omits the colons, IPv4 is
  *       currently the same
+ * - 'I6c' for IPv6 addresses printed in the compressed form of RFC 5952,
+ *       such as 2001:db8::1
  *
- * Note: IPv6 support is currently if(0)'ed out. If you ever need
- * %pI6, please add an IPV6 Kconfig knob, make your code select or
- * depend on that, and change the 0 below to CONFIG_IS_ENABLED(IPV6).
+ * Note: IPv6 addresses are only printed with CONFIG_IPV6.
  */
 static char *pointer(const char *fmt, char *buf, char *end, void *ptr,
 		int field_width, int precision, int flags)
@@ -498,10 +542,14 @@ static char *pointer(const char *fmt, char *buf, char *end, void *ptr,
 		flags |= SPECIAL;
 		/* Fallthrough */
 	case 'I':
-		/* %pI6 currently unused */
-		if (0 && fmt[1] == '6')
+		if (IS_ENABLED(CONFIG_IPV6) && fmt[1] == '6') {
+			if (fmt[2] == 'c')
+				return ip6_compressed_string(buf, end, ptr,
+							     field_width,
+							     precision, flags);
 			return ip6_addr_string(buf, end, ptr, field_width,
 					       precision, flags);
+		}
 		if (fmt[1] == '4')
 			return ip4_addr_string(buf, end, ptr, field_width,
 					       precision, flags);
@@ -41,6 +41,143 @@ int		arp_wait_try;
 uchar	       *arp_tx_packet; /* THE ARP transmit packet */
 static uchar	arp_tx_packet_buf[PKTSIZE_ALIGN + PKTALIGN];
 
+/* Address to resolve to reach @dest: @dest itself, or the gateway */
+static struct in_addr arp_next_hop(struct in_addr dest)
+{
+	if ((dest.s_addr & net_netmask.s_addr) !=
+	    (net_ip.s_addr & net_netmask.s_addr) && net_gateway.s_addr)
+		return net_gateway;
+
+	return dest;
+}
+
+#ifdef CONFIG_NET_ARP_CACHE
+/**
+ * struct arp_entry - a neighbour whose MAC address is known
+ *
+ * @ip:		IP address, 0 if the entry is free
+ * @ethaddr:	MAC address
+ * @dev:	index of the Ethernet device the neighbour is on
+ * @learned:	time when the address was last seen in an ARP packet
+ * @used:	time when the entry was last used, for LRU replacement
+ */
+struct arp_entry {
+	struct in_addr ip;
+	uchar ethaddr[ARP_HLEN];
+	int dev;
+	ulong learned;
+	ulong used;
+};
+
+/* Kept across calls to net_loop(), so hosts are not resolved each time */
+static struct arp_entry arp_cache[CONFIG_NET_ARP_CACHE_SIZE];
+
+static bool arp_entry_expired(struct arp_entry *entry)
+{
+	return get_timer(entry->learned) >=
+		CONFIG_NET_ARP_CACHE_TIMEOUT * 1000UL;
+}
+
+static struct arp_entry *arp_cache_find(struct in_addr ip)
+{
+	struct arp_entry *entry;
+	int dev = eth_get_dev_index();
+
+	for (entry = arp_cache; entry < arp_cache + ARRAY_SIZE(arp_cache);
+	     entry++) {
+		if (entry->ip.s_addr != ip.s_addr || entry->dev != dev)
+			continue;
+		if (!arp_entry_expired(entry))
+			return entry;
+		entry->ip.s_addr = 0;
+		break;
+	}
+
+	return NULL;
+}
+
+static void arp_cache_add(struct in_addr ip, const uchar *ethaddr)
+{
+	struct arp_entry *entry, *lru;
+
+	if (!ip.s_addr || !is_valid_ethaddr(ethaddr))
+		return;
+
+	entry = arp_cache_find(ip);
+	if (!entry) {
+		/* Take a free entry, or else the least recently used one */
+		lru = arp_cache;
+		for (entry = arp_cache;
+		     entry < arp_cache + ARRAY_SIZE(arp_cache); entry++) {
+			if (!entry->ip.s_addr) {
+				lru = entry;
+				break;
+			}
+			if ((long)(entry->used - lru->used) < 0)
+				lru = entry;
+		}
+		entry = lru;
+		entry->ip = ip;
+		entry->dev = eth_get_dev_index();
+	}
+	debug_cond(DEBUG_DEV_PKT, "ARP cache: %pI4 is %pM\n", &ip, ethaddr);
+	memcpy(entry->ethaddr, ethaddr, ARP_HLEN);
+	entry->learned = get_timer(0);
+	entry->used = entry->learned;
+}
+
+int arp_cache_lookup(struct in_addr dest, uchar *ethaddr)
+{
+	struct arp_entry *entry;
+
+	entry = arp_cache_find(arp_next_hop(dest));
+	if (!entry)
+		return -ENOENT;
+
+	memcpy(ethaddr, entry->ethaddr, ARP_HLEN);
+	entry->used = get_timer(0);
+
+	return 0;
+}
+
+int arp_cache_delete(struct in_addr ip)
+{
+	struct arp_entry *entry;
+	int ret = -ENOENT;
+
+	for (entry = arp_cache; entry < arp_cache + ARRAY_SIZE(arp_cache);
+	     entry++) {
+		if (entry->ip.s_addr && (!ip.s_addr ||
+					 entry->ip.s_addr == ip.s_addr)) {
+			entry->ip.s_addr = 0;
+			ret = 0;
+		}
+	}
+
+	return ret;
+}
+
+void arp_cache_show(void)
+{
+	struct arp_entry *entry;
+	char ip[16];
+
+	puts("IP address       MAC address        Age  Device\n");
+	for (entry = arp_cache; entry < arp_cache + ARRAY_SIZE(arp_cache);
+	     entry++) {
+		if (!entry->ip.s_addr || arp_entry_expired(entry))
+			continue;
+		sprintf(ip, "%pI4", &entry->ip);
+		printf("%-16s %pM %4lus  eth%d\n", ip, entry->ethaddr,
+		       get_timer(entry->learned) / 1000, entry->dev);
+	}
+}
+#else
+static inline void arp_cache_add(struct in_addr ip, const uchar *ethaddr)
+{
+}
+#endif /* CONFIG_NET_ARP_CACHE */
+
 void arp_init(void)
 {
 	/* XXX problem with bss workaround */
@@ -85,16 +222,10 @@ void arp_raw_request(struct in_addr source_ip, const uchar *target_ethaddr,
 void arp_request(void)
 {
 	if ((net_arp_wait_packet_ip.s_addr & net_netmask.s_addr) !=
-	    (net_ip.s_addr & net_netmask.s_addr)) {
-		if (net_gateway.s_addr == 0) {
-			puts("## Warning: gatewayip needed but not set\n");
-			net_arp_wait_reply_ip = net_arp_wait_packet_ip;
-		} else {
-			net_arp_wait_reply_ip = net_gateway;
-		}
-	} else {
-		net_arp_wait_reply_ip = net_arp_wait_packet_ip;
-	}
+	    (net_ip.s_addr & net_netmask.s_addr) && net_gateway.s_addr == 0)
+		puts("## Warning: gatewayip needed but not set\n");
+
+	net_arp_wait_reply_ip = arp_next_hop(net_arp_wait_packet_ip);
 
 	arp_raw_request(net_ip, net_null_ethaddr, net_arp_wait_reply_ip);
 }
@@ -164,6 +295,9 @@ void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 
 	switch (ntohs(arp->ar_op)) {
 	case ARPOP_REQUEST:
+		/* the sender is likely to talk to us next */
+		arp_cache_add(net_read_ip(&arp->ar_spa), &arp->ar_sha);
+
 		/* reply with our IP address */
 		debug_cond(DEBUG_DEV_PKT, "Got ARP REQUEST, return our IP\n");
 		eth_hdr_size = net_update_ether(et, et->et_src, PROT_ARP);
@@ -215,6 +349,7 @@ void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 			if (arp_wait_packet_ethaddr != NULL)
 				memcpy(arp_wait_packet_ethaddr,
 				       &arp->ar_sha, ARP_HLEN);
+			arp_cache_add(reply_ip_addr, &arp->ar_sha);
 
 			net_get_arp_handler()((uchar *)arp, 0, reply_ip_addr,
 					      0, len);
@@ -29,4 +29,20 @@ void arp_raw_request(struct in_addr source_ip, const uchar *targetEther,
 int arp_timeout_check(void);
 void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len);
 
+#ifdef CONFIG_NET_ARP_CACHE
+/**
+ * arp_cache_lookup() - find the MAC address to send to in the ARP cache
+ *
+ * @dest:	IP address of the destination, which may be behind the gateway
+ * @ethaddr:	set to the MAC address of @dest or of the gateway if found
+ * Return: 0 if found, -ENOENT if an ARP request is needed
+ */
+int arp_cache_lookup(struct in_addr dest, uchar *ethaddr);
+#else
+static inline int arp_cache_lookup(struct in_addr dest, uchar *ethaddr)
+{
+	return -ENOENT;
+}
+#endif
+
 #endif /* __ARP_H__ */
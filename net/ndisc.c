@@ -0,0 +1,358 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Neighbour discovery for IPv6 (RFC 4861)
+ *
+ * This does for IPv6 what arp.c does for IPv4: a packet whose next hop has
+ * an unknown MAC address waits in net_tx_packet while neighbour
+ * solicitations are sent, and goes out when the advertisement arrives.
+ * Router advertisements give the default router and, with stateless
+ * address autoconfiguration (RFC 4862), our global address.
+ */
+
+#include <common.h>
+#include <console.h>
+#include <log.h>
+#include <net.h>
+#include <net6.h>
+
+#include "ndisc.h"
+
+/* Milliseconds before soliciting again, RETRANS_TIMER in RFC 4861 */
+#define ND_TIMEOUT		1000UL
+
+#ifndef	CONFIG_NET_RETRY_COUNT
+# define ND_TIMEOUT_COUNT	5	/* # of timeouts before giving up  */
+#else
+# define ND_TIMEOUT_COUNT	CONFIG_NET_RETRY_COUNT
+#endif
+
+/* Router solicitations: MAX_RTR_SOLICITATIONS, with a shorter interval */
+#define ND_RS_COUNT		3
+#define ND_RS_TIMEOUT		1000UL
+
+#define ND_OPT_LL_ADDR_SIZE	(ND_OPT_LL_ADDR_LEN * 8)
+#define NS_MSG_SIZE		(sizeof(struct nd_msg) + ND_OPT_LL_ADDR_SIZE)
+#define NA_MSG_SIZE		NS_MSG_SIZE
+#define RS_MSG_SIZE		(sizeof(struct rs_msg) + ND_OPT_LL_ADDR_SIZE)
+
+struct in6_addr net_nd_sol_packet_ip6;
+uchar *net_nd_packet_mac;
+int net_nd_tx_packet_size;
+ulong net_nd_timer_start;
+int net_nd_try;
+uchar *net_nd_tx_packet;
+static uchar net_nd_tx_packet_buf[PKTSIZE_ALIGN + PKTALIGN];
+
+/* A router advertisement was received since the last solicitation */
+static bool ndisc_ra_received;
+
+static const struct in6_addr all_routers_mcast = {
+	.s6_addr = { 0xff, 0x02, [15] = 0x02 }
+};
+
+void ndisc_init(void)
+{
+	net_nd_packet_mac = NULL;
+	memset(&net_nd_sol_packet_ip6, '\0', sizeof(net_nd_sol_packet_ip6));
+	net_nd_tx_packet_size = 0;
+	net_nd_tx_packet = &net_nd_tx_packet_buf[0] + (PKTALIGN - 1);
+	net_nd_tx_packet -= (ulong)net_nd_tx_packet % PKTALIGN;
+}
+
+void ndisc_init_loop(void)
+{
+	net_nd_packet_mac = NULL;
+	memset(&net_nd_sol_packet_ip6, '\0', sizeof(net_nd_sol_packet_ip6));
+	net_nd_tx_packet_size = 0;
+}
+
+bool ndisc_is_waiting(void)
+{
+	return !ip6_is_unspecified_addr(&net_nd_sol_packet_ip6);
+}
+
+/* Write a link-layer address option, return its size */
+static int ndisc_add_ll_option(uchar *opt, int type)
+{
+	opt[0] = type;
+	opt[1] = ND_OPT_LL_ADDR_LEN;
+	memcpy(opt + 2, net_ethaddr, ARP_HLEN);
+
+	return ND_OPT_LL_ADDR_SIZE;
+}
+
+/* Find an option of @type in @len bytes of options, NULL if not there */
+static uchar *ndisc_find_option(uchar *opt, int len, int type)
+{
+	int opt_len;
+
+	while (len >= 2) {
+		opt_len = opt[1] * 8;
+		if (!opt_len || opt_len > len)
+			return NULL;
+		if (opt[0] == type)
+			return opt;
+		opt += opt_len;
+		len -= opt_len;
+	}
+
+	return NULL;
+}
+
+/* Send an ICMPv6 message of @len bytes, written after the IPv6 header */
+static void ndisc_send(uchar *pkt, const uchar *ether,
+		       const struct in6_addr *src, const struct in6_addr *dest,
+		       int len)
+{
+	struct icmp6_hdr *icmp;
+	int eth_hdr_size;
+
+	eth_hdr_size = net_set_ether(pkt, ether, PROT_IPV6);
+	ip6_add_hdr(pkt + eth_hdr_size, src, dest, IPPROTO_ICMPV6,
+		    ND_HOP_LIMIT, len);
+	icmp = (struct icmp6_hdr *)(pkt + eth_hdr_size + IP6_HDR_SIZE);
+	icmp->icmp6_cksum = 0;
+	icmp->icmp6_cksum = ip6_csum(src, dest, len, IPPROTO_ICMPV6, icmp);
+
+	net_send_packet(pkt, eth_hdr_size + IP6_HDR_SIZE + len);
+}
+
+void ndisc_request(void)
+{
+	struct in6_addr dest;
+	uchar ether[ARP_HLEN];
+	struct nd_msg *msg;
+
+	debug_cond(DEBUG_DEV_PKT, "NS for %pI6c, try %d\n",
+		   &net_nd_sol_packet_ip6, net_nd_try);
+
+	ip6_make_snma(&dest, &net_nd_sol_packet_ip6);
+	ip6_make_mult_ethdstaddr(ether, &dest);
+
+	msg = (struct nd_msg *)(net_nd_tx_packet + net_eth_hdr_size() +
+				IP6_HDR_SIZE);
+	memset(msg, '\0', sizeof(*msg));
+	msg->icmph.icmp6_type = ICMPV6_NEIGHBOUR_SOLICIT;
+	msg->target = net_nd_sol_packet_ip6;
+	ndisc_add_ll_option(msg->opt, ND_OPT_SOURCE_LL_ADDR);
+
+	ndisc_send(net_nd_tx_packet, ether, net_ip6_src(&net_nd_sol_packet_ip6),
+		   &dest, NS_MSG_SIZE);
+}
+
+int ndisc_timeout_check(void)
+{
+	ulong t;
+
+	if (!ndisc_is_waiting())
+		return 0;
+
+	t = get_timer(0);
+
+	/* check for neighbour solicitation timeout */
+	if ((t - net_nd_timer_start) > ND_TIMEOUT) {
+		net_nd_try++;
+
+		if (net_nd_try >= ND_TIMEOUT_COUNT) {
+			puts("\nNeighbour discovery retry count exceeded; starting again\n");
+			net_nd_try = 0;
+			memset(&net_nd_sol_packet_ip6, '\0',
+			       sizeof(net_nd_sol_packet_ip6));
+			net_set_state(NETLOOP_FAIL);
+		} else {
+			net_nd_timer_start = t;
+			ndisc_request();
+		}
+	}
+
+	return 1;
+}
+
+/* Answer a neighbour solicitation for one of our addresses */
+static void ndisc_send_na(struct ethernet_hdr *et, struct ip6_hdr *ip6,
+			  const struct in6_addr *target)
+{
+	struct in6_addr src = *target;
+	struct in6_addr dest = ip6->ip6_src;
+	uchar ether[ARP_HLEN];
+	struct nd_msg *msg;
+	uchar *pkt;
+	u32 flags = ICMPV6_NA_OVERRIDE;
+
+	debug_cond(DEBUG_DEV_PKT, "Got NS for %pI6c, return NA\n", &src);
+
+	/* Duplicate address detection: tell everyone the address is taken */
+	if (ip6_is_unspecified_addr(&dest)) {
+		dest = net_all_nodes_mcast;
+		ip6_make_mult_ethdstaddr(ether, &dest);
+	} else {
+		flags |= ICMPV6_NA_SOLICITED;
+		memcpy(ether, et->et_src, ARP_HLEN);
+	}
+
+	pkt = net_get_async_tx_pkt_buf();
+	msg = (struct nd_msg *)(pkt + net_eth_hdr_size() + IP6_HDR_SIZE);
+	memset(msg, '\0', sizeof(*msg));
+	msg->icmph.icmp6_type = ICMPV6_NEIGHBOUR_ADVERT;
+	msg->icmph.un.na_flags = htonl(flags);
+	msg->target = src;
+	ndisc_add_ll_option(msg->opt, ND_OPT_TARGET_LL_ADDR);
+
+	ndisc_send(pkt, ether, &src, &dest, NA_MSG_SIZE);
+}
+
+/* Send the packet waiting for the advertised neighbour */
+static void ndisc_got_na(struct ethernet_hdr *et, struct nd_msg *msg, int len)
+{
+	uchar *opt;
+	const uchar *ethaddr = et->et_src;
+
+	opt = ndisc_find_option(msg->opt, len - sizeof(*msg),
+				ND_OPT_TARGET_LL_ADDR);
+	if (opt && opt[1] == ND_OPT_LL_ADDR_LEN)
+		ethaddr = opt + 2;
+
+	debug_cond(DEBUG_DEV_PKT, "Got NA, %pI6c is %pM\n", &msg->target,
+		   ethaddr);
+
+	/* save address for later use */
+	if (net_nd_packet_mac)
+		memcpy(net_nd_packet_mac, ethaddr, ARP_HLEN);
+
+	/* set the mac address in the waiting packet's header and transmit it */
+	memcpy(((struct ethernet_hdr *)net_tx_packet)->et_dest, ethaddr,
+	       ARP_HLEN);
+	net_send_packet(net_tx_packet, net_nd_tx_packet_size);
+
+	/* no solicitation pending now */
+	memset(&net_nd_sol_packet_ip6, '\0', sizeof(net_nd_sol_packet_ip6));
+	net_nd_tx_packet_size = 0;
+	net_nd_packet_mac = NULL;
+}
+
+/* Take the router and, for SLAAC, the prefix from an advertisement */
+static void ndisc_got_ra(struct ip6_hdr *ip6, struct ra_msg *msg, int len)
+{
+	struct nd_opt_prefix_info *pi;
+	uchar *end = (uchar *)msg + len;
+	uchar *opt = msg->opt;
+	int i;
+
+	ndisc_ra_received = true;
+
+	if (msg->icmph.un.ra.lifetime &&
+	    ip6_is_unspecified_addr(&net_gateway6)) {
+		net_gateway6 = ip6->ip6_src;
+		debug_cond(DEBUG_DEV_PKT, "RA: router %pI6c\n", &net_gateway6);
+	}
+
+	if (!ip6_is_unspecified_addr(&net_ip6))
+		return;
+
+	while ((opt = ndisc_find_option(opt, end - opt, ND_OPT_PREFIX_INFO))) {
+		pi = (struct nd_opt_prefix_info *)opt;
+		opt += opt[1] * 8;
+
+		/* Only 64-bit prefixes go with an interface ID from the MAC */
+		if (pi->nd_opt_len != 4 || !(pi->flags & ND_OPT_PI_FLAG_AUTO) ||
+		    pi->prefix_len != 64 || !pi->valid_lifetime ||
+		    ip6_is_link_local(&pi->prefix))
+			continue;
+
+		for (i = 0; i < 8; i++)
+			net_ip6.s6_addr[i] = pi->prefix.s6_addr[i];
+		for (; i < 16; i++)
+			net_ip6.s6_addr[i] = net_link_local_ip6.s6_addr[i];
+		net_prefix_length = pi->prefix_len;
+		debug_cond(DEBUG_DEV_PKT, "RA: address %pI6c/%d\n", &net_ip6,
+			   net_prefix_length);
+		break;
+	}
+}
+
+int ndisc_receive(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len)
+{
+	struct icmp6_hdr *icmp = (struct icmp6_hdr *)(ip6 + 1);
+	struct nd_msg *msg = (struct nd_msg *)icmp;
+	int icmp_len = len - IP6_HDR_SIZE;
+
+	/* Messages which crossed a router are forged (RFC 4861 7.1.1) */
+	if (ip6->ip6_hlim != ND_HOP_LIMIT || icmp->icmp6_code)
+		return -EINVAL;
+
+	switch (icmp->icmp6_type) {
+	case ICMPV6_NEIGHBOUR_SOLICIT:
+		if (icmp_len < sizeof(*msg) || ip6_is_multicast(&msg->target))
+			return -EINVAL;
+		if (ip6_addr_equal(&msg->target, &net_link_local_ip6) ||
+		    (!ip6_is_unspecified_addr(&net_ip6) &&
+		     ip6_addr_equal(&msg->target, &net_ip6)))
+			ndisc_send_na(et, ip6, &msg->target);
+		return 0;
+
+	case ICMPV6_NEIGHBOUR_ADVERT:
+		if (icmp_len < sizeof(*msg))
+			return -EINVAL;
+		/* are we waiting for a reply? */
+		if (ndisc_is_waiting() &&
+		    ip6_addr_equal(&msg->target, &net_nd_sol_packet_ip6))
+			ndisc_got_na(et, msg, icmp_len);
+		return 0;
+
+	case ICMPV6_ROUTER_ADVERT:
+		if (icmp_len < sizeof(struct ra_msg) ||
+		    !ip6_is_link_local(&ip6->ip6_src))
+			return -EINVAL;
+		ndisc_got_ra(ip6, (struct ra_msg *)icmp, icmp_len);
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+static void ndisc_send_rs(void)
+{
+	struct rs_msg *msg;
+	uchar ether[ARP_HLEN];
+
+	ip6_make_mult_ethdstaddr(ether, &all_routers_mcast);
+	msg = (struct rs_msg *)(net_nd_tx_packet + net_eth_hdr_size() +
+				IP6_HDR_SIZE);
+	memset(msg, '\0', sizeof(*msg));
+	msg->icmph.icmp6_type = ICMPV6_ROUTER_SOLICIT;
+	ndisc_add_ll_option(msg->opt, ND_OPT_SOURCE_LL_ADDR);
+
+	ndisc_send(net_nd_tx_packet, ether, &net_link_local_ip6,
+		   &all_routers_mcast, RS_MSG_SIZE);
+}
+
+int ndisc_router_discover(void)
+{
+	ulong start;
+	int try;
+
+	ndisc_ra_received = false;
+	for (try = 0; try < ND_RS_COUNT && !ndisc_ra_received; try++) {
+		debug_cond(DEBUG_DEV_PKT, "RS, try %d\n", try + 1);
+		ndisc_send_rs();
+		start = get_timer(0);
+		while (!ndisc_ra_received && get_timer(start) < ND_RS_TIMEOUT) {
+			eth_rx();
+			if (ctrlc())
+				return -EINTR;
+		}
+	}
+
+	if (!ndisc_ra_received) {
+		puts("No IPv6 router answered\n");
+		return -ETIMEDOUT;
+	}
+	if (!ip6_is_unspecified_addr(&net_ip6))
+		printf("IPv6 address %pI6c/%d", &net_ip6, net_prefix_length);
+	if (!ip6_is_unspecified_addr(&net_gateway6))
+		printf("%srouter %pI6c", ip6_is_unspecified_addr(&net_ip6) ?
+		       "IPv6 " : ", ", &net_gateway6);
+	putc('\n');
+
+	return 0;
+}
@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Neighbour discovery for IPv6 (RFC 4861)
+ */
+
+#ifndef __NDISC_H__
+#define __NDISC_H__
+
+#include <net6.h>
+
+/* Address of the next hop we are soliciting, unspecified if none */
+extern struct in6_addr net_nd_sol_packet_ip6;
+/* MAC address of the waiting packet's destination */
+extern uchar *net_nd_packet_mac;
+/* Size of the waiting packet, in net_tx_packet */
+extern int net_nd_tx_packet_size;
+extern ulong net_nd_timer_start;
+extern int net_nd_try;
+/* Transmit buffer for neighbour and router solicitations */
+extern uchar *net_nd_tx_packet;
+
+/**
+ * ndisc_init() - set up the transmit buffer, once
+ */
+void ndisc_init(void);
+
+/**
+ * ndisc_init_loop() - forget any solicitation of an earlier net_loop()
+ */
+void ndisc_init_loop(void);
+
+/**
+ * ndisc_request() - send a neighbour solicitation for net_nd_sol_packet_ip6
+ */
+void ndisc_request(void);
+
+/**
+ * ndisc_timeout_check() - send the solicitation again if it timed out
+ *
+ * Return: 1 if waiting for an advertisement, 0 if not
+ */
+int ndisc_timeout_check(void);
+
+/**
+ * ndisc_is_waiting() - check if a packet is waiting for a neighbour
+ *
+ * Return: true if a solicitation is in progress
+ */
+bool ndisc_is_waiting(void);
+
+/**
+ * ndisc_receive() - handle a neighbour discovery message
+ *
+ * The checksum must have been checked already.
+ *
+ * @et:		Ethernet header of the packet
+ * @ip6:	IPv6 header of the packet
+ * @len:	length of the packet from the IPv6 header on
+ * Return: 0 if handled, -ve if the message is invalid
+ */
+int ndisc_receive(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len);
+
+/**
+ * ndisc_router_discover() - find a router and an address with SLAAC
+ *
+ * Send router solicitations and wait for an advertisement. The default
+ * router is taken from it unless gatewayip6 is set, and an address is made
+ * from its prefix unless ip6addr is set. Packets are received while
+ * waiting, so this must not be called while a packet is being built in
+ * net_tx_packet: net_ip6_start_loop() calls it before a protocol starts.
+ *
+ * Return: 0 if a router answered, -ETIMEDOUT if none did, -EINTR if
+ *	interrupted with Ctrl-C
+ */
+int ndisc_router_discover(void);
+
+#endif /* __NDISC_H__ */
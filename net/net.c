@@ -91,7 +91,9 @@
 #include <image.h>
 #include <log.h>
 #include <net.h>
+#include <net6.h>
 #include <net/fastboot.h>
+#include <net/tcp.h>
 #include <net/tftp.h>
 #if defined(CONFIG_CMD_PCAP)
 #include <net/pcap.h>
@@ -110,9 +112,12 @@
 #include "dns.h"
 #endif
 #include "link_local.h"
+#include "ndisc.h"
 #include "nfs.h"
 #include "ping.h"
+#include "ping6.h"
 #include "rarp.h"
+#include "wget.h"
 #if defined(CONFIG_CMD_WOL)
 #include "wol.h"
 #endif
@@ -350,6 +355,9 @@ static int net_init_loop(void)
 		 */
 		return -ENONET;
 
+	if (IS_ENABLED(CONFIG_IPV6))
+		net_ip6_init_loop();
+
 	return 0;
 }
 
@@ -358,6 +366,8 @@ static void net_clear_handlers(void)
 	net_set_udp_handler(NULL);
 	net_set_arp_handler(NULL);
 	net_set_timeout_handler(0, NULL);
+	if (IS_ENABLED(CONFIG_PROT_TCP))
+		tcp_release();
 }
 
 static void net_cleanup_loop(void)
@@ -382,6 +392,8 @@ int net_init(void)
 				(i + 1) * PKTSIZE_ALIGN;
 		}
 		arp_init();
+		if (IS_ENABLED(CONFIG_IPV6))
+			ndisc_init();
 		net_clear_handlers();
 
 		/* Only need to setup buffer pointers once. */
@@ -404,6 +416,10 @@ int net_loop(enum proto_t protocol)
 #if defined(CONFIG_CMD_PING)
 	if (protocol != PING)
 		net_ping_ip.s_addr = 0;
+#endif
+#if defined(CONFIG_CMD_PING6)
+	if (protocol != PING6)
+		memset(&net_ping_ip6, '\0', sizeof(net_ping_ip6));
 #endif
 	net_restarted = 0;
 	net_dev_exists = 0;
@@ -451,6 +467,15 @@ restart:
 	case 0:
 		net_dev_exists = 1;
 		net_boot_file_size = 0;
+		if (net_ip6_start_loop(protocol) == -EINTR) {
+			net_cleanup_loop();
+			eth_halt();
+			/* Invalidate the last protocol */
+			eth_set_last_protocol(BOOTP);
+			puts("\nAbort\n");
+			ret = -EINTR;
+			goto done;
+		}
 		switch (protocol) {
 #ifdef CONFIG_CMD_TFTPBOOT
 		case TFTPGET:
@@ -497,6 +522,11 @@ restart:
 			ping_start();
 			break;
 #endif
+#if defined(CONFIG_CMD_PING6)
+		case PING6:
+			ping6_start();
+			break;
+#endif
 #if defined(CONFIG_CMD_NFS) && !defined(CONFIG_SPL_BUILD)
 		case NFS:
 			nfs_start();
@@ -526,6 +556,11 @@ restart:
 		case WOL:
 			wol_start();
 			break;
+#endif
+#if defined(CONFIG_CMD_WGET)
+		case WGET:
+			wget_start();
+			break;
 #endif
 		default:
 			break;
@@ -562,6 +597,8 @@ restart:
 		WATCHDOG_RESET();
 		if (arp_timeout_check() > 0)
 			time_start = get_timer(0);
+		if (IS_ENABLED(CONFIG_IPV6) && ndisc_timeout_check() > 0)
+			time_start = get_timer(0);
 
 		/*
 		 *	Check the ethernet for a new packet.  The ethernet
@@ -577,6 +614,9 @@ restart:
 		if (ctrlc()) {
 			/* cancel any ARP that may not have completed */
 			net_arp_wait_packet_ip.s_addr = 0;
+			if (IS_ENABLED(CONFIG_IPV6))
+				memset(&net_nd_sol_packet_ip6, '\0',
+				       sizeof(net_nd_sol_packet_ip6));
 
 			net_cleanup_loop();
 			eth_halt();
@@ -805,6 +845,8 @@ uchar *net_get_async_tx_pkt_buf(void)
 {
 	if (arp_is_waiting())
 		return arp_tx_packet; /* If we are waiting, we already sent */
+	else if (IS_ENABLED(CONFIG_IPV6) && ndisc_is_waiting())
+		return net_nd_tx_packet;
 	else
 		return net_tx_packet;
 }
@@ -836,6 +878,9 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 	/* if broadcast, make the ether address a broadcast and don't do ARP */
 	if (dest.s_addr == 0xFFFFFFFF)
 		ether = (uchar *)net_bcast_ethaddr;
+	/* else the address may be known from an earlier ARP exchange */
+	else if (memcmp(ether, net_null_ethaddr, 6) == 0)
+		arp_cache_lookup(dest, ether);
 
 	pkt = (uchar *)net_tx_packet;
 
@@ -847,6 +892,14 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 				   payload_len);
 		pkt_hdr_size = eth_hdr_size + IP_UDP_HDR_SIZE;
 		break;
+#if defined(CONFIG_PROT_TCP)
+	case IPPROTO_TCP:
+		pkt_hdr_size = eth_hdr_size +
+			tcp_set_tcp_header(pkt + eth_hdr_size, dest, dport,
+					   sport, payload_len, action,
+					   tcp_seq_num, tcp_ack_num);
+		break;
+#endif
 	default:
 		return -EINVAL;
 	}
@@ -1256,6 +1309,11 @@ void net_process_received_packet(uchar *in_packet, int len)
 		if (ip->ip_p == IPPROTO_ICMP) {
 			receive_icmp(ip, len, src_ip, et);
 			return;
+#if defined(CONFIG_PROT_TCP)
+		} else if (ip->ip_p == IPPROTO_TCP) {
+			tcp_receive((struct ip_hdr *)ip, len);
+			return;
+#endif
 		} else if (ip->ip_p != IPPROTO_UDP) {	/* Only UDP packets */
 			return;
 		}
@@ -1321,6 +1379,11 @@ void net_process_received_packet(uchar *in_packet, int len)
 	case PROT_WOL:
 		wol_receive(ip, len);
 		break;
+#endif
+#ifdef CONFIG_IPV6
+	case PROT_IPV6:
+		net_ip6_handler(et, (struct ip6_hdr *)ip, len);
+		break;
 #endif
 	}
 }
@@ -1339,6 +1402,15 @@ static int net_check_prereq(enum proto_t protocol)
 		}
 		goto common;
 #endif
+#if defined(CONFIG_CMD_PING6)
+	case PING6:
+		if (ip6_is_unspecified_addr(&net_ping_ip6)) {
+			puts("*** ERROR: ping address not given\n");
+			return 1;
+		}
+		/* the link-local address is made from the MAC address */
+		goto ethaddr;
+#endif
 #if defined(CONFIG_CMD_DNS)
 	case DNS:
 		if (net_dns_server.s_addr == 0) {
@@ -1356,10 +1428,23 @@ static int net_check_prereq(enum proto_t protocol)
 
 #if defined(CONFIG_CMD_NFS)
 	case NFS:
+#endif
+#if defined(CONFIG_CMD_WGET)
+	case WGET:
 #endif
 		/* Fall through */
 	case TFTPGET:
 	case TFTPPUT:
+#if defined(CONFIG_IPV6)
+		if (net_use_ip6) {
+			if (ip6_is_unspecified_addr(&net_server_ip6) &&
+			    !is_serverip_in_cmd()) {
+				puts("*** ERROR: `serverip6' not set\n");
+				return 1;
+			}
+			goto ethaddr;
+		}
+#endif
 		if (net_server_ip.s_addr == 0 && !is_serverip_in_cmd()) {
 			puts("*** ERROR: `serverip' not set\n");
 			return 1;
@@ -1386,6 +1471,9 @@ common:
 	case CDP:
 	case DHCP:
 	case LINKLOCAL:
+#if defined(CONFIG_IPV6)
+ethaddr:
+#endif
 		if (memcmp(net_ethaddr, "\0\0\0\0\0\0", 6) == 0) {
 			int num = eth_get_dev_index();
 
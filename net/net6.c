@@ -0,0 +1,491 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * IPv6 network code
+ *
+ * Our addresses are the link-local one, made from the MAC address, and a
+ * global one which is either set in the ip6addr variable or learned from a
+ * router advertisement (SLAAC). Only UDP and ICMPv6 are handled, without
+ * extension headers or fragments.
+ */
+
+#include <common.h>
+#include <env.h>
+#include <log.h>
+#include <net.h>
+#include <net6.h>
+#include <search.h>
+#include "ndisc.h"
+#include "ping6.h"
+
+/* Our global IPv6 address, unspecified if we only have a link-local one */
+struct in6_addr net_ip6;
+/* Our link-local address, made from the MAC address in net_ip6_init_loop() */
+struct in6_addr net_link_local_ip6;
+/* Prefix length of net_ip6 */
+u32 net_prefix_length;
+/* Default router */
+struct in6_addr net_gateway6;
+/* Server IPv6 address */
+struct in6_addr net_server_ip6;
+/* Send over IPv6 rather than IPv4, for protocols which can do both */
+bool net_use_ip6;
+
+/* All nodes on the link */
+const struct in6_addr net_all_nodes_mcast = {
+	.s6_addr = { 0xff, 0x02, [15] = 0x01 }
+};
+
+static int on_ip6addr(const char *name, const char *value, enum env_op op,
+		      int flags)
+{
+	struct in6_addr addr;
+	const char *slash;
+	ulong prefix_length = 64;
+	size_t len;
+
+	if (flags & H_PROGRAMMATIC)
+		return 0;
+
+	if (op == env_op_delete) {
+		memset(&net_ip6, '\0', sizeof(net_ip6));
+		net_prefix_length = 0;
+		return 0;
+	}
+
+	slash = strchr(value, '/');
+	len = slash ? slash - value : strlen(value);
+	if (slash)
+		prefix_length = dectoul(slash + 1, NULL);
+	if (string_to_ip6(value, len, &addr) || prefix_length > 128) {
+		printf("Invalid IPv6 address '%s'\n", value);
+		return -EINVAL;
+	}
+
+	net_ip6 = addr;
+	net_prefix_length = prefix_length;
+
+	return 0;
+}
+U_BOOT_ENV_CALLBACK(ip6addr, on_ip6addr);
+
+static int on_ip6_var(const char *value, enum env_op op,
+		      struct in6_addr *addr)
+{
+	if (op == env_op_delete) {
+		memset(addr, '\0', sizeof(*addr));
+		return 0;
+	}
+
+	if (string_to_ip6(value, strlen(value), addr)) {
+		printf("Invalid IPv6 address '%s'\n", value);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int on_gatewayip6(const char *name, const char *value, enum env_op op,
+			 int flags)
+{
+	if (flags & H_PROGRAMMATIC)
+		return 0;
+
+	return on_ip6_var(value, op, &net_gateway6);
+}
+U_BOOT_ENV_CALLBACK(gatewayip6, on_gatewayip6);
+
+static int on_serverip6(const char *name, const char *value, enum env_op op,
+			int flags)
+{
+	if (flags & H_PROGRAMMATIC)
+		return 0;
+
+	return on_ip6_var(value, op, &net_server_ip6);
+}
+U_BOOT_ENV_CALLBACK(serverip6, on_serverip6);
+
+bool ip6_is_our_addr(const struct in6_addr *addr)
+{
+	struct in6_addr snma;
+
+	if (ip6_addr_equal(addr, &net_link_local_ip6) ||
+	    ip6_addr_equal(addr, &net_all_nodes_mcast))
+		return true;
+	ip6_make_snma(&snma, &net_link_local_ip6);
+	if (ip6_addr_equal(addr, &snma))
+		return true;
+
+	if (ip6_is_unspecified_addr(&net_ip6))
+		return false;
+	if (ip6_addr_equal(addr, &net_ip6))
+		return true;
+	ip6_make_snma(&snma, &net_ip6);
+
+	return ip6_addr_equal(addr, &snma);
+}
+
+void ip6_make_lladdr(struct in6_addr *lladdr, const uchar enetaddr[ARP_HLEN])
+{
+	memset(lladdr, '\0', sizeof(*lladdr));
+	lladdr->s6_addr[0] = 0xfe;
+	lladdr->s6_addr[1] = 0x80;
+	/* Modified EUI-64, RFC 4291 appendix A */
+	lladdr->s6_addr[8] = enetaddr[0] ^ 0x02;
+	lladdr->s6_addr[9] = enetaddr[1];
+	lladdr->s6_addr[10] = enetaddr[2];
+	lladdr->s6_addr[11] = 0xff;
+	lladdr->s6_addr[12] = 0xfe;
+	lladdr->s6_addr[13] = enetaddr[3];
+	lladdr->s6_addr[14] = enetaddr[4];
+	lladdr->s6_addr[15] = enetaddr[5];
+}
+
+void ip6_make_snma(struct in6_addr *mcast_addr, const struct in6_addr *addr)
+{
+	memset(mcast_addr, '\0', sizeof(*mcast_addr));
+	mcast_addr->s6_addr[0] = 0xff;
+	mcast_addr->s6_addr[1] = 0x02;
+	mcast_addr->s6_addr[11] = 0x01;
+	mcast_addr->s6_addr[12] = 0xff;
+	mcast_addr->s6_addr[13] = addr->s6_addr[13];
+	mcast_addr->s6_addr[14] = addr->s6_addr[14];
+	mcast_addr->s6_addr[15] = addr->s6_addr[15];
+}
+
+void ip6_make_mult_ethdstaddr(uchar enetaddr[ARP_HLEN],
+			      const struct in6_addr *mcast_addr)
+{
+	enetaddr[0] = 0x33;
+	enetaddr[1] = 0x33;
+	memcpy(&enetaddr[2], &mcast_addr->s6_addr[12], 4);
+}
+
+bool ip6_addr_in_subnet(const struct in6_addr *our_addr,
+			const struct in6_addr *neigh_addr, u32 prefix_length)
+{
+	u32 bytes = prefix_length / 8;
+	u32 bits = prefix_length % 8;
+	u8 mask;
+
+	if (prefix_length > 128)
+		return false;
+	if (memcmp(our_addr, neigh_addr, bytes))
+		return false;
+	if (!bits)
+		return true;
+	mask = 0xff << (8 - bits);
+
+	return !((our_addr->s6_addr[bytes] ^ neigh_addr->s6_addr[bytes]) &
+		 mask);
+}
+
+u16 ip6_csum(const struct in6_addr *saddr, const struct in6_addr *daddr,
+	     u16 len, u8 proto, const void *data)
+{
+	struct {
+		struct in6_addr saddr;
+		struct in6_addr daddr;
+		__be32 len;
+		u8 zero[3];
+		u8 proto;
+	} __packed ph;
+
+	ph.saddr = *saddr;
+	ph.daddr = *daddr;
+	ph.len = htonl(len);
+	memset(ph.zero, '\0', sizeof(ph.zero));
+	ph.proto = proto;
+
+	return add_ip_checksums(sizeof(ph), compute_ip_checksum(&ph, sizeof(ph)),
+				compute_ip_checksum(data, len));
+}
+
+int ip6_add_hdr(uchar *xip, const struct in6_addr *src,
+		const struct in6_addr *dest, int nextheader, int hoplimit,
+		int payload_len)
+{
+	struct ip6_hdr *ip6 = (struct ip6_hdr *)xip;
+
+	ip6->ip6_vfc = htonl(IP6_VERSION << 28);
+	ip6->ip6_plen = htons(payload_len);
+	ip6->ip6_nxt = nextheader;
+	ip6->ip6_hlim = hoplimit;
+	ip6->ip6_src = *src;
+	ip6->ip6_dst = *dest;
+
+	return IP6_HDR_SIZE;
+}
+
+const struct in6_addr *net_ip6_src(const struct in6_addr *dest)
+{
+	if (ip6_is_link_local(dest) || ip6_is_multicast(dest) ||
+	    ip6_is_unspecified_addr(&net_ip6))
+		return &net_link_local_ip6;
+
+	return &net_ip6;
+}
+
+/* Address to resolve to reach @dest: @dest itself, or the router */
+static int net_ip6_next_hop(const struct in6_addr *dest, struct in6_addr *hop)
+{
+	if (ip6_is_link_local(dest) ||
+	    (!ip6_is_unspecified_addr(&net_ip6) &&
+	     ip6_addr_in_subnet(&net_ip6, dest, net_prefix_length))) {
+		*hop = *dest;
+		return 0;
+	}
+
+	/* A router and our address come from net_ip6_start_loop() */
+	if (ip6_is_unspecified_addr(&net_ip6)) {
+		puts("*** ERROR: `ip6addr' not set\n");
+		return -ENETUNREACH;
+	}
+	if (ip6_addr_in_subnet(&net_ip6, dest, net_prefix_length)) {
+		*hop = *dest;
+		return 0;
+	}
+	if (ip6_is_unspecified_addr(&net_gateway6)) {
+		puts("*** ERROR: `gatewayip6' needed but not set\n");
+		return -ENETUNREACH;
+	}
+	*hop = net_gateway6;
+
+	return 0;
+}
+
+int net_send_ip_packet6(uchar *ether, const struct in6_addr *dest, int proto,
+			int len)
+{
+	static uchar mcast_ethaddr[ARP_HLEN];
+	const struct in6_addr *src;
+	struct in6_addr hop = *dest;
+	struct udp_hdr *udp;
+	struct icmp6_hdr *icmp;
+	uchar *pkt;
+	int eth_hdr_size;
+	int ret;
+	u16 csum;
+
+	/* make sure the net_tx_packet is initialized (net_init() was called) */
+	assert(net_tx_packet != NULL);
+	if (net_tx_packet == NULL)
+		return -1;
+
+	if (ip6_is_multicast(dest)) {
+		ip6_make_mult_ethdstaddr(mcast_ethaddr, dest);
+		ether = mcast_ethaddr;
+	} else if (memcmp(ether, net_null_ethaddr, ARP_HLEN) == 0) {
+		ret = net_ip6_next_hop(dest, &hop);
+		if (ret)
+			return ret;
+	}
+
+	src = net_ip6_src(dest);
+	pkt = (uchar *)net_tx_packet;
+	eth_hdr_size = net_set_ether(pkt, ether, PROT_IPV6);
+	pkt += eth_hdr_size;
+	pkt += ip6_add_hdr(pkt, src, dest, proto, IP6_HOP_LIMIT, len);
+
+	switch (proto) {
+	case IPPROTO_UDP:
+		udp = (struct udp_hdr *)pkt;
+		udp->udp_xsum = 0;
+		csum = ip6_csum(src, dest, len, proto, udp);
+		/* a zero checksum is not allowed over IPv6 */
+		udp->udp_xsum = csum ? csum : 0xffff;
+		break;
+	case IPPROTO_ICMPV6:
+		icmp = (struct icmp6_hdr *)pkt;
+		icmp->icmp6_cksum = 0;
+		icmp->icmp6_cksum = ip6_csum(src, dest, len, proto, icmp);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	/* if MAC address was not discovered yet, do neighbour discovery */
+	if (memcmp(ether, net_null_ethaddr, ARP_HLEN) == 0) {
+		debug_cond(DEBUG_DEV_PKT, "sending NS for %pI6c\n", &hop);
+
+		/* save the address and MAC for the packet to send after NA */
+		net_nd_sol_packet_ip6 = hop;
+		net_nd_packet_mac = ether;
+
+		/* size of the waiting packet */
+		net_nd_tx_packet_size = eth_hdr_size + IP6_HDR_SIZE + len;
+
+		/* and do the neighbour solicitation */
+		net_nd_try = 1;
+		net_nd_timer_start = get_timer(0);
+		ndisc_request();
+		return 1;	/* waiting */
+	}
+
+	debug_cond(DEBUG_DEV_PKT, "sending IPv6 to %pI6c/%pM\n", dest, ether);
+	net_send_packet(net_tx_packet, eth_hdr_size + IP6_HDR_SIZE + len);
+
+	return 0;	/* transmitted */
+}
+
+int net_send_udp_packet6(uchar *ether, const struct in6_addr *dest, int dport,
+			 int sport, int len)
+{
+	struct udp_hdr *udp;
+
+	udp = (struct udp_hdr *)(net_tx_packet + net_eth_hdr_size() +
+				 IP6_HDR_SIZE);
+	udp->udp_src = htons(sport);
+	udp->udp_dst = htons(dport);
+	udp->udp_len = htons(sizeof(*udp) + len);
+
+	return net_send_ip_packet6(ether, dest, IPPROTO_UDP,
+				   sizeof(*udp) + len);
+}
+
+int net_ip6_handler(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len)
+{
+	struct in_addr zero_ip = { .s_addr = 0 };
+	struct icmp6_hdr *icmp;
+	struct udp_hdr *udp;
+	uint plen, udp_len;
+
+	if (len < IP6_HDR_SIZE)
+		return -EINVAL;
+	if (ntohl(ip6->ip6_vfc) >> 28 != IP6_VERSION)
+		return -EINVAL;
+	plen = ntohs(ip6->ip6_plen);
+	if (plen > len - IP6_HDR_SIZE) {
+		debug("len bad %d < %d\n", len, (int)(plen + IP6_HDR_SIZE));
+		return -EINVAL;
+	}
+	len = IP6_HDR_SIZE + plen;
+
+	/* If it is not for us, ignore it */
+	if (!ip6_is_our_addr(&ip6->ip6_dst))
+		return -EINVAL;
+
+	switch (ip6->ip6_nxt) {
+	case IPPROTO_ICMPV6:
+		icmp = (struct icmp6_hdr *)(ip6 + 1);
+		if (plen < ICMP6_HDR_SIZE)
+			return -EINVAL;
+		if (ip6_csum(&ip6->ip6_src, &ip6->ip6_dst, plen,
+			     IPPROTO_ICMPV6, icmp)) {
+			debug("ICMPv6 checksum bad\n");
+			return -EINVAL;
+		}
+
+		switch (icmp->icmp6_type) {
+		case ICMPV6_ECHO_REQUEST:
+		case ICMPV6_ECHO_REPLY:
+#if defined(CONFIG_CMD_PING6)
+			ping6_receive(et, ip6, len);
+#endif
+			break;
+		case ICMPV6_ROUTER_ADVERT:
+		case ICMPV6_NEIGHBOUR_SOLICIT:
+		case ICMPV6_NEIGHBOUR_ADVERT:
+			return ndisc_receive(et, ip6, len);
+		default:
+			break;
+		}
+		break;
+
+	case IPPROTO_UDP:
+		udp = (struct udp_hdr *)(ip6 + 1);
+		if (plen < sizeof(*udp))
+			return -EINVAL;
+		udp_len = ntohs(udp->udp_len);
+		if (udp_len < sizeof(*udp) || udp_len > plen)
+			return -EINVAL;
+		/* the checksum is not optional over IPv6 */
+		if (!udp->udp_xsum ||
+		    ip6_csum(&ip6->ip6_src, &ip6->ip6_dst, udp_len,
+			     IPPROTO_UDP, udp)) {
+			printf(" UDP wrong checksum %04x\n",
+			       ntohs(udp->udp_xsum));
+			return -EINVAL;
+		}
+
+		debug_cond(DEBUG_DEV_PKT,
+			   "received UDP (to=%pI6c, from=%pI6c, len=%d)\n",
+			   &ip6->ip6_dst, &ip6->ip6_src, udp_len);
+
+		/* Only a protocol which was asked to use IPv6 gets datagrams */
+		if (!net_use_ip6)
+			return -EINVAL;
+
+		/*
+		 * The handlers take an IPv4 source address; they get 0, and
+		 * those which can use IPv6 know the address of their peer.
+		 */
+		net_get_udp_handler()((uchar *)(udp + 1), ntohs(udp->udp_dst),
+				      zero_ip, ntohs(udp->udp_src),
+				      udp_len - sizeof(*udp));
+		break;
+
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+void net_ip6_init_loop(void)
+{
+	ip6_make_lladdr(&net_link_local_ip6, net_ethaddr);
+	ndisc_init_loop();
+}
+
+int net_ip6_start_loop(enum proto_t protocol)
+{
+	const struct in6_addr *peer;
+
+	if (net_use_ip6)
+		peer = &net_server_ip6;
+#if defined(CONFIG_CMD_PING6)
+	else if (protocol == PING6)
+		peer = &net_ping_ip6;
+#endif
+	else
+		return 0;
+
+	/*
+	 * A peer on the link is reached without a router. The address of a
+	 * server given with the file name is not known yet, so unless it can
+	 * be reached through a router, ask for one.
+	 */
+	if (ip6_is_link_local(peer) ||
+	    (!ip6_is_unspecified_addr(&net_ip6) &&
+	     (!ip6_is_unspecified_addr(&net_gateway6) ||
+	      ip6_addr_in_subnet(&net_ip6, peer, net_prefix_length))))
+		return 0;
+
+	return ndisc_router_discover();
+}
+
+int net_parse_bootfile6(struct in6_addr *ipaddr, char *filename, int max_len)
+{
+	const char *name = net_boot_file_name;
+	const char *close;
+
+	if (name[0] == '\0')
+		return 0;
+
+	/* [2001:db8::1]:file, the brackets keep the colons apart */
+	if (name[0] == '[') {
+		close = strchr(name, ']');
+		if (close && close[1] == ':') {
+			if (ipaddr &&
+			    string_to_ip6(name + 1, close - name - 1, ipaddr)) {
+				printf("Invalid IPv6 address in '%s'\n", name);
+				return -EINVAL;
+			}
+			name = close + 2;
+		}
+	}
+	strncpy(filename, name, max_len);
+	filename[max_len - 1] = '\0';
+
+	return 1;
+}
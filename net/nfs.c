@@ -39,6 +39,7 @@
 #include <time.h>
 
 #define HASHES_PER_LINE 65	/* Number of "loading" hashes per line	*/
+#define HASH_SIZE	(NFS_READ_SIZE / 2 * 10)	/* Bytes per hash	*/
 #define NFS_RETRY_COUNT 30
 #ifndef CONFIG_NFS_TIMEOUT
 # define NFS_TIMEOUT 2000UL
@@ -51,10 +52,22 @@
 
 static int fs_mounted;
 static unsigned long rpc_id;
-static int nfs_offset = -1;
-static int nfs_len;
 static ulong nfs_timeout = NFS_TIMEOUT;
 
+/* A READ request waiting for its reply */
+struct nfs_read_slot {
+	unsigned long id;	/* RPC id of the request */
+	unsigned int offset;	/* offset in the file */
+	unsigned int len;	/* number of bytes asked for */
+	bool busy;		/* the request is outstanding */
+};
+
+static struct nfs_read_slot nfs_reads[CONFIG_NFS_READ_REQS];
+static unsigned int nfs_read_size;	/* size of READ requests */
+static unsigned int nfs_read_next;	/* offset of the next READ */
+static unsigned int nfs_read_end;	/* end of file, once reached */
+static unsigned long nfs_read_total;	/* bytes received so far */
+
 static char dirfh[NFS_FHSIZE];	/* NFSv2 / NFSv3 file handle of directory */
 static char filefh[NFS3_FHSIZE]; /* NFSv2 / NFSv3 file handle */
 static unsigned int filefh3_length;	/* (variable) length of filefh when NFSv3 */
@@ -391,6 +404,74 @@ static void nfs_read_req(int offset, int readlen)
 	rpc_req(PROG_NFS, NFS_READ, data, len);
 }
 
+/* Send a READ request from @slot */
+static void nfs_read_send_one(struct nfs_read_slot *slot, unsigned int offset,
+			      unsigned int len)
+{
+	slot->offset = offset;
+	slot->len = len;
+	slot->busy = true;
+	nfs_read_req(offset, len);
+	slot->id = rpc_id;
+}
+
+/* Send READ requests for the next blocks, up to CONFIG_NFS_READ_REQS */
+static void nfs_read_fill(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(nfs_reads); i++) {
+		if (nfs_read_next >= nfs_read_end)
+			break;
+		if (nfs_reads[i].busy)
+			continue;
+		nfs_read_send_one(&nfs_reads[i], nfs_read_next, nfs_read_size);
+		nfs_read_next += nfs_read_size;
+	}
+}
+
+/* Send the outstanding READ requests again, then new ones */
+static void nfs_read_send(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(nfs_reads); i++) {
+		if (nfs_reads[i].busy)
+			nfs_read_send_one(&nfs_reads[i], nfs_reads[i].offset,
+					  nfs_reads[i].len);
+	}
+	nfs_read_fill();
+}
+
+/* Largest READ whose reply can be received, a power of two */
+static unsigned int nfs_read_size_max(void)
+{
+	unsigned int max = NFS_READ_SIZE;
+	unsigned int size = NFS_READ_SIZE;
+
+#ifdef CONFIG_IP_DEFRAG
+	max = CONFIG_NET_MAXDEFRAG - IP_UDP_HDR_SIZE - NFS_READ_HDR_SIZE;
+#endif
+	if (supported_nfs_versions & NFSV2_FLAG)
+		max = min(max, (unsigned int)NFS2_MAXDATA);
+	while (size * 2 <= max)
+		size *= 2;
+
+	return size;
+}
+
+/* Get ready to read the file from the start */
+static void nfs_read_start(void)
+{
+	memset(nfs_reads, '\0', sizeof(nfs_reads));
+	nfs_read_size = nfs_read_size_max();
+	nfs_read_next = 0;
+	nfs_read_end = UINT_MAX;
+	nfs_read_total = 0;
+	debug("NFS read size %u, %d requests\n", nfs_read_size,
+	      CONFIG_NFS_READ_REQS);
+}
+
 /**************************************************************************
 RPC request dispatcher
 **************************************************************************/
@@ -421,7 +502,7 @@ static void nfs_send(void)
 		nfs_lookup_req(nfs_filename);
 		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		nfs_read_send();
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
@@ -662,20 +743,50 @@ static int nfs_readlink_reply(uchar *pkt, unsigned len)
 	return 0;
 }
 
-static int nfs_read_reply(uchar *pkt, unsigned len)
+static void nfs_show_progress(unsigned int rlen)
+{
+	unsigned long hashes = nfs_read_total / HASH_SIZE;
+
+	nfs_read_total += rlen;
+	for (; hashes < nfs_read_total / HASH_SIZE; hashes++) {
+		if (hashes && !(hashes % HASHES_PER_LINE))
+			puts("\n\t ");
+		putc('#');
+	}
+}
+
+static struct nfs_read_slot *nfs_read_find(unsigned long id)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(nfs_reads); i++) {
+		if (nfs_reads[i].busy && nfs_reads[i].id == id)
+			return &nfs_reads[i];
+	}
+
+	return NULL;
+}
+
+static int nfs_read_reply(uchar *pkt, unsigned len,
+			  struct nfs_read_slot **slotp)
 {
 	struct rpc_t rpc_pkt;
-	int rlen;
+	struct nfs_read_slot *slot;
+	unsigned int data_off;
 	uchar *data_ptr;
+	int eof = 0;
+	int rlen;
 
 	debug("%s\n", __func__);
 
-	memcpy(&rpc_pkt.u.data[0], pkt, sizeof(rpc_pkt.u.reply));
+	/* Only the header is copied, the data is stored from the packet */
+	memcpy(&rpc_pkt.u.data[0], pkt,
+	       min_t(unsigned int, len, NFS_READ_HDR_SIZE));
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
-		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	slot = nfs_read_find(ntohl(rpc_pkt.u.reply.id));
+	if (!slot)
 		return -NFS_RPC_DROP;
+	*slotp = slot;
 
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
@@ -688,12 +799,6 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if ((nfs_offset != 0) && !((nfs_offset) %
-			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
-		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
-		putc('#');
-
 	if (supported_nfs_versions & NFSV2_FLAG) {
 		rlen = ntohl(rpc_pkt.u.reply.data[18]);
 		data_ptr = (uchar *)&(rpc_pkt.u.reply.data[19]);
@@ -703,23 +808,58 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 
 		/* count value */
 		rlen = ntohl(rpc_pkt.u.reply.data[1 + nfsv3_data_offset]);
+		eof = ntohl(rpc_pkt.u.reply.data[2 + nfsv3_data_offset]);
 		/* Skip unused values :
-			EOF:		32 bits value,
 			data_size:	32 bits value,
 		*/
 		data_ptr = (uchar *)
 			&(rpc_pkt.u.reply.data[4 + nfsv3_data_offset]);
 	}
 
-	if (((uchar *)&(rpc_pkt.u.reply.data[0]) - (uchar *)(&rpc_pkt) + rlen) > len)
-			return -9999;
+	data_off = data_ptr - (uchar *)&rpc_pkt;
+	if (rlen < 0 || rlen > slot->len || data_off + rlen > len)
+		return -9999;
 
-	if (store_block(data_ptr, nfs_offset, rlen))
-			return -9999;
+	if (store_block(pkt + data_off, slot->offset, rlen))
+		return -9999;
+	nfs_show_progress(rlen);
+
+	/* Nothing is read past the end of the file */
+	if (eof || !rlen)
+		nfs_read_end = min(nfs_read_end, slot->offset + rlen);
 
 	return rlen;
 }
 
+/*
+ * Account for the reply to a READ request and send the next requests
+ *
+ * Return: true if requests are still waiting for their reply
+ */
+static bool nfs_read_done(struct nfs_read_slot *slot, int rlen)
+{
+	int i;
+
+	slot->busy = false;
+	if (rlen < slot->len && slot->offset + rlen < nfs_read_end) {
+		/*
+		 * The server sent less than asked for: ask for the rest, and
+		 * for no more than it sends from now on
+		 */
+		while (nfs_read_size > rlen && nfs_read_size > NFS_READ_SIZE)
+			nfs_read_size /= 2;
+		nfs_read_send_one(slot, slot->offset + rlen, slot->len - rlen);
+	}
+	nfs_read_fill();
+
+	for (i = 0; i < ARRAY_SIZE(nfs_reads); i++) {
+		if (nfs_reads[i].busy)
+			return true;
+	}
+
+	return false;
+}
+
 /**************************************************************************
 Interfaces of U-BOOT
 **************************************************************************/
@@ -740,12 +880,14 @@ static void nfs_timeout_handler(void)
 static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			unsigned src, unsigned len)
 {
+	struct nfs_read_slot *slot;
 	int rlen;
 	int reply;
 
 	debug("%s\n", __func__);
 
-	if (len > sizeof(struct rpc_t))
+	/* READ replies are not copied whole, they can be bigger */
+	if (len > sizeof(struct rpc_t) && nfs_state != STATE_READ_REQ)
 		return;
 
 	if (dest != nfs_our_port)
@@ -812,8 +954,7 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			nfs_send();
 		} else {
 			nfs_state = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
+			nfs_read_start();
 			nfs_send();
 		}
 		break;
@@ -837,22 +978,22 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		break;
 
 	case STATE_READ_REQ:
-		rlen = nfs_read_reply(pkt, len);
+		rlen = nfs_read_reply(pkt, len, &slot);
 		if (rlen == -NFS_RPC_DROP)
 			break;
 		net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
-		if (rlen > 0) {
-			nfs_offset += rlen;
+		if (rlen >= 0) {
+			if (nfs_read_done(slot, rlen))
+				break;
+			nfs_download_state = NETLOOP_SUCCESS;
+			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
 			nfs_state = STATE_READLINK_REQ;
 			nfs_send();
 		} else {
-			if (!rlen)
-				nfs_download_state = NETLOOP_SUCCESS;
-			if (rlen < 0)
-				debug("NFS READ error (%d)\n", rlen);
+			debug("NFS READ error (%d)\n", rlen);
 			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		}
@@ -38,11 +38,16 @@
 /*
  * Block size used for NFS read accesses.  A RPC reply packet (including  all
  * headers) must fit within a single Ethernet frame to avoid fragmentation.
- * However, if CONFIG_IP_DEFRAG is set, a bigger value could be used.  In any
- * case, most NFS servers are optimized for a power of 2.
+ * However, if CONFIG_IP_DEFRAG is set, reads as big as the reassembly
+ * buffer allows are used instead.  In any case, most NFS servers are
+ * optimized for a power of 2.
  */
 #define NFS_READ_SIZE	1024	/* biggest power of two that fits Ether frame */
 #define NFS_MAX_ATTRS	26
+/* Room for the RPC header and attributes in front of READ reply data */
+#define NFS_READ_HDR_SIZE	((6 + NFS_MAX_ATTRS) * sizeof(uint32_t))
+/* Largest READ allowed by NFSv2 (RFC 1094) */
+#define NFS2_MAXDATA	8192
 
 /* Values for Accept State flag on RPC answers (See: rfc1831) */
 enum rpc_accept_stat {
@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * ICMPv6 echo, for the ping6 command
+ *
+ * This is ping.c for IPv6: the neighbour is always solicited again, so
+ * that ping6 also checks that neighbour discovery works.
+ */
+
+#include <common.h>
+#include <log.h>
+#include <net.h>
+#include <net6.h>
+#include "ping6.h"
+
+static ushort ping6_seq_number;
+
+/* The IPv6 address to ping */
+struct in6_addr net_ping_ip6;
+
+/* MAC address of the host pinged, found with neighbour discovery */
+static uchar ping6_ethaddr[ARP_HLEN];
+
+static int ping6_send(void)
+{
+	struct icmp6_hdr *icmp;
+
+	icmp = (struct icmp6_hdr *)(net_tx_packet + net_eth_hdr_size() +
+				    IP6_HDR_SIZE);
+	icmp->icmp6_type = ICMPV6_ECHO_REQUEST;
+	icmp->icmp6_code = 0;
+	icmp->un.echo.id = 0;
+	icmp->un.echo.sequence = htons(ping6_seq_number++);
+
+	/* XXX always do neighbour discovery */
+	memset(ping6_ethaddr, '\0', ARP_HLEN);
+
+	return net_send_ip_packet6(ping6_ethaddr, &net_ping_ip6, IPPROTO_ICMPV6,
+				   ICMP6_HDR_SIZE);
+}
+
+static void ping6_timeout_handler(void)
+{
+	eth_halt();
+	net_set_state(NETLOOP_FAIL);	/* we did not get the reply */
+}
+
+void ping6_start(void)
+{
+	printf("Using %s device\n", eth_get_name());
+	net_set_timeout_handler(10000UL, ping6_timeout_handler);
+
+	if (ping6_send() < 0)
+		net_set_state(NETLOOP_FAIL);
+}
+
+void ping6_receive(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len)
+{
+	struct icmp6_hdr *icmp = (struct icmp6_hdr *)(ip6 + 1);
+	struct in6_addr src;
+	int eth_hdr_size;
+	uchar *tx_packet;
+
+	switch (icmp->icmp6_type) {
+	case ICMPV6_ECHO_REPLY:
+		if (ip6_addr_equal(&ip6->ip6_src, &net_ping_ip6))
+			net_set_state(NETLOOP_SUCCESS);
+		return;
+	case ICMPV6_ECHO_REQUEST:
+		eth_hdr_size = net_update_ether(et, et->et_src, PROT_IPV6);
+
+		debug_cond(DEBUG_DEV_PKT,
+			   "Got ICMPv6 ECHO REQUEST, return %d bytes\n",
+			   eth_hdr_size + len);
+
+		/* a request to a multicast group is answered from our address */
+		if (ip6_is_multicast(&ip6->ip6_dst))
+			src = *net_ip6_src(&ip6->ip6_src);
+		else
+			src = ip6->ip6_dst;
+		ip6->ip6_dst = ip6->ip6_src;
+		ip6->ip6_src = src;
+		ip6->ip6_hlim = IP6_HOP_LIMIT;
+
+		icmp->icmp6_type = ICMPV6_ECHO_REPLY;
+		icmp->icmp6_cksum = 0;
+		icmp->icmp6_cksum = ip6_csum(&ip6->ip6_src, &ip6->ip6_dst,
+					     len - IP6_HDR_SIZE, IPPROTO_ICMPV6,
+					     icmp);
+
+		tx_packet = net_get_async_tx_pkt_buf();
+		memcpy(tx_packet, et, eth_hdr_size + len);
+		net_send_packet(tx_packet, eth_hdr_size + len);
+		return;
+	}
+}
@@ -0,0 +1,623 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Minimal TCP client
+ *
+ * This implements the client side of RFC 793 for a single connection, with
+ * the window scale option of RFC 7323 and the fast retransmit algorithm of
+ * RFC 5681. It is meant for downloading: the data we send is limited to one
+ * segment at a time, while the receive side keeps a large window open.
+ *
+ * Segments which arrive out of order are kept in a small pool of buffers
+ * and every one of them is answered at once with a duplicate ACK. Without
+ * SACK this is what lets the sender find out about a lost segment after
+ * three duplicate ACKs and send it again, instead of waiting for its
+ * retransmission timer. When the missing segment arrives, the buffered ones
+ * are delivered behind it and acknowledged together.
+ */
+
+#include <common.h>
+#include <log.h>
+#include <malloc.h>
+#include <net.h>
+#include <net/tcp.h>
+#include <asm/unaligned.h>
+
+#define TCP_RTO_INIT	1000	/* Initial retransmission timeout, ms */
+#define TCP_RTO_MAX	8000	/* Retransmission timeout limit, ms */
+#define TCP_RETRIES	8	/* Retransmissions before giving up */
+#define TCP_DELACK_MS	1	/* Delay before acknowledging one segment */
+#define TCP_IDLE_MS	30000	/* Time to wait for the peer to send data */
+#define TCP_DEF_MSS	536	/* Peer MSS if it does not send the option */
+
+#define SEQ_LT(a, b)	((s32)((a) - (b)) < 0)
+#define SEQ_LE(a, b)	((s32)((a) - (b)) <= 0)
+#define SEQ_GT(a, b)	((s32)((a) - (b)) > 0)
+
+enum tcp_state {
+	TCP_CLOSED,
+	TCP_SYN_SENT,
+	TCP_ESTABLISHED,
+};
+
+/*
+ * A segment received beyond a hole in the sequence space
+ */
+struct tcp_seg {
+	bool used;
+	bool fin;
+	u16 len;
+	u32 seq;
+	uchar data[TCP_MSS];
+};
+
+struct tcp_pseudo_hdr {
+	struct in_addr	src;
+	struct in_addr	dst;
+	u8		zero;
+	u8		proto;
+	u16		len;
+} __attribute__((packed));
+
+static enum tcp_state tcp_state;
+static rxhand_tcp_f *tcp_rx;
+static tcp_event_f *tcp_event;
+
+static struct in_addr tcp_dest;
+static uchar tcp_ether[ARP_HLEN];
+static u16 tcp_dport;
+static u16 tcp_sport;
+
+/* Send side */
+static u32 tcp_iss;
+static u32 tcp_snd_una;
+static u32 tcp_snd_nxt;
+static uint tcp_snd_mss;
+static uchar tcp_tx_buf[TCP_MSS];
+static u32 tcp_tx_seq;
+static uint tcp_tx_len;
+static bool tcp_fin_sent;
+static u32 tcp_fin_seq;
+static uint tcp_dupacks;
+
+/* Receive side */
+static u32 tcp_rcv_nxt;
+static u32 tcp_rcv_wnd;
+static uint tcp_rcv_wscale;
+static bool tcp_fin_rcvd;
+static struct tcp_seg *tcp_ooo;
+static uint tcp_ooo_count;
+
+/* Timers */
+static ulong tcp_rto;
+static ulong tcp_rto_start;
+static uint tcp_retries;
+static bool tcp_ack_pending;
+static uint tcp_ack_segs;
+static ulong tcp_ack_time;
+static ulong tcp_last_rx;
+
+static void tcp_timer(void);
+
+static uint tcp_checksum(struct in_addr src, struct in_addr dst,
+			 const void *tcp, uint len)
+{
+	struct tcp_pseudo_hdr ph;
+
+	ph.src = src;
+	ph.dst = dst;
+	ph.zero = 0;
+	ph.proto = IPPROTO_TCP;
+	ph.len = htons(len);
+
+	return add_ip_checksums(sizeof(ph), compute_ip_checksum(&ph, sizeof(ph)),
+				compute_ip_checksum(tcp, len));
+}
+
+static u16 tcp_window(u8 action)
+{
+	/* The window in a SYN segment is never scaled */
+	if (action & TCP_SYN)
+		return min_t(u32, tcp_rcv_wnd, 0xffff);
+
+	return min_t(u32, tcp_rcv_wnd >> tcp_rcv_wscale, 0xffff);
+}
+
+int tcp_set_tcp_header(uchar *pkt, struct in_addr dest, int dport, int sport,
+		       int payload_len, u8 action, u32 tcp_seq_num,
+		       u32 tcp_ack_num)
+{
+	struct tcp_hdr *tcp = (struct tcp_hdr *)(pkt + IP_HDR_SIZE);
+	uchar *opt = (uchar *)(tcp + 1);
+	int hdr_len = TCP_HDR_SIZE;
+	uint wscale = 0;
+
+	/*
+	 * Only SYN segments carry options, so the data of any other segment
+	 * always starts at IP_TCP_HDR_SIZE.
+	 */
+	if (action & TCP_SYN) {
+		while ((tcp_rcv_wnd >> wscale) > 0xffff)
+			wscale++;
+		opt[0] = TCP_OPT_MSS;
+		opt[1] = 4;
+		put_unaligned_be16(TCP_MSS, opt + 2);
+		opt[4] = TCP_OPT_NOP;
+		opt[5] = TCP_OPT_WS;
+		opt[6] = 3;
+		opt[7] = wscale;
+		hdr_len += 8;
+	}
+
+	tcp->tcp_src = htons(sport);
+	tcp->tcp_dst = htons(dport);
+	tcp->tcp_seq = htonl(tcp_seq_num);
+	tcp->tcp_ack = htonl(action & TCP_ACK ? tcp_ack_num : 0);
+	tcp->tcp_hlen = (hdr_len / 4) << 4;
+	tcp->tcp_flags = action;
+	tcp->tcp_win = htons(tcp_window(action));
+	tcp->tcp_xsum = 0;
+	tcp->tcp_urg = 0;
+	tcp->tcp_xsum = tcp_checksum(net_ip, dest, tcp, hdr_len + payload_len);
+
+	net_set_ip_header(pkt, dest, net_ip, IP_HDR_SIZE + hdr_len + payload_len,
+			  IPPROTO_TCP);
+
+	return IP_HDR_SIZE + hdr_len;
+}
+
+static int tcp_send_segment(u8 action, u32 seq, const void *data, uint len)
+{
+	uchar *pkt = net_tx_packet + net_eth_hdr_size() + IP_TCP_HDR_SIZE;
+
+	if (len)
+		memcpy(pkt, data, len);
+	if (action & TCP_ACK) {
+		tcp_ack_pending = false;
+		tcp_ack_segs = 0;
+	}
+
+	return net_send_ip_packet(tcp_ether, tcp_dest, tcp_dport, tcp_sport,
+				  len, IPPROTO_TCP, action, seq, tcp_rcv_nxt);
+}
+
+static void tcp_send_ack(void)
+{
+	tcp_send_segment(TCP_ACK, tcp_snd_nxt, NULL, 0);
+}
+
+static bool tcp_outstanding(void)
+{
+	return tcp_snd_una != tcp_snd_nxt;
+}
+
+static void tcp_arm_timer(void)
+{
+	ulong now = get_timer(0);
+	ulong deadline;
+
+	if (tcp_ack_pending)
+		deadline = tcp_ack_time + TCP_DELACK_MS;
+	else if (tcp_outstanding())
+		deadline = tcp_rto_start + tcp_rto;
+	else
+		deadline = tcp_last_rx + TCP_IDLE_MS;
+
+	net_set_timeout_handler((long)(deadline - now) > 0 ? deadline - now : 0,
+				tcp_timer);
+}
+
+/* Forget the connection and tell the user why */
+static void tcp_fail(enum tcp_event event)
+{
+	tcp_state = TCP_CLOSED;
+	net_set_timeout_handler(0, NULL);
+	tcp_event(event);
+}
+
+/* Send again the oldest data which has not been acknowledged */
+static void tcp_retransmit(void)
+{
+	u32 end = tcp_tx_seq + tcp_tx_len;
+
+	if (tcp_state == TCP_SYN_SENT) {
+		tcp_send_segment(TCP_SYN, tcp_iss, NULL, 0);
+	} else {
+		if (SEQ_LT(tcp_snd_una, end)) {
+			uint off = tcp_snd_una - tcp_tx_seq;
+
+			tcp_send_segment(TCP_ACK | TCP_PUSH, tcp_snd_una,
+					 tcp_tx_buf + off, tcp_tx_len - off);
+		}
+		if (tcp_fin_sent && SEQ_LE(tcp_snd_una, tcp_fin_seq))
+			tcp_send_segment(TCP_FIN | TCP_ACK, tcp_fin_seq, NULL, 0);
+	}
+	tcp_rto_start = get_timer(0);
+}
+
+static void tcp_timer(void)
+{
+	ulong now = get_timer(0);
+
+	if (tcp_state == TCP_CLOSED)
+		return;
+
+	if (tcp_ack_pending) {
+		tcp_send_ack();
+	} else if (tcp_outstanding()) {
+		if (now - tcp_rto_start >= tcp_rto) {
+			if (++tcp_retries > TCP_RETRIES) {
+				tcp_fail(TCP_EV_TIMEOUT);
+				return;
+			}
+			debug_cond(DEBUG_DEV_PKT, "TCP: retransmit %u\n",
+				   tcp_retries);
+			tcp_rto = min(tcp_rto * 2, (ulong)TCP_RTO_MAX);
+			tcp_retransmit();
+		}
+	} else if (now - tcp_last_rx >= TCP_IDLE_MS) {
+		tcp_fail(TCP_EV_TIMEOUT);
+		return;
+	}
+	tcp_arm_timer();
+}
+
+static void tcp_parse_options(const uchar *opt, int len)
+{
+	bool wscale = false;
+
+	tcp_snd_mss = TCP_DEF_MSS;
+	while (len > 0) {
+		if (opt[0] == TCP_OPT_EOL)
+			break;
+		if (opt[0] == TCP_OPT_NOP) {
+			opt++;
+			len--;
+			continue;
+		}
+		if (len < 2 || opt[1] < 2 || opt[1] > len)
+			break;
+		if (opt[0] == TCP_OPT_MSS && opt[1] == 4)
+			tcp_snd_mss = get_unaligned_be16(opt + 2);
+		else if (opt[0] == TCP_OPT_WS && opt[1] == 3)
+			wscale = true;
+		len -= opt[1];
+		opt += opt[1];
+	}
+
+	/* Our windows are only scaled if both sides sent the option */
+	tcp_rcv_wscale = 0;
+	if (wscale) {
+		while ((tcp_rcv_wnd >> tcp_rcv_wscale) > 0xffff)
+			tcp_rcv_wscale++;
+	} else {
+		tcp_rcv_wnd = min_t(u32, tcp_rcv_wnd, 0xffff);
+	}
+}
+
+static void tcp_process_ack(u32 ack, uint len, u8 flags)
+{
+	if (SEQ_GT(ack, tcp_snd_nxt))
+		return;
+
+	if (SEQ_GT(ack, tcp_snd_una)) {
+		tcp_snd_una = ack;
+		tcp_dupacks = 0;
+		tcp_retries = 0;
+		tcp_rto = TCP_RTO_INIT;
+		tcp_rto_start = get_timer(0);
+		if (tcp_fin_sent && tcp_fin_rcvd && !tcp_outstanding())
+			tcp_state = TCP_CLOSED;
+		return;
+	}
+
+	/* A duplicate ACK carries no data and does not move the window edge */
+	if (ack == tcp_snd_una && tcp_outstanding() && !len &&
+	    !(flags & TCP_FIN) && ++tcp_dupacks == 3) {
+		debug_cond(DEBUG_DEV_PKT, "TCP: fast retransmit\n");
+		tcp_retransmit();
+	}
+}
+
+static void tcp_ooo_store(u32 seq, const uchar *data, uint len, bool fin)
+{
+	struct tcp_seg *seg, *free_seg = NULL;
+	int i;
+
+	if (len > TCP_MSS)
+		return;
+
+	for (i = 0; i < CONFIG_TCP_RX_BUFS; i++) {
+		seg = &tcp_ooo[i];
+		if (!seg->used) {
+			if (!free_seg)
+				free_seg = seg;
+		} else if (seg->seq == seq && seg->len >= len) {
+			return;
+		}
+	}
+	if (!free_seg)
+		return;
+
+	free_seg->used = true;
+	free_seg->fin = fin;
+	free_seg->seq = seq;
+	free_seg->len = len;
+	memcpy(free_seg->data, data, len);
+	tcp_ooo_count++;
+}
+
+/* Deliver in-order data, return false if the connection went away */
+static bool tcp_deliver(const uchar *data, uint len, bool fin)
+{
+	if (len) {
+		tcp_rcv_nxt += len;
+		tcp_rx(data, len);
+		if (tcp_state == TCP_CLOSED)
+			return false;
+	}
+	if (fin) {
+		tcp_rcv_nxt++;
+		tcp_fin_rcvd = true;
+	}
+
+	return true;
+}
+
+/* Deliver the buffered segments which the last one made contiguous */
+static bool tcp_ooo_drain(void)
+{
+	struct tcp_seg *seg;
+	bool progress;
+	uint skip;
+	int i;
+
+	do {
+		progress = false;
+		for (i = 0; i < CONFIG_TCP_RX_BUFS && tcp_ooo_count; i++) {
+			seg = &tcp_ooo[i];
+			if (!seg->used || SEQ_GT(seg->seq, tcp_rcv_nxt))
+				continue;
+			seg->used = false;
+			tcp_ooo_count--;
+			skip = tcp_rcv_nxt - seg->seq;
+			if (skip > seg->len || tcp_fin_rcvd)
+				continue;
+			if (!tcp_deliver(seg->data + skip, seg->len - skip,
+					 seg->fin))
+				return false;
+			progress = true;
+		}
+	} while (progress && tcp_ooo_count);
+
+	return true;
+}
+
+static void tcp_process_data(u32 seq, const uchar *data, uint len, bool fin)
+{
+	u32 end = seq + len;
+	bool filled;
+
+	/* Already received, our ACK was probably lost */
+	if (tcp_fin_rcvd || SEQ_LT(end, tcp_rcv_nxt) ||
+	    (end == tcp_rcv_nxt && !fin)) {
+		tcp_send_ack();
+		return;
+	}
+	if (SEQ_LT(seq, tcp_rcv_nxt)) {
+		data += tcp_rcv_nxt - seq;
+		len -= tcp_rcv_nxt - seq;
+		seq = tcp_rcv_nxt;
+	}
+
+	/* Beyond our window */
+	if (SEQ_LE(tcp_rcv_nxt + tcp_rcv_wnd, seq)) {
+		tcp_send_ack();
+		return;
+	}
+	if (SEQ_GT(seq + len, tcp_rcv_nxt + tcp_rcv_wnd)) {
+		len = tcp_rcv_nxt + tcp_rcv_wnd - seq;
+		fin = false;
+	}
+
+	if (seq != tcp_rcv_nxt) {
+		tcp_ooo_store(seq, data, len, fin);
+		tcp_send_ack();
+		return;
+	}
+
+	filled = tcp_ooo_count;
+	if (!tcp_deliver(data, len, fin) ||
+	    (tcp_ooo_count && !tcp_ooo_drain()))
+		return;
+
+	/*
+	 * Acknowledge every second segment, and at once when a hole was
+	 * filled or the peer is done
+	 */
+	if (filled || tcp_fin_rcvd || ++tcp_ack_segs >= 2) {
+		tcp_send_ack();
+	} else if (!tcp_ack_pending) {
+		tcp_ack_pending = true;
+		tcp_ack_time = get_timer(0);
+	}
+
+	if (tcp_fin_rcvd) {
+		if (tcp_fin_sent && !tcp_outstanding())
+			tcp_state = TCP_CLOSED;
+		tcp_event(TCP_EV_CLOSED);
+	}
+}
+
+void tcp_receive(struct ip_hdr *ip, unsigned int len)
+{
+	struct tcp_hdr *tcp = (struct tcp_hdr *)(ip + 1);
+	struct in_addr src, dst;
+	uint tcp_len, hdr_len;
+	u32 seq, ack;
+	u8 flags;
+
+	if (tcp_state == TCP_CLOSED || len < IP_TCP_HDR_SIZE)
+		return;
+
+	src = net_read_ip(&ip->ip_src);
+	dst = net_read_ip(&ip->ip_dst);
+	if (src.s_addr != tcp_dest.s_addr ||
+	    ntohs(tcp->tcp_src) != tcp_dport ||
+	    ntohs(tcp->tcp_dst) != tcp_sport)
+		return;
+
+	tcp_len = len - IP_HDR_SIZE;
+	hdr_len = (tcp->tcp_hlen >> 4) * 4;
+	if (hdr_len < TCP_HDR_SIZE || hdr_len > tcp_len)
+		return;
+	if (tcp_checksum(src, dst, tcp, tcp_len)) {
+		debug("TCP: bad checksum\n");
+		return;
+	}
+
+	seq = ntohl(tcp->tcp_seq);
+	ack = ntohl(tcp->tcp_ack);
+	flags = tcp->tcp_flags;
+	tcp_last_rx = get_timer(0);
+
+	if (tcp_state == TCP_SYN_SENT) {
+		if (!(flags & TCP_ACK) || ack != tcp_iss + 1)
+			return;
+		if (flags & TCP_RST) {
+			tcp_fail(TCP_EV_RESET);
+			return;
+		}
+		if (!(flags & TCP_SYN))
+			return;
+
+		tcp_parse_options((uchar *)(tcp + 1), hdr_len - TCP_HDR_SIZE);
+		tcp_rcv_nxt = seq + 1;
+		tcp_snd_una = ack;
+		tcp_retries = 0;
+		tcp_rto = TCP_RTO_INIT;
+		tcp_state = TCP_ESTABLISHED;
+		tcp_send_ack();
+		tcp_event(TCP_EV_CONNECTED);
+		if (tcp_state != TCP_CLOSED)
+			tcp_arm_timer();
+		return;
+	}
+
+	if (flags & TCP_RST) {
+		if (SEQ_LE(tcp_rcv_nxt, seq) &&
+		    SEQ_LT(seq, tcp_rcv_nxt + tcp_rcv_wnd))
+			tcp_fail(TCP_EV_RESET);
+		return;
+	}
+	/* Our ACK of the SYN was lost */
+	if (flags & TCP_SYN) {
+		tcp_send_ack();
+		return;
+	}
+
+	if (flags & TCP_ACK)
+		tcp_process_ack(ack, tcp_len - hdr_len, flags);
+	if (tcp_state != TCP_CLOSED && (tcp_len > hdr_len || flags & TCP_FIN))
+		tcp_process_data(seq, (uchar *)tcp + hdr_len, tcp_len - hdr_len,
+				 flags & TCP_FIN);
+	if (tcp_state != TCP_CLOSED)
+		tcp_arm_timer();
+}
+
+int tcp_connect(struct in_addr dest, u16 dport, rxhand_tcp_f *rx,
+		tcp_event_f *event)
+{
+	if (!tcp_ooo) {
+		tcp_ooo = malloc(CONFIG_TCP_RX_BUFS * sizeof(*tcp_ooo));
+		if (!tcp_ooo)
+			return -ENOMEM;
+	}
+	memset(tcp_ooo, '\0', CONFIG_TCP_RX_BUFS * sizeof(*tcp_ooo));
+	tcp_ooo_count = 0;
+
+	tcp_dest = dest;
+	tcp_dport = dport;
+	/* make the port a little random, like DNS and TFTP do */
+	tcp_sport = 1024 + (get_timer(0) % 0x4000);
+	memset(tcp_ether, '\0', ARP_HLEN);
+	tcp_rx = rx;
+	tcp_event = event;
+
+	tcp_iss = (u32)get_ticks();
+	tcp_snd_una = tcp_iss;
+	tcp_snd_nxt = tcp_iss + 1;
+	tcp_snd_mss = TCP_DEF_MSS;
+	tcp_tx_seq = tcp_snd_nxt;
+	tcp_tx_len = 0;
+	tcp_fin_sent = false;
+	tcp_dupacks = 0;
+
+	tcp_rcv_nxt = 0;
+	tcp_rcv_wnd = CONFIG_TCP_RX_BUFS * TCP_MSS;
+	tcp_rcv_wscale = 0;
+	tcp_fin_rcvd = false;
+
+	tcp_rto = TCP_RTO_INIT;
+	tcp_rto_start = get_timer(0);
+	tcp_retries = 0;
+	tcp_ack_pending = false;
+	tcp_ack_segs = 0;
+	tcp_last_rx = tcp_rto_start;
+
+	tcp_state = TCP_SYN_SENT;
+	tcp_send_segment(TCP_SYN, tcp_iss, NULL, 0);
+	tcp_arm_timer();
+
+	return 0;
+}
+
+int tcp_send(const void *data, unsigned int len)
+{
+	if (tcp_state != TCP_ESTABLISHED || tcp_fin_sent)
+		return -ENOTCONN;
+	if (tcp_outstanding())
+		return -EBUSY;
+	if (len > TCP_MSS || len > tcp_snd_mss)
+		return -EMSGSIZE;
+
+	memcpy(tcp_tx_buf, data, len);
+	tcp_tx_seq = tcp_snd_nxt;
+	tcp_tx_len = len;
+	tcp_snd_nxt += len;
+	tcp_rto_start = get_timer(0);
+	tcp_send_segment(TCP_ACK | TCP_PUSH, tcp_tx_seq, tcp_tx_buf, len);
+	tcp_arm_timer();
+
+	return 0;
+}
+
+void tcp_close(void)
+{
+	if (tcp_state != TCP_ESTABLISHED || tcp_fin_sent)
+		return;
+
+	tcp_fin_sent = true;
+	tcp_fin_seq = tcp_snd_nxt++;
+	tcp_rto_start = get_timer(0);
+	tcp_send_segment(TCP_FIN | TCP_ACK, tcp_fin_seq, NULL, 0);
+	tcp_arm_timer();
+}
+
+void tcp_abort(void)
+{
+	if (tcp_state == TCP_CLOSED)
+		return;
+
+	if (tcp_state == TCP_ESTABLISHED)
+		tcp_send_segment(TCP_RST | TCP_ACK, tcp_snd_nxt, NULL, 0);
+	tcp_state = TCP_CLOSED;
+	net_set_timeout_handler(0, NULL);
+}
+
+void tcp_release(void)
+{
+	tcp_state = TCP_CLOSED;
+	free(tcp_ooo);
+	tcp_ooo = NULL;
+	tcp_ooo_count = 0;
+}
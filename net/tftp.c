@@ -14,7 +14,9 @@
 #include <log.h>
 #include <mapmem.h>
 #include <net.h>
+#include <net6.h>
 #include <asm/global_data.h>
+#include <linux/bitmap.h>
 #include <net/tftp.h>
 #include "bootp.h"
 #ifdef CONFIG_SYS_DIRECT_FLASH_TFTP
@@ -74,6 +76,8 @@ enum {
 };
 
 static struct in_addr tftp_remote_ip;
+/* The server's IPv6 address, used instead when net_use_ip6 is set */
+static struct in6_addr tftp_remote_ip6;
 /* The UDP port at their end */
 static int	tftp_remote_port;
 /* The UDP port at our end */
@@ -104,6 +108,30 @@ static ushort	tftp_windowsize;
 static ushort	tftp_next_ack;
 /* Last nack block we send */
 static ushort	tftp_last_nack;
+/*
+ * Blocks received ahead of a lost one are stored straight away and
+ * marked here, indexed by block number, so that only the missing blocks
+ * have to be waited for.
+ */
+#define TFTP_OOO_BLOCKS	256
+static DECLARE_BITMAP(tftp_ooo_map, TFTP_OOO_BLOCKS);
+/* Number of blocks marked in tftp_ooo_map */
+static int	tftp_ooo_count;
+/* Number of the last block if it was received out of order, else -1 */
+static int	tftp_ooo_last;
+/* Window size to ask for, with CONFIG_TFTP_ADAPTIVE_WINDOW */
+static ushort	tftp_adapt_window;
+/* Windows acknowledged in this transfer, and those which lost blocks */
+static uint	tftp_adapt_windows;
+static uint	tftp_adapt_lost;
+/* Smoothed round-trip time x 8 and its mean deviation x 4, in ms */
+static ulong	tftp_srtt;
+static ulong	tftp_rttvar;
+/* Timeout for the current ACK, in ms */
+static ulong	tftp_rto;
+/* When the last ACK was sent, if it can be used to measure the RTT */
+static ulong	tftp_ack_time;
+static bool	tftp_rtt_pending;
 #ifdef CONFIG_CMD_TFTPPUT
 /* 1 if writing, else 0 */
 static int	tftp_put_active;
@@ -126,6 +154,10 @@ static int	tftp_put_final_block_sent;
 #define TFTP_BLOCK_SIZE		512
 /* sequence number is 16 bit */
 #define TFTP_SEQUENCE_SIZE	((ulong)(1<<16))
+/* Largest block in one Ethernet frame with the 40-byte IPv6 header */
+#define TFTP_MTU_BLOCKSIZE6	1448
+/* Shortest ACK timeout in adaptive mode, in ms */
+#define TFTP_RTO_MIN		200
 
 #define DEFAULT_NAME_LEN	(8 + 4 + 1)
 static char default_filename[DEFAULT_NAME_LEN];
@@ -158,6 +190,23 @@ static unsigned short tftp_block_size = TFTP_BLOCK_SIZE;
 static unsigned short tftp_block_size_option = CONFIG_TFTP_BLOCKSIZE;
 static unsigned short tftp_window_size_option = TFTP_WINDOWSIZE;
 
+static bool tftp_use_ip6(void)
+{
+	return IS_ENABLED(CONFIG_IPV6) && net_use_ip6;
+}
+
+/*
+ * The block size asked for: IPv6 packets are not fragmented, so a block
+ * must fit in one frame with the larger header.
+ */
+static unsigned short tftp_block_size_request(void)
+{
+	if (tftp_use_ip6() && tftp_block_size_option > TFTP_MTU_BLOCKSIZE6)
+		return TFTP_MTU_BLOCKSIZE6;
+
+	return tftp_block_size_option;
+}
+
 static inline int store_block(int block, uchar *src, unsigned int len)
 {
 	ulong offset = block * tftp_block_size + tftp_block_wrap_offset -
@@ -218,6 +267,11 @@ static void new_transfer(void)
 	tftp_prev_block = 0;
 	tftp_block_wrap = 0;
 	tftp_block_wrap_offset = 0;
+	bitmap_zero(tftp_ooo_map, TFTP_OOO_BLOCKS);
+	tftp_ooo_count = 0;
+	tftp_ooo_last = -1;
+	tftp_adapt_windows = 0;
+	tftp_adapt_lost = 0;
 #ifdef CONFIG_CMD_TFTPPUT
 	tftp_put_final_block_sent = 0;
 #endif
@@ -311,6 +365,143 @@ static void update_block_number(void)
 	show_block_marker();
 }
 
+/* Window size to ask the server for */
+static ushort tftp_window_size_request(void)
+{
+	if (IS_ENABLED(CONFIG_TFTP_ADAPTIVE_WINDOW))
+		return tftp_adapt_window;
+
+	return tftp_window_size_option;
+}
+
+/* Choose the window size of the next request from the loss in this one */
+static void tftp_adapt_update(void)
+{
+	if (!IS_ENABLED(CONFIG_TFTP_ADAPTIVE_WINDOW) || tftp_put_active ||
+	    !tftp_adapt_windows)
+		return;
+
+	if (!tftp_adapt_lost)
+		tftp_adapt_window = min_t(int, tftp_windowsize * 2,
+					  tftp_window_size_option);
+	else if (tftp_adapt_lost * 8 > tftp_adapt_windows)
+		tftp_adapt_window = max_t(int, tftp_windowsize / 2, 1);
+	else
+		tftp_adapt_window = tftp_windowsize;
+	debug("TFTP: %u of %u windows lost, next windowsize %d\n",
+	      tftp_adapt_lost, tftp_adapt_windows, tftp_adapt_window);
+}
+
+/* Timeout to use while waiting for data blocks */
+static ulong tftp_data_timeout(void)
+{
+	if (!IS_ENABLED(CONFIG_TFTP_ADAPTIVE_WINDOW) || tftp_put_active)
+		return timeout_ms;
+
+	return tftp_rto;
+}
+
+/*
+ * Update the round-trip time estimate and the ACK timeout, as TCP does
+ * (RFC 6298), when a block arrives in answer to our last ACK
+ */
+static void tftp_rtt_sample(void)
+{
+	long rtt, err;
+
+	if (!IS_ENABLED(CONFIG_TFTP_ADAPTIVE_WINDOW) || !tftp_rtt_pending)
+		return;
+	tftp_rtt_pending = false;
+
+	rtt = get_timer(tftp_ack_time);
+	if (!tftp_srtt && !tftp_rttvar) {
+		tftp_srtt = rtt << 3;
+		tftp_rttvar = rtt << 1;
+	} else {
+		err = rtt - (long)(tftp_srtt >> 3);
+		tftp_srtt += err;
+		if (err < 0)
+			err = -err;
+		tftp_rttvar += err - (long)(tftp_rttvar >> 2);
+	}
+	tftp_rto = clamp((tftp_srtt >> 3) + tftp_rttvar, (ulong)TFTP_RTO_MIN,
+			 timeout_ms);
+}
+
+/*
+ * Send an ACK for the blocks received so far
+ *
+ * @lost: true if blocks were lost since the previous ACK
+ */
+static void tftp_send_ack(bool lost)
+{
+	tftp_send();
+	if (!IS_ENABLED(CONFIG_TFTP_ADAPTIVE_WINDOW))
+		return;
+
+	tftp_adapt_windows++;
+	if (lost)
+		tftp_adapt_lost++;
+	tftp_ack_time = get_timer(0);
+	tftp_rtt_pending = true;
+	net_set_timeout_handler(tftp_rto, tftp_timeout_handler);
+}
+
+/*
+ * Store a block which arrived ahead of the next expected one, so that it
+ * need not be received again once the missing blocks have been resent
+ *
+ * @block:	block number
+ * @src:	block data
+ * @len:	length of the block data
+ * Return: 0 if OK or if the block was not kept, -ve on error
+ */
+static int tftp_store_ahead(ushort block, uchar *src, unsigned int len)
+{
+	ushort ahead = block - (ushort)(tftp_cur_block + 1);
+	int bit = block % TFTP_OOO_BLOCKS;
+
+	/* Blocks behind us are duplicates; keep to a single window */
+	if (tftp_state != STATE_DATA || tftp_windowsize <= 1 ||
+	    ahead >= TFTP_OOO_BLOCKS || test_bit(bit, tftp_ooo_map))
+		return 0;
+
+	if (store_block(tftp_cur_block + 1 + ahead, src, len))
+		return -1;
+	__set_bit(bit, tftp_ooo_map);
+	tftp_ooo_count++;
+	if (len < tftp_block_size)
+		tftp_ooo_last = block;
+	tftp_rtt_sample();
+
+	return 0;
+}
+
+/*
+ * Move past the blocks already stored after the current one
+ *
+ * Return: true if any was found
+ */
+static bool tftp_skip_stored(void)
+{
+	bool found = false;
+	int bit;
+
+	while (tftp_ooo_count) {
+		bit = (ushort)(tftp_cur_block + 1) % TFTP_OOO_BLOCKS;
+		if (!test_bit(bit, tftp_ooo_map))
+			break;
+		__clear_bit(bit, tftp_ooo_map);
+		tftp_ooo_count--;
+		tftp_cur_block = (tftp_cur_block + 1) % TFTP_SEQUENCE_SIZE;
+		update_block_number();
+		tftp_prev_block = tftp_cur_block;
+		found = true;
+	}
+
+	return found;
+}
+
 /* The TFTP get or put is complete */
 static void tftp_complete(void)
 {
@@ -329,6 +520,12 @@ static void tftp_complete(void)
 		print_size(net_boot_file_size /
 			time_start * 1000, "/s");
 	}
+	if (IS_ENABLED(CONFIG_TFTP_ADAPTIVE_WINDOW) && !tftp_put_active) {
+		printf("\n\t window %d: %u of %u windows lost, RTT %lu ms",
+		       tftp_windowsize, tftp_adapt_lost, tftp_adapt_windows,
+		       tftp_srtt >> 3);
+		tftp_adapt_update();
+	}
 	puts("\ndone\n");
 	if (IS_ENABLED(CONFIG_CMD_BOOTEFI)) {
 		if (!tftp_put_active)
@@ -351,7 +548,8 @@ static void tftp_send(void)
 	 *	We will always be sending some sort of packet, so
 	 *	cobble together the packet headers now.
 	 */
-	pkt = net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE;
+	pkt = net_tx_packet + net_eth_hdr_size() +
+		(tftp_use_ip6() ? IP6_UDP_HDR_SIZE : IP_UDP_HDR_SIZE);
 
 	switch (tftp_state) {
 	case STATE_SEND_RRQ:
@@ -380,15 +578,16 @@ static void tftp_send(void)
 #endif
 		/* try for more effic. blk size */
 		pkt += sprintf((char *)pkt, "blksize%c%d%c",
-				0, tftp_block_size_option, 0);
+				0, tftp_block_size_request(), 0);
 
 		/* try for more effic. window size.
 		 * Implemented only for tftp get.
 		 * Don't bother sending if it's 1
 		 */
-		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_option > 1)
+		if (tftp_state == STATE_SEND_RRQ &&
+		    tftp_window_size_request() > 1)
 			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
-					0, tftp_window_size_option, 0);
+					0, tftp_window_size_request(), 0);
 		len = pkt - xp;
 		break;
 
@@ -453,8 +652,18 @@ static void tftp_send(void)
 		break;
 	}
 
-	net_send_udp_packet(net_server_ethaddr, tftp_remote_ip,
-			    tftp_remote_port, tftp_our_port, len);
+	if (tftp_use_ip6()) {
+		/* There may be no route to the server */
+		if (net_send_udp_packet6(net_server_ethaddr, &tftp_remote_ip6,
+					 tftp_remote_port, tftp_our_port,
+					 len) < 0) {
+			net_set_state(NETLOOP_FAIL);
+			return;
+		}
+	} else {
+		net_send_udp_packet(net_server_ethaddr, tftp_remote_ip,
+				    tftp_remote_port, tftp_our_port, len);
+	}
 
 	if (err_pkt)
 		net_set_state(NETLOOP_FAIL);
@@ -557,7 +766,7 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 					dectoul((char *)pkt + i + 8, NULL);
 				debug("Blocksize oack: %s, %d\n",
 				      (char *)pkt + i + 8, tftp_block_size);
-				if (tftp_block_size > tftp_block_size_option) {
+				if (tftp_block_size > tftp_block_size_request()) {
 					printf("Invalid blk size(=%d)\n",
 					       tftp_block_size);
 					tftp_state = STATE_INVALID_OPTION;
@@ -610,6 +819,12 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			debug("Received unexpected block: %d, expected: %d\n",
 			      ntohs(*(__be16 *)pkt),
 			      (ushort)(tftp_cur_block + 1));
+			if (tftp_store_ahead(ntohs(*(__be16 *)pkt), pkt + 2,
+					     len)) {
+				eth_halt();
+				net_set_state(NETLOOP_FAIL);
+				break;
+			}
 			/*
 			 * If one packet is dropped most likely
 			 * all other buffers in the window
@@ -617,7 +832,7 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 * This just overwellms the server, let's just send one.
 			 */
 			if (tftp_last_nack != tftp_cur_block) {
-				tftp_send();
+				tftp_send_ack(true);
 				tftp_last_nack = tftp_cur_block;
 				tftp_next_ack = (ushort)(tftp_cur_block +
 							 tftp_windowsize);
@@ -658,7 +873,9 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		update_block_number();
 		tftp_prev_block = tftp_cur_block;
 		timeout_count_max = tftp_timeout_count_max;
-		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+		tftp_rtt_sample();
+		net_set_timeout_handler(tftp_data_timeout(),
+					tftp_timeout_handler);
 
 		if (store_block(tftp_cur_block, pkt + 2, len)) {
 			eth_halt();
@@ -672,12 +889,30 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			break;
 		}
 
+		/*
+		 * This filled a hole: acknowledge everything received so far
+		 * at once, so that the remote goes on from there rather than
+		 * sending the rest of the window again.
+		 */
+		if (tftp_skip_stored()) {
+			if (tftp_ooo_last == (ushort)tftp_cur_block) {
+				tftp_send();
+				tftp_complete();
+				break;
+			}
+			tftp_send_ack(false);
+			tftp_last_nack = tftp_cur_block;
+			tftp_next_ack = (ushort)(tftp_cur_block +
+						 tftp_windowsize);
+			break;
+		}
+
 		/*
 		 *	Acknowledge the block just received, which will prompt
 		 *	the remote for the next one.
 		 */
 		if (tftp_cur_block == tftp_next_ack) {
-			tftp_send();
+			tftp_send_ack(false);
 			tftp_next_ack += tftp_windowsize;
 		}
 		break;
@@ -710,7 +945,21 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 static void tftp_timeout_handler(void)
 {
+	if (IS_ENABLED(CONFIG_TFTP_ADAPTIVE_WINDOW) &&
+	    tftp_state == STATE_DATA && !tftp_put_active) {
+		tftp_adapt_lost++;
+		tftp_rtt_pending = false;
+		/* Retries before the full timeout do not count, back off */
+		if (tftp_rto < timeout_ms) {
+			tftp_rto = min(tftp_rto * 2, timeout_ms);
+			net_set_timeout_handler(tftp_rto, tftp_timeout_handler);
+			tftp_send();
+			return;
+		}
+	}
+
 	if (++timeout_count > timeout_count_max) {
+		tftp_adapt_update();
 		restart("Retry count exceeded");
 	} else {
 		puts("T ");
@@ -741,6 +990,7 @@ static int tftp_init_load_addr(void)
 
 void tftp_start(enum proto_t protocol)
 {
+	int ret;
 #if CONFIG_NET_TFTP_VARS
 	char *ep;             /* Environment pointer */
 
@@ -782,7 +1032,18 @@ void tftp_start(enum proto_t protocol)
 	      tftp_block_size_option, tftp_window_size_option, timeout_ms);
 
 	tftp_remote_ip = net_server_ip;
-	if (!net_parse_bootfile(&tftp_remote_ip, tftp_filename, MAX_LEN)) {
+	if (tftp_use_ip6()) {
+		tftp_remote_ip6 = net_server_ip6;
+		ret = net_parse_bootfile6(&tftp_remote_ip6, tftp_filename,
+					  MAX_LEN);
+		if (ret <= 0) {
+			if (!ret)
+				puts("*** ERROR: no boot file name\n");
+			net_set_state(NETLOOP_FAIL);
+			return;
+		}
+	} else if (!net_parse_bootfile(&tftp_remote_ip, tftp_filename,
+				       MAX_LEN)) {
 		sprintf(default_filename, "%02X%02X%02X%02X.img",
 			net_ip.s_addr & 0xFF,
 			(net_ip.s_addr >>  8) & 0xFF,
@@ -797,16 +1058,25 @@ void tftp_start(enum proto_t protocol)
 	}
 
 	printf("Using %s device\n", eth_get_name());
-	printf("TFTP %s server %pI4; our IP address is %pI4",
+	if (tftp_use_ip6())
+		printf("TFTP %s server %pI6c",
+#ifdef CONFIG_CMD_TFTPPUT
+		       protocol == TFTPPUT ? "to" : "from",
+#else
+		       "from",
+#endif
+		       &tftp_remote_ip6);
+	else
+		printf("TFTP %s server %pI4; our IP address is %pI4",
 #ifdef CONFIG_CMD_TFTPPUT
-	       protocol == TFTPPUT ? "to" : "from",
+		       protocol == TFTPPUT ? "to" : "from",
 #else
-	       "from",
+		       "from",
 #endif
-	       &tftp_remote_ip, &net_ip);
+		       &tftp_remote_ip, &net_ip);
 
 	/* Check if we need to send across this subnet */
-	if (net_gateway.s_addr && net_netmask.s_addr) {
+	if (!tftp_use_ip6() && net_gateway.s_addr && net_netmask.s_addr) {
 		struct in_addr our_net;
 		struct in_addr remote_net;
 
@@ -874,6 +1144,12 @@ void tftp_start(enum proto_t protocol)
 	tftp_cur_block = 0;
 	tftp_windowsize = 1;
 	tftp_last_nack = 0;
+	if (!tftp_adapt_window || tftp_adapt_window > tftp_window_size_option)
+		tftp_adapt_window = tftp_window_size_option;
+	tftp_srtt = 0;
+	tftp_rttvar = 0;
+	tftp_rto = timeout_ms;
+	tftp_rtt_pending = false;
 	/* zero out server ether in case the server ip has changed */
 	memset(net_server_ethaddr, 0, 6);
 	/* Revert tftp_block_size to dflt */
@@ -912,6 +1188,10 @@ void tftp_start_server(void)
 	tftp_block_size = TFTP_BLOCK_SIZE;
 	tftp_cur_block = 0;
 	tftp_our_port = WELL_KNOWN_PORT;
+	tftp_srtt = 0;
+	tftp_rttvar = 0;
+	tftp_rto = timeout_ms;
+	tftp_rtt_pending = false;
 
 #ifdef CONFIG_TFTP_TSIZE
 	tftp_tsize = 0;
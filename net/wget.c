@@ -0,0 +1,308 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * HTTP/1.1 download over TCP
+ *
+ * A single GET request is sent and the body of the response is stored at
+ * the load address as it arrives, like TFTP does with its data blocks.
+ * Only plain responses with status 200 are accepted; chunked transfer
+ * encoding is not supported, so the server has to send a Content-Length or
+ * close the connection at the end of the file.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <env.h>
+#include <image.h>
+#include <lmb.h>
+#include <log.h>
+#include <mapmem.h>
+#include <net.h>
+#include <net/tcp.h>
+#include <asm/global_data.h>
+#include "wget.h"
+
+DECLARE_GLOBAL_DATA_PTR;
+
+#define WGET_PORT		80
+#define WGET_LINE_MAX		256
+#define WGET_HASHES		50
+#define WGET_HASH_SIZE		(256 << 10)
+#define HASHES_PER_LINE		65
+
+enum wget_state {
+	WGET_STATUS,	/* Waiting for the status line */
+	WGET_HEADERS,	/* Reading the header fields */
+	WGET_BODY,	/* Storing the body */
+	WGET_DONE,	/* Finished, successfully or not */
+};
+
+static enum wget_state wget_state;
+static struct in_addr wget_server_ip;
+static u16 wget_port;
+static char wget_path[1024];
+
+static char wget_line[WGET_LINE_MAX];
+static uint wget_line_len;
+static bool wget_has_length;
+static ulong wget_length;
+
+static ulong wget_load_addr;
+static ulong wget_load_size;
+static ulong wget_offset;
+static uint wget_hashes;
+static ulong wget_start_time;
+
+static void wget_fail(const char *msg)
+{
+	if (wget_state == WGET_DONE)
+		return;
+
+	printf("\nHTTP error: %s\n", msg);
+	wget_state = WGET_DONE;
+	tcp_abort();
+	net_set_state(NETLOOP_FAIL);
+}
+
+static void wget_show_progress(void)
+{
+	if (wget_has_length && wget_length) {
+		while (wget_hashes < (u64)wget_offset * WGET_HASHES /
+		       wget_length) {
+			putc('#');
+			wget_hashes++;
+		}
+		return;
+	}
+
+	while (wget_hashes < wget_offset / WGET_HASH_SIZE) {
+		putc('#');
+		if (++wget_hashes % HASHES_PER_LINE == 0)
+			puts("\n\t ");
+	}
+}
+
+static void wget_done(void)
+{
+	ulong time;
+
+	wget_state = WGET_DONE;
+	tcp_close();
+
+	time = get_timer(wget_start_time);
+	puts("\n\t ");
+	print_size(net_boot_file_size, "");
+	if (time > 0) {
+		puts(" at ");
+		print_size(net_boot_file_size / time * 1000, "/s");
+	}
+	puts("\ndone\n");
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+static int wget_store(const uchar *data, uint len)
+{
+	void *ptr;
+
+	if (wget_has_length && len > wget_length - wget_offset)
+		len = wget_length - wget_offset;
+
+	if (wget_load_size && len > wget_load_size - wget_offset) {
+		wget_fail("trying to overwrite reserved memory...");
+		return -ENOSPC;
+	}
+
+	ptr = map_sysmem(wget_load_addr + wget_offset, len);
+	memcpy(ptr, data, len);
+	unmap_sysmem(ptr);
+	wget_offset += len;
+	net_boot_file_size = wget_offset;
+	wget_show_progress();
+
+	if (wget_has_length && wget_offset == wget_length)
+		wget_done();
+
+	return 0;
+}
+
+/* Handle one line of the response header, without its end of line */
+static int wget_header_line(char *line)
+{
+	const char *val;
+
+	if (wget_state == WGET_STATUS) {
+		/* HTTP/1.x nnn reason */
+		if (strncmp(line, "HTTP/1.", 7) || strlen(line) < 12) {
+			wget_fail("bad response from server");
+			return -EPROTO;
+		}
+		if (simple_strtoul(line + 9, NULL, 10) != 200) {
+			wget_fail(line + 9);
+			return -ENOENT;
+		}
+		wget_state = WGET_HEADERS;
+		return 0;
+	}
+
+	if (!*line) {
+		wget_state = WGET_BODY;
+		if (wget_has_length) {
+			printf("Size is 0x%lx Bytes = ", wget_length);
+			print_size(wget_length, "\n");
+		}
+		puts("Loading: ");
+		if (wget_has_length && !wget_length)
+			wget_done();
+		return 0;
+	}
+
+	val = strchr(line, ':');
+	if (!val)
+		return 0;
+	for (val++; *val == ' ' || *val == '\t'; val++)
+		;
+
+	if (!strncasecmp(line, "Content-Length:", 15)) {
+		wget_length = simple_strtoul(val, NULL, 10);
+		wget_has_length = true;
+		if (wget_load_size && wget_length > wget_load_size) {
+			wget_fail("trying to overwrite reserved memory...");
+			return -ENOSPC;
+		}
+	} else if (!strncasecmp(line, "Transfer-Encoding:", 18) &&
+		   strncasecmp(val, "identity", 8)) {
+		wget_fail("transfer encoding not supported");
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+static void wget_rx(const uchar *data, unsigned int len)
+{
+	char c;
+
+	while (len && wget_state < WGET_BODY) {
+		c = *data++;
+		len--;
+		if (c != '\n') {
+			if (wget_line_len < WGET_LINE_MAX - 1)
+				wget_line[wget_line_len++] = c;
+			continue;
+		}
+		if (wget_line_len && wget_line[wget_line_len - 1] == '\r')
+			wget_line_len--;
+		wget_line[wget_line_len] = '\0';
+		wget_line_len = 0;
+		if (wget_header_line(wget_line))
+			return;
+	}
+
+	if (len && wget_state == WGET_BODY)
+		wget_store(data, len);
+}
+
+static void wget_send_request(void)
+{
+	char host[sizeof("255.255.255.255:65535")];
+	char req[TCP_MSS];
+	int len;
+
+	/* The port is part of the host unless it is the default one */
+	len = snprintf(host, sizeof(host), "%pI4", &wget_server_ip);
+	if (wget_port != WGET_PORT)
+		snprintf(host + len, sizeof(host) - len, ":%u", wget_port);
+
+	/* The request target must be an absolute path */
+	len = snprintf(req, sizeof(req),
+		       "GET %s%s HTTP/1.1\r\n"
+		       "Host: %s\r\n"
+		       "User-Agent: U-Boot\r\n"
+		       "Connection: close\r\n\r\n",
+		       *wget_path == '/' ? "" : "/", wget_path, host);
+	if (len >= sizeof(req) || tcp_send(req, len))
+		wget_fail("request too long");
+}
+
+static void wget_event(enum tcp_event event)
+{
+	switch (event) {
+	case TCP_EV_CONNECTED:
+		wget_send_request();
+		break;
+	case TCP_EV_CLOSED:
+		if (wget_state == WGET_DONE)
+			break;
+		if (wget_state == WGET_BODY && !wget_has_length)
+			wget_done();
+		else
+			wget_fail("connection closed by server");
+		break;
+	case TCP_EV_RESET:
+		wget_fail("connection reset by server");
+		break;
+	case TCP_EV_TIMEOUT:
+		wget_fail("timed out");
+		break;
+	}
+}
+
+/* Initialize wget_load_addr and wget_load_size from image_load_addr and lmb */
+static int wget_init_load_addr(void)
+{
+#ifdef CONFIG_LMB
+	struct lmb lmb;
+	phys_size_t max_size;
+
+	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
+
+	max_size = lmb_get_free_size(&lmb, image_load_addr);
+	if (!max_size)
+		return -1;
+
+	wget_load_size = max_size;
+#endif
+	wget_load_addr = image_load_addr;
+	return 0;
+}
+
+void wget_start(void)
+{
+	int ret;
+
+	wget_server_ip = net_server_ip;
+	if (!net_parse_bootfile(&wget_server_ip, wget_path,
+				sizeof(wget_path))) {
+		puts("\nHTTP error: no file name given\n");
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+	wget_port = env_get_ulong("httpdstp", 10, WGET_PORT);
+
+	printf("Using %s device\n", eth_get_name());
+	printf("HTTP from server %pI4:%u; our IP address is %pI4\n",
+	       &wget_server_ip, wget_port, &net_ip);
+	printf("Filename '%s'.\n", wget_path);
+
+	wget_load_size = 0;
+	if (wget_init_load_addr()) {
+		puts("\nHTTP error: trying to overwrite reserved memory...\n");
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+	printf("Load address: 0x%lx\n", wget_load_addr);
+
+	wget_state = WGET_STATUS;
+	wget_line_len = 0;
+	wget_has_length = false;
+	wget_length = 0;
+	wget_offset = 0;
+	wget_hashes = 0;
+	wget_start_time = get_timer(0);
+
+	ret = tcp_connect(wget_server_ip, wget_port, wget_rx, wget_event);
+	if (ret) {
+		printf("\nHTTP error: cannot connect (%d)\n", ret);
+		wget_state = WGET_DONE;
+		net_set_state(NETLOOP_FAIL);
+	}
+}
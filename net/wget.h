@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * HTTP/1.1 download over TCP
+ */
+
+#ifndef __WGET_H__
+#define __WGET_H__
+
+/*
+ * Initialize wget (beginning of netloop)
+ */
+void wget_start(void);
+
+#endif /* __WGET_H__ */
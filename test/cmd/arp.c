@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test for the ARP cache and the 'arp' command
+ *
+ * A fake TFTP server answers each request with an error, so that each
+ * 'tftpboot' sends a single packet. The ARP requests sent before it are
+ * counted: once the server is in the ARP cache there should be none.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <net.h>
+#include <stdio_dev.h>
+#include <asm/eth.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define ARP_TEST_PORT		5000
+#define ARP_TEST_TFTP_ERROR	5
+#define ARP_TEST_NC_PORT	6666
+
+/**
+ * struct arp_test_env - state of the fake server
+ *
+ * @uts:	unit test state
+ * @arp_reqs:	number of ARP requests sent by U-Boot
+ * @tftp_reqs:	number of TFTP requests sent by U-Boot
+ * @nc_pkts:	number of netconsole packets sent by U-Boot
+ */
+struct arp_test_env {
+	struct unit_test_state *uts;
+	int arp_reqs;
+	int tftp_reqs;
+	int nc_pkts;
+};
+
+/* Answer a TFTP request with a 'file not found' error */
+static int arp_test_tftp_error(struct udevice *dev, struct ip_udp_hdr *req)
+{
+	static const char msg[] = "File not found";
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth, *req_eth;
+	struct ip_udp_hdr *ip;
+	uchar *data;
+	uint len = 4 + sizeof(msg);
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return -ENOSPC;
+
+	req_eth = (void *)req - ETHER_HDR_SIZE;
+	eth = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth->et_dest, req_eth->et_src, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+	ip = (void *)eth + ETHER_HDR_SIZE;
+	net_set_ip_header((uchar *)ip, req->ip_src, priv->fake_host_ipaddr,
+			  IP_UDP_HDR_SIZE + len, IPPROTO_UDP);
+	ip->udp_src = htons(ARP_TEST_PORT);
+	ip->udp_dst = req->udp_src;
+	ip->udp_len = htons(UDP_HDR_SIZE + len);
+	ip->udp_xsum = 0;
+	data = (uchar *)(ip + 1);
+	*(__be16 *)data = htons(ARP_TEST_TFTP_ERROR);
+	*(__be16 *)(data + 2) = htons(1);
+	memcpy(data + 4, msg, sizeof(msg));
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+static int arp_test_tx_handler(struct udevice *dev, void *packet,
+			       unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct arp_test_env *env = priv->priv;
+	/* uts is updated by the ut_assert* macros */
+	struct unit_test_state *uts = env->uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len)) {
+		env->arp_reqs++;
+		return 0;
+	}
+
+	ut_asserteq(PROT_IP, ntohs(eth->et_protlen));
+	ut_asserteq_mem(priv->fake_host_hwaddr, eth->et_dest, ARP_HLEN);
+	ip = packet + ETHER_HDR_SIZE;
+	ut_asserteq(IPPROTO_UDP, ip->ip_p);
+	if (ntohs(ip->udp_dst) == ARP_TEST_NC_PORT) {
+		env->nc_pkts++;
+		return 0;
+	}
+	ut_asserteq(69, ntohs(ip->udp_dst));
+	env->tftp_reqs++;
+
+	return arp_test_tftp_error(dev, ip);
+}
+
+/* Test that a server is only resolved once, and of the 'arp' command */
+static int dm_test_cmd_arp(struct unit_test_state *uts)
+{
+	struct arp_test_env env = { .uts = uts };
+
+	env_set("ethact", "eth@10002000");
+	sandbox_eth_set_tx_handler(0, arp_test_tx_handler);
+	sandbox_eth_set_priv(0, &env);
+	ut_assertok(run_command("arp -d", 0));
+
+	ut_asserteq(1, run_command("tftpboot 10000 192.0.2.2:file.bin", 0));
+	ut_asserteq(1, env.arp_reqs);
+	ut_asserteq(1, env.tftp_reqs);
+
+	/* The server is known now */
+	ut_asserteq(1, run_command("tftpboot 10000 192.0.2.2:file.bin", 0));
+	ut_asserteq(1, env.arp_reqs);
+	ut_asserteq(2, env.tftp_reqs);
+
+	ut_assertok(console_record_reset_enable());
+	ut_assertok(run_command("arp", 0));
+	ut_assert_nextline("IP address       MAC address        Age  Device");
+	ut_assert_nextlinen("192.0.2.2        00:00:66:44:22:00 ");
+	ut_assert_console_end();
+
+	/* Once removed, it has to be resolved again */
+	ut_assertok(run_command("arp -d 192.0.2.2", 0));
+	ut_asserteq(1, run_command("arp -d 192.0.2.2", 0));
+	ut_assert_nextline("192.0.2.2 is not in the ARP cache");
+	ut_assert_console_end();
+	ut_assertok(run_command("arp", 0));
+	ut_assert_nextline("IP address       MAC address        Age  Device");
+	ut_assert_console_end();
+
+	ut_asserteq(1, run_command("tftpboot 10000 192.0.2.2:file.bin", 0));
+	ut_asserteq(2, env.arp_reqs);
+	ut_asserteq(3, env.tftp_reqs);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	ut_assertok(run_command("arp -d", 0));
+
+	return 0;
+}
+DM_TEST(dm_test_cmd_arp, UT_TESTF_SCAN_FDT | UT_TESTF_CONSOLE_REC);
+
+/* Test that netconsole sends to a server in the ARP cache without waiting */
+static int dm_test_cmd_arp_netconsole(struct unit_test_state *uts)
+{
+	struct arp_test_env env = { .uts = uts };
+	struct stdio_dev *dev;
+
+	dev = stdio_get_by_name("nc");
+	ut_assertnonnull(dev);
+
+	env_set("ethact", "eth@10002000");
+	sandbox_eth_set_tx_handler(0, arp_test_tx_handler);
+	sandbox_eth_set_priv(0, &env);
+	ut_assertok(run_command("arp -d", 0));
+	ut_asserteq(1, run_command("tftpboot 10000 192.0.2.2:file.bin", 0));
+	ut_asserteq(1, env.arp_reqs);
+
+	/* This used to wait forever for an ARP reply which never came */
+	env_set("ncip", "192.0.2.2");
+	ut_assertok(dev->start(dev));
+	dev->puts(dev, "first");
+	ut_asserteq(1, env.nc_pkts);
+	dev->puts(dev, "second");
+	ut_asserteq(2, env.nc_pkts);
+	ut_asserteq(1, env.arp_reqs);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("ncip", NULL);
+	ut_assertok(run_command("arp -d", 0));
+
+	return 0;
+}
+DM_TEST(dm_test_cmd_arp_netconsole, UT_TESTF_SCAN_FDT);
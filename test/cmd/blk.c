@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test for the 'blk' command
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dm.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+/* Test of 'blk bench' on the emulated MMC card */
+static int dm_test_blk_bench_cmd(struct unit_test_state *uts)
+{
+	struct udevice *dev;
+
+	ut_assertok(uclass_get_device(UCLASS_MMC, 0, &dev));
+	ut_assertok(console_record_reset_enable());
+
+	ut_assertok(run_command("blk bench mmc 0 write 10000 0 100 10", 0));
+	ut_assert_nextlinen("write: 16 I/Os of 16 blocks, 131072 bytes in ");
+	ut_assert_nextlinen("throughput: ");
+	ut_assert_nextlinen("latency: min ");
+	console_record_reset();
+
+	ut_assertok(run_command("blk bench mmc 0 randread 10000 0 100", 0));
+	ut_assert_nextlinen("randread: 2 I/Os of 128 blocks, 131072 bytes in ");
+	console_record_reset();
+
+	/* the I/Os must fit in the device */
+	ut_asserteq(1, run_command("blk bench mmc 0 read 10000 7ff 2 1", 0));
+	ut_assert_nextline("Blocks 2047 to 2048 are beyond the device");
+	ut_assert_console_end();
+
+	ut_assert(run_command("blk bench mmc 0 copy 10000 0 100", 0));
+	console_record_reset();
+
+	return 0;
+}
+DM_TEST(dm_test_blk_bench_cmd, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT |
+	UT_TESTF_CONSOLE_REC);
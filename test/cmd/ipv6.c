@@ -0,0 +1,283 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for IPv6: 'ping6' and 'tftpboot -ipv6'
+ *
+ * The sandbox Ethernet driver answers neighbour solicitations and echo
+ * requests. For TFTP, a fake router also answers router solicitations with
+ * a prefix, so that U-Boot has to configure its global address itself
+ * before it can reach the server, which answers with an error.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <net.h>
+#include <net6.h>
+#include <asm/eth.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define IPV6_TEST_PORT		5000
+#define IPV6_TEST_TFTP_ERROR	5
+
+static const struct in6_addr ipv6_test_router = {
+	.s6_addr = { 0xfe, 0x80, [15] = 0x01 }
+};
+
+static const struct in6_addr ipv6_test_prefix = {
+	.s6_addr = { 0x20, 0x01, 0x0d, 0xb8, 0x00, 0x01 }
+};
+
+static const struct in6_addr ipv6_test_server = {
+	.s6_addr = { 0x20, 0x01, 0x0d, 0xb8, 0x00, 0x01, [15] = 0x02 }
+};
+
+/**
+ * struct ipv6_test_env - state of the fake router and server
+ *
+ * @uts:	unit test state
+ * @rs:		number of router solicitations sent by U-Boot
+ * @ns:		number of neighbour solicitations sent by U-Boot
+ * @tftp_reqs:	number of TFTP requests sent by U-Boot
+ * @src:	source address of the last TFTP request
+ * @blksize:	block size asked for in the last TFTP request
+ */
+struct ipv6_test_env {
+	struct unit_test_state *uts;
+	int rs;
+	int ns;
+	int tftp_reqs;
+	struct in6_addr src;
+	int blksize;
+};
+
+/* Test the parsing and printing of IPv6 addresses */
+static int dm_test_string_to_ip6(struct unit_test_state *uts)
+{
+	struct in6_addr addr;
+	char str[INET6_ADDRSTRLEN];
+
+	ut_assertok(string_to_ip6("2001:db8:1::2", 13, &addr));
+	ut_assert(ip6_addr_equal(&ipv6_test_server, &addr));
+	ut_assertok(string_to_ip6("fe80:0:0:0:0:0:0:1", 18, &addr));
+	ut_assert(ip6_addr_equal(&ipv6_test_router, &addr));
+	/* the length stops before the prefix length */
+	ut_assertok(string_to_ip6("2001:db8:1::/64", 12, &addr));
+	ut_assert(ip6_addr_equal(&ipv6_test_prefix, &addr));
+	ut_assertok(string_to_ip6("::ffff:192.0.2.1", 16, &addr));
+	ut_asserteq(htonl(0xc0000201), addr.s6_addr32[3]);
+
+	ut_asserteq(-EINVAL, string_to_ip6("2001:db8::1::2", 14, &addr));
+	ut_asserteq(-EINVAL, string_to_ip6("1:2:3:4:5:6:7:8:9", 17, &addr));
+	ut_asserteq(-EINVAL, string_to_ip6("2001:db8:12345::", 16, &addr));
+	ut_asserteq(-EINVAL, string_to_ip6("fe80::g", 7, &addr));
+
+	snprintf(str, sizeof(str), "%pI6c", &ipv6_test_server);
+	ut_asserteq_str("2001:db8:1::2", str);
+	snprintf(str, sizeof(str), "%pI6", &ipv6_test_router);
+	ut_asserteq_str("fe80:0000:0000:0000:0000:0000:0000:0001", str);
+
+	return 0;
+}
+DM_TEST(dm_test_string_to_ip6, 0);
+
+/* Test of 'ping6', which has to find the MAC address of the host first */
+static int dm_test_cmd_ping6(struct unit_test_state *uts)
+{
+	env_set("ethact", "eth@10002000");
+	ut_assertok(run_command("ping6 fe80::2", 0));
+	ut_asserteq(CMD_RET_USAGE, run_command("ping6 fe80::g", 0));
+
+	return 0;
+}
+DM_TEST(dm_test_cmd_ping6, UT_TESTF_SCAN_FDT);
+
+/* Queue an IPv6 packet of @len bytes at @data, return -ENOSPC if no room */
+static int ipv6_test_reply(struct udevice *dev, const uchar *ether,
+			   const struct in6_addr *src,
+			   const struct in6_addr *dest, int proto, int hlim,
+			   const void *data, uint len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth;
+	struct ip6_hdr *ip6;
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return -ENOSPC;
+
+	eth = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth->et_dest, ether, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IPV6);
+	ip6 = (void *)eth + ETHER_HDR_SIZE;
+	ip6_add_hdr((uchar *)ip6, src, dest, proto, hlim, len);
+	memcpy(ip6 + 1, data, len);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP6_HDR_SIZE + len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+/* Answer a router solicitation with the prefix 2001:db8:1::/64 */
+static int ipv6_test_ra(struct udevice *dev, struct ethernet_hdr *req_eth)
+{
+	static const struct in6_addr all_nodes = {
+		.s6_addr = { 0xff, 0x02, [15] = 0x01 }
+	};
+	struct {
+		struct ra_msg ra;
+		struct nd_opt_prefix_info pi;
+	} __packed msg;
+
+	memset(&msg, '\0', sizeof(msg));
+	msg.ra.icmph.icmp6_type = ICMPV6_ROUTER_ADVERT;
+	msg.ra.icmph.un.ra.hop_limit = IP6_HOP_LIMIT;
+	msg.ra.icmph.un.ra.lifetime = htons(1800);
+	msg.pi.nd_opt_type = ND_OPT_PREFIX_INFO;
+	msg.pi.nd_opt_len = sizeof(msg.pi) / 8;
+	msg.pi.prefix_len = 64;
+	msg.pi.flags = ND_OPT_PI_FLAG_ONLINK | ND_OPT_PI_FLAG_AUTO;
+	msg.pi.valid_lifetime = htonl(86400);
+	msg.pi.preferred_lifetime = htonl(14400);
+	msg.pi.prefix = ipv6_test_prefix;
+	msg.ra.icmph.icmp6_cksum = ip6_csum(&ipv6_test_router, &all_nodes,
+					    sizeof(msg), IPPROTO_ICMPV6, &msg);
+
+	return ipv6_test_reply(dev, req_eth->et_src, &ipv6_test_router,
+			       &all_nodes, IPPROTO_ICMPV6, ND_HOP_LIMIT, &msg,
+			       sizeof(msg));
+}
+
+/* Answer a TFTP request with a 'file not found' error */
+static int ipv6_test_tftp_error(struct udevice *dev,
+				struct ethernet_hdr *req_eth,
+				struct ip6_hdr *req)
+{
+	static const char err[] = "File not found";
+	struct udp_hdr *req_udp = (struct udp_hdr *)(req + 1);
+	struct {
+		struct udp_hdr udp;
+		__be16 opcode;
+		__be16 code;
+		char msg[sizeof(err)];
+	} __packed msg;
+
+	msg.udp.udp_src = htons(IPV6_TEST_PORT);
+	msg.udp.udp_dst = req_udp->udp_src;
+	msg.udp.udp_len = htons(sizeof(msg));
+	msg.udp.udp_xsum = 0;
+	msg.opcode = htons(IPV6_TEST_TFTP_ERROR);
+	msg.code = htons(1);
+	memcpy(msg.msg, err, sizeof(err));
+	msg.udp.udp_xsum = ip6_csum(&ipv6_test_server, &req->ip6_src,
+				    sizeof(msg), IPPROTO_UDP, &msg);
+
+	return ipv6_test_reply(dev, req_eth->et_src, &ipv6_test_server,
+			       &req->ip6_src, IPPROTO_UDP, IP6_HOP_LIMIT, &msg,
+			       sizeof(msg));
+}
+
+static int ipv6_test_tx_handler(struct udevice *dev, void *packet,
+				unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ipv6_test_env *env = priv->priv;
+	/* uts is updated by the ut_assert* macros */
+	struct unit_test_state *uts = env->uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip6_hdr *ip6 = packet + ETHER_HDR_SIZE;
+	struct icmp6_hdr *icmp = (struct icmp6_hdr *)(ip6 + 1);
+	struct udp_hdr *udp = (struct udp_hdr *)(ip6 + 1);
+	char *opt, *end;
+
+	ut_asserteq(PROT_IPV6, ntohs(eth->et_protlen));
+	if (ip6->ip6_nxt == IPPROTO_ICMPV6) {
+		if (icmp->icmp6_type == ICMPV6_ROUTER_SOLICIT) {
+			env->rs++;
+			return ipv6_test_ra(dev, eth);
+		}
+		ut_asserteq(ICMPV6_NEIGHBOUR_SOLICIT, icmp->icmp6_type);
+		env->ns++;
+		return sandbox_eth_nd_req_to_reply(dev, packet, len);
+	}
+
+	ut_asserteq(IPPROTO_UDP, ip6->ip6_nxt);
+	ut_asserteq_mem(priv->fake_host_hwaddr, eth->et_dest, ARP_HLEN);
+	ut_assert(ip6_addr_equal(&ipv6_test_server, &ip6->ip6_dst));
+	ut_asserteq(69, ntohs(udp->udp_dst));
+	ut_assertok(ip6_csum(&ip6->ip6_src, &ip6->ip6_dst,
+			     ntohs(udp->udp_len), IPPROTO_UDP, udp));
+	env->tftp_reqs++;
+	env->src = ip6->ip6_src;
+
+	/* opcode, file name and mode, then the options */
+	opt = (char *)(udp + 1) + 2;
+	end = (char *)udp + ntohs(udp->udp_len);
+	ut_asserteq_str("file.bin", opt);
+	env->blksize = 0;
+	for (opt += strlen(opt) + 1; opt < end; opt += strlen(opt) + 1) {
+		if (!strcmp(opt, "blksize"))
+			env->blksize = dectoul(opt + 8, NULL);
+	}
+
+	return ipv6_test_tftp_error(dev, eth, ip6);
+}
+
+/* Test of 'tftpboot -ipv6' with an address configured from the router */
+static int dm_test_cmd_tftp_ipv6(struct unit_test_state *uts)
+{
+	struct ipv6_test_env env = { .uts = uts };
+	struct in6_addr addr;
+	int i;
+
+	/* Nothing is configured yet */
+	memset(&net_ip6, '\0', sizeof(net_ip6));
+	memset(&net_gateway6, '\0', sizeof(net_gateway6));
+
+	env_set("ethact", "eth@10002000");
+	sandbox_eth_set_tx_handler(0, ipv6_test_tx_handler);
+	sandbox_eth_set_priv(0, &env);
+
+	ut_asserteq(1, run_command("tftpboot 10000 [2001:db8:1::2]:file.bin -ipv6",
+				   0));
+	ut_asserteq(1, env.rs);
+	ut_asserteq(1, env.ns);
+	ut_asserteq(1, env.tftp_reqs);
+	/* larger blocks would not fit in a frame */
+	ut_asserteq(1448, env.blksize);
+
+	/* The prefix of the router and an interface ID from the MAC address */
+	ip6_make_lladdr(&addr, net_ethaddr);
+	for (i = 0; i < 8; i++)
+		addr.s6_addr[i] = ipv6_test_prefix.s6_addr[i];
+	ut_assert(ip6_addr_equal(&addr, &env.src));
+	ut_assert(ip6_addr_equal(&addr, &net_ip6));
+	ut_assert(ip6_addr_equal(&ipv6_test_router, &net_gateway6));
+
+	/* A static address and the server from the environment */
+	env_set("ip6addr", "2001:db8:1::10");
+	env_set("serverip6", "2001:db8:1::2");
+	ut_asserteq(1, run_command("tftpboot 10000 file.bin -ipv6", 0));
+	ut_asserteq(1, env.rs);
+	ut_asserteq(2, env.ns);
+	ut_asserteq(2, env.tftp_reqs);
+	ut_assertok(string_to_ip6("2001:db8:1::10", 14, &addr));
+	ut_assert(ip6_addr_equal(&addr, &env.src));
+
+	/* A bad server address fails without sending a request */
+	ut_asserteq(1, run_command("tftpboot 10000 [2001:db8:1::g]:file.bin -ipv6",
+				   0));
+	ut_asserteq(2, env.tftp_reqs);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("ip6addr", NULL);
+	env_set("serverip6", NULL);
+	memset(&net_gateway6, '\0', sizeof(net_gateway6));
+
+	return 0;
+}
+DM_TEST(dm_test_cmd_tftp_ipv6, UT_TESTF_SCAN_FDT);
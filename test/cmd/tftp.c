@@ -0,0 +1,276 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test for TFTP downloads with a window (RFC 7440)
+ *
+ * A fake TFTP server answers through the sandbox Ethernet driver and drops
+ * some of the blocks it sends. The client has to keep the blocks received
+ * after a lost one and acknowledge them all as soon as the hole is filled,
+ * without waiting for the blocks it already has to be sent again.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <net.h>
+#include <asm/eth.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define TFTP_TEST_ADDR		0x10000
+#define TFTP_TEST_BLKSIZE	512
+/* Ten full blocks and a short one */
+#define TFTP_TEST_BLOCKS	11
+#define TFTP_TEST_LAST_LEN	100
+#define TFTP_TEST_SIZE		((TFTP_TEST_BLOCKS - 1) * TFTP_TEST_BLKSIZE + \
+				 TFTP_TEST_LAST_LEN)
+/* Largest window the server accepts, which fits in PKTBUFSRX */
+#define TFTP_TEST_WINDOW	2
+#define TFTP_TEST_PORT		5000
+
+#define TFTP_TEST_RRQ		1
+#define TFTP_TEST_DATA		3
+#define TFTP_TEST_ACK		4
+#define TFTP_TEST_OACK		6
+
+/* Blocks dropped by the server, and on which transmission */
+static const struct {
+	int block;
+	int count;
+} tftp_test_drops[] = {
+	{ 3, 1 },
+	{ 4, 2 },
+};
+
+/**
+ * struct tftp_test_env - state of the fake TFTP server
+ *
+ * @uts:	unit test state
+ * @client_mac:	MAC address of U-Boot
+ * @client_ip:	IP address of U-Boot
+ * @client_port: UDP port of U-Boot
+ * @drop:	drop the blocks in tftp_test_drops
+ * @req_window:	window size asked for by U-Boot, 0 if none
+ * @window:	window size in use
+ * @sent:	number of times each block was sent
+ * @acks:	block numbers acknowledged by U-Boot
+ * @num_acks:	number of entries in @acks
+ * @data:	data of the file
+ */
+struct tftp_test_env {
+	struct unit_test_state *uts;
+	uchar client_mac[ARP_HLEN];
+	struct in_addr client_ip;
+	u16 client_port;
+	bool drop;
+	int req_window;
+	int window;
+	int sent[TFTP_TEST_BLOCKS + 1];
+	int acks[TFTP_TEST_BLOCKS * 2];
+	int num_acks;
+	uchar data[TFTP_TEST_SIZE];
+};
+
+/* Queue a packet from the server, return false if there is no room */
+static bool tftp_test_reply(struct udevice *dev, struct tftp_test_env *env,
+			    const void *data, uint len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth;
+	struct ip_udp_hdr *ip;
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return false;
+
+	eth = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth->et_dest, env->client_mac, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+	ip = (void *)eth + ETHER_HDR_SIZE;
+	net_set_ip_header((uchar *)ip, env->client_ip, priv->fake_host_ipaddr,
+			  IP_UDP_HDR_SIZE + len, IPPROTO_UDP);
+	ip->udp_src = htons(TFTP_TEST_PORT);
+	ip->udp_dst = htons(env->client_port);
+	ip->udp_len = htons(UDP_HDR_SIZE + len);
+	ip->udp_xsum = 0;
+	memcpy(ip + 1, data, len);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+	++priv->recv_packets;
+
+	return true;
+}
+
+/* Send a data block, unless it is one to drop */
+static bool tftp_test_send_block(struct udevice *dev,
+				 struct tftp_test_env *env, int block)
+{
+	uchar pkt[4 + TFTP_TEST_BLKSIZE];
+	uint len = TFTP_TEST_BLKSIZE;
+	int i;
+
+	env->sent[block]++;
+	for (i = 0; env->drop && i < ARRAY_SIZE(tftp_test_drops); i++) {
+		if (tftp_test_drops[i].block == block &&
+		    tftp_test_drops[i].count == env->sent[block])
+			return true;
+	}
+
+	if (block == TFTP_TEST_BLOCKS)
+		len = TFTP_TEST_LAST_LEN;
+	*(__be16 *)pkt = htons(TFTP_TEST_DATA);
+	*(__be16 *)(pkt + 2) = htons(block);
+	memcpy(pkt + 4, env->data + (block - 1) * TFTP_TEST_BLKSIZE, len);
+
+	return tftp_test_reply(dev, env, pkt, 4 + len);
+}
+
+/* Answer a read request with an OACK, taking the window size into account */
+static int tftp_test_rrq(struct udevice *dev, struct tftp_test_env *env,
+			 const char *req, const char *end)
+{
+	/* uts is updated by the ut_assert* macros */
+	struct unit_test_state *uts = env->uts;
+	const char *timeout = "5";
+	char oack[64], *p;
+
+	ut_asserteq_str("file.bin", req);
+	req += strlen(req) + 1;
+	ut_asserteq_str("octet", req);
+	req += strlen(req) + 1;
+
+	env->req_window = 0;
+	while (req < end) {
+		const char *val = req + strlen(req) + 1;
+
+		if (!strcmp(req, "timeout"))
+			timeout = val;
+		else if (!strcmp(req, "windowsize"))
+			env->req_window = dectoul(val, NULL);
+		req = val + strlen(val) + 1;
+	}
+	env->window = min(env->req_window, TFTP_TEST_WINDOW);
+	if (!env->window)
+		env->window = 1;
+
+	p = oack;
+	*(__be16 *)p = htons(TFTP_TEST_OACK);
+	p += 2;
+	p += sprintf(p, "blksize%c%d%c", 0, TFTP_TEST_BLKSIZE, 0);
+	p += sprintf(p, "timeout%c%s%c", 0, timeout, 0);
+	if (env->req_window)
+		p += sprintf(p, "windowsize%c%d%c", 0, env->window, 0);
+	ut_assert(tftp_test_reply(dev, env, oack, p - oack));
+
+	return 0;
+}
+
+static int tftp_test_tx_handler(struct udevice *dev, void *packet,
+				unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct tftp_test_env *env = priv->priv;
+	struct unit_test_state *uts = env->uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip;
+	uchar *data;
+	int block, last;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+
+	ut_asserteq(PROT_IP, ntohs(eth->et_protlen));
+	ip = packet + ETHER_HDR_SIZE;
+	ut_asserteq(IPPROTO_UDP, ip->ip_p);
+	ut_asserteq(priv->fake_host_ipaddr.s_addr, ip->ip_dst.s_addr);
+	data = (uchar *)(ip + 1);
+
+	if (ntohs(ip->udp_dst) == 69) {
+		ut_asserteq(TFTP_TEST_RRQ, ntohs(*(__be16 *)data));
+		memcpy(env->client_mac, eth->et_src, ARP_HLEN);
+		env->client_ip = ip->ip_src;
+		env->client_port = ntohs(ip->udp_src);
+		env->num_acks = 0;
+		memset(env->sent, '\0', sizeof(env->sent));
+
+		return tftp_test_rrq(dev, env, (char *)data + 2,
+				     (char *)data + ntohs(ip->udp_len) -
+				     UDP_HDR_SIZE);
+	}
+
+	ut_asserteq(TFTP_TEST_PORT, ntohs(ip->udp_dst));
+	ut_asserteq(env->client_port, ntohs(ip->udp_src));
+	ut_asserteq(TFTP_TEST_ACK, ntohs(*(__be16 *)data));
+	block = ntohs(*(__be16 *)(data + 2));
+	ut_assert(env->num_acks < ARRAY_SIZE(env->acks));
+	env->acks[env->num_acks++] = block;
+
+	last = min(block + env->window, TFTP_TEST_BLOCKS);
+	for (block++; block <= last; block++)
+		ut_assert(tftp_test_send_block(dev, env, block));
+
+	return 0;
+}
+
+/* Test of 'tftpboot' with a window, losing some of the blocks */
+static int dm_test_cmd_tftp_window(struct unit_test_state *uts)
+{
+	/*
+	 * Block 3 is lost, so block 4 comes alone and is kept. Asked for
+	 * again, block 3 arrives but block 4 is lost this time: the client
+	 * already has it and goes on with block 5 at once.
+	 */
+	static const int acks[] = { 0, 2, 2, 4, 6, 8, 10, 11 };
+	struct tftp_test_env *env;
+	uchar *buf;
+	int i;
+
+	env = calloc(1, sizeof(*env));
+	ut_assertnonnull(env);
+	env->uts = uts;
+	for (i = 0; i < TFTP_TEST_SIZE; i++)
+		env->data[i] = i * 7 + (i >> 8);
+
+	buf = map_sysmem(TFTP_TEST_ADDR, TFTP_TEST_SIZE);
+	memset(buf, '\0', TFTP_TEST_SIZE);
+
+	env_set("ethact", "eth@10002000");
+	env_set("tftpwindowsize", "2");
+	sandbox_eth_set_tx_handler(0, tftp_test_tx_handler);
+	sandbox_eth_set_priv(0, env);
+
+	env->drop = true;
+	ut_assertok(run_command("tftpboot 10000 192.0.2.2:file.bin", 0));
+	ut_asserteq(2, env->req_window);
+	ut_asserteq(ARRAY_SIZE(acks), env->num_acks);
+	ut_asserteq_mem(acks, env->acks, sizeof(acks));
+	ut_asserteq(TFTP_TEST_SIZE, env_get_hex("filesize", 0));
+	ut_asserteq_mem(env->data, buf, TFTP_TEST_SIZE);
+
+	if (IS_ENABLED(CONFIG_TFTP_ADAPTIVE_WINDOW)) {
+		/*
+		 * One window in six lost blocks, so the next request asks
+		 * for a smaller one. That transfer has no loss, which lets
+		 * the window grow back for later runs.
+		 */
+		env->drop = false;
+		memset(buf, '\0', TFTP_TEST_SIZE);
+		ut_assertok(run_command("tftpboot 10000 192.0.2.2:file.bin",
+					0));
+		ut_asserteq(0, env->req_window);
+		ut_asserteq(TFTP_TEST_BLOCKS + 1, env->num_acks);
+		ut_asserteq_mem(env->data, buf, TFTP_TEST_SIZE);
+	}
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("tftpwindowsize", NULL);
+	unmap_sysmem(buf);
+	free(env);
+
+	return 0;
+}
+DM_TEST(dm_test_cmd_tftp_window, UT_TESTF_SCAN_FDT);
@@ -0,0 +1,309 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test for the 'wget' command
+ *
+ * A fake HTTP server answers through the sandbox Ethernet driver. It sends
+ * the response in a fixed order with one segment held back, so that the TCP
+ * client has to buffer the segments after the hole and acknowledge them
+ * with duplicate ACKs until the missing one arrives.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <net.h>
+#include <net/tcp.h>
+#include <asm/eth.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define WGET_TEST_ADDR		0x10000
+#define WGET_TEST_SEG_SIZE	1000
+#define WGET_TEST_SEGS		8
+#define WGET_TEST_SIZE		(WGET_TEST_SEG_SIZE * WGET_TEST_SEGS)
+#define WGET_TEST_ISS		0x12345678
+#define WGET_TEST_PORT		80
+
+static const char wget_test_hdr[] =
+	"HTTP/1.1 200 OK\r\n"
+	"Content-Type: application/octet-stream\r\n"
+	"Content-Length: 8000\r\n"
+	"\r\n";
+
+/* Order in which the server sends the segments: 0 is the header */
+static const int wget_test_order[] = { 0, 1, 2, 4, 5, 3, 6, 7, 8 };
+
+/**
+ * struct wget_test_env - state of the fake HTTP server
+ *
+ * @uts:	unit test state
+ * @client_mac:	MAC address of U-Boot
+ * @client_ip:	IP address of U-Boot
+ * @sport:	TCP port of U-Boot
+ * @port:	TCP port of the server
+ * @host:	Host header expected in the request
+ * @next:	next entry of wget_test_order to send
+ * @got_syn:	a SYN with the expected options was received
+ * @got_req:	the request was received
+ * @got_fin:	U-Boot closed the connection
+ * @dup_acks:	number of ACKs for the missing segment
+ * @body:	data of the file
+ */
+struct wget_test_env {
+	struct unit_test_state *uts;
+	uchar client_mac[ARP_HLEN];
+	struct in_addr client_ip;
+	u16 sport;
+	u16 port;
+	const char *host;
+	int next;
+	bool got_syn;
+	bool got_req;
+	bool got_fin;
+	int dup_acks;
+	uchar body[WGET_TEST_SIZE];
+};
+
+static uint wget_test_xsum(struct in_addr src, struct in_addr dst,
+			   const void *tcp, uint len)
+{
+	struct {
+		struct in_addr src;
+		struct in_addr dst;
+		u8 zero;
+		u8 proto;
+		u16 len;
+	} __packed ph = { src, dst, 0, IPPROTO_TCP, htons(len) };
+
+	return add_ip_checksums(sizeof(ph), compute_ip_checksum(&ph, sizeof(ph)),
+				compute_ip_checksum(tcp, len));
+}
+
+/* Queue a segment from the server, return false if there is no room */
+static bool wget_test_reply(struct udevice *dev, struct wget_test_env *env,
+			    u8 flags, u32 seq, u32 ack, const void *data,
+			    uint len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth;
+	struct tcp_hdr *tcp;
+	uchar *ip, *opt;
+	uint hdr_len = TCP_HDR_SIZE;
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return false;
+
+	eth = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth->et_dest, env->client_mac, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+	ip = (uchar *)eth + ETHER_HDR_SIZE;
+	tcp = (struct tcp_hdr *)(ip + IP_HDR_SIZE);
+	opt = (uchar *)(tcp + 1);
+
+	if (flags & TCP_SYN) {
+		opt[0] = TCP_OPT_MSS;
+		opt[1] = 4;
+		opt[2] = TCP_MSS >> 8;
+		opt[3] = TCP_MSS & 0xff;
+		hdr_len += 4;
+	}
+	memcpy((uchar *)tcp + hdr_len, data, len);
+
+	tcp->tcp_src = htons(env->port);
+	tcp->tcp_dst = htons(env->sport);
+	tcp->tcp_seq = htonl(seq);
+	tcp->tcp_ack = htonl(ack);
+	tcp->tcp_hlen = (hdr_len / 4) << 4;
+	tcp->tcp_flags = flags;
+	tcp->tcp_win = htons(0xffff);
+	tcp->tcp_xsum = 0;
+	tcp->tcp_urg = 0;
+	tcp->tcp_xsum = wget_test_xsum(priv->fake_host_ipaddr, env->client_ip,
+				       tcp, hdr_len + len);
+	net_set_ip_header(ip, env->client_ip, priv->fake_host_ipaddr,
+			  IP_HDR_SIZE + hdr_len + len, IPPROTO_TCP);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_HDR_SIZE + hdr_len + len;
+	++priv->recv_packets;
+
+	return true;
+}
+
+/* Send the next segments of the response, as many as there is room for */
+static void wget_test_send_data(struct udevice *dev, struct wget_test_env *env,
+				u32 ack)
+{
+	u32 body_seq = WGET_TEST_ISS + 1 + sizeof(wget_test_hdr) - 1;
+	int seg, count;
+
+	for (count = 0; count < 2 && env->next < ARRAY_SIZE(wget_test_order);
+	     count++) {
+		seg = wget_test_order[env->next];
+		if (!seg) {
+			if (!wget_test_reply(dev, env, TCP_ACK | TCP_PUSH,
+					     WGET_TEST_ISS + 1, ack,
+					     wget_test_hdr,
+					     sizeof(wget_test_hdr) - 1))
+				return;
+		} else if (!wget_test_reply(dev, env, TCP_ACK,
+					    body_seq + (seg - 1) *
+					    WGET_TEST_SEG_SIZE, ack,
+					    env->body + (seg - 1) *
+					    WGET_TEST_SEG_SIZE,
+					    WGET_TEST_SEG_SIZE)) {
+			return;
+		}
+		env->next++;
+	}
+}
+
+static int wget_test_tx_handler(struct udevice *dev, void *packet,
+				unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct wget_test_env *env = priv->priv;
+	/* uts is updated by the ut_assert* macros */
+	struct unit_test_state *uts = env->uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_hdr *ip;
+	struct tcp_hdr *tcp;
+	uint tcp_len, hdr_len;
+	u32 missing_seq;
+	uchar *opt;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+
+	ut_asserteq(PROT_IP, ntohs(eth->et_protlen));
+	ip = packet + ETHER_HDR_SIZE;
+	ut_asserteq(IPPROTO_TCP, ip->ip_p);
+	ut_asserteq(priv->fake_host_ipaddr.s_addr, ip->ip_dst.s_addr);
+	tcp = (struct tcp_hdr *)(ip + 1);
+	ut_asserteq(env->port, ntohs(tcp->tcp_dst));
+	tcp_len = ntohs(ip->ip_len) - IP_HDR_SIZE;
+	hdr_len = (tcp->tcp_hlen >> 4) * 4;
+	ut_asserteq(0, wget_test_xsum(ip->ip_src, ip->ip_dst, tcp, tcp_len));
+
+	if (tcp->tcp_flags & TCP_SYN) {
+		/* MSS, then the window scale which the window needs */
+		opt = (uchar *)(tcp + 1);
+		ut_asserteq(TCP_HDR_SIZE + 8, hdr_len);
+		ut_asserteq(TCP_OPT_MSS, opt[0]);
+		ut_asserteq(TCP_MSS, (opt[2] << 8) | opt[3]);
+		ut_asserteq(TCP_OPT_WS, opt[5]);
+		ut_asserteq(0xffff, ntohs(tcp->tcp_win));
+		ut_assert((CONFIG_TCP_RX_BUFS * TCP_MSS) >> opt[7] <= 0xffff);
+
+		memcpy(env->client_mac, eth->et_src, ARP_HLEN);
+		env->client_ip = ip->ip_src;
+		env->sport = ntohs(tcp->tcp_src);
+		env->got_syn = true;
+		wget_test_reply(dev, env, TCP_SYN | TCP_ACK, WGET_TEST_ISS,
+				ntohl(tcp->tcp_seq) + 1, NULL, 0);
+		return 0;
+	}
+
+	ut_assert(env->got_syn);
+	ut_assert(tcp->tcp_flags & TCP_ACK);
+	if (tcp->tcp_flags & TCP_FIN) {
+		env->got_fin = true;
+		return 0;
+	}
+
+	if (tcp_len > hdr_len) {
+		const char *req = (char *)tcp + hdr_len;
+		const char *line = "GET /file.bin HTTP/1.1\r\n";
+
+		ut_asserteq_strn(line, req);
+		ut_asserteq_strn(env->host, req + strlen(line));
+		ut_assert(!env->got_req);
+		env->got_req = true;
+	} else if (!env->got_req) {
+		/* ACK of our SYN */
+		return 0;
+	}
+
+	missing_seq = WGET_TEST_ISS + 1 + sizeof(wget_test_hdr) - 1 +
+		      2 * WGET_TEST_SEG_SIZE;
+	if (ntohl(tcp->tcp_ack) == missing_seq && env->next > 3)
+		env->dup_acks++;
+
+	wget_test_send_data(dev, env, ntohl(tcp->tcp_seq) + tcp_len - hdr_len);
+
+	return 0;
+}
+
+/* Test of 'wget' with a segment arriving out of order */
+static int dm_test_cmd_wget(struct unit_test_state *uts)
+{
+	struct wget_test_env *env;
+	uchar *buf;
+	int i;
+
+	env = calloc(1, sizeof(*env));
+	ut_assertnonnull(env);
+	env->uts = uts;
+	env->port = WGET_TEST_PORT;
+	env->host = "Host: 192.0.2.2\r\n";
+	for (i = 0; i < WGET_TEST_SIZE; i++)
+		env->body[i] = i * 7 + (i >> 8);
+
+	buf = map_sysmem(WGET_TEST_ADDR, WGET_TEST_SIZE);
+	memset(buf, '\0', WGET_TEST_SIZE);
+
+	env_set("ethact", "eth@10002000");
+	sandbox_eth_set_tx_handler(0, wget_test_tx_handler);
+	sandbox_eth_set_priv(0, env);
+	ut_assertok(run_command("wget 10000 192.0.2.2:/file.bin", 0));
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	ut_assert(env->got_req);
+	ut_assert(env->got_fin);
+	ut_assert(env->dup_acks >= 2);
+	ut_asserteq(WGET_TEST_SIZE, env_get_hex("filesize", 0));
+	ut_asserteq_mem(env->body, buf, WGET_TEST_SIZE);
+
+	/* A path without a leading '/' is requested as /file.bin too */
+	env->next = 0;
+	env->got_syn = false;
+	env->got_req = false;
+	env->got_fin = false;
+	memset(buf, '\0', WGET_TEST_SIZE);
+	sandbox_eth_set_tx_handler(0, wget_test_tx_handler);
+	ut_assertok(run_command("wget 10000 192.0.2.2:file.bin", 0));
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	ut_assert(env->got_req);
+	ut_assert(env->got_fin);
+	ut_asserteq_mem(env->body, buf, WGET_TEST_SIZE);
+
+	/* A port other than 80 is sent in the Host header */
+	env->next = 0;
+	env->got_syn = false;
+	env->got_req = false;
+	env->got_fin = false;
+	env->port = 8080;
+	env->host = "Host: 192.0.2.2:8080\r\n";
+	memset(buf, '\0', WGET_TEST_SIZE);
+	env_set("httpdstp", "8080");
+	sandbox_eth_set_tx_handler(0, wget_test_tx_handler);
+	ut_assertok(run_command("wget 10000 192.0.2.2:/file.bin", 0));
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("httpdstp", NULL);
+
+	ut_assert(env->got_req);
+	ut_assert(env->got_fin);
+	ut_asserteq_mem(env->body, buf, WGET_TEST_SIZE);
+
+	unmap_sysmem(buf);
+	free(env);
+
+	return 0;
+}
+DM_TEST(dm_test_cmd_wget, UT_TESTF_SCAN_FDT);
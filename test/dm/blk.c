@@ -5,7 +5,10 @@
 
 #include <common.h>
 #include <dm.h>
+#include <mapmem.h>
+#include <os.h>
 #include <part.h>
+#include <sandboxblockdev.h>
 #include <usb.h>
 #include <asm/global_data.h>
 #include <asm/state.h>
@@ -217,3 +220,201 @@ static int dm_test_blk_iter(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_iter, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Test queued block requests */
+static int dm_test_blk_queue(struct unit_test_state *uts)
+{
+	struct blk_req reqs[SANDBOX_HOST_QUEUE_DEPTH + 1];
+	const int size = 0x100000;
+	struct blk_desc *desc;
+	struct udevice *dev;
+	u8 *src, *dst;
+	int i;
+
+	src = map_sysmem(0x20000, size);
+	for (i = 0; i < size; i++)
+		src[i] = i * 7 + i / 512;
+	ut_assertok(os_write_file("blk_queue.img", src, size));
+	ut_assertok(host_dev_bind(0, "blk_queue.img", false));
+	ut_assertok(blk_get_device(IF_TYPE_HOST, 0, &dev));
+	desc = dev_get_uclass_plat(dev);
+
+	/* The device accepts a limited number of requests */
+	dst = map_sysmem(0x20000 + size, size);
+	memset(dst, '\0', size);
+	for (i = 0; i < ARRAY_SIZE(reqs); i++) {
+		reqs[i].op = BLK_REQ_READ;
+		reqs[i].start = i * 8;
+		reqs[i].blkcnt = 8;
+		reqs[i].buffer = dst + i * 8 * 512;
+	}
+	for (i = 0; i < SANDBOX_HOST_QUEUE_DEPTH; i++)
+		ut_assertok(blk_submit(dev, &reqs[i]));
+	ut_asserteq(-EBUSY, blk_submit(dev, &reqs[i]));
+	ut_asserteq(false, reqs[0].done);
+
+	/* Requests finish in order, one per poll */
+	ut_asserteq(1, blk_poll(dev));
+	ut_asserteq(true, reqs[0].done);
+	ut_asserteq(8, reqs[0].result);
+	ut_asserteq(false, reqs[1].done);
+	ut_assertok(blk_submit(dev, &reqs[i]));
+	ut_asserteq(8, blk_wait(dev, &reqs[i]));
+	for (i = 1; i < SANDBOX_HOST_QUEUE_DEPTH; i++)
+		ut_asserteq(true, reqs[i].done);
+	ut_asserteq_mem(src, dst, ARRAY_SIZE(reqs) * 8 * 512);
+
+	/* A large read is split into queued requests */
+	memset(dst, '\0', size);
+	ut_asserteq(size / 512, blk_dread(desc, 0, size / 512, dst));
+	ut_asserteq_mem(src, dst, size);
+
+	/* Queued writes go to the device too */
+	memset(src, 0x5a, 0x1000);
+	reqs[0].op = BLK_REQ_WRITE;
+	reqs[0].start = 0x10;
+	reqs[0].blkcnt = 8;
+	reqs[0].buffer = src;
+	ut_assertok(blk_submit(dev, &reqs[0]));
+	ut_asserteq(8, blk_wait(dev, &reqs[0]));
+	ut_asserteq(8, blk_dread(desc, 0x10, 8, dst));
+	ut_asserteq_mem(src, dst, 0x1000);
+
+	/* A cancelled request is dropped from the queue */
+	for (i = 0; i < 2; i++) {
+		reqs[i].op = BLK_REQ_READ;
+		reqs[i].start = i * 8;
+		reqs[i].blkcnt = 8;
+		reqs[i].buffer = dst;
+		ut_assertok(blk_submit(dev, &reqs[i]));
+	}
+	ut_assertok(blk_cancel(dev, &reqs[0]));
+	ut_asserteq(1, blk_poll(dev));
+	ut_asserteq(false, reqs[0].done);
+	ut_asserteq(true, reqs[1].done);
+	ut_asserteq(0, blk_poll(dev));
+
+	ut_assertok(host_dev_bind(0, NULL, false));
+	os_unlink("blk_queue.img");
+
+	return 0;
+}
+DM_TEST(dm_test_blk_queue, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(BLOCK_CACHE)
+/* Find the cache statistics for a device */
+static int blkcache_find_stats(int iftype, int devnum,
+			       struct block_cache_stats *stats)
+{
+	int i, type, num;
+
+	for (i = 0; !blkcache_dev_stats(i, &type, &num, stats); i++) {
+		if (type == iftype && num == devnum)
+			return 0;
+	}
+
+	return -ENOENT;
+}
+
+/* Test the hashed block cache */
+static int dm_test_blk_cache(struct unit_test_state *uts)
+{
+	struct block_cache_stats stats;
+	char buf[4 * 512], out[4 * 512];
+	const int devnum = 99;
+	int i;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i / 512;
+
+	/* 8 entries of up to 4 blocks: two sets of four entries each */
+	ut_assertok(blkcache_configure_dev(IF_TYPE_HOST, devnum, 4, 8));
+
+	blkcache_fill(IF_TYPE_HOST, devnum, 0, 4, 512, buf);
+	ut_asserteq(1, blkcache_read(IF_TYPE_HOST, devnum, 1, 2, 512, out));
+	ut_asserteq_mem(buf + 512, out, 2 * 512);
+	ut_asserteq(0, blkcache_read(IF_TYPE_HOST, devnum, 2, 4, 512, out));
+	ut_asserteq(0, blkcache_read(IF_TYPE_HOST, devnum, 1, 2, 1024, out));
+
+	/* An entry crossing a bucket boundary is found from the next bucket */
+	blkcache_fill(IF_TYPE_HOST, devnum, 6, 4, 512, buf);
+	ut_asserteq(1, blkcache_read(IF_TYPE_HOST, devnum, 8, 2, 512, out));
+	ut_asserteq_mem(buf + 2 * 512, out, 2 * 512);
+
+	ut_assertok(blkcache_find_stats(IF_TYPE_HOST, devnum, &stats));
+	ut_asserteq(2, stats.hits);
+	ut_asserteq(2, stats.misses);
+	ut_asserteq(2, stats.entries);
+	ut_asserteq(0, stats.evictions);
+
+	/* Buckets 0, 2, 4, 6 and 8 share a set, so the LRU one is evicted */
+	for (i = 1; i < 5; i++)
+		blkcache_fill(IF_TYPE_HOST, devnum, i * 8, 1, 512, buf);
+	ut_asserteq(0, blkcache_read(IF_TYPE_HOST, devnum, 0, 1, 512, out));
+	ut_asserteq(1, blkcache_read(IF_TYPE_HOST, devnum, 32, 1, 512, out));
+	ut_asserteq(1, blkcache_read(IF_TYPE_HOST, devnum, 7, 1, 512, out));
+
+	ut_assertok(blkcache_find_stats(IF_TYPE_HOST, devnum, &stats));
+	ut_asserteq(1, stats.evictions);
+	ut_asserteq(5, stats.entries);
+
+	blkcache_invalidate(IF_TYPE_HOST, devnum);
+	ut_asserteq(0, blkcache_read(IF_TYPE_HOST, devnum, 32, 1, 512, out));
+	ut_assertok(blkcache_find_stats(IF_TYPE_HOST, devnum, &stats));
+	ut_asserteq(0, stats.entries);
+
+	/* Drop the device so later tests see the default settings */
+	blkcache_free(IF_TYPE_HOST, devnum);
+	ut_asserteq(-ENOENT, blkcache_find_stats(IF_TYPE_HOST, devnum, &stats));
+
+	return 0;
+}
+DM_TEST(dm_test_blk_cache, 0);
+#endif
+
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+/* Test that sequential reads are served from the read-ahead buffer */
+static int dm_test_blk_readahead(struct unit_test_state *uts)
+{
+	struct blk_readahead_stats stats;
+	char wbuf[16 * 512], rbuf[512];
+	struct blk_desc *desc;
+	int i;
+
+	ut_asserteq(2, blk_get_device_by_str("mmc", "2", &desc));
+	for (i = 0; i < sizeof(wbuf); i++)
+		wbuf[i] = i / 512 + 1;
+	ut_asserteq(16, blk_dwrite(desc, 0, 16, wbuf));
+
+	ut_assertok(blk_set_readahead(desc->bdev, 8));
+	for (i = 0; i < 16; i++) {
+		ut_asserteq(1, blk_dread(desc, i, 1, rbuf));
+		ut_asserteq_mem(wbuf + i * 512, rbuf, 512);
+	}
+	ut_assertok(blk_get_readahead(desc->bdev, &stats));
+	ut_asserteq(8, stats.window);
+	ut_asserteq(2, stats.fills);
+	ut_asserteq(14, stats.hits);
+	ut_asserteq(2, stats.misses);
+
+	/* A random read goes straight to the device */
+	ut_asserteq(1, blk_dread(desc, 100, 1, rbuf));
+	ut_assertok(blk_get_readahead(desc->bdev, &stats));
+	ut_asserteq(2, stats.fills);
+	ut_asserteq(3, stats.misses);
+
+	/* A write drops the buffer */
+	ut_asserteq(1, blk_dread(desc, 101, 1, rbuf));
+	memset(wbuf, 0xaa, 512);
+	ut_asserteq(1, blk_dwrite(desc, 102, 1, wbuf));
+	ut_asserteq(1, blk_dread(desc, 102, 1, rbuf));
+	ut_asserteq_mem(wbuf, rbuf, 512);
+	ut_assertok(blk_get_readahead(desc->bdev, &stats));
+	ut_asserteq(4, stats.fills);
+
+	ut_assertok(blk_set_readahead(desc->bdev, 0));
+
+	return 0;
+}
+DM_TEST(dm_test_blk_readahead, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+#endif
@@ -7,6 +7,8 @@
 #include <dm.h>
 #include <fastboot.h>
 #include <fb_mmc.h>
+#include <image-sparse.h>
+#include <malloc.h>
 #include <mmc.h>
 #include <part.h>
 #include <part_efi.h>
@@ -93,3 +95,197 @@ static int dm_test_fastboot_mmc_part(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_fastboot_mmc_part, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+#define FB_STREAM_BUF_SIZE	0x2000
+#define FB_STREAM_PART_START	48
+#define FB_STREAM_PART_SIZE	256
+
+/* Run a fastboot command and check its response */
+static int fb_stream_cmd(struct unit_test_state *uts, const char *cmd,
+			 const char *expect)
+{
+	char response[FASTBOOT_RESPONSE_LEN] = {0};
+	char cmd_string[FASTBOOT_COMMAND_LEN];
+
+	strlcpy(cmd_string, cmd, sizeof(cmd_string));
+	fastboot_handle_command(cmd_string, response);
+	ut_asserteq_str(expect, response);
+
+	return 0;
+}
+
+/* Send an image the way the USB gadget does, in 4KiB packets */
+static int fb_stream_download(struct unit_test_state *uts, const void *img,
+			      u32 size, const char *expect)
+{
+	char response[FASTBOOT_RESPONSE_LEN] = {0};
+	char cmd[FASTBOOT_COMMAND_LEN], data[FASTBOOT_RESPONSE_LEN];
+	u32 off, n;
+
+	snprintf(cmd, sizeof(cmd), "download:%08x", size);
+	snprintf(data, sizeof(data), "DATA%08x", size);
+	ut_assertok(fb_stream_cmd(uts, cmd, data));
+	for (off = 0; off < size; off += n) {
+		n = min(size - off, 4096U);
+		fastboot_data_download(img + off, n, response);
+		ut_asserteq_str("", response);
+		fastboot_data_flush();
+	}
+	ut_asserteq(0, fastboot_data_remaining());
+	fastboot_data_complete(response);
+	ut_asserteq_str(expect, response);
+
+	return 0;
+}
+
+static int dm_test_fastboot_mmc_stream(struct unit_test_state *uts)
+{
+	struct disk_partition parts[1] = {
+		{
+			.start = FB_STREAM_PART_START,
+			.size = FB_STREAM_PART_SIZE,
+			.name = "test1",
+		},
+	};
+	const uint raw_size = 5 * FB_STREAM_BUF_SIZE - 200;
+	char str_disk_guid[UUID_STR_LEN + 1];
+	struct blk_desc *mmc_dev_desc;
+	sparse_header_t *sparse;
+	chunk_header_t *chunk;
+	u8 *buf, *img, *cmp, *p;
+	uint i;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &mmc_dev_desc));
+	if (CONFIG_IS_ENABLED(RANDOM_UUID)) {
+		gen_rand_uuid_str(parts[0].uuid, UUID_STR_FORMAT_STD);
+		gen_rand_uuid_str(str_disk_guid, UUID_STR_FORMAT_STD);
+	}
+	ut_assertok(gpt_restore(mmc_dev_desc, str_disk_guid, parts,
+				ARRAY_SIZE(parts)));
+
+	buf = malloc(FB_STREAM_BUF_SIZE);
+	img = malloc(FB_STREAM_PART_SIZE * 512);
+	cmp = malloc(FB_STREAM_PART_SIZE * 512);
+	ut_assertnonnull(buf);
+	ut_assertnonnull(img);
+	ut_assertnonnull(cmp);
+	fastboot_init(buf, FB_STREAM_BUF_SIZE);
+
+	/* A raw image much larger than the download buffer */
+	for (i = 0; i < raw_size; i++)
+		img[i] = i * 7;
+	ut_assertok(fb_stream_cmd(uts, "getvar:max-download-size",
+				  "OKAY0x00002000"));
+	ut_assertok(fb_stream_cmd(uts, "oem stream:test1", "OKAY"));
+	ut_assertok(fb_stream_cmd(uts, "getvar:max-download-size",
+				  "OKAY0xffffffff"));
+	ut_assertok(fb_stream_download(uts, img, raw_size, "OKAY"));
+	ut_assertok(fb_stream_cmd(uts, "flash:test1", "OKAY"));
+
+	ut_asserteq(DIV_ROUND_UP(raw_size, 512),
+		    blk_dread(mmc_dev_desc, FB_STREAM_PART_START,
+			      DIV_ROUND_UP(raw_size, 512), cmp));
+	ut_asserteq_mem(img, cmp, raw_size);
+	for (i = raw_size; i < ALIGN(raw_size, 512); i++)
+		ut_asserteq(0, cmp[i]);
+
+	/*
+	 * A sparse image: 2 raw blocks, 3 blocks left alone, 2 filled blocks
+	 * and a final raw block
+	 */
+	memset(img, '\0', FB_STREAM_PART_SIZE * 512);
+	sparse = (sparse_header_t *)img;
+	sparse->magic = SPARSE_HEADER_MAGIC;
+	sparse->major_version = 1;
+	sparse->file_hdr_sz = sizeof(*sparse);
+	sparse->chunk_hdr_sz = sizeof(*chunk);
+	sparse->blk_sz = 4096;
+	sparse->total_blks = 8;
+	sparse->total_chunks = 4;
+	p = img + sizeof(*sparse);
+
+	chunk = (chunk_header_t *)p;
+	chunk->chunk_type = CHUNK_TYPE_RAW;
+	chunk->chunk_sz = 2;
+	chunk->total_sz = sizeof(*chunk) + 2 * 4096;
+	p += sizeof(*chunk);
+	for (i = 0; i < 2 * 4096; i++)
+		*p++ = i * 3;
+
+	chunk = (chunk_header_t *)p;
+	chunk->chunk_type = CHUNK_TYPE_DONT_CARE;
+	chunk->chunk_sz = 3;
+	chunk->total_sz = sizeof(*chunk);
+	p += sizeof(*chunk);
+
+	chunk = (chunk_header_t *)p;
+	chunk->chunk_type = CHUNK_TYPE_FILL;
+	chunk->chunk_sz = 2;
+	chunk->total_sz = sizeof(*chunk) + sizeof(u32);
+	p += sizeof(*chunk);
+	*(u32 *)p = 0xdeadbeef;
+	p += sizeof(u32);
+
+	chunk = (chunk_header_t *)p;
+	chunk->chunk_type = CHUNK_TYPE_RAW;
+	chunk->chunk_sz = 1;
+	chunk->total_sz = sizeof(*chunk) + 4096;
+	p += sizeof(*chunk);
+	memset(p, 0x5a, 4096);
+	p += 4096;
+
+	ut_assertok(fb_stream_cmd(uts, "oem stream:test1", "OKAY"));
+	ut_assertok(fb_stream_download(uts, img, p - img, "OKAY"));
+	ut_assertok(fb_stream_cmd(uts, "flash:test1", "OKAY"));
+
+	ut_asserteq(64, blk_dread(mmc_dev_desc, FB_STREAM_PART_START, 64, cmp));
+	for (i = 0; i < 2 * 4096; i++)
+		ut_asserteq((u8)(i * 3), cmp[i]);
+	/* the raw image written above is still there */
+	for (i = 2 * 4096; i < 5 * 4096; i++)
+		ut_asserteq((u8)(i * 7), cmp[i]);
+	for (i = 5 * 4096; i < 7 * 4096; i += 4)
+		ut_asserteq(0xdeadbeef, *(u32 *)(cmp + i));
+	for (i = 7 * 4096; i < 8 * 4096; i++)
+		ut_asserteq(0x5a, cmp[i]);
+
+	/* A zero fill over the whole image, which may be done by erasing */
+	sparse->total_blks = 8;
+	sparse->total_chunks = 1;
+	p = img + sizeof(*sparse);
+	chunk = (chunk_header_t *)p;
+	chunk->chunk_type = CHUNK_TYPE_FILL;
+	chunk->chunk_sz = 8;
+	chunk->total_sz = sizeof(*chunk) + sizeof(u32);
+	p += sizeof(*chunk);
+	*(u32 *)p = 0;
+	p += sizeof(u32);
+
+	ut_assertok(fb_stream_cmd(uts, "oem stream:test1", "OKAY"));
+	ut_assertok(fb_stream_download(uts, img, p - img, "OKAY"));
+	ut_assertok(fb_stream_cmd(uts, "flash:test1", "OKAY"));
+
+	ut_asserteq(64, blk_dread(mmc_dev_desc, FB_STREAM_PART_START, 64, cmp));
+	for (i = 0; i < 8 * 4096; i++)
+		ut_asserteq(0, cmp[i]);
+
+	/* The streamed image cannot be flashed anywhere else */
+	memset(img, 0x11, 4096);
+	ut_assertok(fb_stream_cmd(uts, "oem stream:test1", "OKAY"));
+	ut_assertok(fb_stream_download(uts, img, 4096, "OKAY"));
+	ut_assertok(fb_stream_cmd(uts, "flash:test2",
+				  "FAILimage was streamed to another partition"));
+
+	/* Without "oem stream" downloads are limited to the buffer again */
+	ut_assertok(fb_stream_cmd(uts, "download:00002001", "FAIL00002001"));
+
+	fastboot_init(NULL, 0);
+	free(cmp);
+	free(img);
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_fastboot_mmc_stream, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+#endif
@@ -52,3 +52,35 @@ static int dm_test_mmc_blk(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_mmc_blk, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Multi-block transfers with SET_BLOCK_COUNT and with STOP_TRANSMISSION */
+static int dm_test_mmc_set_block_count(struct unit_test_state *uts)
+{
+	struct udevice *dev;
+	struct blk_desc *dev_desc;
+	struct mmc *mmc;
+	char write[8192], read[8192];
+	int i;
+
+	ut_assertok(uclass_get_device(UCLASS_MMC, 0, &dev));
+	ut_assertok(blk_get_device_by_str("mmc", "0", &dev_desc));
+	mmc = mmc_get_mmc_dev(dev);
+	ut_assert(mmc->set_block_count);
+
+	/* Too large for the block cache, so each read goes to the card */
+	for (i = 0; i < sizeof(write); i++)
+		write[i] = i * 3;
+	ut_asserteq(16, blk_dwrite(dev_desc, 16, 16, write));
+	ut_asserteq(16, blk_dread(dev_desc, 16, 16, read));
+	ut_asserteq_mem(write, read, sizeof(write));
+
+	/* The emulator rejects a stop after a transfer of known length */
+	mmc->set_block_count = false;
+	memset(read, '\0', sizeof(read));
+	ut_asserteq(16, blk_dread(dev_desc, 16, 16, read));
+	ut_asserteq_mem(write, read, sizeof(write));
+	mmc->set_block_count = true;
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_set_block_count, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
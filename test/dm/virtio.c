@@ -130,3 +130,64 @@ static int dm_test_virtio_remove(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_virtio_remove, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Test adding a chain of buffers through an indirect descriptor table */
+static int dm_test_virtio_ring_indirect(struct unit_test_state *uts)
+{
+	struct udevice *bus, *dev;
+	struct virtio_dev_priv *uc_priv;
+	struct virtio_sg sg[3];
+	struct virtio_sg *sgs[] = { &sg[0], &sg[1], &sg[2] };
+	struct vring_desc *desc;
+	struct virtqueue *vq;
+	u8 hdr[16], data[512], status;
+	unsigned int num;
+
+	/* check probe success */
+	ut_assertok(uclass_first_device(UCLASS_VIRTIO, &bus));
+	ut_assertnonnull(bus);
+
+	/* check the child virtio-blk device is bound */
+	ut_assertok(device_find_first_child(bus, &dev));
+	ut_assertnonnull(dev);
+
+	uc_priv = dev_get_uclass_priv(bus);
+	ut_assertnonnull(uc_priv);
+	uc_priv->vdev = dev;
+	ut_assertok(virtio_find_vqs(dev, 1, &vq));
+	num = virtqueue_get_vring_size(vq);
+
+	/* the chain takes a single ring descriptor */
+	vq->indirect = true;
+	sg[0].addr = hdr;
+	sg[0].length = sizeof(hdr);
+	sg[1].addr = data;
+	sg[1].length = sizeof(data);
+	sg[2].addr = &status;
+	sg[2].length = sizeof(status);
+	ut_assertok(virtqueue_add(vq, sgs, 1, 2));
+	ut_asserteq(num - 1, vq->num_free);
+	ut_asserteq(VRING_DESC_F_INDIRECT,
+		    virtio16_to_cpu(dev, vq->vring.desc[0].flags));
+	ut_asserteq(3 * sizeof(*desc),
+		    virtio32_to_cpu(dev, vq->vring.desc[0].len));
+
+	desc = (void *)(uintptr_t)virtio64_to_cpu(dev, vq->vring.desc[0].addr);
+	ut_asserteq_ptr(hdr, (void *)(uintptr_t)virtio64_to_cpu(dev,
+								desc[0].addr));
+	ut_asserteq(VRING_DESC_F_NEXT, virtio16_to_cpu(dev, desc[0].flags));
+	ut_asserteq(VRING_DESC_F_NEXT | VRING_DESC_F_WRITE,
+		    virtio16_to_cpu(dev, desc[1].flags));
+	ut_asserteq(VRING_DESC_F_WRITE, virtio16_to_cpu(dev, desc[2].flags));
+
+	/* complete it as the device would */
+	vq->vring.used->ring[0].id = cpu_to_virtio32(dev, 0);
+	vq->vring.used->idx = cpu_to_virtio16(dev, 1);
+	ut_asserteq_ptr(hdr, virtqueue_get_buf(vq, NULL));
+	ut_asserteq(num, vq->num_free);
+
+	ut_assertok(virtio_del_vqs(dev));
+
+	return 0;
+}
+DM_TEST(dm_test_virtio_ring_indirect, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
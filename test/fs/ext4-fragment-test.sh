@@ -0,0 +1,137 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0+
+
+# This script tests U-Boot's ext4 filesystem code's ability to read
+# fragmented files, and checks how many device reads it takes to do so.
+#
+# ext4fs_read_file() maps a file one extent at a time and reads every run of
+# blocks which is contiguous on disk with a single device read. Loading a file
+# made of N extents should therefore cost no more than N reads on top of what
+# it takes to load a file made of a single extent (superblock, group
+# descriptors, inodes and directory blocks).
+#
+# To execute the test, simply run it from the U-Boot source root directory:
+#
+#    cd u-boot
+#    ./test/fs/ext4-fragment-test.sh
+#
+# The test creates an ext4 image with debugfs (no root access is needed),
+# fragments a randomly generated file in it, builds U-Boot sandbox and loads
+# both that file and a contiguous one with the block cache disabled, so that
+# each device read shows up as a cache miss in 'blkcache show'. The file
+# contents are checked with crc32 and the last line of the output contains
+# either "PASS" or "FAILURE".
+#
+# All temporary files used by this script are created in ./sandbox to avoid
+# polluting the source tree. test/fs/fs-test.sh also uses this directory for
+# the same purpose.
+
+odir=sandbox
+img=${odir}/ext4-fragment.img
+tmp=${odir}/ext4-fragment
+fill=/dev/urandom
+fragfn=fragment.bin
+contigfn=contig.bin
+crcaddr=0
+loadaddr=1000
+
+for prereq in fallocate mkfs.ext4 debugfs dd crc32; do
+    if [ ! -x "`which $prereq`" ]; then
+        echo "Missing $prereq binary. Exiting!"
+        exit 1
+    fi
+done
+
+make O=${odir} -s sandbox_defconfig && make O=${odir} -s -j8
+
+rm -rf ${tmp} ${img}
+mkdir -p ${tmp}
+fallocate -l 64M ${img}
+if [ $? -ne 0 ]; then
+    echo fallocate failed - using dd instead
+    dd if=/dev/zero of=${img} bs=1024 count=$((64 * 1024))
+    if [ $? -ne 0 ]; then
+        echo Could not create empty disk image
+        exit 1
+    fi
+fi
+mkfs.ext4 -q -b 1024 ${img}
+if [ $? -ne 0 ]; then
+    echo Could not create ext4 filesystem
+    exit 1
+fi
+
+# Interleave files to keep and files to remove, then write the test file
+# into the holes left behind.
+cmds=${tmp}/cmds
+: > ${cmds}
+for ((sects=8; sects < 512; sects += 8)); do
+    dd if=${fill} of=${tmp}/keep-${sects} bs=512 count=${sects} \
+        >/dev/null 2>&1
+    dd if=${fill} of=${tmp}/remove-${sects} bs=512 count=${sects} \
+        >/dev/null 2>&1
+    echo "write ${tmp}/keep-${sects} keep-${sects}.img" >> ${cmds}
+    echo "write ${tmp}/remove-${sects} remove-${sects}.img" >> ${cmds}
+done
+for ((sects=8; sects < 512; sects += 8)); do
+    echo "rm remove-${sects}.img" >> ${cmds}
+done
+
+# 511 deliberately to trigger a file size that's not a multiple of the
+# sector size.
+dd if=${fill} of=${tmp}/${fragfn} bs=511 count=16384 >/dev/null 2>&1
+dd if=${fill} of=${tmp}/${contigfn} bs=511 count=16 >/dev/null 2>&1
+echo "write ${tmp}/${fragfn} ${fragfn}" >> ${cmds}
+echo "write ${tmp}/${contigfn} ${contigfn}" >> ${cmds}
+
+debugfs -w -f ${cmds} ${img} >/dev/null 2>&1
+if [ $? -ne 0 ]; then
+    echo Could not populate test filesystem
+    exit 1
+fi
+
+# Count the leaf extents of the test file
+extents=`debugfs -R "ex ${fragfn}" ${img} 2>/dev/null | \
+    awk '$1 == $2 "/" { n++ } END { print n + 0 }'`
+if [ ${extents} -lt 2 ]; then
+    echo Test file is not fragmented
+    exit 1
+fi
+
+crc=0x`crc32 ${tmp}/${fragfn}`
+crc=`printf %02x%02x%02x%02x \
+    $((${crc} & 0xff)) \
+    $(((${crc} >> 8) & 0xff)) \
+    $(((${crc} >> 16) & 0xff)) \
+    $((${crc} >> 24))`
+
+out=$(./sandbox/u-boot << EOF
+host bind 0 ${img}
+blkcache configure 0 0
+blkcache show
+load host 0:0 ${loadaddr} ${contigfn}
+blkcache show
+load host 0:0 ${loadaddr} ${fragfn}
+blkcache show
+crc32 ${loadaddr} \$filesize ${crcaddr}
+if itest.l *${crcaddr} != ${crc}; then echo FAILURE; else echo PASS; fi
+reset
+EOF
+)
+if [ $? -ne 0 ]; then
+    echo "${out}"
+    echo U-Boot exit status indicates an error
+    exit 1
+fi
+echo "${out}"
+
+reads=(`echo "${out}" | awk '/^misses:/ { print $2 }'`)
+contig=${reads[1]}
+frag=${reads[2]}
+echo "${extents} extents: ${frag} reads, single extent: ${contig} reads"
+if [ -z "${frag}" ] || [ ${frag} -gt $((contig + extents)) ]; then
+    echo FAILURE
+    exit 1
+fi
+echo "${out}" | grep -q "^PASS$" || exit 1
+echo PASS
@@ -0,0 +1,110 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0+
+
+# This script compares the speed of U-Boot's SquashFS file reads with data
+# blocks fetched in batches against one data block per device read.
+#
+# sqfs_read() reads up to CONFIG_SQUASHFS_READ_BATCH_SIZE KiB of consecutive
+# compressed data blocks with a single device read, and starts reading the
+# next batch before decompressing the current one. Setting the option to 0
+# gives each data block its own blocking device read, as U-Boot used to do.
+#
+# To execute the test, simply run it from the U-Boot source root directory:
+#
+#    cd u-boot
+#    ./test/fs/squashfs-bench-test.sh
+#
+# The test builds U-Boot sandbox twice, once with the default batch size and
+# once with batching disabled, creates a SquashFS image holding a large file
+# which is partly compressible and partly not, and loads it several times
+# with each build. The file contents are checked with crc32, and the time
+# taken by each build is printed. The last line of the output contains either
+# "PASS" or "FAILURE"; the timings are informational only since they depend
+# on the host.
+#
+# All temporary files used by this script are created in ./sandbox to avoid
+# polluting the source tree. test/fs/fs-test.sh also uses this directory for
+# the same purpose.
+
+odir=sandbox
+seqdir=sandbox-sqfs-seq
+img=${odir}/squashfs-bench.img
+tmp=${odir}/squashfs-bench
+fn=bench.bin
+crcaddr=0
+loadaddr=1000
+loops=5
+
+for prereq in mksquashfs dd crc32; do
+    if [ ! -x "`which $prereq`" ]; then
+        echo "Missing $prereq binary. Exiting!"
+        exit 1
+    fi
+done
+
+make O=${odir} -s sandbox_defconfig && make O=${odir} -s -j8 || exit 1
+make O=${seqdir} -s sandbox_defconfig || exit 1
+echo CONFIG_SQUASHFS_READ_BATCH_SIZE=0 >> ${seqdir}/.config
+make O=${seqdir} -s olddefconfig && make O=${seqdir} -s -j8 || exit 1
+
+rm -rf ${tmp} ${img}
+mkdir -p ${tmp}/root
+
+# Alternate text, which compresses well, and random data, which SquashFS
+# stores uncompressed.
+for ((i = 0; i < 32; i++)); do
+    seq $((i * 100000)) $((i * 100000 + 120000))
+    dd if=/dev/urandom bs=64k count=8 2>/dev/null
+done > ${tmp}/root/${fn}
+
+mksquashfs ${tmp}/root ${img} -noappend >/dev/null
+if [ $? -ne 0 ]; then
+    echo Could not create SquashFS image
+    exit 1
+fi
+
+crc=0x`crc32 ${tmp}/root/${fn}`
+crc=`printf %02x%02x%02x%02x \
+    $((${crc} & 0xff)) \
+    $(((${crc} >> 8) & 0xff)) \
+    $(((${crc} >> 16) & 0xff)) \
+    $((${crc} >> 24))`
+
+# Run $loops loads of the test file with the given U-Boot binary and print
+# the total time taken in ms.
+bench() {
+    local cmds="host bind 0 ${img}
+blkcache configure 0 0"
+    local out ms
+
+    for ((i = 0; i < ${loops}; i++)); do
+        cmds="${cmds}
+sqfsload host 0 ${loadaddr} ${fn}
+crc32 ${loadaddr} \$filesize ${crcaddr}
+if itest.l *${crcaddr} != ${crc}; then echo FAILURE; fi"
+    done
+
+    out=$(echo "${cmds}
+reset" | $1)
+    if [ $? -ne 0 ] || echo "${out}" | grep -q "^FAILURE$"; then
+        echo "${out}" >&2
+        return 1
+    fi
+
+    ms=`echo "${out}" | \
+        awk '/bytes read in/ { n++; ms += $5 } END { print n == '${loops}' ? ms : "" }'`
+    if [ -z "${ms}" ]; then
+        echo "${out}" >&2
+        return 1
+    fi
+    echo ${ms}
+}
+
+batched=`bench ./${odir}/u-boot` || { echo FAILURE; exit 1; }
+single=`bench ./${seqdir}/u-boot` || { echo FAILURE; exit 1; }
+
+size=`stat -c %s ${tmp}/root/${fn}`
+echo "${loops} loads of ${size} bytes:"
+echo "  batched reads:        ${batched} ms"
+echo "  one block per read:   ${single} ms"
+echo PASS
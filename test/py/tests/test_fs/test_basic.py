@@ -290,3 +290,77 @@ class TestFsBasic(object):
                 'setenv filesize'])
             assert(md5val[0] in ''.join(output))
             assert_fs_integrity(fs_type, fs_img)
+
+    def test_fs14(self, u_boot_console, fs_obj_basic):
+        """
+        Test Case 14 - filesystem kept mounted across commands
+        """
+        fs_type,fs_img,md5val = fs_obj_basic
+        if not u_boot_console.config.buildconfig.get('config_fs_mount_cache',
+                                                     None):
+            pytest.skip('.config feature "FS_MOUNT_CACHE" not enabled')
+        with u_boot_console.log.section('Test Case 14 - mount cache'):
+            # Test Case 14a - A second command reuses the mount and the
+            # path looked up by the first one
+            u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                'fscache flush',
+                'fscache'])
+            output = u_boot_console.run_command_list([
+                '%ssize host 0:0 /%s' % (fs_type, SMALL_FILE),
+                'mw.b %x 00 100' % ADDR,
+                '%sload host 0:0 %x /%s' % (fs_type, ADDR, SMALL_FILE),
+                'md5sum %x $filesize' % ADDR,
+                'setenv filesize',
+                'fscache'])
+            assert(md5val[0] in ''.join(output))
+            assert(re.search('mounts: 1\\b', output[-1]))
+            assert(not re.search('reuses: 0\\b', output[-1]))
+            assert(not re.search('hits: 0\\b', output[-1]))
+
+            # Test Case 14b - Writing drops the mount, and the new file
+            # is found afterwards
+            output = u_boot_console.run_command_list([
+                '%sload host 0:0 %x /%s' % (fs_type, ADDR, SMALL_FILE),
+                '%swrite host 0:0 %x /%s.w14 $filesize'
+                    % (fs_type, ADDR, SMALL_FILE),
+                'fscache',
+                'mw.b %x 00 100' % ADDR,
+                '%sload host 0:0 %x /%s.w14' % (fs_type, ADDR, SMALL_FILE),
+                'md5sum %x $filesize' % ADDR,
+                'setenv filesize',
+                'fscache'])
+            assert('1048576 bytes written' in ''.join(output))
+            assert(md5val[0] in ''.join(output))
+            assert(re.search('mounts: 1\\b', output[-1]))
+            assert(re.search('reuses: 0\\b', output[-1]))
+            assert_fs_integrity(fs_type, fs_img)
+
+    def test_fs15(self, u_boot_console, fs_obj_basic):
+        """
+        Test Case 15 - file data read straight into an aligned destination
+        """
+        fs_type,fs_img,md5val = fs_obj_basic
+        if not u_boot_console.config.buildconfig.get('config_fs_bounce_stats',
+                                                     None):
+            pytest.skip('.config feature "FS_BOUNCE_STATS" not enabled')
+        with u_boot_console.log.section('Test Case 15 - bounce buffers'):
+            # Test Case 15a - Nothing is bounced with an aligned destination
+            aligned = ADDR & ~0xfff
+            output = u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                'mw.b %x 00 100' % aligned,
+                '%sload host 0:0 %x /%s' % (fs_type, aligned, SMALL_FILE),
+                'md5sum %x $filesize' % aligned,
+                'setenv filesize'])
+            assert(md5val[0] in ''.join(output))
+            assert('bounce buffers' not in ''.join(output))
+
+            # Test Case 15b - A misaligned destination is bounced
+            output = u_boot_console.run_command_list([
+                'mw.b %x 00 100' % (aligned + 1),
+                '%sload host 0:0 %x /%s' % (fs_type, aligned + 1, SMALL_FILE),
+                'md5sum %x $filesize' % (aligned + 1),
+                'setenv filesize'])
+            assert(md5val[0] in ''.join(output))
+            assert('bytes went through bounce buffers' in ''.join(output))
@@ -317,3 +317,37 @@ class TestFsExt(object):
             assert('FILE0123456789_79' in output)
 
             assert_fs_integrity(fs_type, fs_img)
+
+    def test_fs_ext12(self, u_boot_console, fs_obj_ext):
+        """
+        Test Case 12 - ext4 metadata cache across commands
+        """
+        fs_type,fs_img,md5val = fs_obj_ext
+        if fs_type != 'ext4':
+            pytest.skip('metadata cache is only implemented for ext4')
+        if not u_boot_console.config.buildconfig.get('config_ext4_cache',
+                                                     None):
+            pytest.skip('.config feature "EXT4_CACHE" not enabled')
+        with u_boot_console.log.section('Test Case 12 - metadata cache'):
+            # Test Case 12a - Repeated lookups are served from the cache
+            u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                'ext4cache flush',
+                '%sls host 0:0 /dir1' % fs_type,
+                'ext4cache'])
+            output = u_boot_console.run_command_list([
+                '%sls host 0:0 /dir1' % fs_type,
+                'ext4cache'])
+            assert(re.search('misses: 0\\b', output[-1]))
+            assert(not re.search('hits: 0\\b', output[-1]))
+
+            # Test Case 12b - Writing drops the cached metadata
+            output = u_boot_console.run_command_list([
+                '%sload host 0:0 %x /%s' % (fs_type, ADDR, MIN_FILE),
+                '%swrite host 0:0 %x /dir1/%s.w12 $filesize'
+                    % (fs_type, ADDR, MIN_FILE),
+                '%sls host 0:0 /dir1' % fs_type,
+                'ext4cache'])
+            assert('20480 bytes written' in ''.join(output))
+            assert(not re.search('misses: 0\\b', output[-1]))
+            assert_fs_integrity(fs_type, fs_img)
@@ -3,6 +3,7 @@
 # Author: Joao Marcos Costa <joaomarcos.costa@bootlin.com>
 
 import os
+import re
 import subprocess
 import pytest
 
@@ -106,6 +107,29 @@ def sqfs_load_non_existent_file(u_boot_console):
     out = u_boot_console.run_command('sqfsload host 0 {} {}'.format(address, file))
     assert 'Failed to load' in out
 
+def sqfs_load_cached(u_boot_console):
+    """ Loads a file twice and checks that the cache is used the second time.
+
+    The decompressed inode and directory tables and the fragment block holding
+    the end of the file should not be decompressed again.
+
+    Args:
+        u_boot_console: provides the means to interact with U-Boot's console.
+    """
+    if not u_boot_console.config.buildconfig.get('config_squashfs_cache', None):
+        return
+
+    files = ['f1000']
+    sizes = ['1000']
+    address = '$kernel_addr_r'
+    u_boot_console.run_command('sqfscache flush')
+    sqfs_load_files(u_boot_console, files, sizes, address)
+    u_boot_console.run_command('sqfscache')
+    sqfs_load_files(u_boot_console, files, sizes, address)
+    out = u_boot_console.run_command('sqfscache')
+    assert re.search('tables: hits [1-9][0-9]*, misses 0,', out)
+    assert 'misses 0, entries' in out
+
 def sqfs_run_all_load_tests(u_boot_console):
     """ Runs all the previously defined test cases.
 
@@ -115,6 +139,7 @@ def sqfs_run_all_load_tests(u_boot_console):
     sqfs_load_files_at_root(u_boot_console)
     sqfs_load_files_at_subdir(u_boot_console)
     sqfs_load_non_existent_file(u_boot_console)
+    sqfs_load_cached(u_boot_console)
 
 @pytest.mark.boardspec('sandbox')
 @pytest.mark.buildconfigspec('cmd_fs_generic')